@@ -0,0 +1,15 @@
+#pragma once
+
+// Selects the ADS implementation: Beckhoff's TcAdsDll on Windows, or the
+// built-in AMS/TCP client when ADS_NATIVE_TRANSPORT is defined (the default
+// for the Linux CMake build). Both expose the same AdsSync* functions.
+
+#if defined(ADS_NATIVE_TRANSPORT)
+#include "AdsNativeApi.h"
+#else
+#include <windows.h>
+#include <TcAdsDef.h>
+#include <TcAdsApi.h>
+
+#pragma comment(lib, "TcAdsDll.lib")
+#endif
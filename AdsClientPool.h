@@ -0,0 +1,431 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "AdsApi.h"
+#include "AdsSymbolCache.h"
+#include "Logger.h"
+
+// Thread-safe ADS client for a gateway with many callers. Each worker
+// thread owns one ADS port and one symbol cache per target, so workers
+// share nothing and tag access runs on as many ports in parallel as there
+// are workers. Callers from any thread queue jobs for a target; the queue
+// is bounded: Submit() blocks while it is full, TrySubmit() gives up, so
+// a burst slows its callers down instead of piling up requests.
+//
+// Targets are named AMS addresses added before Start(): the PLC (851),
+// the EtherCAT master (500) or a device behind a remote NetID.
+//
+//   AdsClientPool pool;
+//   size_t plc = pool.AddTarget("plc", AdsClientPool::Address("127.0.0.1.1.1", 851));
+//   pool.Start();
+//   pool.Read(plc, "MAIN.nValue", &value, sizeof(value));    // any thread but a worker
+//
+// The blocking helpers (Read(), Write(), ReadTags()...) wait for a worker,
+// so calling them from inside a pool job deadlocks once every worker does
+// so. A job works on the Session it is given instead.
+class AdsClientPool {
+public:
+    struct Settings {
+        size_t workers;              // ADS ports and threads
+        size_t queueCapacity;        // jobs waiting for a worker
+        long timeoutMs;              // per ADS request, 0 = port default
+        size_t minTagsPerWorker;     // ReadTags()/WriteTags() split below this, 0 counts as 1
+
+        Settings() : workers(4), queueCapacity(256), timeoutMs(0), minTagsPerWorker(64) {}
+    };
+
+    // What a job gets to work with: the worker's port, the target and the
+    // worker's symbol cache for it
+    struct Session {
+        long port;
+        AmsAddr addr;
+        AdsSymbolCache& symbols;
+    };
+
+    typedef std::function<void(Session&)> Job;
+
+    // One tag of ReadTags()/WriteTags(); result is the ADS error of this tag
+    struct Tag {
+        std::string name;
+        void* pData;
+        unsigned long size;
+        long result;
+    };
+
+    struct Stats {
+        unsigned long submitted;
+        unsigned long completed;
+        unsigned long rejected;      // TrySubmit() with a full queue
+        unsigned long blocked;       // Submit() had to wait for room
+        size_t maxDepth;             // deepest the queue has been
+    };
+
+private:
+    struct Target {
+        std::string name;
+        AmsAddr addr;
+    };
+
+    struct Queued {
+        size_t target;
+        Job job;
+    };
+
+    struct Worker {
+        long port;
+        std::thread thread;
+        std::vector<std::unique_ptr<AdsSymbolCache>> symbols;     // per target, attached on first use
+    };
+
+    // Counts a fan-out down; the caller waits until every part has run
+    class Latch {
+    private:
+        std::mutex m_lock;
+        std::condition_variable m_done;
+        size_t m_count;
+
+    public:
+        explicit Latch(size_t count) : m_count(count) {}
+
+        void CountDown() {
+            std::lock_guard<std::mutex> guard(m_lock);
+            if (--m_count == 0) {
+                m_done.notify_all();
+            }
+        }
+
+        void Wait() {
+            std::unique_lock<std::mutex> guard(m_lock);
+            m_done.wait(guard, [this] { return m_count == 0; });
+        }
+    };
+
+    Settings m_settings;
+    std::vector<Target> m_targets;
+    std::vector<std::unique_ptr<Worker>> m_workers;
+
+    std::mutex m_lock;
+    std::condition_variable m_notEmpty;
+    std::condition_variable m_notFull;
+    std::deque<Queued> m_queue;
+    bool m_bRunning;
+    Stats m_stats;                   // under m_lock, except completed
+    std::atomic<unsigned long> m_completed;
+
+    void WorkerLoop(Worker& worker) {
+        for (;;) {
+            Queued queued;
+            {
+                std::unique_lock<std::mutex> guard(m_lock);
+                m_notEmpty.wait(guard, [this] { return !m_queue.empty() || !m_bRunning; });
+                if (m_queue.empty()) {
+                    return;             // stopped and drained
+                }
+                queued = std::move(m_queue.front());
+                m_queue.pop_front();
+            }
+            m_notFull.notify_one();
+
+            std::unique_ptr<AdsSymbolCache>& pSymbols = worker.symbols[queued.target];
+            const Target& target = m_targets[queued.target];
+            if (!pSymbols) {
+                pSymbols.reset(new AdsSymbolCache());
+                pSymbols->Attach(worker.port, target.addr);
+            }
+            Session session = { worker.port, target.addr, *pSymbols };
+            queued.job(session);
+            m_completed.fetch_add(1, std::memory_order_relaxed);
+        }
+    }
+
+    bool Enqueue(size_t target, Job&& job, bool bWait) {
+        {
+            std::unique_lock<std::mutex> guard(m_lock);
+            if (bWait && m_bRunning && m_queue.size() >= m_settings.queueCapacity) {
+                m_stats.blocked++;
+                m_notFull.wait(guard, [this] { return m_queue.size() < m_settings.queueCapacity || !m_bRunning; });
+            }
+            if (!m_bRunning || target >= m_targets.size()) {
+                return false;
+            }
+            if (m_queue.size() >= m_settings.queueCapacity) {
+                m_stats.rejected++;
+                return false;
+            }
+            m_queue.push_back(Queued{ target, std::move(job) });
+            m_stats.submitted++;
+            m_stats.maxDepth = std::max(m_stats.maxDepth, m_queue.size());
+        }
+        m_notEmpty.notify_one();
+        return true;
+    }
+
+    // Runs job on a worker and waits for it; ADSERR_CLIENT_PORTNOTOPEN if
+    // the pool is not running
+    long Call(size_t target, const std::function<long(Session&)>& job) {
+        long nErr = ADSERR_CLIENT_PORTNOTOPEN;
+        Latch latch(1);
+        if (!Submit(target, [&](Session& session) {
+                nErr = job(session);
+                latch.CountDown();
+            })) {
+            return nErr;
+        }
+        latch.Wait();
+        return nErr;
+    }
+
+    // Splits the tag list into one sum command per worker, at least
+    // minTagsPerWorker tags each, and waits for all parts
+    long FanOut(size_t target, std::vector<Tag>& tags, bool bWrite) {
+        if (tags.empty()) {
+            return 0;
+        }
+        size_t minTags = std::max<size_t>(m_settings.minTagsPerWorker, 1);
+        size_t parts = std::min(m_workers.size(), (tags.size() + minTags - 1) / minTags);
+        parts = std::max<size_t>(parts, 1);
+        size_t perPart = (tags.size() + parts - 1) / parts;
+        parts = (tags.size() + perPart - 1) / perPart;
+
+        std::vector<long> errors(parts, ADSERR_CLIENT_PORTNOTOPEN);
+        Latch latch(parts);
+        for (size_t part = 0; part < parts; part++) {
+            size_t first = part * perPart;
+            size_t last = std::min(first + perPart, tags.size());
+            bool bQueued = Submit(target, [&tags, &errors, &latch, part, first, last, bWrite](Session& session) {
+                errors[part] = RunTags(session, &tags[first], last - first, bWrite);
+                latch.CountDown();
+            });
+            if (!bQueued) {
+                latch.CountDown();
+            }
+        }
+        latch.Wait();
+        for (long nErr : errors) {
+            if (nErr) {
+                return nErr;
+            }
+        }
+        return 0;
+    }
+
+    static long RunTags(Session& session, Tag* pTags, size_t count, bool bWrite) {
+        std::vector<std::string> names(count);
+        for (size_t i = 0; i < count; i++) {
+            names[i] = pTags[i].name;
+        }
+        std::vector<AdsSymbolCache::Symbol*> symbols;
+        long nErr = session.symbols.ResolveAll(names, symbols);
+        std::vector<AdsSymbolCache::Access> batch;
+        batch.reserve(count);
+        for (size_t i = 0; i < count; i++) {
+            pTags[i].result = symbols[i] ? 0 : ADSERR_DEVICE_SYMBOLNOTFOUND;
+            if (symbols[i]) {
+                batch.push_back(AdsSymbolCache::Access{ symbols[i], pTags[i].pData, pTags[i].size, 0 });
+            }
+        }
+        if (!batch.empty()) {
+            nErr = bWrite ? session.symbols.WriteBatch(batch.data(), batch.size())
+                          : session.symbols.ReadBatch(batch.data(), batch.size());
+        }
+        size_t item = 0;
+        for (size_t i = 0; i < count; i++) {
+            if (symbols[i]) {
+                pTags[i].result = batch[item++].result;
+            }
+        }
+        return nErr;
+    }
+
+public:
+    AdsClientPool() : m_bRunning(false), m_stats(), m_completed(0) {}
+
+    ~AdsClientPool() {
+        Stop();
+    }
+
+    AdsClientPool(const AdsClientPool&) = delete;
+    AdsClientPool& operator=(const AdsClientPool&) = delete;
+
+    void SetSettings(const Settings& settings) {
+        m_settings = settings;
+    }
+
+    // "a.b.c.d.e.f" and an ADS port
+    static AmsAddr Address(const std::string& netId, unsigned short port) {
+        AmsAddr addr = AmsAddr();
+        unsigned int bytes[6] = { 0 };
+        sscanf(netId.c_str(), "%u.%u.%u.%u.%u.%u", &bytes[0], &bytes[1], &bytes[2], &bytes[3], &bytes[4], &bytes[5]);
+        for (size_t i = 0; i < 6; i++) {
+            addr.netId.b[i] = static_cast<unsigned char>(bytes[i]);
+        }
+        addr.port = port;
+        return addr;
+    }
+
+    // Adds a destination before Start() and returns its id for the
+    // requests. host routes a remote NetID over the native transport;
+    // with TcAdsDll, routes come from the TwinCAT router instead.
+    size_t AddTarget(const std::string& name, const AmsAddr& addr, const std::string& host = std::string()) {
+#if defined(ADS_NATIVE_TRANSPORT)
+        if (!host.empty()) {
+            AdsAddRoute(addr.netId, host.c_str());
+        }
+#else
+        (void)host;
+#endif
+        m_targets.push_back(Target{ name, addr });
+        return m_targets.size() - 1;
+    }
+
+    // Target id by name, or SIZE_MAX
+    size_t FindTarget(const std::string& name) const {
+        for (size_t i = 0; i < m_targets.size(); i++) {
+            if (m_targets[i].name == name) {
+                return i;
+            }
+        }
+        return SIZE_MAX;
+    }
+
+    // Opens one ADS port per worker and starts the threads
+    bool Start() {
+        if (m_bRunning) {
+            return true;
+        }
+        if (m_targets.empty() || m_settings.workers == 0 || m_settings.queueCapacity == 0) {
+            LogError() << "Error: ADS client pool needs targets, workers and a queue";
+            return false;
+        }
+        for (size_t i = 0; i < m_settings.workers; i++) {
+            long port = AdsPortOpenEx();
+            if (port == 0) {
+                LogError() << "Error: ADS client pool could only open " << i << " of " << m_settings.workers
+                           << " ports";
+                break;
+            }
+            if (m_settings.timeoutMs) {
+                AdsSyncSetTimeoutEx(port, m_settings.timeoutMs);
+            }
+            std::unique_ptr<Worker> pWorker(new Worker());
+            pWorker->port = port;
+            pWorker->symbols.resize(m_targets.size());
+            m_workers.push_back(std::move(pWorker));
+        }
+        if (m_workers.empty()) {
+            return false;
+        }
+        m_bRunning = true;
+        for (std::unique_ptr<Worker>& pWorker : m_workers) {
+            Worker& worker = *pWorker;
+            worker.thread = std::thread([this, &worker] { WorkerLoop(worker); });
+        }
+        LogInfo() << "ADS client pool: " << m_workers.size() << " ports, " << m_targets.size() << " targets";
+        return true;
+    }
+
+    // Runs what is queued, then releases every worker's handles and closes
+    // its port
+    void Stop() {
+        {
+            std::lock_guard<std::mutex> guard(m_lock);
+            if (!m_bRunning) {
+                return;
+            }
+            m_bRunning = false;
+        }
+        m_notEmpty.notify_all();
+        m_notFull.notify_all();
+        for (std::unique_ptr<Worker>& pWorker : m_workers) {
+            pWorker->thread.join();
+            for (std::unique_ptr<AdsSymbolCache>& pSymbols : pWorker->symbols) {
+                if (pSymbols) {
+                    pSymbols->ReleaseAll();
+                }
+            }
+            AdsPortCloseEx(pWorker->port);
+        }
+        m_workers.clear();
+    }
+
+    // Queues a job for the target; waits while the queue is full. False if
+    // the pool is not running or the target is unknown.
+    bool Submit(size_t target, Job job) {
+        return Enqueue(target, std::move(job), true);
+    }
+
+    // As Submit(), but fails at once when the queue is full
+    bool TrySubmit(size_t target, Job job) {
+        return Enqueue(target, std::move(job), false);
+    }
+
+    // --- Blocking helpers, callable from any thread except the workers ---
+
+    long Read(size_t target, const std::string& name, void* pData, unsigned long size,
+              unsigned long* pBytesRead = nullptr) {
+        return Call(target, [&](Session& session) -> long {
+            long nErr = 0;
+            AdsSymbolCache::Symbol* pSymbol = session.symbols.Resolve(name, &nErr);
+            unsigned long bytesRead = 0;
+            nErr = pSymbol ? session.symbols.Read(pSymbol, pData, size, &bytesRead) : nErr;
+            if (pBytesRead) {
+                *pBytesRead = bytesRead;
+            }
+            return nErr;
+        });
+    }
+
+    long Write(size_t target, const std::string& name, void* pData, unsigned long size) {
+        return Call(target, [&](Session& session) -> long {
+            long nErr = 0;
+            AdsSymbolCache::Symbol* pSymbol = session.symbols.Resolve(name, &nErr);
+            return pSymbol ? session.symbols.Write(pSymbol, pData, size) : nErr;
+        });
+    }
+
+    // Index group/offset access, e.g. the EtherCAT master on port 500
+    long ReadRaw(size_t target, unsigned long indexGroup, unsigned long indexOffset, void* pData,
+                 unsigned long size, unsigned long* pBytesRead = nullptr) {
+        return Call(target, [&](Session& session) {
+            return AdsSyncReadReqEx2(session.port, &session.addr, indexGroup, indexOffset, size, pData, pBytesRead);
+        });
+    }
+
+    long ReadState(size_t target, unsigned short* pAdsState, unsigned short* pDeviceState) {
+        return Call(target, [&](Session& session) {
+            return AdsSyncReadStateReqEx(session.port, &session.addr, pAdsState, pDeviceState);
+        });
+    }
+
+    // A tag list spread over the workers as parallel sum commands.
+    // Returns the first transport error; per-tag errors are in Tag::result.
+    long ReadTags(size_t target, std::vector<Tag>& tags) {
+        return FanOut(target, tags, false);
+    }
+
+    long WriteTags(size_t target, std::vector<Tag>& tags) {
+        return FanOut(target, tags, true);
+    }
+
+    size_t GetWorkerCount() const {
+        return m_workers.size();
+    }
+
+    Stats GetStats() {
+        std::lock_guard<std::mutex> guard(m_lock);
+        Stats stats = m_stats;
+        stats.completed = m_completed.load(std::memory_order_relaxed);
+        return stats;
+    }
+};
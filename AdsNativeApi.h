@@ -0,0 +1,364 @@
+#pragma once
+
+// TcAdsApi.h-compatible functions implemented on the native AMS/TCP client,
+// plus asynchronous variants (AdsAsync*) that return immediately so many
+// requests can be in flight at once.
+
+#include <condition_variable>
+#include <future>
+#include <mutex>
+#include "AmsTcpClient.h"
+
+struct AdsAsyncResult {
+    long nErr;
+    unsigned long nBytesRead;
+};
+
+typedef std::function<void(long nErr, unsigned long nBytesRead)> AdsAsyncCompletion;
+
+// Default port used by the functions without the Ex suffix
+inline long& AdsNativeDefaultPort() {
+    static long port = 0;
+    return port;
+}
+
+// Waits for one request on the calling thread; parse runs on the receive
+// thread with the response payload and returns the ADS result
+template <typename Parse>
+long AdsNativeSyncRequest(long port, const AmsAddr* pAddr, uint16_t commandId,
+                          const uint8_t* pPayload, uint32_t length, Parse parse) {
+    if (!pAddr) {
+        return ADSERR_CLIENT_NOAMSADDR;
+    }
+
+    std::mutex lock;
+    std::condition_variable done;
+    bool finished = false;
+    long result = 0;
+
+    long nErr = AmsRouter::Instance().Request(port, *pAddr, commandId, pPayload, length,
+        [&](long nErr, const uint8_t* pData, uint32_t size) {
+            long value = nErr ? nErr : parse(pData, size);
+            std::lock_guard<std::mutex> guard(lock);
+            result = value;
+            finished = true;
+            done.notify_one();
+        });
+    if (nErr) {
+        return nErr;
+    }
+
+    std::unique_lock<std::mutex> guard(lock);
+    done.wait(guard, [&] { return finished; });
+    return result;
+}
+
+// Parses "result, length, data" replies (Read / ReadWrite)
+inline long AdsNativeCopyData(const uint8_t* pData, uint32_t size, void* pDest,
+                              unsigned long capacity, unsigned long* pcbReturn) {
+    if (size < 8) {
+        return ADSERR_DEVICE_INVALIDDATA;
+    }
+    long result = static_cast<long>(AmsGet32(pData));
+    uint32_t length = AmsGet32(pData + 4);
+    if (length > size - 8) {
+        length = size - 8;
+    }
+    if (length > capacity) {
+        length = static_cast<uint32_t>(capacity);
+    }
+    if (!result) {
+        memcpy(pDest, pData + 8, length);
+    }
+    if (pcbReturn) {
+        *pcbReturn = result ? 0 : length;
+    }
+    return result;
+}
+
+inline long AdsNativeResultOnly(const uint8_t* pData, uint32_t size) {
+    return size < 4 ? ADSERR_DEVICE_INVALIDDATA : static_cast<long>(AmsGet32(pData));
+}
+
+inline void AdsNativeEncodeReadWrite(std::vector<uint8_t>& request, unsigned long indexGroup,
+                                     unsigned long indexOffset, unsigned long readLength,
+                                     unsigned long writeLength, const void* pWriteData) {
+    request.resize(16 + writeLength);
+    AmsPut32(request.data(), static_cast<uint32_t>(indexGroup));
+    AmsPut32(request.data() + 4, static_cast<uint32_t>(indexOffset));
+    AmsPut32(request.data() + 8, static_cast<uint32_t>(readLength));
+    AmsPut32(request.data() + 12, static_cast<uint32_t>(writeLength));
+    if (writeLength) {
+        memcpy(request.data() + 16, pWriteData, writeLength);
+    }
+}
+
+// --- Ports, routes and settings -------------------------------------------
+
+inline long AdsPortOpenEx() {
+    return AmsRouter::Instance().OpenPort();
+}
+
+inline long AdsPortCloseEx(long port) {
+    return AmsRouter::Instance().ClosePort(port);
+}
+
+inline long AdsPortOpen() {
+    if (AdsNativeDefaultPort() == 0) {
+        AdsNativeDefaultPort() = AdsPortOpenEx();
+    }
+    return AdsNativeDefaultPort();
+}
+
+inline long AdsPortClose() {
+    long port = AdsNativeDefaultPort();
+    AdsNativeDefaultPort() = 0;
+    return port ? AdsPortCloseEx(port) : ADSERR_CLIENT_PORTNOTOPEN;
+}
+
+inline long AdsGetLocalAddressEx(long port, PAmsAddr pAddr) {
+    return AmsRouter::Instance().GetLocalAddress(port, pAddr);
+}
+
+inline long AdsSyncSetTimeoutEx(long port, long timeoutMs) {
+    return AmsRouter::Instance().SetTimeout(port, static_cast<unsigned long>(timeoutMs));
+}
+
+inline long AdsSyncSetTimeout(long timeoutMs) {
+    return AdsSyncSetTimeoutEx(AdsNativeDefaultPort(), timeoutMs);
+}
+
+// Native-only: route an AMS NetID to a host (default: first 4 bytes as IP)
+inline long AdsAddRoute(const AmsNetId& netId, const char* host) {
+    AmsRouter::Instance().AddRoute(netId, host);
+    return 0;
+}
+
+inline long AdsSetLocalAddress(const AmsNetId& netId) {
+    AmsRouter::Instance().SetLocalNetId(netId);
+    return 0;
+}
+
+inline long AdsAmsRegisterRouterNotification(PAmsRouterNotificationFuncEx pNoteFunc) {
+    AmsRouter::Instance().SetRouterCallback(pNoteFunc);
+    return 0;
+}
+
+inline long AdsAmsUnRegisterRouterNotification() {
+    AmsRouter::Instance().SetRouterCallback(nullptr);
+    return 0;
+}
+
+// --- Synchronous requests ---------------------------------------------------
+
+inline long AdsSyncReadReqEx2(long port, PAmsAddr pAddr, unsigned long indexGroup,
+                              unsigned long indexOffset, unsigned long length, void* pData,
+                              unsigned long* pcbReturn) {
+    uint8_t request[12];
+    AmsPut32(request, static_cast<uint32_t>(indexGroup));
+    AmsPut32(request + 4, static_cast<uint32_t>(indexOffset));
+    AmsPut32(request + 8, static_cast<uint32_t>(length));
+    return AdsNativeSyncRequest(port, pAddr, ADSCMD_READ, request, sizeof(request),
+        [&](const uint8_t* pReply, uint32_t size) {
+            return AdsNativeCopyData(pReply, size, pData, length, pcbReturn);
+        });
+}
+
+inline long AdsSyncReadReq(PAmsAddr pAddr, unsigned long indexGroup, unsigned long indexOffset,
+                           unsigned long length, void* pData) {
+    return AdsSyncReadReqEx2(AdsNativeDefaultPort(), pAddr, indexGroup, indexOffset, length, pData, nullptr);
+}
+
+inline long AdsSyncWriteReqEx(long port, PAmsAddr pAddr, unsigned long indexGroup,
+                              unsigned long indexOffset, unsigned long length, void* pData) {
+    std::vector<uint8_t> request(12 + length);
+    AmsPut32(request.data(), static_cast<uint32_t>(indexGroup));
+    AmsPut32(request.data() + 4, static_cast<uint32_t>(indexOffset));
+    AmsPut32(request.data() + 8, static_cast<uint32_t>(length));
+    if (length) {
+        memcpy(request.data() + 12, pData, length);
+    }
+    return AdsNativeSyncRequest(port, pAddr, ADSCMD_WRITE, request.data(),
+                                static_cast<uint32_t>(request.size()), AdsNativeResultOnly);
+}
+
+inline long AdsSyncWriteReq(PAmsAddr pAddr, unsigned long indexGroup, unsigned long indexOffset,
+                            unsigned long length, void* pData) {
+    return AdsSyncWriteReqEx(AdsNativeDefaultPort(), pAddr, indexGroup, indexOffset, length, pData);
+}
+
+inline long AdsSyncReadWriteReqEx2(long port, PAmsAddr pAddr, unsigned long indexGroup,
+                                   unsigned long indexOffset, unsigned long readLength, void* pReadData,
+                                   unsigned long writeLength, void* pWriteData, unsigned long* pcbReturn) {
+    std::vector<uint8_t> request;
+    AdsNativeEncodeReadWrite(request, indexGroup, indexOffset, readLength, writeLength, pWriteData);
+    return AdsNativeSyncRequest(port, pAddr, ADSCMD_READWRITE, request.data(),
+                                static_cast<uint32_t>(request.size()),
+        [&](const uint8_t* pReply, uint32_t size) {
+            return AdsNativeCopyData(pReply, size, pReadData, readLength, pcbReturn);
+        });
+}
+
+inline long AdsSyncReadStateReqEx(long port, PAmsAddr pAddr, unsigned short* pAdsState,
+                                  unsigned short* pDeviceState) {
+    return AdsNativeSyncRequest(port, pAddr, ADSCMD_READSTATE, nullptr, 0,
+        [&](const uint8_t* pReply, uint32_t size) -> long {
+            if (size < 8) {
+                return ADSERR_DEVICE_INVALIDDATA;
+            }
+            *pAdsState = AmsGet16(pReply + 4);
+            *pDeviceState = AmsGet16(pReply + 6);
+            return static_cast<long>(AmsGet32(pReply));
+        });
+}
+
+inline long AdsSyncReadStateReq(PAmsAddr pAddr, unsigned short* pAdsState, unsigned short* pDeviceState) {
+    return AdsSyncReadStateReqEx(AdsNativeDefaultPort(), pAddr, pAdsState, pDeviceState);
+}
+
+inline long AdsSyncWriteControlReqEx(long port, PAmsAddr pAddr, unsigned short adsState,
+                                     unsigned short deviceState, unsigned long length, void* pData) {
+    std::vector<uint8_t> request(8 + length);
+    AmsPut16(request.data(), adsState);
+    AmsPut16(request.data() + 2, deviceState);
+    AmsPut32(request.data() + 4, static_cast<uint32_t>(length));
+    if (length) {
+        memcpy(request.data() + 8, pData, length);
+    }
+    return AdsNativeSyncRequest(port, pAddr, ADSCMD_WRITECONTROL, request.data(),
+                                static_cast<uint32_t>(request.size()), AdsNativeResultOnly);
+}
+
+inline long AdsSyncWriteControlReq(PAmsAddr pAddr, unsigned short adsState, unsigned short deviceState,
+                                   unsigned long length, void* pData) {
+    return AdsSyncWriteControlReqEx(AdsNativeDefaultPort(), pAddr, adsState, deviceState, length, pData);
+}
+
+inline long AdsSyncReadDeviceInfoReqEx(long port, PAmsAddr pAddr, char* pDevName, PAdsVersion pVersion) {
+    return AdsNativeSyncRequest(port, pAddr, ADSCMD_READDEVICEINFO, nullptr, 0,
+        [&](const uint8_t* pReply, uint32_t size) -> long {
+            if (size < 24) {
+                return ADSERR_DEVICE_INVALIDDATA;
+            }
+            pVersion->version = pReply[4];
+            pVersion->revision = pReply[5];
+            pVersion->build = AmsGet16(pReply + 6);
+            memcpy(pDevName, pReply + 8, 16);
+            pDevName[15] = '\0';
+            return static_cast<long>(AmsGet32(pReply));
+        });
+}
+
+inline long AdsSyncReadDeviceInfoReq(PAmsAddr pAddr, char* pDevName, PAdsVersion pVersion) {
+    return AdsSyncReadDeviceInfoReqEx(AdsNativeDefaultPort(), pAddr, pDevName, pVersion);
+}
+
+inline long AdsSyncAddDeviceNotificationReqEx(long port, PAmsAddr pAddr, unsigned long indexGroup,
+                                              unsigned long indexOffset, PAdsNotificationAttrib pNoteAttrib,
+                                              PAdsNotificationFuncEx pNoteFunc, unsigned long hUser,
+                                              unsigned long* pNotification) {
+    uint8_t request[40] = {};
+    AmsPut32(request, static_cast<uint32_t>(indexGroup));
+    AmsPut32(request + 4, static_cast<uint32_t>(indexOffset));
+    AmsPut32(request + 8, static_cast<uint32_t>(pNoteAttrib->cbLength));
+    AmsPut32(request + 12, static_cast<uint32_t>(pNoteAttrib->nTransMode));
+    AmsPut32(request + 16, static_cast<uint32_t>(pNoteAttrib->nMaxDelay));
+    AmsPut32(request + 20, static_cast<uint32_t>(pNoteAttrib->nCycleTime));
+
+    AmsAddr target = *pAddr;
+    // The handle is registered on the receive thread before the next frame
+    // is read, so the first sample can never arrive unrouted
+    return AdsNativeSyncRequest(port, pAddr, ADSCMD_ADDNOTIFICATION, request, sizeof(request),
+        [&](const uint8_t* pReply, uint32_t size) -> long {
+            if (size < 8) {
+                return ADSERR_DEVICE_INVALIDDATA;
+            }
+            long result = static_cast<long>(AmsGet32(pReply));
+            if (!result) {
+                uint32_t handle = AmsGet32(pReply + 4);
+                AmsRouter::Instance().RegisterNotification(target, handle,
+                    AmsRouter::NotificationTarget{ port, target, pNoteFunc, hUser });
+                *pNotification = handle;
+            }
+            return result;
+        });
+}
+
+inline long AdsSyncDelDeviceNotificationReqEx(long port, PAmsAddr pAddr, unsigned long hNotification) {
+    AmsRouter::Instance().UnregisterNotification(*pAddr, static_cast<uint32_t>(hNotification));
+    uint8_t request[4];
+    AmsPut32(request, static_cast<uint32_t>(hNotification));
+    return AdsNativeSyncRequest(port, pAddr, ADSCMD_DELNOTIFICATION, request, sizeof(request),
+                                AdsNativeResultOnly);
+}
+
+// --- Asynchronous requests --------------------------------------------------
+// Buffers must stay valid until the completion has run. Completions run on
+// the receive thread and must not block.
+
+inline long AdsAsyncReadReqEx(long port, PAmsAddr pAddr, unsigned long indexGroup,
+                              unsigned long indexOffset, unsigned long length, void* pData,
+                              AdsAsyncCompletion completion, unsigned long timeoutMs = 0) {
+    uint8_t request[12];
+    AmsPut32(request, static_cast<uint32_t>(indexGroup));
+    AmsPut32(request + 4, static_cast<uint32_t>(indexOffset));
+    AmsPut32(request + 8, static_cast<uint32_t>(length));
+    return AmsRouter::Instance().Request(port, *pAddr, ADSCMD_READ, request, sizeof(request),
+        [pData, length, completion](long nErr, const uint8_t* pReply, uint32_t size) {
+            unsigned long bytesRead = 0;
+            if (!nErr) {
+                nErr = AdsNativeCopyData(pReply, size, pData, length, &bytesRead);
+            }
+            completion(nErr, bytesRead);
+        }, timeoutMs);
+}
+
+inline long AdsAsyncWriteReqEx(long port, PAmsAddr pAddr, unsigned long indexGroup,
+                               unsigned long indexOffset, unsigned long length, const void* pData,
+                               AdsAsyncCompletion completion, unsigned long timeoutMs = 0) {
+    std::vector<uint8_t> request(12 + length);
+    AmsPut32(request.data(), static_cast<uint32_t>(indexGroup));
+    AmsPut32(request.data() + 4, static_cast<uint32_t>(indexOffset));
+    AmsPut32(request.data() + 8, static_cast<uint32_t>(length));
+    if (length) {
+        memcpy(request.data() + 12, pData, length);
+    }
+    return AmsRouter::Instance().Request(port, *pAddr, ADSCMD_WRITE, request.data(),
+                                         static_cast<uint32_t>(request.size()),
+        [completion](long nErr, const uint8_t* pReply, uint32_t size) {
+            completion(nErr ? nErr : AdsNativeResultOnly(pReply, size), 0);
+        }, timeoutMs);
+}
+
+inline long AdsAsyncReadWriteReqEx(long port, PAmsAddr pAddr, unsigned long indexGroup,
+                                   unsigned long indexOffset, unsigned long readLength, void* pReadData,
+                                   unsigned long writeLength, const void* pWriteData,
+                                   AdsAsyncCompletion completion, unsigned long timeoutMs = 0) {
+    std::vector<uint8_t> request;
+    AdsNativeEncodeReadWrite(request, indexGroup, indexOffset, readLength, writeLength, pWriteData);
+    return AmsRouter::Instance().Request(port, *pAddr, ADSCMD_READWRITE, request.data(),
+                                         static_cast<uint32_t>(request.size()),
+        [pReadData, readLength, completion](long nErr, const uint8_t* pReply, uint32_t size) {
+            unsigned long bytesRead = 0;
+            if (!nErr) {
+                nErr = AdsNativeCopyData(pReply, size, pReadData, readLength, &bytesRead);
+            }
+            completion(nErr, bytesRead);
+        }, timeoutMs);
+}
+
+// Future-based read for callers that prefer to collect results later
+inline std::future<AdsAsyncResult> AdsAsyncReadReqEx(long port, PAmsAddr pAddr, unsigned long indexGroup,
+                                                     unsigned long indexOffset, unsigned long length,
+                                                     void* pData, unsigned long timeoutMs = 0) {
+    auto promise = std::make_shared<std::promise<AdsAsyncResult>>();
+    std::future<AdsAsyncResult> future = promise->get_future();
+    long nErr = AdsAsyncReadReqEx(port, pAddr, indexGroup, indexOffset, length, pData,
+        [promise](long nErr, unsigned long bytesRead) {
+            promise->set_value(AdsAsyncResult{ nErr, bytesRead });
+        }, timeoutMs);
+    if (nErr) {
+        promise->set_value(AdsAsyncResult{ nErr, 0 });
+    }
+    return future;
+}
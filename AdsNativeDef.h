@@ -0,0 +1,116 @@
+#pragma once
+
+// TcAdsDef.h-compatible types and constants for the native AMS/TCP
+// transport, so the masters compile unchanged where TcAdsDll is not
+// available. Values match the Beckhoff definitions.
+
+#include <cstdint>
+
+#ifndef __stdcall
+#define __stdcall
+#endif
+
+#ifndef ANYSIZE_ARRAY
+#define ANYSIZE_ARRAY 1
+#endif
+
+typedef struct {
+    unsigned char b[6];
+} AmsNetId, *PAmsNetId;
+
+typedef struct {
+    AmsNetId netId;
+    unsigned short port;
+} AmsAddr, *PAmsAddr;
+
+typedef struct {
+    unsigned char version;
+    unsigned char revision;
+    unsigned short build;
+} AdsVersion, *PAdsVersion;
+
+typedef enum {
+    ADSTRANS_NOTRANS     = 0,
+    ADSTRANS_CLIENTCYCLE = 1,
+    ADSTRANS_CLIENTONCHA = 2,
+    ADSTRANS_SERVERCYCLE = 3,
+    ADSTRANS_SERVERONCHA = 4
+} ADSTRANSMODE;
+
+typedef struct {
+    unsigned long cbLength;
+    ADSTRANSMODE nTransMode;
+    unsigned long nMaxDelay;     // 100 ns units
+    union {
+        unsigned long nCycleTime; // 100 ns units
+        unsigned long dwChangeFilter;
+    };
+} AdsNotificationAttrib, *PAdsNotificationAttrib;
+
+typedef struct {
+    int64_t nTimeStamp;          // FILETIME
+    unsigned long hNotification;
+    unsigned long cbSampleSize;
+    unsigned char data[ANYSIZE_ARRAY];
+} AdsNotificationHeader, *PAdsNotificationHeader;
+
+typedef void (__stdcall *PAdsNotificationFuncEx)(AmsAddr* pAddr, AdsNotificationHeader* pNotification,
+                                                 unsigned long hUser);
+typedef void (__stdcall *PAmsRouterNotificationFuncEx)(long nEvent);
+
+// Ports
+#define AMSPORT_R0_PLC_TC3            851
+
+// Index groups
+#define ADSIGRP_SYM_HNDBYNAME         0xF003
+#define ADSIGRP_SYM_VALBYNAME         0xF004
+#define ADSIGRP_SYM_VALBYHND          0xF005
+#define ADSIGRP_SYM_RELEASEHND        0xF006
+#define ADSIGRP_SYM_INFOBYNAME        0xF007
+#define ADSIGRP_SYM_VERSION           0xF008
+#define ADSIGRP_SUMUP_READ            0xF080
+#define ADSIGRP_SUMUP_WRITE           0xF081
+#define ADSIGRP_SUMUP_READWRITE       0xF082
+#define ADSIGRP_DEVICE_DATA           0xF100
+#define ADSIOFFS_DEVDATA_ADSSTATE     0x0000
+#define ADSIOFFS_DEVDATA_DEVSTATE     0x0002
+
+// Router events
+#define AMSEVENT_ROUTERSTOP           0
+#define AMSEVENT_ROUTERSTART          1
+#define AMSEVENT_ROUTERREMOVED        2
+
+// Error codes
+#define ADSERR_NOERR                        0x00
+#define ERR_ADSERRS                         0x0700
+#define ADSERR_DEVICE_ERROR                 (0x00 + ERR_ADSERRS)
+#define ADSERR_DEVICE_SRVNOTSUPP            (0x01 + ERR_ADSERRS)
+#define ADSERR_DEVICE_INVALIDGRP            (0x02 + ERR_ADSERRS)
+#define ADSERR_DEVICE_INVALIDOFFSET         (0x03 + ERR_ADSERRS)
+#define ADSERR_DEVICE_INVALIDACCESS         (0x04 + ERR_ADSERRS)
+#define ADSERR_DEVICE_INVALIDSIZE           (0x05 + ERR_ADSERRS)
+#define ADSERR_DEVICE_INVALIDDATA           (0x06 + ERR_ADSERRS)
+#define ADSERR_DEVICE_NOTREADY              (0x07 + ERR_ADSERRS)
+#define ADSERR_DEVICE_BUSY                  (0x08 + ERR_ADSERRS)
+#define ADSERR_DEVICE_NOMEMORY              (0x0A + ERR_ADSERRS)
+#define ADSERR_DEVICE_INVALIDPARM           (0x0B + ERR_ADSERRS)
+#define ADSERR_DEVICE_NOTFOUND              (0x0C + ERR_ADSERRS)
+#define ADSERR_DEVICE_SYMBOLNOTFOUND        (0x10 + ERR_ADSERRS)
+#define ADSERR_DEVICE_SYMBOLVERSIONINVALID  (0x11 + ERR_ADSERRS)
+#define ADSERR_DEVICE_INVALIDSTATE          (0x12 + ERR_ADSERRS)
+#define ADSERR_DEVICE_NOTIFYHNDINVALID      (0x14 + ERR_ADSERRS)
+#define ADSERR_DEVICE_TIMEOUT               (0x19 + ERR_ADSERRS)
+#define ADSERR_CLIENT_ERROR                 (0x40 + ERR_ADSERRS)
+#define ADSERR_CLIENT_INVALIDPARM           (0x41 + ERR_ADSERRS)
+#define ADSERR_CLIENT_NOAMSADDR             (0x44 + ERR_ADSERRS)
+#define ADSERR_CLIENT_SYNCTIMEOUT           (0x45 + ERR_ADSERRS)
+#define ADSERR_CLIENT_PORTNOTOPEN           (0x48 + ERR_ADSERRS)
+#define ADSERR_CLIENT_NOMEMORY              (0x4A + ERR_ADSERRS)
+#define ADSERR_CLIENT_REMOVEHASH            (0x51 + ERR_ADSERRS)
+#define ADSERR_CLIENT_SYNCPORTLOCKED        (0x55 + ERR_ADSERRS)
+
+// Transport-level errors of the native client (outside the ADS range)
+#define GLOBALERR_TARGET_PORT               0x06
+#define GLOBALERR_MISSING_ROUTE             0x07
+#define GLOBALERR_NO_MEMORY                 0x19
+#define GLOBALERR_TCP_SEND                  0x1A
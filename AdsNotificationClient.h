@@ -0,0 +1,282 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstring>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "AdsApi.h"
+#include "MpscQueue.h"
+
+#ifndef ADSIGRP_DEVICE_DATA
+#define ADSIGRP_DEVICE_DATA       0xF100
+#endif
+#ifndef ADSIOFFS_DEVDATA_ADSSTATE
+#define ADSIOFFS_DEVDATA_ADSSTATE 0x0000
+#endif
+
+// A sample delivered by an ADS device notification
+struct AdsNotificationEvent {
+    static const unsigned long kMaxSampleSize = 128;
+
+    unsigned long subscription;    // id returned by Subscribe...()
+    long long timestamp;           // FILETIME, 100 ns since 1601
+    unsigned long size;            // sample size reported by the server
+    bool truncated;                // sample was larger than kMaxSampleSize
+    unsigned char data[kMaxSampleSize];
+};
+
+// Push-based replacement for polling: registers ADS device notifications
+// and moves every sample from the ADS callback threads into a lock-free MPSC
+// queue that the application thread drains with Poll(). The native
+// transport runs one receive thread per host, so there can be several
+// producers. The server only
+// sends when a value changes (or at the requested cycle), so an idle link
+// carries no traffic.
+class AdsNotificationClient {
+public:
+    enum Mode {
+        ON_CHANGE,  // send when the value changes, at most every cycleTimeMs
+        CYCLIC      // send every cycleTimeMs regardless of changes
+    };
+
+    static const size_t kQueueSize = 1024;
+    static const unsigned long kInvalidSubscription = 0xFFFFFFFF;
+
+private:
+    struct Subscription {
+        unsigned long hNotification;
+        bool active;
+    };
+
+    // hUser is only 32 bits wide, so callbacks find their client through a
+    // small static table: hUser = (client slot << 24) | subscription index
+    static const unsigned long kMaxClients = 16;
+    static inline std::atomic<AdsNotificationClient*> s_clients[kMaxClients] = {};
+    static inline std::atomic<long> s_routerEvent{ -1 };
+    // Callbacks currently inside a slot's client; the destructor waits for
+    // this to drop to zero before the queue goes away
+    static inline std::atomic<unsigned long> s_busy[kMaxClients] = {};
+
+    long m_nPort;
+    AmsAddr m_Addr;
+    unsigned long m_slot;
+    std::vector<Subscription> m_subscriptions;
+
+    MpscQueue<AdsNotificationEvent, kQueueSize> m_queue;
+    std::atomic<unsigned long> m_dropped;
+
+    // Wake-up for WaitForEvents(); the producer only touches the mutex when
+    // the consumer is actually sleeping
+    std::atomic<bool> m_bWaiting;
+    std::mutex m_waitMutex;
+    std::condition_variable m_waitCond;
+
+    static void __stdcall OnNotification(AmsAddr* pAddr, AdsNotificationHeader* pNotification,
+                                         unsigned long hUser) {
+        (void)pAddr;
+        unsigned long slot = hUser >> 24;
+        if (slot >= kMaxClients) {
+            return;
+        }
+        s_busy[slot].fetch_add(1);
+        AdsNotificationClient* pClient = s_clients[slot].load();
+        if (pClient) {
+            pClient->Push(hUser & 0x00FFFFFF, pNotification);
+        }
+        s_busy[slot].fetch_sub(1);
+    }
+
+    static void __stdcall OnRouterEvent(long nEvent) {
+        s_routerEvent.store(nEvent, std::memory_order_release);
+        for (unsigned long i = 0; i < kMaxClients; i++) {
+            s_busy[i].fetch_add(1);
+            AdsNotificationClient* pClient = s_clients[i].load();
+            if (pClient) {
+                pClient->Wake();
+            }
+            s_busy[i].fetch_sub(1);
+        }
+    }
+
+    void Push(unsigned long subscription, const AdsNotificationHeader* pNotification) {
+        AdsNotificationEvent event;
+        unsigned long size = pNotification->cbSampleSize;
+        unsigned long copy = size < AdsNotificationEvent::kMaxSampleSize
+                           ? size : AdsNotificationEvent::kMaxSampleSize;
+        event.subscription = subscription;
+        event.timestamp = pNotification->nTimeStamp;
+        event.size = size;
+        event.truncated = (copy < size);
+        memcpy(event.data, pNotification->data, copy);
+        if (!m_queue.TryPush(event)) {
+            m_dropped.fetch_add(1, std::memory_order_relaxed);
+            return;
+        }
+        Wake();
+    }
+
+    void Wake() {
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (m_bWaiting.load(std::memory_order_relaxed)) {
+            std::lock_guard<std::mutex> lock(m_waitMutex);
+            m_waitCond.notify_one();
+        }
+    }
+
+    bool HasPending() const {
+        return !m_queue.Empty() || s_routerEvent.load(std::memory_order_acquire) >= 0;
+    }
+
+public:
+    AdsNotificationClient()
+        : m_nPort(0), m_slot(kMaxClients), m_dropped(0), m_bWaiting(false) {
+        m_Addr = AmsAddr();
+        for (unsigned long i = 0; i < kMaxClients; i++) {
+            AdsNotificationClient* pExpected = nullptr;
+            if (s_clients[i].compare_exchange_strong(pExpected, this)) {
+                m_slot = i;
+                break;
+            }
+        }
+    }
+
+    // Unregisters first, then waits for callbacks already past the slot
+    // lookup, so no Push is in flight when the queue is destroyed
+    ~AdsNotificationClient() {
+        UnsubscribeAll();
+        if (m_slot < kMaxClients) {
+            s_clients[m_slot].store(nullptr);
+            while (s_busy[m_slot].load() != 0) {
+                std::this_thread::yield();
+            }
+        }
+    }
+
+    AdsNotificationClient(const AdsNotificationClient&) = delete;
+    AdsNotificationClient& operator=(const AdsNotificationClient&) = delete;
+
+    void Attach(long nPort, const AmsAddr& addr) {
+        m_nPort = nPort;
+        m_Addr = addr;
+    }
+
+    // Subscribes to an index group/offset. cycleTimeMs is the sampling
+    // period on the server; maxDelayMs lets the server batch samples for up
+    // to that long before sending (0 = send immediately).
+    unsigned long Subscribe(unsigned long indexGroup, unsigned long indexOffset, unsigned long size,
+                            Mode mode, unsigned long cycleTimeMs, unsigned long maxDelayMs,
+                            long* pErr = nullptr) {
+        if (m_slot >= kMaxClients || m_subscriptions.size() >= 0x00FFFFFF) {
+            if (pErr) {
+                *pErr = ADSERR_CLIENT_NOMEMORY;
+            }
+            return kInvalidSubscription;
+        }
+
+        // Notification times are in 100 ns units
+        AdsNotificationAttrib attrib = {};
+        attrib.cbLength = size;
+        attrib.nTransMode = (mode == CYCLIC) ? ADSTRANS_SERVERCYCLE : ADSTRANS_SERVERONCHA;
+        attrib.nMaxDelay = maxDelayMs * 10000;
+        attrib.nCycleTime = cycleTimeMs * 10000;
+
+        unsigned long id = static_cast<unsigned long>(m_subscriptions.size());
+        unsigned long hNotification = 0;
+        long nErr = AdsSyncAddDeviceNotificationReqEx(m_nPort, &m_Addr, indexGroup, indexOffset,
+                                                      &attrib, &AdsNotificationClient::OnNotification,
+                                                      (m_slot << 24) | id, &hNotification);
+        if (pErr) {
+            *pErr = nErr;
+        }
+        if (nErr) {
+            return kInvalidSubscription;
+        }
+
+        m_subscriptions.push_back(Subscription{ hNotification, true });
+        return id;
+    }
+
+    // Subscribes to a PLC variable by symbol handle (see AdsSymbolCache)
+    unsigned long SubscribeHandle(unsigned long handle, unsigned long size, Mode mode,
+                                  unsigned long cycleTimeMs, unsigned long maxDelayMs,
+                                  long* pErr = nullptr) {
+        return Subscribe(ADSIGRP_SYM_VALBYHND, handle, size, mode, cycleTimeMs, maxDelayMs, pErr);
+    }
+
+    // Subscribes to the target's ADS state (RUN/STOP/CONFIG...). The sample
+    // is the 16-bit ADS state.
+    unsigned long SubscribeAdsState(long* pErr = nullptr) {
+        return Subscribe(ADSIGRP_DEVICE_DATA, ADSIOFFS_DEVDATA_ADSSTATE, sizeof(unsigned short),
+                         ON_CHANGE, 0, 0, pErr);
+    }
+
+    // Reports local AMS router stop/start through PollRouterEvent(), so a
+    // lost connection is noticed without periodic state reads
+    static long EnableRouterEvents() {
+        return AdsAmsRegisterRouterNotification(&AdsNotificationClient::OnRouterEvent);
+    }
+
+    static void DisableRouterEvents() {
+        AdsAmsUnRegisterRouterNotification();
+    }
+
+    long Unsubscribe(unsigned long id) {
+        if (id >= m_subscriptions.size() || !m_subscriptions[id].active) {
+            return ADSERR_CLIENT_INVALIDPARM;
+        }
+        m_subscriptions[id].active = false;
+        return AdsSyncDelDeviceNotificationReqEx(m_nPort, &m_Addr, m_subscriptions[id].hNotification);
+    }
+
+    // Must run while the ADS port is still open
+    void UnsubscribeAll() {
+        for (unsigned long i = 0; i < m_subscriptions.size(); i++) {
+            if (m_subscriptions[i].active) {
+                Unsubscribe(i);
+            }
+        }
+        m_subscriptions.clear();
+    }
+
+    // Blocks the application thread until a sample or router event is
+    // queued or the timeout expires. Returns true if something is pending.
+    bool WaitForEvents(unsigned long timeoutMs) {
+        if (HasPending()) {
+            return true;
+        }
+
+        std::unique_lock<std::mutex> lock(m_waitMutex);
+        m_bWaiting.store(true, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        bool bPending = m_waitCond.wait_for(lock, std::chrono::milliseconds(timeoutMs),
+                                            [this] { return HasPending(); });
+        m_bWaiting.store(false, std::memory_order_relaxed);
+        return bPending;
+    }
+
+    // Drains queued samples on the application thread. handler is called
+    // as handler(const AdsNotificationEvent&). Returns the number handled.
+    template <typename Handler>
+    size_t Poll(Handler handler) {
+        size_t count = 0;
+        AdsNotificationEvent event;
+        while (m_queue.TryPop(event)) {
+            handler(event);
+            count++;
+        }
+        return count;
+    }
+
+    // Returns the last router event (AMSEVENT_*) once, or -1 if none
+    static long PollRouterEvent() {
+        return s_routerEvent.exchange(-1, std::memory_order_acq_rel);
+    }
+
+    // Samples lost because the application did not drain fast enough
+    unsigned long GetDroppedCount() const {
+        return m_dropped.load(std::memory_order_relaxed);
+    }
+};
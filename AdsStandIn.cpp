@@ -0,0 +1,82 @@
+// ads_standin: runs AdsStandInServer as a process so EtherCATMaster and
+// EtherCATStateMaster can be exercised on Linux without a TwinCAT target.
+//
+//   ads_standin [--port N] [--latency-ms N] [--slaves N] [--tags N] [--any]
+//
+// Serves MAIN.bStart, MAIN.nCounter (incremented every 100 ms so on-change
+// notifications fire), MAIN.fSetpoint and --tags 4-byte tags GVL.nTag[i].
+
+#include <cerrno>
+#include <csignal>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include "AdsStandInServer.h"
+
+static volatile sig_atomic_t g_bStop = 0;
+
+static void OnSignal(int) {
+    g_bStop = 1;
+}
+
+int main(int argc, char* argv[]) {
+    uint16_t port = AMS_TCP_PORT;
+    unsigned long latencyMs = 0;
+    unsigned long slaves = 3;
+    unsigned long tags = 0;
+    bool loopbackOnly = true;
+
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        bool hasValue = (i + 1 < argc);
+        if (arg == "--port" && hasValue) {
+            port = static_cast<uint16_t>(strtoul(argv[++i], nullptr, 10));
+        } else if (arg == "--latency-ms" && hasValue) {
+            latencyMs = strtoul(argv[++i], nullptr, 10);
+        } else if (arg == "--slaves" && hasValue) {
+            slaves = strtoul(argv[++i], nullptr, 10);
+        } else if (arg == "--tags" && hasValue) {
+            tags = strtoul(argv[++i], nullptr, 10);
+        } else if (arg == "--any") {
+            loopbackOnly = false;
+        } else {
+            std::cout << "Usage: " << argv[0]
+                      << " [--port N] [--latency-ms N] [--slaves N] [--tags N] [--any]\n";
+            return 1;
+        }
+    }
+
+    AdsStandInServer server;
+    server.AddSymbol("MAIN.bStart", 1);
+    server.AddSymbol("MAIN.nCounter", 4);
+    server.AddSymbol("MAIN.fSetpoint", 8);
+    for (unsigned long i = 0; i < tags; i++) {
+        server.AddSymbol("GVL.nTag[" + std::to_string(i) + "]", 4);
+    }
+    server.SetSlaveCount(static_cast<uint16_t>(slaves));
+    server.SetLatency(std::chrono::milliseconds(latencyMs));
+
+    uint16_t bound = server.Start(port, loopbackOnly);
+    if (!bound) {
+        std::cerr << "Error starting ADS stand-in on port " << port << ": " << strerror(errno) << std::endl;
+        return 1;
+    }
+
+    signal(SIGINT, OnSignal);
+    signal(SIGTERM, OnSignal);
+    std::cout << "ADS stand-in listening on port " << bound
+              << " (latency " << latencyMs << " ms, " << slaves << " slaves, "
+              << tags << " tags)" << std::endl;
+
+    uint32_t counter = 0;
+    while (!g_bStop) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+        counter++;
+        server.SetSymbolValue("MAIN.nCounter", &counter, sizeof(counter));
+    }
+
+    server.Stop();
+    std::cout << "Served " << server.GetRequestCount() << " requests" << std::endl;
+    return 0;
+}
@@ -0,0 +1,780 @@
+#pragma once
+
+// Small in-process ADS server speaking AMS/TCP, standing in for a TwinCAT
+// runtime so the native transport, the masters and the benchmarks can run
+// on a machine without TwinCAT. It serves:
+//   - ADS state / device info / write control on every port
+//   - PLC symbols on port 851: handles by name, values by handle or name,
+//     symbol version, sum read/write/read-write, device notifications
+//   - flat memory areas 0x4020 (%M), 0xF020 (inputs), 0xF030 (outputs)
+//   - the EtherCAT master index group 0x9000 on port 500
+// An optional per-request latency emulates a WAN link; replies are delayed
+// without serialising the requests behind each other.
+
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <atomic>
+#include <cctype>
+#include <chrono>
+#include <deque>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+#include "AmsProtocol.h"
+
+class AdsStandInServer {
+public:
+    static const unsigned short kPlcPort = 851;
+    static const unsigned short kEtherCATMasterPort = 500;
+    static const uint32_t kMemoryAreaSize = 64 * 1024;
+
+private:
+    typedef std::chrono::steady_clock Clock;
+
+    struct Symbol {
+        std::string name;
+        std::vector<uint8_t> value;
+    };
+
+    struct Client {
+        int fd;
+        std::vector<uint8_t> rx;
+    };
+
+    struct Notification {
+        int fd;
+        AmsAddr client;
+        AmsAddr server;
+        uint32_t indexGroup;
+        uint32_t indexOffset;
+        uint32_t length;
+        uint32_t mode;
+        Clock::duration cycle;
+        Clock::time_point nextSample;
+        std::vector<uint8_t> lastValue;
+        bool sentOnce;
+    };
+
+    struct DelayedFrame {
+        Clock::time_point due;
+        int fd;
+        std::vector<uint8_t> frame;
+    };
+
+    int m_listenFd;
+    std::thread m_thread;
+    std::atomic<bool> m_bRunning;
+
+    // Everything below is owned by the server thread, except where the
+    // public setters take m_lock
+    std::mutex m_lock;
+    std::vector<Client> m_clients;
+    std::vector<Symbol> m_symbols;
+    std::unordered_map<std::string, size_t> m_symbolIndex;   // upper-case name -> index
+    std::map<uint32_t, size_t> m_handles;          // handle -> symbol index
+    uint32_t m_nextHandle;
+    uint8_t m_symbolVersion;
+    uint16_t m_adsState;
+    uint16_t m_deviceState;
+    uint16_t m_slaveCount;
+    std::vector<uint8_t> m_memory;
+    std::vector<uint8_t> m_inputs;
+    std::vector<uint8_t> m_outputs;
+    std::map<uint32_t, Notification> m_notifications;
+    uint32_t m_nextNotification;
+    std::deque<DelayedFrame> m_delayed;
+    Clock::duration m_latency;
+    std::atomic<unsigned long> m_requests;
+
+    static std::string Upper(std::string text) {
+        std::transform(text.begin(), text.end(), text.begin(),
+                       [](unsigned char c) { return static_cast<char>(toupper(c)); });
+        return text;
+    }
+
+    // ADS symbol names are case-insensitive
+    int FindSymbol(const std::string& name) const {
+        auto it = m_symbolIndex.find(Upper(name));
+        return it == m_symbolIndex.end() ? -1 : static_cast<int>(it->second);
+    }
+
+    std::vector<uint8_t>* MemoryArea(uint32_t indexGroup) {
+        switch (indexGroup) {
+            case 0x4020: return &m_memory;
+            case 0xF020: return &m_inputs;
+            case 0xF030: return &m_outputs;
+            default:     return nullptr;
+        }
+    }
+
+    static uint32_t CheckRange(const std::vector<uint8_t>& area, uint32_t offset, uint32_t length) {
+        if (offset > area.size() || length > area.size() - offset) {
+            return ADSERR_DEVICE_INVALIDSIZE;
+        }
+        return 0;
+    }
+
+    uint32_t ReadData(uint16_t port, uint32_t indexGroup, uint32_t indexOffset, uint32_t length,
+                      std::vector<uint8_t>& out) {
+        out.clear();
+        if (port == kEtherCATMasterPort) {
+            if (indexGroup != 0x9000) {
+                return ADSERR_DEVICE_INVALIDGRP;
+            }
+            if (indexOffset == 0x0000) {
+                out.resize(4);
+                AmsPut32(out.data(), 0x08);                 // master in OP
+            } else if (indexOffset == 0x0001) {
+                out.resize(2);
+                AmsPut16(out.data(), m_slaveCount);
+            } else if (indexOffset >= 0x0010 && indexOffset < 0x0010u + m_slaveCount) {
+                out.push_back(0x08);                         // slave in OP
+            } else {
+                return ADSERR_DEVICE_INVALIDOFFSET;
+            }
+            out.resize(std::min<size_t>(out.size(), length));
+            return 0;
+        }
+
+        if (indexGroup == ADSIGRP_DEVICE_DATA && indexOffset == ADSIOFFS_DEVDATA_ADSSTATE) {
+            out.resize(2);
+            AmsPut16(out.data(), m_adsState);
+            return length < 2 ? ADSERR_DEVICE_INVALIDSIZE : 0;
+        }
+
+        if (port != kPlcPort) {
+            return ADSERR_DEVICE_SRVNOTSUPP;
+        }
+
+        if (std::vector<uint8_t>* pArea = MemoryArea(indexGroup)) {
+            uint32_t nErr = CheckRange(*pArea, indexOffset, length);
+            if (!nErr) {
+                out.assign(pArea->begin() + indexOffset, pArea->begin() + indexOffset + length);
+            }
+            return nErr;
+        }
+
+        switch (indexGroup) {
+            case ADSIGRP_SYM_VERSION:
+                out.push_back(m_symbolVersion);
+                return 0;
+
+            case ADSIGRP_SYM_VALBYHND: {
+                auto it = m_handles.find(indexOffset);
+                if (it == m_handles.end()) {
+                    return ADSERR_DEVICE_SYMBOLNOTFOUND;
+                }
+                const std::vector<uint8_t>& value = m_symbols[it->second].value;
+                if (length > value.size()) {
+                    return ADSERR_DEVICE_INVALIDSIZE;
+                }
+                out.assign(value.begin(), value.begin() + length);
+                return 0;
+            }
+
+            default:
+                return ADSERR_DEVICE_INVALIDGRP;
+        }
+    }
+
+    uint32_t WriteData(uint16_t port, uint32_t indexGroup, uint32_t indexOffset,
+                       const uint8_t* pData, uint32_t length) {
+        if (port != kPlcPort) {
+            return ADSERR_DEVICE_SRVNOTSUPP;
+        }
+
+        if (std::vector<uint8_t>* pArea = MemoryArea(indexGroup)) {
+            uint32_t nErr = CheckRange(*pArea, indexOffset, length);
+            if (!nErr) {
+                memcpy(pArea->data() + indexOffset, pData, length);
+            }
+            return nErr;
+        }
+
+        switch (indexGroup) {
+            case ADSIGRP_SYM_RELEASEHND: {
+                if (length < 4) {
+                    return ADSERR_DEVICE_INVALIDSIZE;
+                }
+                return m_handles.erase(AmsGet32(pData)) ? 0 : ADSERR_DEVICE_SYMBOLNOTFOUND;
+            }
+
+            case ADSIGRP_SYM_VALBYHND: {
+                auto it = m_handles.find(indexOffset);
+                if (it == m_handles.end()) {
+                    return ADSERR_DEVICE_SYMBOLNOTFOUND;
+                }
+                std::vector<uint8_t>& value = m_symbols[it->second].value;
+                if (length > value.size()) {
+                    return ADSERR_DEVICE_INVALIDSIZE;
+                }
+                memcpy(value.data(), pData, length);
+                return 0;
+            }
+
+            default:
+                return ADSERR_DEVICE_INVALIDGRP;
+        }
+    }
+
+    uint32_t ReadWriteData(uint16_t port, uint32_t indexGroup, uint32_t indexOffset, uint32_t readLength,
+                           const uint8_t* pWrite, uint32_t writeLength, std::vector<uint8_t>& out) {
+        out.clear();
+
+        // Sum commands work on every port; the sub-commands decide
+        switch (indexGroup) {
+            case ADSIGRP_SUMUP_READ:
+                return SumRead(port, indexOffset, pWrite, writeLength, out);
+
+            case ADSIGRP_SUMUP_WRITE:
+                return SumWrite(port, indexOffset, pWrite, writeLength, out);
+
+            case ADSIGRP_SUMUP_READWRITE:
+                return SumReadWrite(port, indexOffset, pWrite, writeLength, out);
+        }
+
+        if (port != kPlcPort) {
+            return ReadData(port, indexGroup, indexOffset, readLength, out);
+        }
+
+        switch (indexGroup) {
+            case ADSIGRP_SYM_HNDBYNAME: {
+                int index = FindSymbol(std::string(reinterpret_cast<const char*>(pWrite),
+                                                   strnlen(reinterpret_cast<const char*>(pWrite), writeLength)));
+                if (index < 0) {
+                    return ADSERR_DEVICE_SYMBOLNOTFOUND;
+                }
+                if (readLength < 4) {
+                    return ADSERR_DEVICE_INVALIDSIZE;
+                }
+                uint32_t handle = m_nextHandle++;
+                m_handles[handle] = static_cast<size_t>(index);
+                out.resize(4);
+                AmsPut32(out.data(), handle);
+                return 0;
+            }
+
+            case ADSIGRP_SYM_VALBYNAME: {
+                int index = FindSymbol(std::string(reinterpret_cast<const char*>(pWrite),
+                                                   strnlen(reinterpret_cast<const char*>(pWrite), writeLength)));
+                if (index < 0) {
+                    return ADSERR_DEVICE_SYMBOLNOTFOUND;
+                }
+                const std::vector<uint8_t>& value = m_symbols[index].value;
+                out.assign(value.begin(), value.begin() + std::min<size_t>(readLength, value.size()));
+                return 0;
+            }
+
+            default:
+                return ReadData(port, indexGroup, indexOffset, readLength, out);
+        }
+    }
+
+    uint32_t SumRead(uint16_t port, uint32_t count, const uint8_t* pWrite, uint32_t writeLength,
+                     std::vector<uint8_t>& out) {
+        if (static_cast<uint64_t>(count) * 12 > writeLength) {
+            return ADSERR_DEVICE_INVALIDSIZE;
+        }
+        std::vector<uint8_t> value;
+        out.resize(count * 4);
+        for (uint32_t i = 0; i < count; i++) {
+            const uint8_t* p = pWrite + i * 12;
+            uint32_t length = AmsGet32(p + 8);
+            uint32_t nErr = ReadData(port, AmsGet32(p), AmsGet32(p + 4), length, value);
+            AmsPut32(out.data() + i * 4, nErr);
+            value.resize(length);   // every slot keeps its requested length
+            out.insert(out.end(), value.begin(), value.end());
+        }
+        return 0;
+    }
+
+    uint32_t SumWrite(uint16_t port, uint32_t count, const uint8_t* pWrite, uint32_t writeLength,
+                      std::vector<uint8_t>& out) {
+        if (static_cast<uint64_t>(count) * 12 > writeLength) {
+            return ADSERR_DEVICE_INVALIDSIZE;
+        }
+        out.resize(count * 4);
+        const uint8_t* pData = pWrite + count * 12;
+        const uint8_t* pEnd = pWrite + writeLength;
+        for (uint32_t i = 0; i < count; i++) {
+            const uint8_t* p = pWrite + i * 12;
+            uint32_t length = AmsGet32(p + 8);
+            uint32_t nErr = ADSERR_DEVICE_INVALIDSIZE;
+            if (length <= static_cast<uint32_t>(pEnd - pData)) {
+                nErr = WriteData(port, AmsGet32(p), AmsGet32(p + 4), pData, length);
+                pData += length;
+            }
+            AmsPut32(out.data() + i * 4, nErr);
+        }
+        return 0;
+    }
+
+    uint32_t SumReadWrite(uint16_t port, uint32_t count, const uint8_t* pWrite, uint32_t writeLength,
+                          std::vector<uint8_t>& out) {
+        if (static_cast<uint64_t>(count) * 16 > writeLength) {
+            return ADSERR_DEVICE_INVALIDSIZE;
+        }
+        std::vector<uint8_t> data;
+        std::vector<uint8_t> value;
+        out.resize(count * 8);
+        const uint8_t* pData = pWrite + count * 16;
+        const uint8_t* pEnd = pWrite + writeLength;
+        for (uint32_t i = 0; i < count; i++) {
+            const uint8_t* p = pWrite + i * 16;
+            uint32_t readLength = AmsGet32(p + 8);
+            uint32_t itemWrite = AmsGet32(p + 12);
+            uint32_t nErr = ADSERR_DEVICE_INVALIDSIZE;
+            value.clear();
+            if (itemWrite <= static_cast<uint32_t>(pEnd - pData)) {
+                nErr = ReadWriteData(port, AmsGet32(p), AmsGet32(p + 4), readLength, pData, itemWrite, value);
+                pData += itemWrite;
+            }
+            if (nErr) {
+                value.clear();
+            }
+            AmsPut32(out.data() + i * 8, nErr);
+            AmsPut32(out.data() + i * 8 + 4, static_cast<uint32_t>(value.size()));
+            data.insert(data.end(), value.begin(), value.end());
+        }
+        out.insert(out.end(), data.begin(), data.end());
+        return 0;
+    }
+
+    void Reply(int fd, const AmsHeader& request, uint32_t errorCode, const std::vector<uint8_t>& payload) {
+        AmsHeader header;
+        header.target = request.source;
+        header.source = request.target;
+        header.commandId = request.commandId;
+        header.stateFlags = AMS_STATEFLAG_RESPONSE;
+        header.dataLength = static_cast<uint32_t>(payload.size());
+        header.errorCode = errorCode;
+        header.invokeId = request.invokeId;
+        Send(fd, header, payload, m_latency);
+    }
+
+    void Send(int fd, const AmsHeader& header, const std::vector<uint8_t>& payload, Clock::duration delay) {
+        std::vector<uint8_t> frame(AMS_FRAME_HEADER_SIZE + payload.size());
+        AmsEncodeHeader(frame.data(), header);
+        if (!payload.empty()) {
+            memcpy(frame.data() + AMS_FRAME_HEADER_SIZE, payload.data(), payload.size());
+        }
+
+        if (delay.count() > 0) {
+            m_delayed.push_back(DelayedFrame{ Clock::now() + delay, fd, std::move(frame) });
+        } else {
+            SendNow(fd, frame);
+        }
+    }
+
+    static void SendNow(int fd, const std::vector<uint8_t>& frame) {
+        const uint8_t* p = frame.data();
+        size_t remaining = frame.size();
+        while (remaining > 0) {
+            ssize_t n = send(fd, p, remaining, MSG_NOSIGNAL);
+            if (n < 0) {
+                if (errno == EINTR || errno == EAGAIN) {
+                    pollfd pfd = { fd, POLLOUT, 0 };
+                    poll(&pfd, 1, 100);
+                    continue;
+                }
+                return;
+            }
+            p += n;
+            remaining -= static_cast<size_t>(n);
+        }
+    }
+
+    static std::vector<uint8_t> Result(uint32_t result) {
+        std::vector<uint8_t> payload(4);
+        AmsPut32(payload.data(), result);
+        return payload;
+    }
+
+    static std::vector<uint8_t> ResultWithData(uint32_t result, const std::vector<uint8_t>& data) {
+        std::vector<uint8_t> payload(8 + data.size());
+        AmsPut32(payload.data(), result);
+        AmsPut32(payload.data() + 4, static_cast<uint32_t>(data.size()));
+        if (!data.empty()) {
+            memcpy(payload.data() + 8, data.data(), data.size());
+        }
+        return payload;
+    }
+
+    void HandleRequest(int fd, const AmsHeader& header, const uint8_t* p, uint32_t length) {
+        m_requests.fetch_add(1, std::memory_order_relaxed);
+        uint16_t port = header.target.port;
+        std::vector<uint8_t> data;
+
+        switch (header.commandId) {
+            case ADSCMD_READDEVICEINFO: {
+                std::vector<uint8_t> payload(24, 0);
+                payload[4] = 3;
+                payload[5] = 1;
+                AmsPut16(payload.data() + 6, 4024);
+                memcpy(payload.data() + 8, "Plc30 App", 9);
+                Reply(fd, header, 0, payload);
+                break;
+            }
+
+            case ADSCMD_READ: {
+                if (length < 12) {
+                    Reply(fd, header, ADSERR_DEVICE_INVALIDSIZE, std::vector<uint8_t>());
+                    break;
+                }
+                uint32_t nErr = ReadData(port, AmsGet32(p), AmsGet32(p + 4), AmsGet32(p + 8), data);
+                if (nErr) {
+                    data.clear();
+                }
+                Reply(fd, header, 0, ResultWithData(nErr, data));
+                break;
+            }
+
+            case ADSCMD_WRITE: {
+                if (length < 12 || AmsGet32(p + 8) > length - 12) {
+                    Reply(fd, header, ADSERR_DEVICE_INVALIDSIZE, std::vector<uint8_t>());
+                    break;
+                }
+                uint32_t nErr = WriteData(port, AmsGet32(p), AmsGet32(p + 4), p + 12, AmsGet32(p + 8));
+                Reply(fd, header, 0, Result(nErr));
+                break;
+            }
+
+            case ADSCMD_READWRITE: {
+                if (length < 16 || AmsGet32(p + 12) > length - 16) {
+                    Reply(fd, header, ADSERR_DEVICE_INVALIDSIZE, std::vector<uint8_t>());
+                    break;
+                }
+                uint32_t nErr = ReadWriteData(port, AmsGet32(p), AmsGet32(p + 4), AmsGet32(p + 8),
+                                              p + 16, AmsGet32(p + 12), data);
+                if (nErr) {
+                    data.clear();
+                }
+                Reply(fd, header, 0, ResultWithData(nErr, data));
+                break;
+            }
+
+            case ADSCMD_READSTATE: {
+                std::vector<uint8_t> payload(8);
+                AmsPut32(payload.data(), 0);
+                AmsPut16(payload.data() + 4, m_adsState);
+                AmsPut16(payload.data() + 6, m_deviceState);
+                Reply(fd, header, 0, payload);
+                break;
+            }
+
+            case ADSCMD_WRITECONTROL: {
+                if (length < 8) {
+                    Reply(fd, header, ADSERR_DEVICE_INVALIDSIZE, std::vector<uint8_t>());
+                    break;
+                }
+                // TwinCAT acknowledges RESET/START by ending up in RUN
+                uint16_t state = AmsGet16(p);
+                m_adsState = (state == 2 || state == 4) ? 5 : state;
+                m_deviceState = AmsGet16(p + 2);
+                Reply(fd, header, 0, Result(0));
+                break;
+            }
+
+            case ADSCMD_ADDNOTIFICATION: {
+                if (length < 24) {
+                    Reply(fd, header, ADSERR_DEVICE_INVALIDSIZE, std::vector<uint8_t>());
+                    break;
+                }
+                Notification note;
+                note.fd = fd;
+                note.client = header.source;
+                note.server = header.target;
+                note.indexGroup = AmsGet32(p);
+                note.indexOffset = AmsGet32(p + 4);
+                note.length = AmsGet32(p + 8);
+                note.mode = AmsGet32(p + 12);
+                note.cycle = std::chrono::microseconds(AmsGet32(p + 20) / 10);
+                note.nextSample = Clock::now();
+                note.sentOnce = false;
+
+                uint32_t nErr = ReadData(port, note.indexGroup, note.indexOffset, note.length, data);
+                std::vector<uint8_t> payload(8);
+                AmsPut32(payload.data(), nErr);
+                if (!nErr) {
+                    uint32_t handle = m_nextNotification++;
+                    m_notifications[handle] = note;
+                    AmsPut32(payload.data() + 4, handle);
+                }
+                Reply(fd, header, 0, payload);
+                break;
+            }
+
+            case ADSCMD_DELNOTIFICATION: {
+                uint32_t nErr = (length >= 4 && m_notifications.erase(AmsGet32(p)))
+                              ? 0 : ADSERR_DEVICE_NOTIFYHNDINVALID;
+                Reply(fd, header, 0, Result(nErr));
+                break;
+            }
+
+            default:
+                Reply(fd, header, ADSERR_DEVICE_SRVNOTSUPP, std::vector<uint8_t>());
+                break;
+        }
+    }
+
+    // FILETIME: 100 ns ticks since 1601-01-01
+    static int64_t FileTimeNow() {
+        auto since1970 = std::chrono::system_clock::now().time_since_epoch();
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(since1970).count() / 100 +
+               116444736000000000LL;
+    }
+
+    void SendNotification(uint32_t handle, const Notification& note, const std::vector<uint8_t>& value) {
+        std::vector<uint8_t> payload(8 + 12 + 8 + value.size());
+        AmsPut32(payload.data(), static_cast<uint32_t>(payload.size() - 4));
+        AmsPut32(payload.data() + 4, 1);                                   // stamps
+        AmsPut64(payload.data() + 8, static_cast<uint64_t>(FileTimeNow()));
+        AmsPut32(payload.data() + 16, 1);                                  // samples
+        AmsPut32(payload.data() + 20, handle);
+        AmsPut32(payload.data() + 24, static_cast<uint32_t>(value.size()));
+        if (!value.empty()) {
+            memcpy(payload.data() + 28, value.data(), value.size());
+        }
+
+        AmsHeader header;
+        header.target = note.client;
+        header.source = note.server;
+        header.commandId = ADSCMD_NOTIFICATION;
+        header.stateFlags = AMS_STATEFLAG_REQUEST;
+        header.dataLength = static_cast<uint32_t>(payload.size());
+        header.errorCode = 0;
+        header.invokeId = 0;
+        Send(note.fd, header, payload, Clock::duration::zero());
+    }
+
+    void ServiceNotifications() {
+        Clock::time_point now = Clock::now();
+        std::vector<uint8_t> value;
+        for (auto& entry : m_notifications) {
+            Notification& note = entry.second;
+            if (now < note.nextSample) {
+                continue;
+            }
+            note.nextSample = now + note.cycle;
+
+            if (ReadData(note.server.port, note.indexGroup, note.indexOffset, note.length, value)) {
+                continue;
+            }
+            bool changed = !note.sentOnce || value != note.lastValue;
+            if (note.mode == ADSTRANS_SERVERCYCLE || changed) {
+                SendNotification(entry.first, note, value);
+                note.lastValue = value;
+                note.sentOnce = true;
+            }
+        }
+    }
+
+    void FlushDelayed() {
+        Clock::time_point now = Clock::now();
+        while (!m_delayed.empty() && m_delayed.front().due <= now) {
+            SendNow(m_delayed.front().fd, m_delayed.front().frame);
+            m_delayed.pop_front();
+        }
+    }
+
+    void DropClient(size_t index) {
+        int fd = m_clients[index].fd;
+        for (auto it = m_notifications.begin(); it != m_notifications.end();) {
+            it = (it->second.fd == fd) ? m_notifications.erase(it) : std::next(it);
+        }
+        m_delayed.erase(std::remove_if(m_delayed.begin(), m_delayed.end(),
+                                       [fd](const DelayedFrame& f) { return f.fd == fd; }),
+                        m_delayed.end());
+        close(fd);
+        m_clients.erase(m_clients.begin() + index);
+    }
+
+    void ReadClient(size_t index) {
+        Client& client = m_clients[index];
+        uint8_t buffer[64 * 1024];
+        ssize_t n = recv(client.fd, buffer, sizeof(buffer), 0);
+        if (n <= 0) {
+            if (n < 0 && (errno == EINTR || errno == EAGAIN)) {
+                return;
+            }
+            DropClient(index);
+            return;
+        }
+        client.rx.insert(client.rx.end(), buffer, buffer + n);
+
+        size_t offset = 0;
+        while (client.rx.size() - offset >= AMS_TCP_HEADER_SIZE) {
+            uint32_t amsLength = AmsGet32(client.rx.data() + offset + 2);
+            if (amsLength < AMS_HEADER_SIZE || amsLength > AMS_MAX_FRAME_SIZE) {
+                DropClient(index);
+                return;
+            }
+            if (client.rx.size() - offset < AMS_TCP_HEADER_SIZE + amsLength) {
+                break;
+            }
+            const uint8_t* pFrame = client.rx.data() + offset + AMS_TCP_HEADER_SIZE;
+            AmsHeader header;
+            AmsDecodeHeader(pFrame, header);
+            uint32_t payload = amsLength - static_cast<uint32_t>(AMS_HEADER_SIZE);
+            if (!(header.stateFlags & 0x0001)) {
+                std::lock_guard<std::mutex> lock(m_lock);
+                HandleRequest(client.fd, header, pFrame + AMS_HEADER_SIZE,
+                              std::min(header.dataLength, payload));
+            }
+            offset += AMS_TCP_HEADER_SIZE + amsLength;
+        }
+        client.rx.erase(client.rx.begin(), client.rx.begin() + offset);
+    }
+
+    void Run() {
+        while (m_bRunning.load()) {
+            std::vector<pollfd> fds;
+            fds.push_back(pollfd{ m_listenFd, POLLIN, 0 });
+            for (const Client& client : m_clients) {
+                fds.push_back(pollfd{ client.fd, POLLIN, 0 });
+            }
+
+            // 1 ms tick drives notifications and delayed replies
+            int timeoutMs = 1;
+            poll(fds.data(), fds.size(), timeoutMs);
+
+            if (fds[0].revents & POLLIN) {
+                int fd = accept(m_listenFd, nullptr, nullptr);
+                if (fd >= 0) {
+                    int one = 1;
+                    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+                    m_clients.push_back(Client{ fd, std::vector<uint8_t>() });
+                }
+            }
+            for (size_t i = fds.size() - 1; i >= 1; i--) {
+                if (fds[i].revents & (POLLIN | POLLHUP | POLLERR)) {
+                    ReadClient(i - 1);
+                }
+            }
+
+            std::lock_guard<std::mutex> lock(m_lock);
+            ServiceNotifications();
+            FlushDelayed();
+        }
+    }
+
+public:
+    AdsStandInServer()
+        : m_listenFd(-1), m_bRunning(false), m_nextHandle(0x10000001), m_symbolVersion(1),
+          m_adsState(5), m_deviceState(0), m_slaveCount(3),
+          m_memory(kMemoryAreaSize), m_inputs(kMemoryAreaSize), m_outputs(kMemoryAreaSize),
+          m_nextNotification(1), m_latency(Clock::duration::zero()), m_requests(0) {}
+
+    ~AdsStandInServer() {
+        Stop();
+    }
+
+    // Listens on 127.0.0.1 (or all interfaces). Port 0 picks a free port.
+    // Returns the bound port, or 0 on failure.
+    uint16_t Start(uint16_t port = AMS_TCP_PORT, bool loopbackOnly = true) {
+        m_listenFd = socket(AF_INET, SOCK_STREAM, 0);
+        if (m_listenFd < 0) {
+            return 0;
+        }
+        int one = 1;
+        setsockopt(m_listenFd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+
+        sockaddr_in addr = {};
+        addr.sin_family = AF_INET;
+        addr.sin_port = htons(port);
+        addr.sin_addr.s_addr = htonl(loopbackOnly ? INADDR_LOOPBACK : INADDR_ANY);
+        socklen_t len = sizeof(addr);
+        if (bind(m_listenFd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) < 0 ||
+            listen(m_listenFd, 16) < 0 ||
+            getsockname(m_listenFd, reinterpret_cast<sockaddr*>(&addr), &len) < 0) {
+            close(m_listenFd);
+            m_listenFd = -1;
+            return 0;
+        }
+
+        m_bRunning.store(true);
+        m_thread = std::thread(&AdsStandInServer::Run, this);
+        return ntohs(addr.sin_port);
+    }
+
+    void Stop() {
+        if (!m_bRunning.exchange(false)) {
+            return;
+        }
+        m_thread.join();
+        for (const Client& client : m_clients) {
+            close(client.fd);
+        }
+        m_clients.clear();
+        close(m_listenFd);
+        m_listenFd = -1;
+    }
+
+    void AddSymbol(const std::string& name, uint32_t size) {
+        std::lock_guard<std::mutex> lock(m_lock);
+        m_symbolIndex[Upper(name)] = m_symbols.size();
+        m_symbols.push_back(Symbol{ name, std::vector<uint8_t>(size, 0) });
+    }
+
+    bool SetSymbolValue(const std::string& name, const void* pData, uint32_t size) {
+        std::lock_guard<std::mutex> lock(m_lock);
+        int index = FindSymbol(name);
+        if (index < 0 || size > m_symbols[index].value.size()) {
+            return false;
+        }
+        memcpy(m_symbols[index].value.data(), pData, size);
+        return true;
+    }
+
+    bool GetSymbolValue(const std::string& name, void* pData, uint32_t size) {
+        std::lock_guard<std::mutex> lock(m_lock);
+        int index = FindSymbol(name);
+        if (index < 0 || size > m_symbols[index].value.size()) {
+            return false;
+        }
+        memcpy(pData, m_symbols[index].value.data(), size);
+        return true;
+    }
+
+    // Simulates an online change: all handles become invalid
+    void BumpSymbolVersion() {
+        std::lock_guard<std::mutex> lock(m_lock);
+        m_symbolVersion++;
+        m_handles.clear();
+    }
+
+    void SetAdsState(uint16_t state) {
+        std::lock_guard<std::mutex> lock(m_lock);
+        m_adsState = state;
+    }
+
+    void SetSlaveCount(uint16_t count) {
+        std::lock_guard<std::mutex> lock(m_lock);
+        m_slaveCount = count;
+    }
+
+    void SetLatency(std::chrono::microseconds latency) {
+        std::lock_guard<std::mutex> lock(m_lock);
+        m_latency = latency;
+    }
+
+    unsigned long GetRequestCount() const {
+        return m_requests.load(std::memory_order_relaxed);
+    }
+
+    size_t GetHandleCount() {
+        std::lock_guard<std::mutex> lock(m_lock);
+        return m_handles.size();
+    }
+};
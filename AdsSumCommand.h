@@ -0,0 +1,320 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstring>
+#include <mutex>
+#include <vector>
+#include "AdsApi.h"
+
+#ifndef ADSIGRP_SUMUP_READ
+#define ADSIGRP_SUMUP_READ      0xF080
+#endif
+#ifndef ADSIGRP_SUMUP_WRITE
+#define ADSIGRP_SUMUP_WRITE     0xF081
+#endif
+#ifndef ADSIGRP_SUMUP_READWRITE
+#define ADSIGRP_SUMUP_READWRITE 0xF082
+#endif
+
+// One sub-command of an ADS sum request. Fill in the index group/offset and
+// the buffers; Read() / Write() / ReadWrite() fill in result (ADS error code
+// of this item) and, for read-write, the number of bytes actually returned.
+struct AdsSumItem {
+    unsigned long indexGroup;
+    unsigned long indexOffset;
+    unsigned long readLength;
+    void* pReadData;
+    unsigned long writeLength;
+    const void* pWriteData;
+    unsigned long bytesRead;
+    long result;
+};
+
+// Packs many ADS reads/writes into ADS sum commands (0xF080/0xF081/0xF082)
+// so a whole tag list costs one round trip per request frame instead of one
+// per tag. Lists are split automatically at the sub-command and frame-size
+// limits; with the native transport the resulting frames are pipelined.
+// Buffers are reused between calls, so a cyclic scan does not allocate once
+// it has run at full size.
+class AdsSumCommand {
+public:
+    // The ADS router rejects sum requests with more than 500 sub-commands,
+    // and request/response frames must fit the AMS frame limit.
+    static const size_t kDefaultMaxItems = 500;
+    static const size_t kDefaultMaxFrameBytes = 0xFFFF - 64;
+
+private:
+    enum Kind { SUM_READ, SUM_WRITE, SUM_READWRITE };
+
+    size_t m_maxItems;
+    size_t m_maxFrameBytes;
+    unsigned long m_roundTrips;
+    std::vector<unsigned char> m_request;
+    std::vector<unsigned char> m_response;
+
+    static void Put32(unsigned char* p, unsigned long value) {
+        unsigned int v = static_cast<unsigned int>(value);
+        memcpy(p, &v, 4);
+    }
+
+    static unsigned long Get32(const unsigned char* p) {
+        unsigned int v;
+        memcpy(&v, p, 4);
+        return v;
+    }
+
+    static size_t HeaderSize(Kind kind) {
+        return kind == SUM_READWRITE ? 16 : 12;
+    }
+
+    static size_t ResultSize(Kind kind) {
+        return kind == SUM_READWRITE ? 8 : 4;
+    }
+
+    static size_t RequestBytes(Kind kind, const AdsSumItem& item) {
+        return HeaderSize(kind) + (kind == SUM_READ ? 0 : item.writeLength);
+    }
+
+    static size_t ResponseBytes(Kind kind, const AdsSumItem& item) {
+        return ResultSize(kind) + (kind == SUM_WRITE ? 0 : item.readLength);
+    }
+
+    // Items too large to share a frame go out as plain requests
+    void SendSingle(Kind kind, long nPort, AmsAddr* pAddr, AdsSumItem& item) {
+        m_roundTrips++;
+        item.bytesRead = 0;
+        switch (kind) {
+            case SUM_READ:
+                item.result = AdsSyncReadReqEx2(nPort, pAddr, item.indexGroup, item.indexOffset,
+                                                item.readLength, item.pReadData, &item.bytesRead);
+                break;
+            case SUM_WRITE:
+                item.result = AdsSyncWriteReqEx(nPort, pAddr, item.indexGroup, item.indexOffset,
+                                                item.writeLength, const_cast<void*>(item.pWriteData));
+                break;
+            case SUM_READWRITE:
+                item.result = AdsSyncReadWriteReqEx2(nPort, pAddr, item.indexGroup, item.indexOffset,
+                                                     item.readLength, item.pReadData,
+                                                     item.writeLength, const_cast<void*>(item.pWriteData),
+                                                     &item.bytesRead);
+                break;
+        }
+    }
+
+    // One sum request: a run of items sharing a frame, with its slices of
+    // the shared request/response buffers
+    struct Chunk {
+        size_t first;
+        size_t count;
+        size_t requestOffset;
+        size_t requestBytes;
+        size_t responseOffset;
+        size_t responseBytes;
+        unsigned long bytesRead;
+        long nErr;
+    };
+    std::vector<Chunk> m_chunks;
+
+    static unsigned long SumGroup(Kind kind) {
+        static const unsigned long groups[] = {
+            ADSIGRP_SUMUP_READ, ADSIGRP_SUMUP_WRITE, ADSIGRP_SUMUP_READWRITE
+        };
+        return groups[kind];
+    }
+
+    void Encode(Kind kind, const AdsSumItem* pItems, const Chunk& chunk) {
+        // Sub-command headers first, then all write data in item order
+        unsigned char* pHeader = m_request.data() + chunk.requestOffset;
+        unsigned char* pWrite = pHeader + chunk.count * HeaderSize(kind);
+        for (size_t i = 0; i < chunk.count; i++) {
+            const AdsSumItem& item = pItems[chunk.first + i];
+            Put32(pHeader + 0, item.indexGroup);
+            Put32(pHeader + 4, item.indexOffset);
+            if (kind == SUM_READ) {
+                Put32(pHeader + 8, item.readLength);
+            } else if (kind == SUM_WRITE) {
+                Put32(pHeader + 8, item.writeLength);
+            } else {
+                Put32(pHeader + 8, item.readLength);
+                Put32(pHeader + 12, item.writeLength);
+            }
+            pHeader += HeaderSize(kind);
+
+            if (kind != SUM_READ && item.writeLength) {
+                memcpy(pWrite, item.pWriteData, item.writeLength);
+                pWrite += item.writeLength;
+            }
+        }
+    }
+
+    void Decode(Kind kind, AdsSumItem* pItems, const Chunk& chunk) {
+        if (chunk.nErr) {
+            for (size_t i = 0; i < chunk.count; i++) {
+                pItems[chunk.first + i].result = chunk.nErr;
+                pItems[chunk.first + i].bytesRead = 0;
+            }
+            return;
+        }
+
+        // Results come first: error code (plus returned length for
+        // read-write) per item, followed by the read data in item order
+        const unsigned char* pResult = m_response.data() + chunk.responseOffset;
+        const unsigned char* pData = pResult + chunk.count * ResultSize(kind);
+        const unsigned char* pEnd = pResult + chunk.bytesRead;
+        for (size_t i = 0; i < chunk.count; i++) {
+            AdsSumItem& item = pItems[chunk.first + i];
+            if (pResult + ResultSize(kind) > pEnd) {
+                item.result = ADSERR_DEVICE_INVALIDSIZE;
+                item.bytesRead = 0;
+                continue;
+            }
+            item.result = static_cast<long>(Get32(pResult));
+            item.bytesRead = 0;
+
+            unsigned long length = 0;
+            if (kind == SUM_READ) {
+                // Sum read keeps every slot at its requested length
+                length = item.readLength;
+            } else if (kind == SUM_READWRITE) {
+                length = Get32(pResult + 4);
+            }
+            pResult += ResultSize(kind);
+
+            if (length > static_cast<unsigned long>(pEnd - pData)) {
+                item.result = item.result ? item.result : ADSERR_DEVICE_INVALIDSIZE;
+                length = static_cast<unsigned long>(pEnd - pData);
+            }
+            if (!item.result && kind != SUM_WRITE) {
+                unsigned long copy = length < item.readLength ? length : item.readLength;
+                memcpy(item.pReadData, pData, copy);
+                item.bytesRead = copy;
+            }
+            pData += length;
+        }
+    }
+
+    void Transfer(Kind kind, long nPort, AmsAddr* pAddr) {
+        m_roundTrips += static_cast<unsigned long>(m_chunks.size());
+
+#if defined(ADS_NATIVE_TRANSPORT)
+        // All frames go out back to back and are matched by invoke ID, so a
+        // large tag list costs about one round trip instead of one per frame
+        std::mutex lock;
+        std::condition_variable done;
+        size_t outstanding = m_chunks.size();
+        for (Chunk& chunk : m_chunks) {
+            Chunk* pChunk = &chunk;
+            long nErr = AdsAsyncReadWriteReqEx(nPort, pAddr, SumGroup(kind),
+                static_cast<unsigned long>(chunk.count),
+                static_cast<unsigned long>(chunk.responseBytes), m_response.data() + chunk.responseOffset,
+                static_cast<unsigned long>(chunk.requestBytes), m_request.data() + chunk.requestOffset,
+                [&, pChunk](long nErr, unsigned long bytesRead) {
+                    std::lock_guard<std::mutex> guard(lock);
+                    pChunk->nErr = nErr;
+                    pChunk->bytesRead = bytesRead;
+                    if (--outstanding == 0) {
+                        done.notify_one();
+                    }
+                });
+            if (nErr) {
+                std::lock_guard<std::mutex> guard(lock);
+                chunk.nErr = nErr;
+                outstanding--;
+            }
+        }
+        std::unique_lock<std::mutex> guard(lock);
+        done.wait(guard, [&] { return outstanding == 0; });
+#else
+        for (Chunk& chunk : m_chunks) {
+            chunk.nErr = AdsSyncReadWriteReqEx2(nPort, pAddr, SumGroup(kind),
+                static_cast<unsigned long>(chunk.count),
+                static_cast<unsigned long>(chunk.responseBytes), m_response.data() + chunk.responseOffset,
+                static_cast<unsigned long>(chunk.requestBytes), m_request.data() + chunk.requestOffset,
+                &chunk.bytesRead);
+        }
+#endif
+    }
+
+    long Execute(Kind kind, long nPort, AmsAddr* pAddr, AdsSumItem* pItems, size_t count) {
+        long nFirstErr = 0;
+        size_t requestTotal = 0;
+        size_t responseTotal = 0;
+        size_t start = 0;
+
+        m_chunks.clear();
+        while (start < count) {
+            Chunk chunk = { start, 0, requestTotal, 0, responseTotal, 0, 0, 0 };
+
+            while (start + chunk.count < count && chunk.count < m_maxItems) {
+                const AdsSumItem& item = pItems[start + chunk.count];
+                size_t req = RequestBytes(kind, item);
+                size_t resp = ResponseBytes(kind, item);
+                if (chunk.requestBytes + req > m_maxFrameBytes ||
+                    chunk.responseBytes + resp > m_maxFrameBytes) {
+                    break;
+                }
+                chunk.requestBytes += req;
+                chunk.responseBytes += resp;
+                chunk.count++;
+            }
+
+            if (chunk.count == 0) {
+                SendSingle(kind, nPort, pAddr, pItems[start]);
+                start++;
+                continue;
+            }
+
+            requestTotal += chunk.requestBytes;
+            responseTotal += chunk.responseBytes;
+            start += chunk.count;
+            m_chunks.push_back(chunk);
+        }
+
+        if (m_chunks.empty()) {
+            return 0;
+        }
+
+        if (m_request.size() < requestTotal) {
+            m_request.resize(requestTotal);
+        }
+        if (m_response.size() < responseTotal) {
+            m_response.resize(responseTotal);
+        }
+        for (const Chunk& chunk : m_chunks) {
+            Encode(kind, pItems, chunk);
+        }
+
+        Transfer(kind, nPort, pAddr);
+
+        for (const Chunk& chunk : m_chunks) {
+            Decode(kind, pItems, chunk);
+            if (chunk.nErr && !nFirstErr) {
+                nFirstErr = chunk.nErr;
+            }
+        }
+        return nFirstErr;
+    }
+
+public:
+    AdsSumCommand(size_t maxItems = kDefaultMaxItems, size_t maxFrameBytes = kDefaultMaxFrameBytes)
+        : m_maxItems(maxItems), m_maxFrameBytes(maxFrameBytes), m_roundTrips(0) {}
+
+    // Each call returns the first transport-level error (0 if every frame
+    // was answered); per-item ADS errors are in AdsSumItem::result.
+    long Read(long nPort, AmsAddr* pAddr, AdsSumItem* pItems, size_t count) {
+        return Execute(SUM_READ, nPort, pAddr, pItems, count);
+    }
+
+    long Write(long nPort, AmsAddr* pAddr, AdsSumItem* pItems, size_t count) {
+        return Execute(SUM_WRITE, nPort, pAddr, pItems, count);
+    }
+
+    long ReadWrite(long nPort, AmsAddr* pAddr, AdsSumItem* pItems, size_t count) {
+        return Execute(SUM_READWRITE, nPort, pAddr, pItems, count);
+    }
+
+    // Total ADS requests issued, for checking how well a tag list packs
+    unsigned long GetRoundTrips() const {
+        return m_roundTrips;
+    }
+};
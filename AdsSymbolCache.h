@@ -0,0 +1,342 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "AdsApi.h"
+#include "AdsSumCommand.h"
+#include "Logger.h"
+
+// Caches ADS symbol handles so a PLC variable name is resolved once
+// (ADSIGRP_SYM_HNDBYNAME) and every later access is a single
+// ADSIGRP_SYM_VALBYHND request. Handles are dropped when the PLC symbol
+// version changes (online change / download) and re-resolved on demand.
+class AdsSymbolCache {
+public:
+    struct Symbol {
+        std::string name;
+        uint32_t handle;
+        bool valid;
+    };
+
+    // One entry of a batched read or write
+    struct Access {
+        Symbol* pSymbol;
+        void* pData;
+        unsigned long nDataSize;
+        long result;
+    };
+
+private:
+    long m_nPort;
+    AmsAddr m_Addr;
+    unsigned char m_symbolVersion;
+    bool m_bVersionKnown;
+
+    // Node-based map: Symbol pointers handed out stay valid until ReleaseAll()
+    std::unordered_map<std::string, Symbol> m_symbols;
+
+    AdsSumCommand m_sum;
+    std::vector<AdsSumItem> m_items;
+    std::vector<Symbol*> m_pending;
+
+    long ResolveHandle(Symbol& symbol) {
+        uint32_t handle = 0;
+        unsigned long bytesRead = 0;
+        long nErr = AdsSyncReadWriteReqEx2(m_nPort, &m_Addr, ADSIGRP_SYM_HNDBYNAME, 0,
+                                           sizeof(handle), &handle,
+                                           static_cast<unsigned long>(symbol.name.size()),
+                                           const_cast<char*>(symbol.name.c_str()),
+                                           &bytesRead);
+        if (nErr) {
+            symbol.valid = false;
+            return nErr;
+        }
+
+        symbol.handle = handle;
+        symbol.valid = true;
+        return 0;
+    }
+
+    // Resolves all symbols in m_pending with one sum read-write per frame
+    long ResolvePending() {
+        if (m_pending.empty()) {
+            return 0;
+        }
+
+        m_items.resize(m_pending.size());
+        for (size_t i = 0; i < m_pending.size(); i++) {
+            Symbol* pSymbol = m_pending[i];
+            m_items[i] = AdsSumItem{ ADSIGRP_SYM_HNDBYNAME, 0,
+                                     sizeof(pSymbol->handle), &pSymbol->handle,
+                                     static_cast<unsigned long>(pSymbol->name.size()),
+                                     pSymbol->name.c_str(), 0, 0 };
+        }
+
+        long nErr = m_sum.ReadWrite(m_nPort, &m_Addr, m_items.data(), m_items.size());
+        for (size_t i = 0; i < m_pending.size(); i++) {
+            m_pending[i]->valid = (m_items[i].result == 0);
+        }
+        m_pending.clear();
+        return nErr;
+    }
+
+    long ExecuteBatch(Access* pAccess, size_t count, bool write) {
+        for (size_t i = 0; i < count; i++) {
+            if (!pAccess[i].pSymbol->valid) {
+                m_pending.push_back(pAccess[i].pSymbol);
+            }
+        }
+        long nErr = ResolvePending();
+        if (nErr) {
+            return nErr;
+        }
+
+        // Two passes at most: the second retries items whose handles went
+        // stale because of an online change since they were resolved
+        for (int pass = 0; pass < 2; pass++) {
+            m_items.clear();
+            for (size_t i = 0; i < count; i++) {
+                Access& access = pAccess[i];
+                if (pass > 0 && !IsStaleHandleError(access.result)) {
+                    continue;
+                }
+                if (!access.pSymbol->valid) {
+                    access.result = ADSERR_DEVICE_SYMBOLNOTFOUND;
+                    continue;
+                }
+                m_items.push_back(AdsSumItem{ ADSIGRP_SYM_VALBYHND, access.pSymbol->handle,
+                                              write ? 0 : access.nDataSize, write ? nullptr : access.pData,
+                                              write ? access.nDataSize : 0, write ? access.pData : nullptr,
+                                              0, 0 });
+            }
+            if (m_items.empty()) {
+                break;
+            }
+
+            nErr = write ? m_sum.Write(m_nPort, &m_Addr, m_items.data(), m_items.size())
+                         : m_sum.Read(m_nPort, &m_Addr, m_items.data(), m_items.size());
+
+            bool stale = false;
+            size_t item = 0;
+            for (size_t i = 0; i < count; i++) {
+                Access& access = pAccess[i];
+                if (pass > 0 && !IsStaleHandleError(access.result)) {
+                    continue;
+                }
+                if (!access.pSymbol->valid) {
+                    continue;
+                }
+                access.result = m_items[item++].result;
+                stale = stale || IsStaleHandleError(access.result);
+            }
+            if (nErr || !stale || pass > 0) {
+                break;
+            }
+
+            CheckSymbolVersion();
+            for (size_t i = 0; i < count; i++) {
+                Symbol* pSymbol = pAccess[i].pSymbol;
+                if (IsStaleHandleError(pAccess[i].result)) {
+                    pSymbol->valid = false;
+                }
+                if (!pSymbol->valid) {
+                    m_pending.push_back(pSymbol);
+                }
+            }
+            nErr = ResolvePending();
+            if (nErr) {
+                break;
+            }
+        }
+        return nErr;
+    }
+
+    static bool IsStaleHandleError(long nErr) {
+        return nErr == ADSERR_DEVICE_SYMBOLNOTFOUND ||
+               nErr == ADSERR_DEVICE_SYMBOLVERSIONINVALID ||
+               nErr == ADSERR_DEVICE_NOTFOUND ||
+               nErr == ADSERR_DEVICE_INVALIDOFFSET;
+    }
+
+    // A handle access failed in a way an online change would cause.
+    // Returns true when the handles were refreshed and a retry makes sense.
+    bool RecoverFromStaleHandle(Symbol& symbol) {
+        if (!CheckSymbolVersion()) {
+            // Version unchanged: only this handle is bad (symbol removed or
+            // re-created), so resolve it alone.
+            symbol.valid = false;
+        }
+        return ResolveHandle(symbol) == 0;
+    }
+
+public:
+    AdsSymbolCache() : m_nPort(0), m_symbolVersion(0), m_bVersionKnown(false) {
+        m_Addr = AmsAddr();
+    }
+
+    void Attach(long nPort, const AmsAddr& addr) {
+        m_nPort = nPort;
+        m_Addr = addr;
+        m_bVersionKnown = false;
+        CheckSymbolVersion();
+    }
+
+    // Reads the one-byte PLC symbol version. If it moved since the last
+    // check, every cached handle is stale and is marked for re-resolution.
+    // Returns true if the handles were invalidated.
+    bool CheckSymbolVersion() {
+        unsigned char version = 0;
+        unsigned long bytesRead = 0;
+        long nErr = AdsSyncReadReqEx2(m_nPort, &m_Addr, ADSIGRP_SYM_VERSION, 0,
+                                      sizeof(version), &version, &bytesRead);
+        if (nErr) {
+            return false;
+        }
+
+        if (m_bVersionKnown && version == m_symbolVersion) {
+            return false;
+        }
+
+        bool changed = m_bVersionKnown;
+        m_symbolVersion = version;
+        m_bVersionKnown = true;
+
+        if (changed) {
+            LogInfo() << "PLC symbol version changed to " << (int)version
+                      << ", invalidating " << m_symbols.size() << " symbol handles";
+            Invalidate();
+        }
+        return changed;
+    }
+
+    // Marks all handles stale without releasing them; after an online change
+    // the PLC has already discarded them.
+    void Invalidate() {
+        for (auto& entry : m_symbols) {
+            entry.second.valid = false;
+        }
+    }
+
+    // Looks the name up in the cache, resolving it through the PLC the first
+    // time. Keep the returned pointer for cyclic access to skip the lookup.
+    Symbol* Resolve(const std::string& name, long* pErr = nullptr) {
+        auto it = m_symbols.find(name);
+        bool inserted = false;
+        if (it == m_symbols.end()) {
+            it = m_symbols.emplace(name, Symbol{ name, 0, false }).first;
+            inserted = true;
+        }
+
+        Symbol& symbol = it->second;
+        long nErr = symbol.valid ? 0 : ResolveHandle(symbol);
+        if (pErr) {
+            *pErr = nErr;
+        }
+        if (nErr) {
+            // Unknown names are not cached; entries already handed out stay
+            // so their pointers remain usable once the symbol reappears.
+            if (inserted) {
+                m_symbols.erase(it);
+            }
+            return nullptr;
+        }
+        return &symbol;
+    }
+
+    long Read(Symbol* pSymbol, void* pData, unsigned long nDataSize, unsigned long* pBytesRead) {
+        if (!pSymbol->valid) {
+            long nErr = ResolveHandle(*pSymbol);
+            if (nErr) {
+                return nErr;
+            }
+        }
+
+        long nErr = AdsSyncReadReqEx2(m_nPort, &m_Addr, ADSIGRP_SYM_VALBYHND,
+                                      pSymbol->handle, nDataSize, pData, pBytesRead);
+        if (IsStaleHandleError(nErr) && RecoverFromStaleHandle(*pSymbol)) {
+            nErr = AdsSyncReadReqEx2(m_nPort, &m_Addr, ADSIGRP_SYM_VALBYHND,
+                                     pSymbol->handle, nDataSize, pData, pBytesRead);
+        }
+        return nErr;
+    }
+
+    long Write(Symbol* pSymbol, void* pData, unsigned long nDataSize) {
+        if (!pSymbol->valid) {
+            long nErr = ResolveHandle(*pSymbol);
+            if (nErr) {
+                return nErr;
+            }
+        }
+
+        long nErr = AdsSyncWriteReqEx(m_nPort, &m_Addr, ADSIGRP_SYM_VALBYHND,
+                                      pSymbol->handle, nDataSize, pData);
+        if (IsStaleHandleError(nErr) && RecoverFromStaleHandle(*pSymbol)) {
+            nErr = AdsSyncWriteReqEx(m_nPort, &m_Addr, ADSIGRP_SYM_VALBYHND,
+                                     pSymbol->handle, nDataSize, pData);
+        }
+        return nErr;
+    }
+
+    // Resolves a whole tag list up front; unresolvable names give nullptr.
+    // Unlike Resolve(), this costs one round trip per request frame rather
+    // than one per name.
+    long ResolveAll(const std::vector<std::string>& names, std::vector<Symbol*>& symbols) {
+        symbols.resize(names.size());
+        for (size_t i = 0; i < names.size(); i++) {
+            auto it = m_symbols.find(names[i]);
+            if (it == m_symbols.end()) {
+                it = m_symbols.emplace(names[i], Symbol{ names[i], 0, false }).first;
+            }
+            symbols[i] = &it->second;
+            if (!symbols[i]->valid) {
+                m_pending.push_back(symbols[i]);
+            }
+        }
+
+        long nErr = ResolvePending();
+        for (size_t i = 0; i < names.size(); i++) {
+            if (!symbols[i]->valid) {
+                symbols[i] = nullptr;
+            }
+        }
+        return nErr;
+    }
+
+    // Batched access through ADS sum commands. Returns the first
+    // transport-level error; per-tag ADS errors are in Access::result.
+    long ReadBatch(Access* pAccess, size_t count) {
+        return ExecuteBatch(pAccess, count, false);
+    }
+
+    long WriteBatch(Access* pAccess, size_t count) {
+        return ExecuteBatch(pAccess, count, true);
+    }
+
+    // Releases every handle on the PLC and empties the cache. Must run while
+    // the ADS port is still open.
+    void ReleaseAll() {
+        m_items.clear();
+        for (auto& entry : m_symbols) {
+            Symbol& symbol = entry.second;
+            if (symbol.valid) {
+                m_items.push_back(AdsSumItem{ ADSIGRP_SYM_RELEASEHND, 0, 0, nullptr,
+                                              sizeof(symbol.handle), &symbol.handle, 0, 0 });
+            }
+        }
+        if (!m_items.empty()) {
+            m_sum.Write(m_nPort, &m_Addr, m_items.data(), m_items.size());
+        }
+        m_items.clear();
+        m_symbols.clear();
+    }
+
+    unsigned long GetRoundTrips() const {
+        return m_sum.GetRoundTrips();
+    }
+
+    size_t Size() const {
+        return m_symbols.size();
+    }
+};
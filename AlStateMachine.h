@@ -0,0 +1,258 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <thread>
+#include <vector>
+#include "CycleTrace.h"
+#include "EscRegisters.h"
+#include "EtherCATDatagramPacker.h"
+#include "FrameTransport.h"
+#include "Logger.h"
+
+// Application-layer state bring-up of the whole segment at once. Each
+// step broadcasts the requested state (BWR 0x0120) and then polls AL
+// status and status code (0x0130-0x0135) of every slave still pending,
+// all in one frame, until each slave has confirmed, reported an error or
+// run out of its own timeout. Nothing waits a fixed time: a step ends
+// with the last slave's confirmation.
+//
+//   AlStateMachine states;
+//   states.SetSlaveTimeout(2, 5000);
+//   states.BringUp(transport, packer, slaveCount, ECAT_STATE_OP, beforeStep);
+class AlStateMachine {
+public:
+    struct Settings {
+        long pollIntervalUs;         // gap between two status polls
+        long frameTimeoutUs;         // per request or poll frame
+        uint32_t preopTimeoutMs;     // default per-slave timeouts by target state
+        uint32_t safeopTimeoutMs;
+        uint32_t opTimeoutMs;
+        uint32_t initTimeoutMs;
+
+        Settings()
+            : pollIntervalUs(200), frameTimeoutUs(100000), preopTimeoutMs(3000),
+              safeopTimeoutMs(10000), opTimeoutMs(10000), initTimeoutMs(5000) {}
+    };
+
+    // Last known state of one slave
+    struct SlaveState {
+        uint8_t status;              // AL status, ECAT_AL_ERROR included
+        uint16_t code;               // AL status code, captured with the error
+        bool bResponding;
+        bool bConfirmed;             // reached the target of the last step
+        bool bFailed;                // error or timeout in the last step
+        int64_t confirmNs;           // time from the request to the confirmation
+    };
+
+private:
+    Settings m_settings;
+    std::vector<uint32_t> m_slaveTimeoutsMs;   // 0 = default for the target
+    std::vector<SlaveState> m_slaves;
+    std::vector<uint16_t> m_pending;           // positions polled in this step
+    unsigned long m_polls;
+
+    static uint32_t AutoIncrement(uint16_t position, uint16_t offset) {
+        return EcatPhysicalAddress(static_cast<uint16_t>(-static_cast<int>(position)), offset);
+    }
+
+    uint32_t DefaultTimeoutMs(uint8_t target) const {
+        switch (target) {
+        case ECAT_STATE_PREOP: return m_settings.preopTimeoutMs;
+        case ECAT_STATE_SAFEOP: return m_settings.safeopTimeoutMs;
+        case ECAT_STATE_OP: return m_settings.opTimeoutMs;
+        default: return m_settings.initTimeoutMs;
+        }
+    }
+
+    uint32_t TimeoutMs(uint16_t position, uint8_t target) const {
+        uint32_t timeoutMs = position < m_slaveTimeoutsMs.size() ? m_slaveTimeoutsMs[position] : 0;
+        return timeoutMs ? timeoutMs : DefaultTimeoutMs(target);
+    }
+
+    // AL status, reserved word and status code of the given slaves
+    bool Poll(FrameTransport& transport, EtherCATDatagramPacker& packer, const std::vector<uint16_t>& positions) {
+        packer.Clear();
+        for (uint16_t position : positions) {
+            packer.Add(ECAT_APRD, AutoIncrement(position, ESC_REG_AL_STATUS), 6);
+        }
+        m_polls++;
+        if (!packer.Send(transport)) {
+            return false;
+        }
+        bool bComplete = packer.Receive(transport, m_settings.frameTimeoutUs);
+        for (size_t i = 0; i < positions.size(); i++) {
+            SlaveState& slave = m_slaves[positions[i]];
+            slave.bResponding = packer.IsReceived(i) && packer.GetWkc(i) == 1;
+            if (slave.bResponding) {
+                const uint8_t* pData = packer.GetData(i);
+                slave.status = static_cast<uint8_t>(EcatGet16(pData) & 0x1F);
+                slave.code = EcatGet16(pData + 4);
+            }
+        }
+        return bComplete;
+    }
+
+    void Reset(uint16_t slaveCount) {
+        m_slaves.assign(slaveCount, SlaveState{ 0, 0, false, false, false, 0 });
+    }
+
+    // Broadcasts the request; slaves that still show an error get the
+    // same request with the acknowledge bit in the same frame
+    bool Request(FrameTransport& transport, EtherCATDatagramPacker& packer, uint8_t target) {
+        uint16_t control = target;
+        uint16_t acknowledge = static_cast<uint16_t>(target | ECAT_AL_ERROR);
+        packer.Clear();
+        size_t broadcast = packer.Add(ECAT_BWR, EcatPhysicalAddress(0, ESC_REG_AL_CONTROL), 2, &control);
+        for (uint16_t position = 0; position < m_slaves.size(); position++) {
+            if (m_slaves[position].status & ECAT_AL_ERROR) {
+                packer.Add(ECAT_APWR, AutoIncrement(position, ESC_REG_AL_CONTROL), 2, &acknowledge);
+            }
+        }
+        if (!packer.Send(transport) || !packer.Receive(transport, m_settings.frameTimeoutUs)) {
+            LogError() << "Error: AL control frame for " << EcatStateName(target) << " lost";
+            return false;
+        }
+        if (packer.GetWkc(broadcast) != m_slaves.size()) {
+            LogWarning() << "Warning: " << packer.GetWkc(broadcast) << " of " << m_slaves.size()
+                         << " slaves took the " << EcatStateName(target) << " request";
+        }
+        return true;
+    }
+
+public:
+    AlStateMachine() : m_polls(0) {}
+
+    void SetSettings(const Settings& settings) {
+        m_settings = settings;
+    }
+
+    // Overrides the default timeout of one slave for every step
+    void SetSlaveTimeout(uint16_t position, uint32_t timeoutMs) {
+        if (position >= m_slaveTimeoutsMs.size()) {
+            m_slaveTimeoutsMs.resize(position + 1, 0);
+        }
+        m_slaveTimeoutsMs[position] = timeoutMs;
+    }
+
+    const SlaveState& GetSlave(uint16_t position) const {
+        return m_slaves[position];
+    }
+
+    // Moves every slave to target and waits until all have confirmed.
+    // False if any slave reported an error or timed out; the others are
+    // in target regardless.
+    bool RequestState(FrameTransport& transport, EtherCATDatagramPacker& packer, uint16_t slaveCount,
+                      uint8_t target) {
+        if (m_slaves.size() != slaveCount) {
+            Reset(slaveCount);
+        }
+        int64_t startNs = CycleTrace::NowNs();
+        m_polls = 0;
+        if (!Request(transport, packer, target)) {
+            return false;
+        }
+
+        m_pending.clear();
+        for (uint16_t position = 0; position < slaveCount; position++) {
+            SlaveState& slave = m_slaves[position];
+            slave.bConfirmed = false;
+            slave.bFailed = false;
+            slave.confirmNs = 0;
+            m_pending.push_back(position);
+        }
+
+        std::vector<uint16_t> polled;
+        while (!m_pending.empty()) {
+            polled.swap(m_pending);
+            Poll(transport, packer, polled);
+            int64_t nowNs = CycleTrace::NowNs();
+            m_pending.clear();
+            for (uint16_t position : polled) {
+                SlaveState& slave = m_slaves[position];
+                if (slave.bResponding && slave.status == target) {
+                    slave.bConfirmed = true;
+                    slave.confirmNs = nowNs - startNs;
+                } else if (slave.bResponding && (slave.status & ECAT_AL_ERROR)) {
+                    slave.bFailed = true;
+                } else if (nowNs - startNs >= static_cast<int64_t>(TimeoutMs(position, target)) * 1000000) {
+                    slave.bFailed = true;
+                } else {
+                    m_pending.push_back(position);
+                }
+            }
+            if (!m_pending.empty()) {
+                std::this_thread::sleep_for(std::chrono::microseconds(m_settings.pollIntervalUs));
+            }
+        }
+
+        int64_t elapsedNs = CycleTrace::NowNs() - startNs;
+        unsigned confirmed = 0;
+        for (uint16_t position = 0; position < slaveCount; position++) {
+            const SlaveState& slave = m_slaves[position];
+            if (slave.bConfirmed) {
+                confirmed++;
+            } else if (!slave.bResponding) {
+                LogError() << "Error: Slave " << position << " did not answer within "
+                           << TimeoutMs(position, target) << " ms on the way to " << EcatStateName(target);
+            } else if (slave.status & ECAT_AL_ERROR) {
+                LogError() << "Error: Slave " << position << " refused " << EcatStateName(target) << ", stays in "
+                           << EcatStateName(slave.status) << ": AL status code 0x" << std::hex << slave.code
+                           << std::dec << " (" << EcatAlCodeName(slave.code) << ")";
+            } else {
+                LogError() << "Error: Slave " << position << " still in " << EcatStateName(slave.status)
+                           << " after " << TimeoutMs(position, target) << " ms on the way to "
+                           << EcatStateName(target);
+            }
+        }
+        LogInfo() << EcatStateName(target) << ": " << confirmed << "/" << slaveCount << " slaves in "
+                  << elapsedNs / 1000 / 1000.0 << " ms (" << m_polls << " status poll"
+                  << (m_polls == 1 ? "" : "s") << ")";
+        return confirmed == slaveCount;
+    }
+
+    // INIT -> PREOP -> SAFEOP -> OP, stopping at target. beforeStep(state)
+    // runs before each state is requested, in the state before it, for
+    // whatever the slaves check on the way there; returning false aborts.
+    bool BringUp(FrameTransport& transport, EtherCATDatagramPacker& packer, uint16_t slaveCount, uint8_t target,
+                 const std::function<bool(uint8_t)>& beforeStep = std::function<bool(uint8_t)>()) {
+        static const uint8_t kSteps[] = { ECAT_STATE_INIT, ECAT_STATE_PREOP, ECAT_STATE_SAFEOP, ECAT_STATE_OP };
+
+        LogInfo() << "\n=== State Bring-up (" << slaveCount << " slaves, INIT -> " << EcatStateName(target)
+                  << ") ===";
+        int64_t startNs = CycleTrace::NowNs();
+
+        // Errors left from before must be acknowledged with the first request
+        Reset(slaveCount);
+        m_pending.clear();
+        for (uint16_t position = 0; position < slaveCount; position++) {
+            m_pending.push_back(position);
+        }
+        Poll(transport, packer, m_pending);
+
+        bool bOk = true;
+        for (uint8_t step : kSteps) {
+            if (beforeStep && !beforeStep(step)) {
+                bOk = false;
+                break;
+            }
+            if (!RequestState(transport, packer, slaveCount, step)) {
+                bOk = false;
+                break;
+            }
+            if (step == target) {
+                break;
+            }
+        }
+        int64_t elapsedNs = CycleTrace::NowNs() - startNs;
+        if (bOk) {
+            LogInfo() << "Bring-up to " << EcatStateName(target) << " took " << elapsedNs / 1000 / 1000.0 << " ms";
+        } else {
+            LogError() << "Error: Bring-up to " << EcatStateName(target) << " failed after "
+                       << elapsedNs / 1000 / 1000.0 << " ms";
+        }
+        return bOk;
+    }
+};
@@ -0,0 +1,89 @@
+#pragma once
+
+// AMS/TCP wire format shared by the native client (AmsTcpClient.h) and the
+// ADS stand-in server. All fields are little-endian on the wire.
+
+#include <cstdint>
+#include <cstring>
+#include "AdsNativeDef.h"
+
+static const uint16_t AMS_TCP_PORT = 48898;
+
+static const size_t AMS_TCP_HEADER_SIZE = 6;    // reserved(2) + length(4)
+static const size_t AMS_HEADER_SIZE = 32;
+static const size_t AMS_FRAME_HEADER_SIZE = AMS_TCP_HEADER_SIZE + AMS_HEADER_SIZE;
+
+// Larger frames are treated as a corrupt stream
+static const uint32_t AMS_MAX_FRAME_SIZE = 4 * 1024 * 1024;
+
+enum AdsCommandId : uint16_t {
+    ADSCMD_READDEVICEINFO   = 1,
+    ADSCMD_READ             = 2,
+    ADSCMD_WRITE            = 3,
+    ADSCMD_READSTATE        = 4,
+    ADSCMD_WRITECONTROL     = 5,
+    ADSCMD_ADDNOTIFICATION  = 6,
+    ADSCMD_DELNOTIFICATION  = 7,
+    ADSCMD_NOTIFICATION     = 8,
+    ADSCMD_READWRITE        = 9
+};
+
+static const uint16_t AMS_STATEFLAG_REQUEST  = 0x0004;
+static const uint16_t AMS_STATEFLAG_RESPONSE = 0x0005;
+
+inline void AmsPut16(uint8_t* p, uint16_t value) { memcpy(p, &value, 2); }
+inline void AmsPut32(uint8_t* p, uint32_t value) { memcpy(p, &value, 4); }
+inline void AmsPut64(uint8_t* p, uint64_t value) { memcpy(p, &value, 8); }
+inline uint16_t AmsGet16(const uint8_t* p) { uint16_t v; memcpy(&v, p, 2); return v; }
+inline uint32_t AmsGet32(const uint8_t* p) { uint32_t v; memcpy(&v, p, 4); return v; }
+inline uint64_t AmsGet64(const uint8_t* p) { uint64_t v; memcpy(&v, p, 8); return v; }
+
+struct AmsHeader {
+    AmsAddr target;
+    AmsAddr source;
+    uint16_t commandId;
+    uint16_t stateFlags;
+    uint32_t dataLength;
+    uint32_t errorCode;
+    uint32_t invokeId;
+};
+
+// Writes AMS/TCP + AMS header (38 bytes) in front of dataLength bytes of
+// ADS payload
+inline void AmsEncodeHeader(uint8_t* p, const AmsHeader& header) {
+    AmsPut16(p, 0);
+    AmsPut32(p + 2, static_cast<uint32_t>(AMS_HEADER_SIZE + header.dataLength));
+    p += AMS_TCP_HEADER_SIZE;
+    memcpy(p, header.target.netId.b, 6);
+    AmsPut16(p + 6, header.target.port);
+    memcpy(p + 8, header.source.netId.b, 6);
+    AmsPut16(p + 14, header.source.port);
+    AmsPut16(p + 16, header.commandId);
+    AmsPut16(p + 18, header.stateFlags);
+    AmsPut32(p + 20, header.dataLength);
+    AmsPut32(p + 24, header.errorCode);
+    AmsPut32(p + 28, header.invokeId);
+}
+
+// Decodes the AMS header (without the AMS/TCP prefix)
+inline void AmsDecodeHeader(const uint8_t* p, AmsHeader& header) {
+    memcpy(header.target.netId.b, p, 6);
+    header.target.port = AmsGet16(p + 6);
+    memcpy(header.source.netId.b, p + 8, 6);
+    header.source.port = AmsGet16(p + 14);
+    header.commandId = AmsGet16(p + 16);
+    header.stateFlags = AmsGet16(p + 18);
+    header.dataLength = AmsGet32(p + 20);
+    header.errorCode = AmsGet32(p + 24);
+    header.invokeId = AmsGet32(p + 28);
+}
+
+inline bool AmsNetIdEqual(const AmsNetId& a, const AmsNetId& b) {
+    return memcmp(a.b, b.b, 6) == 0;
+}
+
+inline uint64_t AmsNetIdKey(const AmsNetId& netId) {
+    uint64_t key = 0;
+    memcpy(&key, netId.b, 6);
+    return key;
+}
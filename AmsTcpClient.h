@@ -0,0 +1,675 @@
+#pragma once
+
+// Native AMS/TCP client (port 48898) used instead of TcAdsDll where the
+// Beckhoff router is not available. Requests are tagged with an invoke ID
+// and completed from a receive thread, so any number of requests can be in
+// flight on one socket; the synchronous AdsSync* functions in
+// AdsNativeApi.h are thin waits on top of the same path.
+
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <cerrno>
+#include <cstddef>
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <future>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+#include "AmsProtocol.h"
+
+// Completion of one ADS request. nErr is the AMS error, a client-side
+// error (timeout, connection lost) or 0. pData/length is the ADS response
+// payload and is only valid during the call. Runs on the receive thread.
+typedef std::function<void(long nErr, const uint8_t* pData, uint32_t length)> AmsCompletion;
+
+struct AmsReply {
+    long nErr;
+    std::vector<uint8_t> data;
+};
+
+class AmsTcpConnection {
+public:
+    typedef std::function<void(const AmsHeader& header, const uint8_t* pData, uint32_t length)> FrameSink;
+
+private:
+    typedef std::chrono::steady_clock Clock;
+
+    struct Pending {
+        AmsCompletion completion;
+        Clock::time_point deadline;
+    };
+
+    int m_socket;
+    std::atomic<bool> m_bOpen;
+    std::atomic<bool> m_bStopping;
+    std::thread m_rxThread;
+    std::atomic<uint32_t> m_nextInvokeId;
+    AmsNetId m_localNetId;
+
+    std::mutex m_sendLock;
+    std::mutex m_pendingLock;
+    std::unordered_map<uint32_t, Pending> m_pending;
+
+    FrameSink m_notificationSink;
+    std::function<void()> m_onClosed;
+
+    static bool SendAll(int fd, const uint8_t* pData, size_t length) {
+        while (length > 0) {
+            ssize_t n = send(fd, pData, length, MSG_NOSIGNAL);
+            if (n < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                return false;
+            }
+            pData += n;
+            length -= static_cast<size_t>(n);
+        }
+        return true;
+    }
+
+    void FailAll(long nErr) {
+        std::unordered_map<uint32_t, Pending> failed;
+        {
+            std::lock_guard<std::mutex> lock(m_pendingLock);
+            failed.swap(m_pending);
+        }
+        for (auto& entry : failed) {
+            entry.second.completion(nErr, nullptr, 0);
+        }
+    }
+
+    void ExpireTimedOut() {
+        Clock::time_point now = Clock::now();
+        std::vector<AmsCompletion> expired;
+        {
+            std::lock_guard<std::mutex> lock(m_pendingLock);
+            for (auto it = m_pending.begin(); it != m_pending.end();) {
+                if (it->second.deadline <= now) {
+                    expired.push_back(std::move(it->second.completion));
+                    it = m_pending.erase(it);
+                } else {
+                    ++it;
+                }
+            }
+        }
+        for (auto& completion : expired) {
+            completion(ADSERR_CLIENT_SYNCTIMEOUT, nullptr, 0);
+        }
+    }
+
+    void Dispatch(const AmsHeader& header, const uint8_t* pData, uint32_t length) {
+        if (header.stateFlags & 0x0001) {
+            AmsCompletion completion;
+            {
+                std::lock_guard<std::mutex> lock(m_pendingLock);
+                auto it = m_pending.find(header.invokeId);
+                if (it == m_pending.end()) {
+                    return;     // late reply to a request that already timed out
+                }
+                completion = std::move(it->second.completion);
+                m_pending.erase(it);
+            }
+            completion(static_cast<long>(header.errorCode), pData, length);
+        } else if (header.commandId == ADSCMD_NOTIFICATION && m_notificationSink) {
+            m_notificationSink(header, pData, length);
+        }
+    }
+
+    void ReceiveLoop() {
+        std::vector<uint8_t> buffer(64 * 1024);
+        size_t filled = 0;
+
+        while (!m_bStopping.load(std::memory_order_relaxed)) {
+            // Short poll tick doubles as the timeout sweep interval
+            pollfd pfd = { m_socket, POLLIN, 0 };
+            int ready = poll(&pfd, 1, 10);
+            ExpireTimedOut();
+            if (ready <= 0) {
+                if (ready < 0 && errno != EINTR) {
+                    break;
+                }
+                continue;
+            }
+
+            if (filled == buffer.size()) {
+                buffer.resize(buffer.size() * 2);
+            }
+            ssize_t n = recv(m_socket, buffer.data() + filled, buffer.size() - filled, 0);
+            if (n <= 0) {
+                if (n < 0 && errno == EINTR) {
+                    continue;
+                }
+                break;
+            }
+            filled += static_cast<size_t>(n);
+
+            size_t offset = 0;
+            bool corrupt = false;
+            while (filled - offset >= AMS_TCP_HEADER_SIZE) {
+                uint32_t amsLength = AmsGet32(buffer.data() + offset + 2);
+                if (amsLength < AMS_HEADER_SIZE || amsLength > AMS_MAX_FRAME_SIZE) {
+                    corrupt = true;
+                    break;
+                }
+                size_t frameSize = AMS_TCP_HEADER_SIZE + amsLength;
+                if (filled - offset < frameSize) {
+                    if (buffer.size() < frameSize) {
+                        buffer.resize(frameSize);
+                    }
+                    break;
+                }
+
+                const uint8_t* pFrame = buffer.data() + offset + AMS_TCP_HEADER_SIZE;
+                AmsHeader header;
+                AmsDecodeHeader(pFrame, header);
+                uint32_t payload = amsLength - static_cast<uint32_t>(AMS_HEADER_SIZE);
+                if (header.dataLength > payload) {
+                    header.dataLength = payload;
+                }
+                Dispatch(header, pFrame + AMS_HEADER_SIZE, header.dataLength);
+                offset += frameSize;
+            }
+            if (corrupt) {
+                break;
+            }
+            if (offset > 0) {
+                memmove(buffer.data(), buffer.data() + offset, filled - offset);
+                filled -= offset;
+            }
+        }
+
+        m_bOpen.store(false);
+        FailAll(ADSERR_CLIENT_ERROR);
+        if (!m_bStopping.load() && m_onClosed) {
+            m_onClosed();
+        }
+    }
+
+public:
+    AmsTcpConnection() : m_socket(-1), m_bOpen(false), m_bStopping(false), m_nextInvokeId(1) {
+        m_localNetId = AmsNetId();
+    }
+
+    ~AmsTcpConnection() {
+        Close();
+    }
+
+    AmsTcpConnection(const AmsTcpConnection&) = delete;
+    AmsTcpConnection& operator=(const AmsTcpConnection&) = delete;
+
+    // Connects with a timeout and starts the receive thread. If localNetId
+    // is all zero, the local IPv4 address + ".1.1" is used as the AMS NetID.
+    long Open(const std::string& host, uint16_t port, const AmsNetId& localNetId,
+              unsigned long timeoutMs, FrameSink notificationSink, std::function<void()> onClosed) {
+        addrinfo hints = {};
+        hints.ai_family = AF_INET;
+        hints.ai_socktype = SOCK_STREAM;
+        addrinfo* pResult = nullptr;
+        if (getaddrinfo(host.c_str(), std::to_string(port).c_str(), &hints, &pResult) != 0 || !pResult) {
+            return GLOBALERR_MISSING_ROUTE;
+        }
+
+        int fd = socket(AF_INET, SOCK_STREAM, 0);
+        if (fd < 0) {
+            freeaddrinfo(pResult);
+            return GLOBALERR_NO_MEMORY;
+        }
+
+        int flags = fcntl(fd, F_GETFL, 0);
+        fcntl(fd, F_SETFL, flags | O_NONBLOCK);
+        int rc = connect(fd, pResult->ai_addr, pResult->ai_addrlen);
+        freeaddrinfo(pResult);
+        if (rc < 0 && errno == EINPROGRESS) {
+            pollfd pfd = { fd, POLLOUT, 0 };
+            int soError = 0;
+            socklen_t len = sizeof(soError);
+            if (poll(&pfd, 1, static_cast<int>(timeoutMs)) == 1 &&
+                getsockopt(fd, SOL_SOCKET, SO_ERROR, &soError, &len) == 0 && soError == 0) {
+                rc = 0;
+            }
+        }
+        if (rc < 0) {
+            close(fd);
+            return GLOBALERR_MISSING_ROUTE;
+        }
+        fcntl(fd, F_SETFL, flags);
+
+        // Requests are small and latency bound; never wait for Nagle
+        int one = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+
+        m_localNetId = localNetId;
+        static const AmsNetId zero = {};
+        if (AmsNetIdEqual(m_localNetId, zero)) {
+            sockaddr_in local = {};
+            socklen_t len = sizeof(local);
+            getsockname(fd, reinterpret_cast<sockaddr*>(&local), &len);
+            memcpy(m_localNetId.b, &local.sin_addr.s_addr, 4);
+            m_localNetId.b[4] = 1;
+            m_localNetId.b[5] = 1;
+        }
+
+        m_socket = fd;
+        m_notificationSink = std::move(notificationSink);
+        m_onClosed = std::move(onClosed);
+        m_bStopping.store(false);
+        m_bOpen.store(true);
+        m_rxThread = std::thread(&AmsTcpConnection::ReceiveLoop, this);
+        return 0;
+    }
+
+    void Close() {
+        if (m_socket < 0) {
+            return;
+        }
+        m_bStopping.store(true);
+        shutdown(m_socket, SHUT_RDWR);
+        if (m_rxThread.joinable()) {
+            m_rxThread.join();
+        }
+        close(m_socket);
+        m_socket = -1;
+    }
+
+    bool IsOpen() const {
+        return m_bOpen.load();
+    }
+
+    const AmsNetId& GetLocalNetId() const {
+        return m_localNetId;
+    }
+
+    // Sends one request without waiting. completion runs exactly once: with
+    // the response, or with ADSERR_CLIENT_SYNCTIMEOUT after timeoutMs, or
+    // with an error if the connection is lost.
+    void Send(const AmsAddr& target, uint16_t sourcePort, uint16_t commandId,
+              const uint8_t* pPayload, uint32_t length, unsigned long timeoutMs,
+              AmsCompletion completion) {
+        if (!IsOpen()) {
+            completion(ADSERR_CLIENT_ERROR, nullptr, 0);
+            return;
+        }
+
+        uint32_t invokeId = m_nextInvokeId.fetch_add(1, std::memory_order_relaxed);
+
+        AmsHeader header;
+        header.target = target;
+        header.source.netId = m_localNetId;
+        header.source.port = sourcePort;
+        header.commandId = commandId;
+        header.stateFlags = AMS_STATEFLAG_REQUEST;
+        header.dataLength = length;
+        header.errorCode = 0;
+        header.invokeId = invokeId;
+
+        // Register before sending: the reply can beat the return of send()
+        {
+            std::lock_guard<std::mutex> lock(m_pendingLock);
+            m_pending[invokeId] = Pending{ std::move(completion),
+                                           Clock::now() + std::chrono::milliseconds(timeoutMs) };
+        }
+
+        uint8_t frameHeader[AMS_FRAME_HEADER_SIZE];
+        AmsEncodeHeader(frameHeader, header);
+
+        bool sent;
+        {
+            std::lock_guard<std::mutex> lock(m_sendLock);
+            sent = SendAll(m_socket, frameHeader, sizeof(frameHeader)) &&
+                   SendAll(m_socket, pPayload, length);
+        }
+
+        // A connection that dropped while we were sending no longer has a
+        // receive thread to complete or expire the request
+        if (!sent || !IsOpen()) {
+            AmsCompletion failed;
+            {
+                std::lock_guard<std::mutex> lock(m_pendingLock);
+                auto it = m_pending.find(invokeId);
+                if (it != m_pending.end()) {
+                    failed = std::move(it->second.completion);
+                    m_pending.erase(it);
+                }
+            }
+            if (failed) {
+                failed(sent ? ADSERR_CLIENT_ERROR : GLOBALERR_TCP_SEND, nullptr, 0);
+            }
+        }
+    }
+
+    size_t GetPendingCount() {
+        std::lock_guard<std::mutex> lock(m_pendingLock);
+        return m_pending.size();
+    }
+};
+
+// Process-wide replacement for the local AMS router: owns the local ADS
+// ports, the AMS NetID -> host routes, one pipelined connection per host
+// and the device-notification table.
+class AmsRouter {
+public:
+    struct NotificationTarget {
+        long port;
+        AmsAddr addr;
+        PAdsNotificationFuncEx callback;
+        unsigned long hUser;
+    };
+
+private:
+    static const long kFirstPort = 30000;
+    static const unsigned long kDefaultTimeoutMs = 5000;
+
+    // One per host. The TCP connect runs without m_lock held; while it is
+    // in progress bConnecting is set and other requests for the same host
+    // wait on m_connected instead of starting a second connect.
+    struct HostConnection {
+        std::shared_ptr<AmsTcpConnection> connection;
+        bool bConnecting = false;
+        long lastError = 0;
+    };
+
+    std::mutex m_lock;
+    std::condition_variable m_connected;
+    AmsNetId m_localNetId;
+    std::map<long, unsigned long> m_ports;                 // port -> timeout ms
+    long m_nextPort;
+    std::map<uint64_t, std::string> m_routes;              // NetID -> host
+    std::map<std::string, HostConnection> m_connections;
+    uint16_t m_tcpPort;
+
+    std::mutex m_notificationLock;
+    // (server NetID/port, notification handle) -> client callback
+    std::map<std::pair<uint64_t, uint32_t>, NotificationTarget> m_notifications;
+
+    std::atomic<PAmsRouterNotificationFuncEx> m_routerCallback;
+
+    AmsRouter() : m_nextPort(kFirstPort), m_tcpPort(AMS_TCP_PORT), m_routerCallback(nullptr) {
+        m_localNetId = AmsNetId();
+    }
+
+    static uint64_t DeviceKey(const AmsAddr& addr) {
+        return (AmsNetIdKey(addr.netId) << 16) | addr.port;
+    }
+
+    std::string HostFor(const AmsNetId& netId) {
+        auto it = m_routes.find(AmsNetIdKey(netId));
+        if (it != m_routes.end()) {
+            return it->second;
+        }
+        // No explicit route: by convention the first four bytes of the
+        // NetID are the target's IPv4 address (127.0.0.1.1.1 -> 127.0.0.1)
+        return std::to_string(netId.b[0]) + "." + std::to_string(netId.b[1]) + "." +
+               std::to_string(netId.b[2]) + "." + std::to_string(netId.b[3]);
+    }
+
+    void RaiseRouterEvent(long nEvent) {
+        PAmsRouterNotificationFuncEx callback = m_routerCallback.load();
+        if (callback) {
+            callback(nEvent);
+        }
+    }
+
+    // Splits a device-notification stream into samples and hands each one
+    // to the registered callback as an AdsNotificationHeader. The callback
+    // is copied out and called without m_notificationLock, so it may
+    // unregister its own notification; each receive thread has its own
+    // sample buffer.
+    void OnNotificationFrame(const AmsHeader& header, const uint8_t* pData, uint32_t length) {
+        if (length < 8) {
+            return;
+        }
+        uint32_t stamps = AmsGet32(pData + 4);
+        const uint8_t* p = pData + 8;
+        const uint8_t* pEnd = pData + length;
+        uint64_t device = DeviceKey(header.source);
+        thread_local std::vector<uint8_t> sampleBuffer;
+
+        for (uint32_t s = 0; s < stamps && pEnd - p >= 12; s++) {
+            int64_t timestamp = static_cast<int64_t>(AmsGet64(p));
+            uint32_t samples = AmsGet32(p + 8);
+            p += 12;
+            for (uint32_t i = 0; i < samples && pEnd - p >= 8; i++) {
+                uint32_t handle = AmsGet32(p);
+                uint32_t size = AmsGet32(p + 4);
+                p += 8;
+                if (size > static_cast<uint32_t>(pEnd - p)) {
+                    return;
+                }
+
+                NotificationTarget target;
+                bool found = false;
+                {
+                    std::lock_guard<std::mutex> lock(m_notificationLock);
+                    auto it = m_notifications.find(std::make_pair(device, handle));
+                    if (it != m_notifications.end()) {
+                        target = it->second;
+                        found = true;
+                    }
+                }
+                if (found) {
+                    size_t needed = offsetof(AdsNotificationHeader, data) + size;
+                    if (sampleBuffer.size() < needed) {
+                        sampleBuffer.resize(needed);
+                    }
+                    AdsNotificationHeader* pHeader =
+                        reinterpret_cast<AdsNotificationHeader*>(sampleBuffer.data());
+                    pHeader->nTimeStamp = timestamp;
+                    pHeader->hNotification = handle;
+                    pHeader->cbSampleSize = size;
+                    memcpy(pHeader->data, p, size);
+                    target.callback(&target.addr, pHeader, target.hUser);
+                }
+                p += size;
+            }
+        }
+    }
+
+    // Called with m_lock held through lock; drops it for the TCP connect,
+    // so an unreachable host only stalls requests to that host. Requests
+    // that waited for another thread's connect share its result.
+    std::shared_ptr<AmsTcpConnection> GetConnection(std::unique_lock<std::mutex>& lock,
+                                                    const AmsNetId& netId, unsigned long timeoutMs,
+                                                    long* pErr) {
+        std::string host = HostFor(netId);
+        HostConnection& entry = m_connections[host];
+        if (entry.bConnecting) {
+            m_connected.wait(lock, [&entry] { return !entry.bConnecting; });
+            if (entry.connection && entry.connection->IsOpen()) {
+                return entry.connection;
+            }
+            *pErr = entry.lastError ? entry.lastError : ADSERR_CLIENT_PORTNOTOPEN;
+            return nullptr;
+        }
+        if (entry.connection && entry.connection->IsOpen()) {
+            return entry.connection;
+        }
+
+        bool reconnect = (entry.connection != nullptr);
+        std::shared_ptr<AmsTcpConnection> stale;
+        stale.swap(entry.connection);
+        entry.bConnecting = true;
+        AmsNetId localNetId = m_localNetId;
+        uint16_t tcpPort = m_tcpPort;
+        lock.unlock();
+
+        stale.reset();
+        auto connection = std::make_shared<AmsTcpConnection>();
+        long nErr = connection->Open(host, tcpPort, localNetId, timeoutMs,
+            [this](const AmsHeader& header, const uint8_t* pData, uint32_t length) {
+                OnNotificationFrame(header, pData, length);
+            },
+            [this]() { RaiseRouterEvent(AMSEVENT_ROUTERSTOP); });
+
+        lock.lock();
+        // std::map references stay valid while the entry is not erased,
+        // and only the destructor erases entries
+        entry.bConnecting = false;
+        entry.lastError = nErr;
+        if (!nErr) {
+            entry.connection = connection;
+            if (AmsNetIdKey(m_localNetId) == 0) {
+                m_localNetId = connection->GetLocalNetId();
+            }
+        }
+        m_connected.notify_all();
+        if (nErr) {
+            *pErr = nErr;
+            return nullptr;
+        }
+        if (reconnect) {
+            RaiseRouterEvent(AMSEVENT_ROUTERSTART);
+        }
+        return connection;
+    }
+
+public:
+    static AmsRouter& Instance() {
+        static AmsRouter router;
+        return router;
+    }
+
+    ~AmsRouter() {
+        std::map<std::string, HostConnection> connections;
+        {
+            std::lock_guard<std::mutex> lock(m_lock);
+            connections.swap(m_connections);
+        }
+        connections.clear();
+    }
+
+    // Maps an AMS NetID to a host name or IP. Must match a route configured
+    // on the target (or the target must accept unrouted connections).
+    void AddRoute(const AmsNetId& netId, const std::string& host) {
+        std::lock_guard<std::mutex> lock(m_lock);
+        m_routes[AmsNetIdKey(netId)] = host;
+    }
+
+    void SetLocalNetId(const AmsNetId& netId) {
+        std::lock_guard<std::mutex> lock(m_lock);
+        m_localNetId = netId;
+    }
+
+    // TCP port of the remote router; only changed for local stand-ins
+    void SetTcpPort(uint16_t port) {
+        std::lock_guard<std::mutex> lock(m_lock);
+        m_tcpPort = port;
+    }
+
+    long OpenPort() {
+        std::lock_guard<std::mutex> lock(m_lock);
+        long port = m_nextPort++;
+        m_ports[port] = kDefaultTimeoutMs;
+        return port;
+    }
+
+    long ClosePort(long port) {
+        {
+            std::lock_guard<std::mutex> lock(m_lock);
+            if (m_ports.erase(port) == 0) {
+                return ADSERR_CLIENT_PORTNOTOPEN;
+            }
+        }
+        std::lock_guard<std::mutex> lock(m_notificationLock);
+        for (auto it = m_notifications.begin(); it != m_notifications.end();) {
+            if (it->second.port == port) {
+                it = m_notifications.erase(it);
+            } else {
+                ++it;
+            }
+        }
+        return 0;
+    }
+
+    long SetTimeout(long port, unsigned long timeoutMs) {
+        std::lock_guard<std::mutex> lock(m_lock);
+        auto it = m_ports.find(port);
+        if (it == m_ports.end()) {
+            return ADSERR_CLIENT_PORTNOTOPEN;
+        }
+        it->second = timeoutMs;
+        return 0;
+    }
+
+    long GetLocalAddress(long port, AmsAddr* pAddr) {
+        std::lock_guard<std::mutex> lock(m_lock);
+        if (m_ports.find(port) == m_ports.end()) {
+            return ADSERR_CLIENT_PORTNOTOPEN;
+        }
+        pAddr->netId = m_localNetId;
+        pAddr->port = static_cast<unsigned short>(port);
+        return 0;
+    }
+
+    // Issues one ADS command asynchronously. Returns 0 if the request was
+    // queued (completion will run) or an error if it could not be sent (in
+    // which case completion is not called).
+    long Request(long port, const AmsAddr& target, uint16_t commandId,
+                 const uint8_t* pPayload, uint32_t length, AmsCompletion completion,
+                 unsigned long timeoutMs = 0) {
+        std::shared_ptr<AmsTcpConnection> connection;
+        {
+            std::unique_lock<std::mutex> lock(m_lock);
+            auto it = m_ports.find(port);
+            if (it == m_ports.end()) {
+                return ADSERR_CLIENT_PORTNOTOPEN;
+            }
+            if (timeoutMs == 0) {
+                timeoutMs = it->second;
+            }
+            long nErr = 0;
+            connection = GetConnection(lock, target.netId, timeoutMs, &nErr);
+            if (!connection) {
+                return nErr;
+            }
+        }
+
+        connection->Send(target, static_cast<uint16_t>(port), commandId, pPayload, length,
+                         timeoutMs, std::move(completion));
+        return 0;
+    }
+
+    // Future-based form of Request() for pipelining from application code
+    std::future<AmsReply> RequestAsync(long port, const AmsAddr& target, uint16_t commandId,
+                                       const uint8_t* pPayload, uint32_t length,
+                                       unsigned long timeoutMs = 0) {
+        auto promise = std::make_shared<std::promise<AmsReply>>();
+        std::future<AmsReply> future = promise->get_future();
+        long nErr = Request(port, target, commandId, pPayload, length,
+            [promise](long nErr, const uint8_t* pData, uint32_t length) {
+                promise->set_value(AmsReply{ nErr, std::vector<uint8_t>(pData, pData + length) });
+            }, timeoutMs);
+        if (nErr) {
+            promise->set_value(AmsReply{ nErr, std::vector<uint8_t>() });
+        }
+        return future;
+    }
+
+    void RegisterNotification(const AmsAddr& target, uint32_t handle, const NotificationTarget& entry) {
+        std::lock_guard<std::mutex> lock(m_notificationLock);
+        m_notifications[std::make_pair(DeviceKey(target), handle)] = entry;
+    }
+
+    void UnregisterNotification(const AmsAddr& target, uint32_t handle) {
+        std::lock_guard<std::mutex> lock(m_notificationLock);
+        m_notifications.erase(std::make_pair(DeviceKey(target), handle));
+    }
+
+    void SetRouterCallback(PAmsRouterNotificationFuncEx callback) {
+        m_routerCallback.store(callback);
+    }
+};
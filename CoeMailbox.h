@@ -0,0 +1,579 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <deque>
+#include <thread>
+#include <utility>
+#include <vector>
+#include "CycleTrace.h"
+#include "EscRegisters.h"
+#include "EtherCATDatagramPacker.h"
+#include "FrameTransport.h"
+#include "Logger.h"
+#include "SiiReader.h"
+
+// CoE SDO transfers through the slaves' mailboxes, every slave at once.
+// Each slave has its own queue with one transfer in flight; one frame per
+// step carries every mailbox write that is due (APWR of the whole SM0
+// area) and a read of every mailbox an answer is expected in (APRD of
+// SM1). A full write mailbox or an empty read mailbox returns WKC 0, so
+// no status registers are polled. Transfers are expedited, normal or
+// segmented as the data needs, with or without complete access.
+//
+// A frame lost after the slave handled its SM1 read takes the answer with
+// it. The read is then repeated the ETG.1000 way: the master toggles the
+// repeat request in SM1's activate register, the slave puts its last mail
+// back and toggles the repeat ack in SM1's PDI control register, and SM1
+// is read again. A mail with the counter of the one before is a repeat of
+// a mail already handled and is dropped.
+//
+// Run() works through the queues at startup. In OP, Queue() and
+// Complete() put mailbox datagrams into the cyclic frame instead, never
+// more than cyclicBudgetBytes, and poll idle mailboxes in turn for
+// emergencies; requests may then only be added from the cycle thread.
+//
+//   CoeMailbox mailbox;
+//   mailbox.AddSlave(position, slaveInfo);
+//   mailbox.Download(position, 0x8010, 1, &current, 2);
+//   mailbox.Run(transport, packer);
+class CoeMailbox {
+public:
+    struct Settings {
+        long frameTimeoutUs;         // per step frame in Run()
+        long pollIntervalUs;         // gap between steps that brought nothing
+        uint32_t sdoTimeoutMs;       // per transfer, unless the request has its own
+        uint16_t maxActiveSlaves;    // slaves with a transfer in flight, 0 = all
+        size_t cyclicBudgetBytes;    // mailbox datagrams per cyclic frame
+
+        Settings()
+            : frameTimeoutUs(100000), pollIntervalUs(100), sdoTimeoutMs(5000), maxActiveSlaves(0),
+              cyclicBudgetBytes(600) {}
+    };
+
+    enum Status { SDO_PENDING, SDO_DONE, SDO_ABORTED, SDO_TIMEOUT, SDO_FAILED };
+
+    struct Request {
+        uint16_t position;
+        uint16_t index;
+        uint8_t subIndex;
+        bool bUpload;
+        bool bCompleteAccess;
+        uint32_t timeoutMs;          // 0 = Settings::sdoTimeoutMs
+        std::vector<uint8_t> data;   // download: to write; upload: what was read
+        Status status;
+        uint32_t abortCode;          // SDO_ABORTED: the slave's, otherwise 0
+    };
+
+    struct Stats {
+        unsigned long transfers;     // finished, either way
+        unsigned long failed;
+        unsigned long mailsSent;
+        unsigned long mailsReceived;
+        unsigned long busy;          // write mailbox still full, sent again
+        unsigned long emergencies;
+        unsigned long steps;         // frames with mailbox datagrams
+        unsigned long repeats;       // SM1 reads repeated after a lost frame
+    };
+
+private:
+    // REPEAT writes the repeat request, REPEAT_ACK reads the ack until it
+    // follows; both go back to WAIT
+    enum Phase { IDLE, SEND, WAIT, REPEAT, REPEAT_ACK };
+
+    struct Mailbox {
+        uint16_t position;
+        uint16_t outStart;
+        uint16_t outSize;
+        uint16_t inStart;
+        uint16_t inSize;
+        bool bCompleteAccess;        // the slave supports it
+        uint8_t counter;             // mailbox header counter, 1-7
+        std::deque<size_t> queue;    // request ids, the front one in flight
+        Phase phase;
+        std::vector<uint8_t> out;    // mail being sent
+        std::vector<uint8_t> in;     // last mail read
+        int64_t deadlineNs;
+        size_t offset;               // data bytes transferred
+        uint8_t toggle;
+        bool bSegments;              // past the initiate exchange
+        uint8_t inCounter;           // counter of the last mail read, 0 = none
+        uint8_t repeatRequest;       // SM1 activate with the current repeat request
+        uint8_t repeatAck;           // SM1 PDI control as read
+    };
+
+    // One mailbox datagram of the current step
+    struct Access {
+        size_t mailbox;
+        size_t id;
+        Phase phase;                 // of the mailbox when added; IDLE = emergency poll
+    };
+
+    Settings m_settings;
+    Stats m_stats;
+    std::vector<Mailbox> m_mailboxes;
+    std::vector<int> m_byPosition;     // position -> m_mailboxes index, -1 = none
+    std::vector<Request> m_requests;
+    std::vector<Access> m_accesses;
+    size_t m_active;                   // mailboxes with a transfer in flight
+    size_t m_nextActive;               // busy mailbox served first in the cycle
+    size_t m_nextPoll;                 // idle mailbox polled next in the cycle
+
+    static uint32_t AutoIncrement(uint16_t position, uint16_t offset) {
+        return EcatPhysicalAddress(static_cast<uint16_t>(-static_cast<int>(position)), offset);
+    }
+
+    static size_t DatagramBytes(uint16_t length) {
+        return ECAT_DATAGRAM_HEADER_SIZE + length + ECAT_WKC_SIZE;
+    }
+
+    // Bytes the mailbox's next datagram carries
+    static uint16_t AccessLength(const Mailbox& mailbox) {
+        return mailbox.phase == SEND ? mailbox.outSize : mailbox.phase >= REPEAT ? 1 : mailbox.inSize;
+    }
+
+    // Starts a CoE SDO request of sdoLength bytes in the mail buffer and
+    // returns where the SDO part goes
+    uint8_t* BeginMail(Mailbox& mailbox, size_t sdoLength) {
+        std::fill(mailbox.out.begin(), mailbox.out.end(), 0);
+        mailbox.counter = static_cast<uint8_t>(mailbox.counter % 7 + 1);
+        EcatPut16(&mailbox.out[0], static_cast<uint16_t>(2 + sdoLength));
+        mailbox.out[5] = static_cast<uint8_t>(ECAT_MBX_TYPE_COE | (mailbox.counter << 4));
+        EcatPut16(&mailbox.out[6], static_cast<uint16_t>(COE_SERVICE_SDO_REQUEST << 12));
+        mailbox.phase = SEND;
+        return &mailbox.out[ECAT_MBX_HEADER_SIZE + 2];
+    }
+
+    void SendInitiate(Mailbox& mailbox, const Request& request) {
+        uint8_t access = request.bCompleteAccess ? SDO_COMPLETE_ACCESS : 0;
+        size_t size = request.data.size();
+        uint8_t* pSdo;
+        if (request.bUpload) {
+            pSdo = BeginMail(mailbox, 8);
+            pSdo[0] = static_cast<uint8_t>(SDO_CCS_UPLOAD | access);
+        } else if (size > 0 && size <= 4 && !request.bCompleteAccess) {
+            pSdo = BeginMail(mailbox, 8);
+            pSdo[0] = static_cast<uint8_t>(SDO_CCS_DOWNLOAD | SDO_EXPEDITED | SDO_SIZE_INDICATED | ((4 - size) << 2));
+            std::copy(request.data.begin(), request.data.end(), pSdo + 4);
+            mailbox.offset = size;
+        } else { // an empty download is a normal initiate with size 0, 4 - 0 would overflow into the specifier
+            size_t chunk = std::min<size_t>(size, mailbox.outSize - ECAT_MBX_HEADER_SIZE - 10);
+            pSdo = BeginMail(mailbox, 8 + chunk);
+            pSdo[0] = static_cast<uint8_t>(SDO_CCS_DOWNLOAD | SDO_SIZE_INDICATED | access);
+            EcatPut32(pSdo + 4, static_cast<uint32_t>(size));
+            std::copy(request.data.begin(), request.data.begin() + chunk, pSdo + 8);
+            mailbox.offset = chunk;
+        }
+        EcatPut16(pSdo + 1, request.index);
+        pSdo[3] = request.subIndex;
+    }
+
+    void SendSegment(Mailbox& mailbox, const Request& request) {
+        mailbox.bSegments = true;
+        if (request.bUpload) {
+            uint8_t* pSdo = BeginMail(mailbox, 8);
+            pSdo[0] = static_cast<uint8_t>(SDO_CCS_UPLOAD_SEGMENT | mailbox.toggle);
+            return;
+        }
+        size_t chunk = std::min<size_t>(request.data.size() - mailbox.offset,
+                                        mailbox.outSize - ECAT_MBX_HEADER_SIZE - 3);
+        bool bLast = mailbox.offset + chunk == request.data.size();
+        uint8_t* pSdo = BeginMail(mailbox, std::max<size_t>(8, 1 + chunk));
+        pSdo[0] = static_cast<uint8_t>(SDO_CCS_DOWNLOAD_SEGMENT | mailbox.toggle | (bLast ? SDO_LAST_SEGMENT : 0) |
+                                       (chunk < 7 ? (7 - chunk) << 1 : 0));
+        std::copy(request.data.begin() + mailbox.offset, request.data.begin() + mailbox.offset + chunk, pSdo + 1);
+        mailbox.offset += chunk;
+    }
+
+    void Finish(Mailbox& mailbox, Status status, uint32_t abortCode = 0) {
+        Request& request = m_requests[mailbox.queue.front()];
+        request.status = status;
+        request.abortCode = abortCode;
+        m_stats.transfers++;
+        if (status != SDO_DONE) {
+            m_stats.failed++;
+            LogError() << "Error: Slave " << request.position << " SDO " << (request.bUpload ? "upload" : "download")
+                       << " 0x" << std::hex << request.index << ":" << static_cast<unsigned>(request.subIndex)
+                       << std::dec << (request.bCompleteAccess ? " (complete access)" : "")
+                       << (status == SDO_TIMEOUT ? " timed out" : status == SDO_ABORTED ? " aborted" : " failed");
+            if (status == SDO_ABORTED) {
+                LogError() << "  abort code 0x" << std::hex << abortCode
+                           << std::dec << " (" << CoeAbortName(abortCode) << ")";
+            }
+        }
+        mailbox.queue.pop_front();
+        mailbox.phase = IDLE;
+        m_active--;
+    }
+
+    // Starts the next queued transfers, at most maxActiveSlaves at a time
+    void Activate() {
+        for (Mailbox& mailbox : m_mailboxes) {
+            if (m_settings.maxActiveSlaves && m_active >= m_settings.maxActiveSlaves) {
+                return;
+            }
+            if (mailbox.phase != IDLE || mailbox.queue.empty()) {
+                continue;
+            }
+            const Request& request = m_requests[mailbox.queue.front()];
+            uint32_t timeoutMs = request.timeoutMs ? request.timeoutMs : m_settings.sdoTimeoutMs;
+            mailbox.deadlineNs = CycleTrace::NowNs() + static_cast<int64_t>(timeoutMs) * 1000000;
+            mailbox.offset = 0;
+            mailbox.toggle = 0;
+            mailbox.bSegments = false;
+            m_active++;
+            SendInitiate(mailbox, request);
+        }
+    }
+
+    void OnEmergency(const Mailbox& mailbox, const uint8_t* pData) {
+        m_stats.emergencies++;
+        LogWarning() << "Warning: Slave " << mailbox.position << " emergency: error code 0x" << std::hex
+                     << EcatGet16(pData) << ", error register 0x" << static_cast<unsigned>(pData[2]) << std::dec;
+    }
+
+    // A mail read from SM1: an emergency, or the answer to the mail sent
+    void OnMail(Mailbox& mailbox) {
+        const uint8_t* p = mailbox.in.data();
+        uint8_t counter = (p[5] >> 4) & 0x07;
+        if (counter && counter == mailbox.inCounter) {
+            return;
+        }
+        mailbox.inCounter = counter;
+        m_stats.mailsReceived++;
+        size_t length = std::min<size_t>(EcatGet16(p), mailbox.inSize - ECAT_MBX_HEADER_SIZE);
+        if ((p[5] & 0x0F) != ECAT_MBX_TYPE_COE || length < 2) {
+            return;
+        }
+        uint16_t service = static_cast<uint16_t>(EcatGet16(p + 6) >> 12);
+        const uint8_t* pSdo = p + ECAT_MBX_HEADER_SIZE + 2;
+        if (service == COE_SERVICE_EMERGENCY && length >= 10) {
+            OnEmergency(mailbox, pSdo);
+            return;
+        }
+        if (service != COE_SERVICE_SDO_RESPONSE || length < 10 || mailbox.phase != WAIT) {
+            return;
+        }
+        size_t sdoLength = length - 2;
+        Request& request = m_requests[mailbox.queue.front()];
+        uint8_t command = pSdo[0];
+        uint8_t specifier = command & SDO_COMMAND_MASK;
+        if (specifier == SDO_CCS_ABORT) {
+            Finish(mailbox, SDO_ABORTED, EcatGet32(pSdo + 4));
+            return;
+        }
+
+        if (!request.bUpload) {
+            if (specifier != (mailbox.bSegments ? SDO_SCS_DOWNLOAD_SEGMENT : SDO_SCS_DOWNLOAD)) {
+                Finish(mailbox, SDO_FAILED);
+                return;
+            }
+            if (mailbox.bSegments) {
+                mailbox.toggle ^= SDO_TOGGLE;
+            }
+            if (mailbox.offset >= request.data.size()) {
+                Finish(mailbox, SDO_DONE);
+            } else {
+                SendSegment(mailbox, request);
+            }
+            return;
+        }
+
+        if (!mailbox.bSegments) {
+            if (specifier != SDO_SCS_UPLOAD) {
+                Finish(mailbox, SDO_FAILED);
+                return;
+            }
+            if (command & SDO_EXPEDITED) {
+                size_t size = (command & SDO_SIZE_INDICATED) ? 4 - ((command >> 2) & 0x03) : 4;
+                request.data.assign(pSdo + 4, pSdo + 4 + size);
+                Finish(mailbox, SDO_DONE);
+                return;
+            }
+            uint32_t size = EcatGet32(pSdo + 4);
+            size_t chunk = std::min<size_t>(sdoLength - 8, size);
+            request.data.assign(pSdo + 8, pSdo + 8 + chunk);
+            request.data.reserve(size);
+            mailbox.offset = size;
+        } else {
+            if (specifier != SDO_SCS_UPLOAD_SEGMENT || (command & SDO_TOGGLE) != mailbox.toggle) {
+                Finish(mailbox, SDO_FAILED);
+                return;
+            }
+            mailbox.toggle ^= SDO_TOGGLE;
+            size_t chunk = (sdoLength == 8) ? 7 - ((command >> 1) & 0x07) : sdoLength - 1;
+            chunk = std::min(chunk, mailbox.offset - request.data.size());
+            request.data.insert(request.data.end(), pSdo + 1, pSdo + 1 + chunk);
+            if (command & SDO_LAST_SEGMENT) {
+                mailbox.offset = request.data.size();
+            }
+        }
+        if (request.data.size() >= mailbox.offset) {
+            Finish(mailbox, SDO_DONE);
+        } else {
+            SendSegment(mailbox, request);
+        }
+    }
+
+    // The datagram the mailbox's phase calls for: the mail to SM0, the
+    // repeat request or ack of SM1, otherwise a read of SM1
+    size_t AddAccess(EtherCATDatagramPacker& packer, size_t index) {
+        Mailbox& mailbox = m_mailboxes[index];
+        uint16_t sm1 = ESC_REG_SM0 + ESC_SM_SIZE;
+        size_t id;
+        switch (mailbox.phase) {
+        case SEND:
+            id = packer.Add(ECAT_APWR, AutoIncrement(mailbox.position, mailbox.outStart), mailbox.outSize,
+                            mailbox.out.data());
+            break;
+        case REPEAT:
+            id = packer.Add(ECAT_APWR, AutoIncrement(mailbox.position, sm1 + ESC_SM_ACTIVATE), 1,
+                            &mailbox.repeatRequest);
+            break;
+        case REPEAT_ACK:
+            id = packer.Add(ECAT_APRD, AutoIncrement(mailbox.position, sm1 + ESC_SM_PDI_CONTROL), 1, nullptr,
+                            &mailbox.repeatAck);
+            break;
+        default:
+            id = packer.Add(ECAT_APRD, AutoIncrement(mailbox.position, mailbox.inStart), mailbox.inSize, nullptr,
+                            mailbox.in.data());
+            break;
+        }
+        m_accesses.push_back(Access{ index, id, mailbox.phase });
+        return DatagramBytes(AccessLength(mailbox));
+    }
+
+    // An SM1 read that may have emptied the mailbox without its data
+    // coming back: its frame was lost, or a resent copy found SM1 empty
+    static bool IsReadLost(const EtherCATDatagramPacker& packer, size_t id) {
+        return !packer.IsReceived(id) || (packer.GetWkc(id) == 0 && packer.GetAttempts(id) > 1);
+    }
+
+    // Results of the step's datagrams; true if any mailbox moved on
+    bool Process(const EtherCATDatagramPacker& packer) {
+        bool bProgress = false;
+        for (const Access& access : m_accesses) {
+            Mailbox& mailbox = m_mailboxes[access.mailbox];
+            bool bAnswered = packer.IsReceived(access.id) && packer.GetWkc(access.id) == 1;
+            if (access.phase == SEND) {
+                if (bAnswered && mailbox.phase == SEND) {
+                    m_stats.mailsSent++;
+                    mailbox.phase = WAIT;
+                    bProgress = true;
+                } else if (packer.IsReceived(access.id)) {
+                    m_stats.busy++;
+                }
+            } else if (access.phase == REPEAT) {
+                if (bAnswered && mailbox.phase == REPEAT) {
+                    mailbox.phase = REPEAT_ACK;
+                    bProgress = true;
+                }
+            } else if (access.phase == REPEAT_ACK) {
+                if (bAnswered && mailbox.phase == REPEAT_ACK &&
+                    !((mailbox.repeatAck ^ mailbox.repeatRequest) & ESC_SM_REPEAT)) {
+                    mailbox.phase = WAIT;
+                    bProgress = true;
+                }
+            } else if (bAnswered) {
+                OnMail(mailbox);
+                bProgress = true;
+            } else if (access.phase == WAIT && mailbox.phase == WAIT && IsReadLost(packer, access.id)) {
+                m_stats.repeats++;
+                mailbox.repeatRequest ^= ESC_SM_REPEAT;
+                mailbox.phase = REPEAT;
+            }
+        }
+        m_accesses.clear();
+
+        int64_t nowNs = CycleTrace::NowNs();
+        for (Mailbox& mailbox : m_mailboxes) {
+            if (mailbox.phase != IDLE && nowNs >= mailbox.deadlineNs) {
+                Finish(mailbox, SDO_TIMEOUT);
+            }
+        }
+        return bProgress;
+    }
+
+    size_t AddRequest(uint16_t position, uint16_t index, uint8_t subIndex, bool bUpload, bool bCompleteAccess,
+                      const void* pData, size_t length, uint32_t timeoutMs) {
+        Request request = { position, index, subIndex, bUpload, bCompleteAccess, timeoutMs,
+                            std::vector<uint8_t>(), SDO_PENDING, 0 };
+        if (pData) {
+            const uint8_t* pBytes = static_cast<const uint8_t*>(pData);
+            request.data.assign(pBytes, pBytes + length);
+        }
+        size_t id = m_requests.size();
+        int mailbox = position < m_byPosition.size() ? m_byPosition[position] : -1;
+        if (mailbox < 0) {
+            LogError() << "Error: Slave " << position << " has no CoE mailbox";
+            request.status = SDO_FAILED;
+        } else if (bCompleteAccess && !m_mailboxes[mailbox].bCompleteAccess) {
+            LogError() << "Error: Slave " << position << " does not support SDO complete access";
+            request.status = SDO_FAILED;
+        } else {
+            m_mailboxes[mailbox].queue.push_back(id);
+            if (bUpload) {
+                // Answers that fit one mail are stored without allocating (in OP: on the cycle path)
+                request.data.reserve(m_mailboxes[mailbox].inSize);
+            }
+        }
+        m_requests.push_back(std::move(request));
+        return id;
+    }
+
+public:
+    CoeMailbox() : m_active(0), m_nextActive(0), m_nextPoll(0) {
+        memset(&m_stats, 0, sizeof(m_stats));
+    }
+
+    void SetSettings(const Settings& settings) {
+        m_settings = settings;
+    }
+
+    // Mailbox layout and CoE support from the slave's SII; false if it
+    // has no mailbox or no CoE SDO support
+    bool AddSlave(uint16_t position, const SlaveInfo& info) {
+        if (!info.mailboxOutSize || !info.mailboxInSize || !(info.coeDetails & SII_COE_SDO)) {
+            return false;
+        }
+        if (position >= m_byPosition.size()) {
+            m_byPosition.resize(position + 1, -1);
+        }
+        if (m_byPosition[position] < 0) {
+            m_byPosition[position] = static_cast<int>(m_mailboxes.size());
+            m_mailboxes.emplace_back();
+            m_accesses.reserve(m_mailboxes.size());     // at most one per mailbox and step
+        }
+        Mailbox& mailbox = m_mailboxes[m_byPosition[position]];
+        mailbox.position = position;
+        mailbox.outStart = info.mailboxOutStart;
+        mailbox.outSize = info.mailboxOutSize;
+        mailbox.inStart = info.mailboxInStart;
+        mailbox.inSize = info.mailboxInSize;
+        mailbox.bCompleteAccess = (info.coeDetails & SII_COE_COMPLETE_ACCESS) != 0;
+        mailbox.counter = 0;
+        mailbox.phase = IDLE;
+        mailbox.inCounter = 0;
+        mailbox.repeatRequest = ESC_SM_ENABLE;     // SM1 is enabled and latches no events
+        mailbox.repeatAck = 0;
+        mailbox.out.assign(mailbox.outSize, 0);
+        mailbox.in.assign(mailbox.inSize, 0);
+        return true;
+    }
+
+    size_t GetSlaveCount() const {
+        return m_mailboxes.size();
+    }
+
+    // Queues a write of length bytes; returns the request id
+    size_t Download(uint16_t position, uint16_t index, uint8_t subIndex, const void* pData, size_t length,
+                    bool bCompleteAccess = false, uint32_t timeoutMs = 0) {
+        return AddRequest(position, index, subIndex, false, bCompleteAccess, pData, length, timeoutMs);
+    }
+
+    // Queues a read; the data is in GetRequest(id).data once done
+    size_t Upload(uint16_t position, uint16_t index, uint8_t subIndex, bool bCompleteAccess = false,
+                  uint32_t timeoutMs = 0) {
+        return AddRequest(position, index, subIndex, true, bCompleteAccess, nullptr, 0, timeoutMs);
+    }
+
+    const Request& GetRequest(size_t id) const {
+        return m_requests[id];
+    }
+
+    // Nothing queued or in flight
+    bool IsIdle() const {
+        if (m_active) {
+            return false;
+        }
+        for (const Mailbox& mailbox : m_mailboxes) {
+            if (!mailbox.queue.empty()) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    const Stats& GetStats() const {
+        return m_stats;
+    }
+
+    // Works through every queue, one frame per step. False if any of the
+    // transfers failed; they are logged.
+    bool Run(FrameTransport& transport, EtherCATDatagramPacker& packer) {
+        int64_t startNs = CycleTrace::NowNs();
+        unsigned long failed = m_stats.failed;
+        unsigned long transfers = m_stats.transfers;
+        unsigned long steps = 0;
+        Activate();
+        while (m_active) {
+            packer.Clear();
+            for (size_t i = 0; i < m_mailboxes.size(); i++) {
+                if (m_mailboxes[i].phase != IDLE) {
+                    AddAccess(packer, i);
+                }
+            }
+            m_stats.steps++;
+            steps++;
+            if (!packer.Send(transport)) {
+                LogError() << "Error: Mailbox frame could not be sent";
+                return false;
+            }
+            packer.Receive(transport, m_settings.frameTimeoutUs);
+            bool bProgress = Process(packer);
+            Activate();
+            if (!bProgress && m_active) {
+                std::this_thread::sleep_for(std::chrono::microseconds(m_settings.pollIntervalUs));
+            }
+        }
+        int64_t elapsedNs = CycleTrace::NowNs() - startNs;
+        LogInfo() << "CoE: " << m_stats.transfers - transfers << " SDO transfers on " << m_mailboxes.size()
+                  << " slaves in " << elapsedNs / 1000 / 1000.0 << " ms (" << steps << " frames), "
+                  << m_stats.failed - failed << " failed";
+        return m_stats.failed == failed;
+    }
+
+    // --- Cycle thread, in OP ---
+
+    // Adds the mailbox datagrams that are due and fit the budget; the
+    // rest of the budget polls idle mailboxes in turn
+    void Queue(EtherCATDatagramPacker& packer) {
+        Activate();
+        m_accesses.clear();
+        size_t budget = m_settings.cyclicBudgetBytes;
+        size_t count = m_mailboxes.size();
+        size_t first = m_nextActive;
+        for (size_t n = 0; n < count; n++) {
+            size_t i = (first + n) % count;
+            const Mailbox& mailbox = m_mailboxes[i];
+            if (mailbox.phase == IDLE) {
+                continue;
+            }
+            if (DatagramBytes(AccessLength(mailbox)) > budget) {
+                m_nextActive = i;       // first in the next cycle
+                break;
+            }
+            budget -= AddAccess(packer, i);
+        }
+        first = m_nextPoll;
+        for (size_t n = 0; n < count; n++) {
+            size_t i = (first + n) % count;
+            if (m_mailboxes[i].phase == IDLE) {
+                if (DatagramBytes(m_mailboxes[i].inSize) > budget) {
+                    break;
+                }
+                budget -= AddAccess(packer, i);
+                m_nextPoll = i + 1;
+            }
+        }
+        if (!m_accesses.empty()) {
+            m_stats.steps++;
+        }
+    }
+
+    void Complete(const EtherCATDatagramPacker& packer) {
+        Process(packer);
+    }
+};
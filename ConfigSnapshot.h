@@ -0,0 +1,511 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <string>
+#include <system_error>
+#include <vector>
+#include "EtherCATConfig.h"
+#include "EtherCATFrame.h"
+#include "Logger.h"
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+// A parsed configuration kept next to its source as <config>.snap, so a
+// restart with an unchanged file maps the tables instead of parsing XML
+// again. The snapshot is only used while the source has the size and
+// modification time it was written for; anything else reparses and
+// rewrites it.
+//
+// File layout, little-endian 32-bit words:
+//   header   magic "ECSN", version, source size (2 words), source mtime
+//            (2 words), payload bytes, payload checksum
+//   scalars  cycle time, priority, CPU affinity, DC enabled, DC shift,
+//            input address and size, output address and size, expected
+//            WKC, log file and topology cache (string refs), recorder
+//            directory (string ref), files and file size, shared image
+//            accepts outputs, frame timeout and retries
+//   tables   offset and count of slaves, PDOs, PDO entries, init
+//            commands, CoE commands, segments, init data and string
+//            pool, offsets from the file start
+// Records are fixed-size word arrays; strings are (offset, length) refs
+// into the string pool.
+class ConfigSnapshot {
+public:
+    static const uint32_t kMagic = 0x4E534345;     // "ECSN"
+    static const uint32_t kVersion = 7;
+
+private:
+    static const size_t kHeaderWords = 8;
+    static const size_t kScalarWords = 21;
+    static const size_t kTableCount = 8;
+    static const size_t kPrefixBytes = (kHeaderWords + kScalarWords + kTableCount * 2) * 4;
+    static const size_t kSlaveWords = 10;
+    static const size_t kPdoWords = 8;
+    static const size_t kEntryWords = 7;
+    static const size_t kCommandWords = 10;
+    static const size_t kCoeCommandWords = 9;
+    static const size_t kSegmentWords = 4;
+
+    enum Table {
+        TableSlaves, TablePdos, TableEntries, TableCommands, TableCoeCommands, TableSegments, TableInitData,
+        TableStrings
+    };
+
+    // Read-only view of a whole file: mapped on Linux, read into memory on Windows
+    class FileView {
+    private:
+        const uint8_t* m_pData;
+        size_t m_size;
+        std::vector<uint8_t> m_buffer;
+#ifndef _WIN32
+        void* m_pMapping;
+#endif
+
+    public:
+        FileView() : m_pData(nullptr), m_size(0) {
+#ifndef _WIN32
+            m_pMapping = nullptr;
+#endif
+        }
+
+        ~FileView() {
+#ifndef _WIN32
+            if (m_pMapping) {
+                munmap(m_pMapping, m_size);
+            }
+#endif
+        }
+
+        FileView(const FileView&) = delete;
+        FileView& operator=(const FileView&) = delete;
+
+        bool Open(const std::string& path) {
+#ifndef _WIN32
+            int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+            if (fd < 0) {
+                return false;
+            }
+            struct stat info;
+            if (fstat(fd, &info) == 0 && info.st_size > 0) {
+                void* pMapping = mmap(nullptr, static_cast<size_t>(info.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+                if (pMapping != MAP_FAILED) {
+                    m_pMapping = pMapping;
+                    m_pData = static_cast<const uint8_t*>(pMapping);
+                    m_size = static_cast<size_t>(info.st_size);
+                }
+            }
+            close(fd);
+            return m_pData != nullptr;
+#else
+            std::ifstream file(path, std::ios::binary | std::ios::ate);
+            if (!file) {
+                return false;
+            }
+            m_buffer.resize(static_cast<size_t>(file.tellg()));
+            file.seekg(0);
+            if (m_buffer.empty() || !file.read(reinterpret_cast<char*>(m_buffer.data()),
+                                               static_cast<std::streamsize>(m_buffer.size()))) {
+                return false;
+            }
+            m_pData = m_buffer.data();
+            m_size = m_buffer.size();
+            return true;
+#endif
+        }
+
+        const uint8_t* GetData() const {
+            return m_pData;
+        }
+
+        size_t GetSize() const {
+            return m_size;
+        }
+    };
+
+    // Appends words and pooled strings while the snapshot is built
+    class Writer {
+    private:
+        std::vector<uint8_t>& m_bytes;
+        std::vector<uint8_t>& m_strings;
+
+    public:
+        Writer(std::vector<uint8_t>& bytes, std::vector<uint8_t>& strings) : m_bytes(bytes), m_strings(strings) {}
+
+        void Word(uint32_t value) {
+            size_t at = m_bytes.size();
+            m_bytes.resize(at + 4);
+            EcatPut32(&m_bytes[at], value);
+        }
+
+        void String(const std::string& value) {
+            Word(static_cast<uint32_t>(m_strings.size()));
+            Word(static_cast<uint32_t>(value.size()));
+            m_strings.insert(m_strings.end(), value.begin(), value.end());
+        }
+    };
+
+    // Walks the records of one table, bounds checked against the file
+    class Reader {
+    private:
+        const uint8_t* m_p;
+        const uint8_t* m_pStrings;
+        uint32_t m_stringBytes;
+        bool m_bOk;
+
+    public:
+        Reader(const uint8_t* p, const uint8_t* pStrings, uint32_t stringBytes)
+            : m_p(p), m_pStrings(pStrings), m_stringBytes(stringBytes), m_bOk(true) {}
+
+        uint32_t Word() {
+            uint32_t value = EcatGet32(m_p);
+            m_p += 4;
+            return value;
+        }
+
+        std::string String() {
+            uint32_t offset = Word();
+            uint32_t length = Word();
+            if (offset > m_stringBytes || length > m_stringBytes - offset) {
+                m_bOk = false;
+                return std::string();
+            }
+            return std::string(reinterpret_cast<const char*>(m_pStrings + offset), length);
+        }
+
+        bool IsOk() const {
+            return m_bOk;
+        }
+    };
+
+    static uint32_t Fnv1a(const uint8_t* pData, size_t length) {
+        uint32_t hash = 2166136261u;
+        for (size_t i = 0; i < length; i++) {
+            hash = (hash ^ pData[i]) * 16777619u;
+        }
+        return hash;
+    }
+
+    // Size and modification time (nanoseconds) of the source file
+    static bool Stamp(const std::string& path, uint64_t& size, uint64_t& mtime) {
+        std::error_code error;
+        size = std::filesystem::file_size(path, error);
+        if (error) {
+            return false;
+        }
+        std::filesystem::file_time_type time = std::filesystem::last_write_time(path, error);
+        if (error) {
+            return false;
+        }
+        mtime = static_cast<uint64_t>(
+            std::chrono::duration_cast<std::chrono::nanoseconds>(time.time_since_epoch()).count());
+        return true;
+    }
+
+    static void PutTable(std::vector<uint8_t>& bytes, size_t table, size_t offset, size_t count) {
+        size_t at = (kHeaderWords + kScalarWords + table * 2) * 4;
+        EcatPut32(&bytes[at], static_cast<uint32_t>(offset));
+        EcatPut32(&bytes[at + 4], static_cast<uint32_t>(count));
+    }
+
+public:
+    static std::string PathFor(const std::string& configPath) {
+        return configPath + ".snap";
+    }
+
+    // False if there is no snapshot or it does not match the source
+    static bool Load(const std::string& configPath, EtherCATConfig& config) {
+        uint64_t sourceSize;
+        uint64_t sourceMtime;
+        FileView view;
+        if (!Stamp(configPath, sourceSize, sourceMtime) || !view.Open(PathFor(configPath))) {
+            return false;
+        }
+        const uint8_t* p = view.GetData();
+        size_t size = view.GetSize();
+        if (size < kPrefixBytes || EcatGet32(p) != kMagic || EcatGet32(p + 4) != kVersion ||
+            EcatGet32(p + 8) != static_cast<uint32_t>(sourceSize) ||
+            EcatGet32(p + 12) != static_cast<uint32_t>(sourceSize >> 32) ||
+            EcatGet32(p + 16) != static_cast<uint32_t>(sourceMtime) ||
+            EcatGet32(p + 20) != static_cast<uint32_t>(sourceMtime >> 32) ||
+            EcatGet32(p + 24) != size - kHeaderWords * 4 ||
+            EcatGet32(p + 28) != Fnv1a(p + kHeaderWords * 4, size - kHeaderWords * 4)) {
+            return false;
+        }
+
+        static const size_t kRecordBytes[kTableCount] = { kSlaveWords * 4, kPdoWords * 4, kEntryWords * 4,
+                                                          kCommandWords * 4, kCoeCommandWords * 4,
+                                                          kSegmentWords * 4, 1, 1 };
+        const uint8_t* pTables[kTableCount];
+        uint32_t counts[kTableCount];
+        for (size_t table = 0; table < kTableCount; table++) {
+            const uint8_t* pDescriptor = p + (kHeaderWords + kScalarWords + table * 2) * 4;
+            uint32_t offset = EcatGet32(pDescriptor);
+            counts[table] = EcatGet32(pDescriptor + 4);
+            if (offset > size || counts[table] > (size - offset) / kRecordBytes[table]) {
+                return false;
+            }
+            pTables[table] = p + offset;
+        }
+
+        const uint8_t* pStrings = pTables[TableStrings];
+        uint32_t stringBytes = counts[TableStrings];
+        EtherCATConfig loaded;
+        Reader scalars(p + kHeaderWords * 4, pStrings, stringBytes);
+        loaded.cycleTimeUs = scalars.Word();
+        loaded.priority = static_cast<int>(scalars.Word());
+        loaded.cpuAffinity = static_cast<int>(scalars.Word());
+        loaded.dcEnabled = scalars.Word() != 0;
+        loaded.dcShiftUs = scalars.Word();
+        loaded.inputAddress = scalars.Word();
+        loaded.inputSize = scalars.Word();
+        loaded.outputAddress = scalars.Word();
+        loaded.outputSize = scalars.Word();
+        loaded.expectedWkc = static_cast<uint16_t>(scalars.Word());
+        loaded.logFile = scalars.String();
+        loaded.topologyCache = scalars.String();
+        loaded.recorderDirectory = scalars.String();
+        loaded.recorderFiles = scalars.Word();
+        loaded.recorderFileMB = scalars.Word();
+        loaded.sharedImageOutputs = scalars.Word() != 0;
+        loaded.frameTimeoutUs = scalars.Word();
+        loaded.frameRetries = scalars.Word();
+
+        Reader slaves(pTables[TableSlaves], pStrings, stringBytes);
+        loaded.slaves.resize(counts[TableSlaves]);
+        for (EtherCATSlaveConfig& slave : loaded.slaves) {
+            slave.position = static_cast<uint16_t>(slaves.Word());
+            slave.vendorId = slaves.Word();
+            slave.productCode = slaves.Word();
+            slave.inputSize = static_cast<uint16_t>(slaves.Word());
+            slave.outputSize = static_cast<uint16_t>(slaves.Word());
+            slave.stateTimeoutMs = slaves.Word();
+            slave.revision = slaves.Word();
+            slave.stationAddress = static_cast<uint16_t>(slaves.Word());
+            slave.name = slaves.String();
+        }
+
+        Reader pdos(pTables[TablePdos], pStrings, stringBytes);
+        loaded.pdos.resize(counts[TablePdos]);
+        for (EtherCATPdoConfig& pdo : loaded.pdos) {
+            pdo.slave = static_cast<uint16_t>(pdos.Word());
+            pdo.index = static_cast<uint16_t>(pdos.Word());
+            pdo.bInput = pdos.Word() != 0;
+            pdo.syncManager = static_cast<int8_t>(pdos.Word());
+            pdo.firstEntry = pdos.Word();
+            pdo.entryCount = pdos.Word();
+            pdo.name = pdos.String();
+        }
+
+        Reader entries(pTables[TableEntries], pStrings, stringBytes);
+        loaded.pdoEntries.resize(counts[TableEntries]);
+        for (EtherCATPdoEntryConfig& entry : loaded.pdoEntries) {
+            entry.index = static_cast<uint16_t>(entries.Word());
+            entry.subIndex = static_cast<uint8_t>(entries.Word());
+            entry.bitLength = static_cast<uint8_t>(entries.Word());
+            entry.name = entries.String();
+            entry.dataType = entries.String();
+        }
+
+        Reader commands(pTables[TableCommands], pStrings, stringBytes);
+        loaded.initCommands.resize(counts[TableCommands]);
+        for (EtherCATInitCommand& command : loaded.initCommands) {
+            command.slave = static_cast<int32_t>(commands.Word());
+            command.transitions = static_cast<uint16_t>(commands.Word());
+            command.command = static_cast<uint8_t>(commands.Word());
+            command.adp = static_cast<uint16_t>(commands.Word());
+            command.ado = static_cast<uint16_t>(commands.Word());
+            command.dataOffset = commands.Word();
+            command.dataLength = static_cast<uint16_t>(commands.Word());
+            command.expectedWkc = static_cast<uint16_t>(commands.Word());
+            command.retries = static_cast<uint16_t>(commands.Word());
+            command.timeoutMs = commands.Word();
+        }
+        Reader coeCommands(pTables[TableCoeCommands], pStrings, stringBytes);
+        loaded.coeCommands.resize(counts[TableCoeCommands]);
+        for (EtherCATCoeCommand& command : loaded.coeCommands) {
+            command.slave = static_cast<uint16_t>(coeCommands.Word());
+            command.transitions = static_cast<uint16_t>(coeCommands.Word());
+            command.bUpload = coeCommands.Word() != 0;
+            command.bCompleteAccess = coeCommands.Word() != 0;
+            command.index = static_cast<uint16_t>(coeCommands.Word());
+            command.subIndex = static_cast<uint8_t>(coeCommands.Word());
+            command.dataOffset = coeCommands.Word();
+            command.dataLength = coeCommands.Word();
+            command.timeoutMs = coeCommands.Word();
+        }
+        Reader segments(pTables[TableSegments], pStrings, stringBytes);
+        loaded.segments.resize(counts[TableSegments]);
+        for (EtherCATSegmentConfig& segment : loaded.segments) {
+            segment.adapter = segments.String();
+            segment.config = segments.String();
+        }
+        loaded.initData.assign(pTables[TableInitData], pTables[TableInitData] + counts[TableInitData]);
+
+        if (!scalars.IsOk() || !slaves.IsOk() || !pdos.IsOk() || !entries.IsOk() || !segments.IsOk()) {
+            return false;
+        }
+        config = std::move(loaded);
+        return true;
+    }
+
+    // Written to a temporary file and renamed, like the topology cache
+    static bool Save(const std::string& configPath, const EtherCATConfig& config) {
+        uint64_t sourceSize;
+        uint64_t sourceMtime;
+        if (!Stamp(configPath, sourceSize, sourceMtime)) {
+            return false;
+        }
+        std::vector<uint8_t> bytes;
+        std::vector<uint8_t> strings;
+        Writer writer(bytes, strings);
+        writer.Word(kMagic);
+        writer.Word(kVersion);
+        writer.Word(static_cast<uint32_t>(sourceSize));
+        writer.Word(static_cast<uint32_t>(sourceSize >> 32));
+        writer.Word(static_cast<uint32_t>(sourceMtime));
+        writer.Word(static_cast<uint32_t>(sourceMtime >> 32));
+        writer.Word(0);                         // payload bytes and checksum, set last
+        writer.Word(0);
+
+        writer.Word(static_cast<uint32_t>(config.cycleTimeUs));
+        writer.Word(static_cast<uint32_t>(config.priority));
+        writer.Word(static_cast<uint32_t>(config.cpuAffinity));
+        writer.Word(config.dcEnabled ? 1 : 0);
+        writer.Word(static_cast<uint32_t>(config.dcShiftUs));
+        writer.Word(config.inputAddress);
+        writer.Word(config.inputSize);
+        writer.Word(config.outputAddress);
+        writer.Word(config.outputSize);
+        writer.Word(config.expectedWkc);
+        writer.String(config.logFile);
+        writer.String(config.topologyCache);
+        writer.String(config.recorderDirectory);
+        writer.Word(static_cast<uint32_t>(config.recorderFiles));
+        writer.Word(static_cast<uint32_t>(config.recorderFileMB));
+        writer.Word(config.sharedImageOutputs ? 1 : 0);
+        writer.Word(static_cast<uint32_t>(config.frameTimeoutUs));
+        writer.Word(static_cast<uint32_t>(config.frameRetries));
+        bytes.resize(kPrefixBytes, 0);
+
+        PutTable(bytes, TableSlaves, bytes.size(), config.slaves.size());
+        for (const EtherCATSlaveConfig& slave : config.slaves) {
+            writer.Word(slave.position);
+            writer.Word(slave.vendorId);
+            writer.Word(slave.productCode);
+            writer.Word(slave.inputSize);
+            writer.Word(slave.outputSize);
+            writer.Word(slave.stateTimeoutMs);
+            writer.Word(slave.revision);
+            writer.Word(slave.stationAddress);
+            writer.String(slave.name);
+        }
+        PutTable(bytes, TablePdos, bytes.size(), config.pdos.size());
+        for (const EtherCATPdoConfig& pdo : config.pdos) {
+            writer.Word(pdo.slave);
+            writer.Word(pdo.index);
+            writer.Word(pdo.bInput ? 1 : 0);
+            writer.Word(static_cast<uint32_t>(static_cast<int32_t>(pdo.syncManager)));
+            writer.Word(pdo.firstEntry);
+            writer.Word(pdo.entryCount);
+            writer.String(pdo.name);
+        }
+        PutTable(bytes, TableEntries, bytes.size(), config.pdoEntries.size());
+        for (const EtherCATPdoEntryConfig& entry : config.pdoEntries) {
+            writer.Word(entry.index);
+            writer.Word(entry.subIndex);
+            writer.Word(entry.bitLength);
+            writer.String(entry.name);
+            writer.String(entry.dataType);
+        }
+        PutTable(bytes, TableCommands, bytes.size(), config.initCommands.size());
+        for (const EtherCATInitCommand& command : config.initCommands) {
+            writer.Word(static_cast<uint32_t>(command.slave));
+            writer.Word(command.transitions);
+            writer.Word(command.command);
+            writer.Word(command.adp);
+            writer.Word(command.ado);
+            writer.Word(command.dataOffset);
+            writer.Word(command.dataLength);
+            writer.Word(command.expectedWkc);
+            writer.Word(command.retries);
+            writer.Word(command.timeoutMs);
+        }
+        PutTable(bytes, TableCoeCommands, bytes.size(), config.coeCommands.size());
+        for (const EtherCATCoeCommand& command : config.coeCommands) {
+            writer.Word(command.slave);
+            writer.Word(command.transitions);
+            writer.Word(command.bUpload ? 1 : 0);
+            writer.Word(command.bCompleteAccess ? 1 : 0);
+            writer.Word(command.index);
+            writer.Word(command.subIndex);
+            writer.Word(command.dataOffset);
+            writer.Word(command.dataLength);
+            writer.Word(command.timeoutMs);
+        }
+        PutTable(bytes, TableSegments, bytes.size(), config.segments.size());
+        for (const EtherCATSegmentConfig& segment : config.segments) {
+            writer.String(segment.adapter);
+            writer.String(segment.config);
+        }
+        PutTable(bytes, TableInitData, bytes.size(), config.initData.size());
+        bytes.insert(bytes.end(), config.initData.begin(), config.initData.end());
+        PutTable(bytes, TableStrings, bytes.size(), strings.size());
+        bytes.insert(bytes.end(), strings.begin(), strings.end());
+
+        EcatPut32(&bytes[24], static_cast<uint32_t>(bytes.size() - kHeaderWords * 4));
+        EcatPut32(&bytes[28], Fnv1a(bytes.data() + kHeaderWords * 4, bytes.size() - kHeaderWords * 4));
+
+        std::string path = PathFor(configPath);
+        std::string temporary = path + ".tmp";
+        {
+            std::ofstream file(temporary, std::ios::binary | std::ios::trunc);
+            if (!file.write(reinterpret_cast<const char*>(bytes.data()), static_cast<std::streamsize>(bytes.size()))) {
+                LogWarning() << "Warning: Cannot write configuration snapshot '" << temporary << "'";
+                return false;
+            }
+        }
+#ifdef _WIN32
+        std::remove(path.c_str());      // rename does not replace there
+#endif
+        if (std::rename(temporary.c_str(), path.c_str()) != 0) {
+            LogWarning() << "Warning: Cannot replace configuration snapshot '" << path << "'";
+            return false;
+        }
+        return true;
+    }
+
+    // The snapshot if it is current, otherwise the XML (ethercat_config.xml
+    // or an ENI) parsed and snapshotted for the next start
+    static bool LoadConfig(const std::string& configPath, EtherCATConfig& config) {
+        auto start = std::chrono::steady_clock::now();
+        if (Load(configPath, config)) {
+            LogInfo() << "Configuration '" << configPath << "' loaded from snapshot in "
+                      << ElapsedMs(start) << " ms (" << config.slaves.size() << " slaves)";
+            return true;
+        }
+        if (!config.Load(configPath)) {
+            return false;
+        }
+        LogInfo() << "Configuration '" << configPath << "' parsed in " << ElapsedMs(start) << " ms ("
+                  << config.slaves.size() << " slaves, " << config.pdos.size() << " PDOs, "
+                  << config.initCommands.size() << " init commands, " << config.coeCommands.size()
+                  << " CoE commands)";
+        Save(configPath, config);
+        return true;
+    }
+
+private:
+    static double ElapsedMs(std::chrono::steady_clock::time_point start) {
+        return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start)
+                   .count() / 1000.0;
+    }
+};
@@ -0,0 +1,35 @@
+#pragma once
+
+// Console helpers used by the interactive loops: Sleep(), _kbhit() and
+// _getch() from <windows.h>/<conio.h>, with POSIX equivalents elsewhere.
+
+#ifdef _WIN32
+#include <windows.h>
+#include <conio.h>
+#else
+#include <sys/select.h>
+#include <unistd.h>
+#include <chrono>
+#include <cstdio>
+#include <thread>
+
+inline void Sleep(unsigned long milliseconds) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(milliseconds));
+}
+
+// The terminal stays in line mode, so keys arrive after Enter, as the
+// Windows prompts already ask for ("Press 'q' + Enter")
+inline int _kbhit() {
+    fd_set fds;
+    FD_ZERO(&fds);
+    FD_SET(STDIN_FILENO, &fds);
+    timeval timeout = { 0, 0 };
+    return select(STDIN_FILENO + 1, &fds, nullptr, nullptr, &timeout) > 0;
+}
+
+inline int _getch() {
+    int c = getchar();
+    // A closed stdin (service, pipe) means nobody can ever press 'q'
+    return c == EOF ? 'q' : c;
+}
+#endif
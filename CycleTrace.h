@@ -0,0 +1,263 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include "Logger.h"
+#include "SharedSegment.h"
+
+#ifndef _WIN32
+#include <time.h>
+#endif
+
+// One cycle, one cache line. Timestamps are monotonic nanoseconds
+// (CLOCK_MONOTONIC on Linux); 0 means the event did not happen this cycle.
+struct CycleTraceRecord {
+    std::atomic<uint64_t> sequence;   // cycle + 1 once complete, 0 while being written
+    uint64_t cycle;
+    int64_t deadlineNs;
+    int64_t wakeupNs;
+    int64_t txNs;                     // frames handed to the NIC
+    int64_t rxNs;                     // replies collected
+    int64_t endNs;                    // stages finished
+    uint16_t wkc;
+    uint16_t expectedWkc;
+    uint16_t flags;                   // CycleTrace::FLAG_*
+    uint16_t reserved;
+};
+
+// Start of the shared-memory segment, followed by the record ring
+struct CycleTraceHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t recordSize;
+    uint32_t capacity;                // records, power of two
+    int64_t cycleTimeNs;
+    int32_t pid;
+    uint32_t reserved;
+    alignas(64) std::atomic<uint64_t> written;   // records committed so far
+};
+
+// Per-cycle trace ring in shared memory. The cycle thread fills one record
+// in local memory while the cycle runs and copies it into the ring at the
+// end, guarded by a per-record sequence number: no locks, no syscalls, and
+// a reader (ecat_trace) can follow it live from another process. A reader
+// that races with the writer on a slot sees the sequence change and skips
+// that record instead of ever stalling the writer.
+//
+//   cycle thread:  trace.BeginCycle(...); trace.MarkTx(); trace.MarkRx();
+//                  trace.SetWkc(wkc, expected); trace.EndCycle(...);
+//   reader:        trace.Open(name); trace.Read(index, record);
+class CycleTrace {
+public:
+    static const uint32_t kMagic = 0x52544345;     // "ECTR"
+    static const uint32_t kVersion = 1;
+    static const uint32_t kDefaultCapacity = 8192;
+
+    static const uint16_t FLAG_OVERRUN = 0x0001;
+    static const uint16_t FLAG_WKC_ERROR = 0x0002;
+    static const uint16_t FLAG_FRAME_LOST = 0x0004;
+
+private:
+    SharedSegment m_segment;
+    CycleTraceHeader* m_pHeader;
+    CycleTraceRecord* m_pRecords;
+
+    // Writer-side record of the running cycle
+    uint64_t m_cycle;
+    int64_t m_deadlineNs;
+    int64_t m_wakeupNs;
+    int64_t m_txNs;
+    int64_t m_rxNs;
+    uint16_t m_wkc;
+    uint16_t m_expectedWkc;
+    uint16_t m_flags;
+
+    static std::string SegmentName(const std::string& name) {
+        return SharedSegment::FullName("ecat_trace_", name);
+    }
+
+    void SetAreas() {
+        m_pHeader = static_cast<CycleTraceHeader*>(m_segment.GetData());
+        m_pRecords = reinterpret_cast<CycleTraceRecord*>(
+            reinterpret_cast<uint8_t*>(m_pHeader) + sizeof(CycleTraceHeader));
+    }
+
+public:
+    CycleTrace()
+        : m_pHeader(nullptr), m_pRecords(nullptr), m_cycle(0), m_deadlineNs(0), m_wakeupNs(0), m_txNs(0), m_rxNs(0),
+          m_wkc(0), m_expectedWkc(0), m_flags(0) {}
+
+    ~CycleTrace() {
+        Close();
+    }
+
+    CycleTrace(const CycleTrace&) = delete;
+    CycleTrace& operator=(const CycleTrace&) = delete;
+
+    // Same clock as CyclicExecutor
+    static int64_t NowNs() {
+#ifdef _WIN32
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+#else
+        timespec ts;
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        return static_cast<int64_t>(ts.tv_sec) * 1000000000LL + ts.tv_nsec;
+#endif
+    }
+
+    // Writer: creates (or replaces) the segment. capacity is rounded up to
+    // a power of two. Call before the cycle thread starts.
+    bool Create(const std::string& name, int64_t cycleTimeNs, uint32_t capacity = kDefaultCapacity) {
+        Close();
+        uint32_t rounded = 1;
+        while (rounded < capacity) {
+            rounded <<= 1;
+        }
+        if (!m_segment.Create(SegmentName(name),
+                              sizeof(CycleTraceHeader) + static_cast<size_t>(rounded) * sizeof(CycleTraceRecord))) {
+            LogWarning() << "Warning: Cannot create trace segment '" << SegmentName(name) << "'";
+            return false;
+        }
+        SetAreas();
+        memset(static_cast<void*>(m_pHeader), 0, m_segment.GetSize());
+        m_pHeader->version = kVersion;
+        m_pHeader->recordSize = sizeof(CycleTraceRecord);
+        m_pHeader->capacity = rounded;
+        m_pHeader->cycleTimeNs = cycleTimeNs;
+        m_pHeader->pid = SharedSegment::CurrentPid();
+        std::atomic_thread_fence(std::memory_order_release);
+        m_pHeader->magic = kMagic;
+        return true;
+    }
+
+    // Reader: attaches read-only to a segment created by another process
+    bool Open(const std::string& name) {
+        Close();
+        if (!m_segment.Open(SegmentName(name), false, sizeof(CycleTraceHeader))) {
+            return false;
+        }
+        SetAreas();
+        if (m_pHeader->magic != kMagic || m_pHeader->version != kVersion ||
+            m_pHeader->recordSize != sizeof(CycleTraceRecord) ||
+            sizeof(CycleTraceHeader) + static_cast<size_t>(m_pHeader->capacity) * sizeof(CycleTraceRecord) >
+                m_segment.GetSize()) {
+            LogError() << "Error: '" << SegmentName(name) << "' is not a compatible trace segment";
+            Close();
+            return false;
+        }
+        return true;
+    }
+
+    // The creator also removes the segment name
+    void Close() {
+        m_segment.Close();
+        m_pHeader = nullptr;
+        m_pRecords = nullptr;
+    }
+
+    bool IsOpen() const {
+        return m_pHeader != nullptr;
+    }
+
+    // --- Cycle thread ---
+
+    void BeginCycle(uint64_t cycle, int64_t deadlineNs, int64_t wakeupNs) {
+        m_cycle = cycle;
+        m_deadlineNs = deadlineNs;
+        m_wakeupNs = wakeupNs;
+        m_txNs = 0;
+        m_rxNs = 0;
+        m_wkc = 0;
+        m_expectedWkc = 0;
+        m_flags = 0;
+    }
+
+    void MarkTx() {
+        m_txNs = NowNs();
+    }
+
+    void MarkRx() {
+        m_rxNs = NowNs();
+    }
+
+    void MarkFrameLost() {
+        m_flags |= FLAG_FRAME_LOST;
+    }
+
+    void SetWkc(uint16_t wkc, uint16_t expectedWkc) {
+        m_wkc = wkc;
+        m_expectedWkc = expectedWkc;
+        if (wkc != expectedWkc) {
+            m_flags |= FLAG_WKC_ERROR;
+        }
+    }
+
+    void EndCycle(int64_t endNs, bool bOverrun) {
+        if (!m_pHeader) {
+            return;
+        }
+        uint64_t index = m_pHeader->written.load(std::memory_order_relaxed);
+        CycleTraceRecord& record = m_pRecords[index & (m_pHeader->capacity - 1)];
+
+        record.sequence.store(0, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        record.cycle = m_cycle;
+        record.deadlineNs = m_deadlineNs;
+        record.wakeupNs = m_wakeupNs;
+        record.txNs = m_txNs;
+        record.rxNs = m_rxNs;
+        record.endNs = endNs;
+        record.wkc = m_wkc;
+        record.expectedWkc = m_expectedWkc;
+        record.flags = static_cast<uint16_t>(m_flags | (bOverrun ? FLAG_OVERRUN : 0));
+        record.sequence.store(m_cycle + 1, std::memory_order_release);
+        m_pHeader->written.store(index + 1, std::memory_order_release);
+    }
+
+    // --- Reader ---
+
+    uint64_t GetWritten() const {
+        return m_pHeader ? m_pHeader->written.load(std::memory_order_acquire) : 0;
+    }
+
+    uint32_t GetCapacity() const {
+        return m_pHeader ? m_pHeader->capacity : 0;
+    }
+
+    int64_t GetCycleTimeNs() const {
+        return m_pHeader ? m_pHeader->cycleTimeNs : 0;
+    }
+
+    int32_t GetWriterPid() const {
+        return m_pHeader ? m_pHeader->pid : 0;
+    }
+
+    // Copies record number index (0 = first ever written). False if it is
+    // not written yet, already overwritten, or was overwritten mid-copy.
+    bool Read(uint64_t index, CycleTraceRecord& record) const {
+        uint64_t written = GetWritten();
+        if (index >= written || written - index > m_pHeader->capacity) {
+            return false;
+        }
+        const CycleTraceRecord& slot = m_pRecords[index & (m_pHeader->capacity - 1)];
+        uint64_t before = slot.sequence.load(std::memory_order_acquire);
+        record.cycle = slot.cycle;
+        record.deadlineNs = slot.deadlineNs;
+        record.wakeupNs = slot.wakeupNs;
+        record.txNs = slot.txNs;
+        record.rxNs = slot.rxNs;
+        record.endNs = slot.endNs;
+        record.wkc = slot.wkc;
+        record.expectedWkc = slot.expectedWkc;
+        record.flags = slot.flags;
+        std::atomic_thread_fence(std::memory_order_acquire);
+        uint64_t after = slot.sequence.load(std::memory_order_relaxed);
+        record.sequence.store(after, std::memory_order_relaxed);
+        return before != 0 && before == after && before == record.cycle + 1 &&
+               GetWritten() - index <= m_pHeader->capacity;
+    }
+};
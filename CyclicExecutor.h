@@ -0,0 +1,411 @@
+#pragma once
+
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include "CycleTrace.h"
+#include "Logger.h"
+#include "RtMemory.h"
+
+#ifdef _WIN32
+#include <windows.h>
+#pragma comment(lib, "winmm.lib")
+#else
+#include <pthread.h>
+#include <sched.h>
+#include <sys/mman.h>
+#include <time.h>
+#endif
+
+// Latency histogram with 1 µs buckets. Record() is wait-free and may run on
+// the cycle thread while another thread calls Summarize().
+class JitterHistogram {
+public:
+    static const size_t kBuckets = 2000;   // last bucket collects >= 1999 µs
+
+    struct Summary {
+        uint64_t samples;
+        int64_t minNs;
+        int64_t maxNs;
+        int64_t meanNs;
+        int64_t p50Ns;
+        int64_t p99Ns;
+        int64_t p999Ns;
+    };
+
+private:
+    std::atomic<uint64_t> m_counts[kBuckets];
+    std::atomic<int64_t> m_sumNs;
+    std::atomic<int64_t> m_minNs;
+    std::atomic<int64_t> m_maxNs;
+
+    // Upper edge of the bucket holding the given fraction of samples
+    int64_t Percentile(const uint64_t* pCounts, uint64_t samples, double fraction, int64_t maxNs) const {
+        uint64_t target = static_cast<uint64_t>(fraction * static_cast<double>(samples));
+        uint64_t seen = 0;
+        for (size_t i = 0; i < kBuckets - 1; i++) {
+            seen += pCounts[i];
+            if (seen > target) {
+                int64_t edge = static_cast<int64_t>(i + 1) * 1000;
+                return edge < maxNs ? edge : maxNs;
+            }
+        }
+        return maxNs;
+    }
+
+public:
+    JitterHistogram() {
+        Reset();
+    }
+
+    // Not safe against a concurrent Record()
+    void Reset() {
+        for (size_t i = 0; i < kBuckets; i++) {
+            m_counts[i].store(0, std::memory_order_relaxed);
+        }
+        m_sumNs.store(0, std::memory_order_relaxed);
+        m_minNs.store(INT64_MAX, std::memory_order_relaxed);
+        m_maxNs.store(0, std::memory_order_relaxed);
+    }
+
+    // Single writer, so plain load/store pairs are enough for min/max
+    void Record(int64_t ns) {
+        if (ns < 0) {
+            ns = 0;
+        }
+        size_t bucket = static_cast<size_t>(ns / 1000);
+        if (bucket >= kBuckets) {
+            bucket = kBuckets - 1;
+        }
+        m_counts[bucket].fetch_add(1, std::memory_order_relaxed);
+        m_sumNs.fetch_add(ns, std::memory_order_relaxed);
+        if (ns < m_minNs.load(std::memory_order_relaxed)) {
+            m_minNs.store(ns, std::memory_order_relaxed);
+        }
+        if (ns > m_maxNs.load(std::memory_order_relaxed)) {
+            m_maxNs.store(ns, std::memory_order_relaxed);
+        }
+    }
+
+    Summary Summarize() const {
+        Summary summary = {};
+        uint64_t counts[kBuckets];
+        uint64_t total = 0;
+        for (size_t i = 0; i < kBuckets; i++) {
+            counts[i] = m_counts[i].load(std::memory_order_relaxed);
+            total += counts[i];
+        }
+        if (total == 0) {
+            return summary;
+        }
+        summary.samples = total;
+        summary.minNs = m_minNs.load(std::memory_order_relaxed);
+        summary.maxNs = m_maxNs.load(std::memory_order_relaxed);
+        summary.meanNs = m_sumNs.load(std::memory_order_relaxed) / static_cast<int64_t>(total);
+        summary.p50Ns = Percentile(counts, total, 0.50, summary.maxNs);
+        summary.p99Ns = Percentile(counts, total, 0.99, summary.maxNs);
+        summary.p999Ns = Percentile(counts, total, 0.999, summary.maxNs);
+        return summary;
+    }
+};
+
+// Runs read/process/write stages on a dedicated thread at a fixed period.
+// Each cycle wakes on an absolute deadline, so sleep and stage overshoot do
+// not accumulate into drift. On Linux the thread runs SCHED_FIFO, pinned to
+// one core, with memory locked; Windows gets TIME_CRITICAL priority and a
+// 1 ms timer resolution as a best effort. Everything from the wake-up to
+// the end of the stages is an RtHeapGuard scope: stages must not allocate.
+class CyclicExecutor {
+public:
+    enum Stage {
+        READ_INPUTS,
+        PROCESS,
+        WRITE_OUTPUTS,
+        STAGE_COUNT
+    };
+
+    struct Settings {
+        unsigned long cycleTimeUs;
+        int priority;        // SCHED_FIFO priority, 0 = leave the scheduler alone
+        int cpuAffinity;     // core to pin to, -1 = any
+        bool lockMemory;     // mlockall() and prefault the stack
+        int64_t startNs;     // first deadline (CycleTrace::NowNs() clock), 0 = one cycle after Start();
+                             // if already past, the next one on its grid
+
+        Settings() : cycleTimeUs(1000), priority(0), cpuAffinity(-1), lockMemory(false), startNs(0) {}
+    };
+
+    struct Stats {
+        uint64_t cycles;
+        uint64_t overruns;       // cycles whose stages ran past the next deadline
+        uint64_t skippedCycles;  // deadlines dropped to recover from overruns
+        JitterHistogram::Summary wakeup;     // actual wake-up minus deadline
+        JitterHistogram::Summary execution;  // time spent in the stages
+    };
+
+private:
+    Settings m_settings;
+    std::function<void()> m_stages[STAGE_COUNT];
+    std::thread m_thread;
+    std::atomic<bool> m_bRunning;
+
+    std::atomic<uint64_t> m_cycles;
+    std::atomic<uint64_t> m_overruns;
+    std::atomic<uint64_t> m_skipped;
+    JitterHistogram m_wakeup;
+    JitterHistogram m_execution;
+    CycleTrace* m_pTrace;
+
+    // Cycle thread only
+    int64_t m_deadlineNs;
+    int64_t m_adjustNs;
+
+    // Start() waits until the thread has applied its real-time settings
+    std::mutex m_startMutex;
+    std::condition_variable m_startCond;
+    bool m_bStarted;
+    bool m_bSchedulerOk;
+    bool m_bAffinityOk;
+    bool m_bMemoryOk;
+
+    static int64_t NowNs() {
+        return CycleTrace::NowNs();
+    }
+
+    static void SleepUntilNs(int64_t deadlineNs) {
+#ifdef _WIN32
+        std::this_thread::sleep_until(std::chrono::steady_clock::time_point(
+            std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+                std::chrono::nanoseconds(deadlineNs))));
+#else
+        timespec ts;
+        ts.tv_sec = static_cast<time_t>(deadlineNs / 1000000000LL);
+        ts.tv_nsec = static_cast<long>(deadlineNs % 1000000000LL);
+        while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, nullptr) == EINTR) {
+        }
+#endif
+    }
+
+    void ApplyRealtimeSettings() {
+#ifdef _WIN32
+        m_bSchedulerOk = (m_settings.priority == 0) ||
+                         SetThreadPriority(GetCurrentThread(), THREAD_PRIORITY_TIME_CRITICAL);
+        m_bAffinityOk = (m_settings.cpuAffinity < 0) ||
+                        SetThreadAffinityMask(GetCurrentThread(),
+                                              static_cast<uintptr_t>(1) << m_settings.cpuAffinity) != 0;
+        m_bMemoryOk = true;
+#else
+        m_bSchedulerOk = true;
+        if (m_settings.priority > 0) {
+            sched_param param = {};
+            param.sched_priority = m_settings.priority;
+            m_bSchedulerOk = pthread_setschedparam(pthread_self(), SCHED_FIFO, &param) == 0;
+        }
+
+        m_bAffinityOk = true;
+        if (m_settings.cpuAffinity >= 0) {
+            cpu_set_t cpus;
+            CPU_ZERO(&cpus);
+            CPU_SET(m_settings.cpuAffinity, &cpus);
+            m_bAffinityOk = pthread_setaffinity_np(pthread_self(), sizeof(cpus), &cpus) == 0;
+        }
+
+        m_bMemoryOk = true;
+        if (m_settings.lockMemory) {
+            m_bMemoryOk = mlockall(MCL_CURRENT | MCL_FUTURE) == 0;
+
+            // Touch the stack now so the first cycles do not page-fault
+            volatile unsigned char stack[64 * 1024];
+            for (size_t i = 0; i < sizeof(stack); i += 4096) {
+                stack[i] = 0;
+            }
+        }
+#endif
+    }
+
+    void Run() {
+        ApplyRealtimeSettings();
+        {
+            std::lock_guard<std::mutex> lock(m_startMutex);
+            m_bStarted = true;
+        }
+        m_startCond.notify_one();
+
+        const int64_t periodNs = static_cast<int64_t>(m_settings.cycleTimeUs) * 1000;
+        int64_t deadline = NowNs() + periodNs;
+        if (m_settings.startNs) {
+            int64_t late = NowNs() - m_settings.startNs;
+            deadline = m_settings.startNs + (late >= 0 ? (late / periodNs + 1) * periodNs : 0);
+        }
+
+        while (m_bRunning.load(std::memory_order_relaxed)) {
+            m_deadlineNs = deadline;
+            SleepUntilNs(deadline);
+            RtHeapGuard::Scope noHeap;
+            int64_t woke = NowNs();
+            m_wakeup.Record(woke - deadline);
+            uint64_t cycle = m_cycles.load(std::memory_order_relaxed);
+            if (m_pTrace) {
+                m_pTrace->BeginCycle(cycle, deadline, woke);
+            }
+
+            for (int i = 0; i < STAGE_COUNT; i++) {
+                if (m_stages[i]) {
+                    m_stages[i]();
+                }
+            }
+
+            int64_t finished = NowNs();
+            m_execution.Record(finished - woke);
+            m_cycles.store(cycle + 1, std::memory_order_relaxed);
+
+            // After an overrun, resume on the next deadline still ahead
+            // instead of running a burst of late cycles back to back
+            deadline += periodNs + m_adjustNs;
+            m_adjustNs = 0;
+            bool bOverrun = finished >= deadline;
+            if (m_pTrace) {
+                m_pTrace->EndCycle(finished, bOverrun);
+            }
+            if (bOverrun) {
+                m_overruns.fetch_add(1, std::memory_order_relaxed);
+                int64_t missed = (finished - deadline) / periodNs + 1;
+                m_skipped.fetch_add(static_cast<uint64_t>(missed), std::memory_order_relaxed);
+                deadline += missed * periodNs;
+            }
+        }
+    }
+
+public:
+    CyclicExecutor()
+        : m_bRunning(false), m_cycles(0), m_overruns(0), m_skipped(0), m_pTrace(nullptr),
+          m_deadlineNs(0), m_adjustNs(0), m_bStarted(false), m_bSchedulerOk(false), m_bAffinityOk(false), m_bMemoryOk(false) {}
+
+    ~CyclicExecutor() {
+        Stop();
+    }
+
+    CyclicExecutor(const CyclicExecutor&) = delete;
+    CyclicExecutor& operator=(const CyclicExecutor&) = delete;
+
+    // Stages run in READ_INPUTS, PROCESS, WRITE_OUTPUTS order every cycle.
+    // Set them before Start(); they run on the cycle thread and must not block.
+    void SetStage(Stage stage, std::function<void()> function) {
+        m_stages[stage] = std::move(function);
+    }
+
+    // Records every cycle into pTrace (nullptr = off). Stages may add TX/RX
+    // times and the working counter to the running record. Set before Start().
+    void SetTrace(CycleTrace* pTrace) {
+        m_pTrace = pTrace;
+    }
+
+    // For stages: the running cycle's deadline, and a one-off shift of the
+    // next one, e.g. to keep the cycle in phase with a DC reference clock.
+    // The period itself never changes.
+    int64_t GetDeadlineNs() const {
+        return m_deadlineNs;
+    }
+
+    void AdjustNextDeadline(int64_t ns) {
+        m_adjustNs += ns;
+    }
+
+    // Starts the cycle thread. Real-time settings that cannot be applied
+    // (usually missing privileges) are reported and the loop runs anyway.
+    bool Start(const Settings& settings) {
+        if (m_bRunning.load()) {
+            return false;
+        }
+        if (settings.cycleTimeUs == 0) {
+            LogError() << "Error: Cycle time must be greater than 0";
+            return false;
+        }
+
+        m_settings = settings;
+        m_cycles.store(0);
+        m_overruns.store(0);
+        m_skipped.store(0);
+        m_adjustNs = 0;
+        m_wakeup.Reset();
+        m_execution.Reset();
+        m_bStarted = false;
+
+#ifdef _WIN32
+        timeBeginPeriod(1);
+#endif
+        m_bRunning.store(true);
+        m_thread = std::thread(&CyclicExecutor::Run, this);
+
+        std::unique_lock<std::mutex> lock(m_startMutex);
+        m_startCond.wait(lock, [this] { return m_bStarted; });
+
+        if (!m_bSchedulerOk) {
+            LogWarning() << "Warning: Could not set real-time priority " << settings.priority
+                         << " for the cycle thread";
+        }
+        if (!m_bAffinityOk) {
+            LogWarning() << "Warning: Could not pin the cycle thread to CPU " << settings.cpuAffinity;
+        }
+        if (!m_bMemoryOk) {
+            LogWarning() << "Warning: Could not lock process memory";
+        }
+        return true;
+    }
+
+    void Stop() {
+        if (!m_bRunning.exchange(false)) {
+            return;
+        }
+        m_thread.join();
+#ifdef _WIN32
+        timeEndPeriod(1);
+#endif
+    }
+
+    bool IsRunning() const {
+        return m_bRunning.load();
+    }
+
+    // True when priority, affinity and memory locking were all applied
+    bool IsRealtime() const {
+        return m_bSchedulerOk && m_bAffinityOk && m_bMemoryOk;
+    }
+
+    Stats GetStats() const {
+        Stats stats;
+        stats.cycles = m_cycles.load(std::memory_order_relaxed);
+        stats.overruns = m_overruns.load(std::memory_order_relaxed);
+        stats.skippedCycles = m_skipped.load(std::memory_order_relaxed);
+        stats.wakeup = m_wakeup.Summarize();
+        stats.execution = m_execution.Summarize();
+        return stats;
+    }
+
+    void PrintStats() const {
+        Stats stats = GetStats();
+        LogInfo() << "\n=== Cycle Statistics ===";
+        LogInfo() << "Cycle time: " << m_settings.cycleTimeUs << " us"
+                  << (IsRealtime() ? " (real-time)" : " (not real-time)");
+        LogInfo() << "Cycles: " << stats.cycles << ", Overruns: " << stats.overruns
+                  << ", Skipped: " << stats.skippedCycles;
+        PrintSummary("Wake-up jitter", stats.wakeup);
+        PrintSummary("Execution time", stats.execution);
+    }
+
+private:
+    static void PrintSummary(const char* label, const JitterHistogram::Summary& summary) {
+        LogInfo() << label << " (us): min " << summary.minNs / 1000.0
+                  << ", mean " << summary.meanNs / 1000.0
+                  << ", p50 " << summary.p50Ns / 1000.0
+                  << ", p99 " << summary.p99Ns / 1000.0
+                  << ", p99.9 " << summary.p999Ns / 1000.0
+                  << ", max " << summary.maxNs / 1000.0;
+    }
+};
@@ -1,30 +1,87 @@
 #include <iostream>
+#include <vector>
+#include <string>
+#include "Logger.h"
+
+#ifdef _WIN32
 #include <windows.h>
 #include <winsock2.h>
 #include <iphlpapi.h>
-#include <vector>
-#include <string>
 
 #pragma comment(lib, "iphlpapi.lib")
 #pragma comment(lib, "ws2_32.lib")
+#else
+#include <ifaddrs.h>
+#include <net/if_arp.h>
+#include <algorithm>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <memory>
+#include <thread>
+#include "ConsoleCompat.h"
+#include "AlStateMachine.h"
+#include "ChangeDetector.h"
+#include "CoeMailbox.h"
+#include "ConfigSnapshot.h"
+#include "CyclicExecutor.h"
+#include "DistributedClocks.h"
+#include "EtherCATConfig.h"
+#include "EtherCATDatagramPacker.h"
+#include "PacketMmapTransport.h"
+#include "ProcessImage.h"
+#include "ProcessRecorder.h"
+#include "RtMemory.h"
+#include "SegmentCoordinator.h"
+#include "SharedProcessImage.h"
+#include "SimulatedTransport.h"
+#include "SlaveConfigurator.h"
+#include "TopologyCache.h"
+#ifdef ECAT_GENERATED_PDO
+#include "EtherCATConfigPdo.h"
+#endif
+#endif
 
 class DirectEtherCATMaster {
 private:
     std::string m_selectedAdapter;
     std::string m_adapterMAC;
+#ifndef _WIN32
+    PacketMmapTransport m_rawTransport;
+    SimulatedSegment m_simulator;
+    SimulatedTransport m_simTransport;
+    FrameTransport* m_pTransport;       // raw engine or simulator
+    RtArena m_arena;                    // cycle buffers; outlives the packer and image
+    EtherCATDatagramPacker m_packer;
+    ProcessImage m_image;
+    std::vector<SlaveInfo> m_slaveInfo;     // from the SII EEPROMs or the topology cache
+    AlStateMachine m_states;
+    SlaveConfigurator m_configurator;
+    DistributedClocks m_clocks;
+    CoeMailbox m_mailbox;
+    uint16_t m_slaveCount;
+    bool m_bDcActive;
+#endif
     
 public:
+#ifndef _WIN32
+    DirectEtherCATMaster()
+        : m_simTransport(m_simulator), m_pTransport(&m_rawTransport), m_slaveCount(0), m_bDcActive(false) {}
+#endif
+
+
     // Structure to hold network adapter information
     struct NetworkAdapter {
         std::string name;
         std::string description;
         std::string macAddress;
         bool isEthernetCapable;
-        DWORD speed;
+        unsigned long speed;    // Mbit/s, 0 if unknown
     };
 
     std::vector<NetworkAdapter> ListNetworkAdapters() {
         std::vector<NetworkAdapter> adapters;
+#ifdef _WIN32
         
         // Get adapter information
         ULONG bufferSize = 0;
@@ -51,26 +108,67 @@ public:
                 // Check if it's Ethernet (exclude loopback, PPP, etc.)
                 adapter.isEthernetCapable = (pAdapter->Type == MIB_IF_TYPE_ETHERNET) ||
                                           (pAdapter->Type == IF_TYPE_IEEE80211); // WiFi
+                adapter.speed = 0;
                 
                 adapters.push_back(adapter);
                 pAdapter = pAdapter->Next;
             }
         }
+#else
+        // One AF_PACKET entry per link-layer interface
+        ifaddrs* pList = nullptr;
+        if (getifaddrs(&pList) == 0) {
+            for (ifaddrs* pEntry = pList; pEntry; pEntry = pEntry->ifa_next) {
+                if (!pEntry->ifa_addr || pEntry->ifa_addr->sa_family != AF_PACKET) {
+                    continue;
+                }
+                const sockaddr_ll* pLink = reinterpret_cast<const sockaddr_ll*>(pEntry->ifa_addr);
+
+                NetworkAdapter adapter;
+                adapter.name = pEntry->ifa_name;
+                adapter.description = pEntry->ifa_name;
+                
+                // Format MAC address
+                char macStr[18];
+                snprintf(macStr, sizeof(macStr), "%02X:%02X:%02X:%02X:%02X:%02X",
+                    pLink->sll_addr[0], pLink->sll_addr[1], pLink->sll_addr[2],
+                    pLink->sll_addr[3], pLink->sll_addr[4], pLink->sll_addr[5]);
+                adapter.macAddress = macStr;
+                
+                adapter.isEthernetCapable = (pLink->sll_hatype == ARPHRD_ETHER) &&
+                                            !(pEntry->ifa_flags & IFF_LOOPBACK);
+
+                // Reported by the driver; virtual links have no speed
+                long speed = 0;
+                std::ifstream speedFile("/sys/class/net/" + adapter.name + "/speed");
+                adapter.speed = (speedFile >> speed && speed > 0) ? static_cast<unsigned long>(speed) : 0;
+                if (!std::ifstream("/sys/class/net/" + adapter.name + "/device")) {
+                    adapter.description += " (Virtual)";
+                }
+
+                adapters.push_back(adapter);
+            }
+            freeifaddrs(pList);
+        }
+#endif
         
         return adapters;
     }
 
     void PrintAvailableAdapters() {
-        std::cout << "\\n=== Available Network Adapters ===" << std::endl;
+        LogInfo() << "\\n=== Available Network Adapters ===";
         auto adapters = ListNetworkAdapters();
         
         int index = 1;
         for (const auto& adapter : adapters) {
-            std::cout << index++ << ". " << adapter.description << std::endl;
-            std::cout << "   Name: " << adapter.name << std::endl;
-            std::cout << "   MAC: " << adapter.macAddress << std::endl;
-            std::cout << "   EtherCAT Capable: " << (adapter.isEthernetCapable ? "Yes" : "No") << std::endl;
-            std::cout << std::endl;
+            LogInfo() << index++ << ". " << adapter.description;
+            LogInfo() << "   Name: " << adapter.name;
+            LogInfo() << "   MAC: " << adapter.macAddress;
+            LogInfo() << "   EtherCAT Capable: " << (adapter.isEthernetCapable ? "Yes" : "No");
+            if (adapter.speed) {
+                LogInfo() << "   Speed: " << adapter.speed << " Mbit/s";
+            }
+            LogInfo() << "";
         }
     }
 
@@ -80,69 +178,678 @@ public:
         for (const auto& adapter : adapters) {
             if (adapter.name == adapterName || adapter.description == adapterName) {
                 if (!adapter.isEthernetCapable) {
-                    std::cerr << "Warning: Selected adapter may not be suitable for EtherCAT" << std::endl;
+                    LogWarning() << "Warning: Selected adapter may not be suitable for EtherCAT";
                 }
                 
                 m_selectedAdapter = adapter.name;
                 m_adapterMAC = adapter.macAddress;
                 
-                std::cout << "Selected adapter: " << adapter.description << std::endl;
-                std::cout << "MAC Address: " << adapter.macAddress << std::endl;
+                LogInfo() << "Selected adapter: " << adapter.description;
+                LogInfo() << "MAC Address: " << adapter.macAddress;
                 return true;
             }
         }
         
-        std::cerr << "Adapter not found: " << adapterName << std::endl;
+        LogError() << "Adapter not found: " << adapterName;
         return false;
     }
 
+#ifndef _WIN32
+    // Per-frame timeout and resends for the exchanges outside the cycle
+    // (<FrameLoss>); in the cycle a frame not back by the next cycle is
+    // given up and the cycle's inputs skipped
+    void SetFrameLoss(const EtherCATConfig& config) {
+        m_packer.SetLossPolicy(config.frameRetries ? EtherCATDatagramPacker::LOSS_RESEND
+                                                   : EtherCATDatagramPacker::LOSS_SKIP,
+                               static_cast<long>(config.frameTimeoutUs), static_cast<unsigned>(config.frameRetries));
+    }
+
+    // Runs against the in-process segment simulator instead of an adapter,
+    // with the <Slaves> from the configuration
+    bool SelectSimulator(const EtherCATConfig& config) {
+        if (config.slaves.empty() || !m_simulator.LoadSlaves(config)) {
+            LogError() << "Error: No <Slaves> to simulate";
+            return false;
+        }
+
+        m_pTransport = &m_simTransport;
+        m_selectedAdapter = "sim";
+        m_adapterMAC = "02:00:00:EC:A7:00";
+        LogInfo() << "Selected adapter: simulated segment";
+        return true;
+    }
+#endif
+
     bool InitializeEtherCAT() {
         if (m_selectedAdapter.empty()) {
-            std::cerr << "No adapter selected! Call SelectAdapter() first." << std::endl;
+            LogError() << "No adapter selected! Call SelectAdapter() first.";
             return false;
         }
 
-        std::cout << "\\n=== Initializing EtherCAT Master ===" << std::endl;
-        std::cout << "Using adapter: " << m_selectedAdapter << std::endl;
-        std::cout << "MAC Address: " << m_adapterMAC << std::endl;
-        
+        LogInfo() << "\\n=== Initializing EtherCAT Master ===";
+        LogInfo() << "Using adapter: " << m_selectedAdapter;
+        LogInfo() << "MAC Address: " << m_adapterMAC;
+
+#ifndef _WIN32
+        // Raw socket with PACKET_MMAP rings: frames are built and parsed
+        // in place, one send() per cycle
+        if (m_pTransport == &m_simTransport) {
+            LogInfo() << "In-process segment simulator (" << m_simulator.GetSlaveCount() << " slaves, "
+                      << m_simulator.GetSettings().forwardingDelayNs << " ns forwarding delay each)";
+        } else if (!m_rawTransport.Open(m_selectedAdapter)) {
+            LogError() << "Failed to open raw Ethernet engine on " << m_selectedAdapter;
+            return false;
+        } else {
+            LogInfo() << "Raw EtherCAT engine open on " << m_selectedAdapter
+                      << " (PACKET_MMAP TX/RX rings, promiscuous)";
+        }
+
+        int slaves = CountSlaves();
+        if (slaves < 0) {
+            LogInfo() << "No EtherCAT frame returned - segment not connected?";
+        } else {
+            LogInfo() << "Slaves responding: " << slaves;
+            m_slaveCount = static_cast<uint16_t>(slaves);
+            ReadSlaveStates(static_cast<uint16_t>(slaves));
+        }
+        return true;
+#else
         // In a real EtherCAT implementation, you would:
         // 1. Open raw socket on the selected adapter
         // 2. Set the adapter to promiscuous mode
         // 3. Initialize EtherCAT frame handling
         // 4. Start the real-time cycle
         
-        std::cout << "\\nEtherCAT Master would be initialized with:" << std::endl;
-        std::cout << "- Raw Ethernet socket on " << m_selectedAdapter << std::endl;
-        std::cout << "- EtherCAT protocol handling" << std::endl;
-        std::cout << "- Real-time cyclic communication" << std::endl;
-        std::cout << "- Slave device management" << std::endl;
+        LogInfo() << "\\nEtherCAT Master would be initialized with:";
+        LogInfo() << "- Raw Ethernet socket on " << m_selectedAdapter;
+        LogInfo() << "- EtherCAT protocol handling";
+        LogInfo() << "- Real-time cyclic communication";
+        LogInfo() << "- Slave device management";
         
+        return true;
+#endif
+    }
+
+#ifndef _WIN32
+    // Broadcast read of the ESC type register: every slave increments the
+    // working counter, so it equals the number of slaves on the segment.
+    // Returns -1 if no frame came back within timeoutUs.
+    int CountSlaves(long timeoutUs = 100000) {
+        size_t capacity = 0;
+        uint8_t* pFrame = m_pTransport->AcquireTx(&capacity);
+        if (!pFrame) {
+            return -1;
+        }
+        const uint8_t index = 0x5A;
+        const uint16_t length = 2;
+        EcatPutEthernetHeader(pFrame, m_pTransport->GetMacAddress());
+        EcatPutFrameHeader(pFrame + ECAT_ETH_HEADER_SIZE,
+                           static_cast<uint16_t>(ECAT_DATAGRAM_HEADER_SIZE + length + ECAT_WKC_SIZE));
+        EcatPutDatagramHeader(pFrame + ECAT_PAYLOAD_OFFSET, ECAT_BRD, index, 0, length, false);
+        m_pTransport->CommitTx(ECAT_PAYLOAD_OFFSET + ECAT_DATAGRAM_HEADER_SIZE + length + ECAT_WKC_SIZE);
+        m_pTransport->Kick();
+
+        while (m_pTransport->WaitRx(timeoutUs)) {
+            size_t rxLength = 0;
+            const uint8_t* pRx = m_pTransport->PollRx(&rxLength);
+            if (!pRx) {
+                continue;
+            }
+            // Our frame comes back with the same datagram index
+            int wkc = -1;
+            const uint8_t* pDatagram = pRx + ECAT_PAYLOAD_OFFSET;
+            if (EcatIsEtherCATFrame(pRx, rxLength) && pDatagram[0] == ECAT_BRD && pDatagram[1] == index) {
+                wkc = EcatGet16(pDatagram + ECAT_DATAGRAM_HEADER_SIZE + length);
+            }
+            m_pTransport->ReleaseRx();
+            if (wkc >= 0) {
+                return wkc;
+            }
+        }
+        return -1;
+    }
+
+    // AL status (0x0130) of every slave by position, packed into as few
+    // frames as possible: 120 slaves fit in two frames
+    bool ReadSlaveStates(uint16_t slaveCount, long timeoutUs = 100000) {
+        m_packer.Clear();
+        for (uint16_t position = 0; position < slaveCount; position++) {
+            uint16_t autoIncrement = static_cast<uint16_t>(-static_cast<int>(position));
+            m_packer.Add(ECAT_APRD, EcatPhysicalAddress(autoIncrement, ESC_REG_AL_STATUS), 2);
+        }
+        if (!m_packer.Send(*m_pTransport)) {
+            LogError() << "Error sending slave state request";
+            return false;
+        }
+        bool bComplete = m_packer.Receive(*m_pTransport, timeoutUs);
+
+        LogInfo() << "\n=== Slave States (" << m_packer.GetFrameCount() << " frame"
+                  << (m_packer.GetFrameCount() == 1 ? "" : "s") << ") ===";
+        for (uint16_t position = 0; position < slaveCount; position++) {
+            if (!m_packer.IsReceived(position) || m_packer.GetWkc(position) != 1) {
+                LogInfo() << "Slave " << position << ": no response";
+                continue;
+            }
+            uint16_t alStatus = EcatGet16(m_packer.GetData(position));
+            LogInfo() << "Slave " << position << " AL status: 0x" << std::hex << (alStatus & 0x1F)
+                      << std::dec << ((alStatus & 0x10) ? " (error)" : "");
+        }
+        return bComplete;
+    }
+
+    // Identity, name and PDO layout of every slave. With a topology cache
+    // that matches <Slaves>, only the identity words are read and compared;
+    // anything else means a full SII scan, which then refreshes the cache.
+    bool ScanSlaves(const EtherCATConfig& config) {
+        LogInfo() << "\n=== Topology ===";
+        int64_t startNs = CycleTrace::NowNs();
+        SiiReader sii;
+        if (!m_slaveCount || !sii.TakeAccess(*m_pTransport, m_packer)) {
+            return false;
+        }
+
+        uint32_t key = TopologyCache::ConfigKey(config);
+        bool bWarm = false;
+        std::vector<SlaveInfo> cached;
+        std::vector<SlaveIdentity> identities;
+        if (!config.topologyCache.empty() && TopologyCache::Load(config.topologyCache, key, cached)) {
+            if (cached.size() != m_slaveCount) {
+                LogInfo() << "Topology cache has " << cached.size() << " slaves, the line " << m_slaveCount;
+            } else if (sii.ReadIdentities(*m_pTransport, m_packer, m_slaveCount, identities)) {
+                bWarm = true;
+                for (uint16_t position = 0; position < m_slaveCount && bWarm; position++) {
+                    if (identities[position] != cached[position].identity) {
+                        LogInfo() << "Slave " << position << " is not the one in the topology cache";
+                        bWarm = false;
+                    }
+                }
+            }
+        }
+        if (bWarm) {
+            m_slaveInfo.swap(cached);
+        } else {
+            if (!sii.ReadAll(*m_pTransport, m_packer, m_slaveCount, m_slaveInfo)) {
+                return false;
+            }
+            if (!config.topologyCache.empty()) {
+                TopologyCache::Save(config.topologyCache, key, m_slaveInfo);
+            }
+        }
+        int64_t elapsedNs = CycleTrace::NowNs() - startNs;
+
+        for (uint16_t position = 0; position < m_slaveCount; position++) {
+            const SlaveInfo& slave = m_slaveInfo[position];
+            LogInfo() << "Slave " << position << ": " << (slave.name.empty() ? "(no name)" : slave.name)
+                      << ", vendor 0x" << std::hex << slave.identity.vendorId << ", product 0x"
+                      << slave.identity.productCode << ", revision 0x" << slave.identity.revision << std::dec
+                      << ", " << slave.inputBits << " input / " << slave.outputBits << " output bits";
+            if (position < config.slaves.size()) {
+                const EtherCATSlaveConfig& expected = config.slaves[position];
+                if (expected.vendorId != slave.identity.vendorId || expected.productCode != slave.identity.productCode) {
+                    LogWarning() << "Warning: Slave " << position << " is not the configured '" << expected.name << "'";
+                }
+            }
+        }
+        LogInfo() << (bWarm ? "Topology from cache, identities checked" : "Full SII scan") << " in "
+                  << elapsedNs / 1000 / 1000.0 << " ms (" << sii.GetSteps() << " EEPROM read steps)";
+        return true;
+    }
+
+    // Runs the CoE init commands of the given transitions, every slave's
+    // queue at once; false if any of them failed
+    bool RunCoeCommands(const EtherCATConfig& config, uint16_t transitions) {
+        for (uint16_t position = 0; position < m_slaveInfo.size(); position++) {
+            m_mailbox.AddSlave(position, m_slaveInfo[position]);
+        }
+        std::vector<size_t> ids;
+        for (const EtherCATCoeCommand& command : config.coeCommands) {
+            if (!(command.transitions & transitions) || command.slave >= config.slaves.size()) {
+                continue;
+            }
+            uint16_t position = config.slaves[command.slave].position;
+            if (command.bUpload) {
+                ids.push_back(m_mailbox.Upload(position, command.index, command.subIndex, command.bCompleteAccess,
+                                               command.timeoutMs));
+            } else {
+                const uint8_t* pData = command.dataLength ? &config.initData[command.dataOffset] : nullptr;
+                ids.push_back(m_mailbox.Download(position, command.index, command.subIndex, pData, command.dataLength,
+                                                 command.bCompleteAccess, command.timeoutMs));
+            }
+        }
+        if (ids.empty()) {
+            return true;
+        }
+        m_mailbox.Run(*m_pTransport, m_packer);
+        for (size_t id : ids) {
+            if (m_mailbox.GetRequest(id).status != CoeMailbox::SDO_DONE) {
+                return false;
+            }
+        }
         return true;
     }
 
+    // Takes every slave to OP, all slaves per step at once. In INIT the
+    // station addresses and mailbox sync managers are written, which the
+    // slaves check on the way to PREOP. In PREOP the CoE init commands for
+    // PREOP->SAFEOP run first, then the process data sync managers and
+    // FMMUs are written, then distributed clocks are set up, so SYNC0 runs
+    // before the slaves check it on the way to SAFEOP. An ENI's register
+    // init commands of a transition take the place of the built-in setup.
+    bool BringUp(const EtherCATConfig& config) {
+        if (!m_slaveCount) {
+            LogError() << "Error: No slaves to bring up";
+            return false;
+        }
+        for (const EtherCATSlaveConfig& slave : config.slaves) {
+            if (slave.stateTimeoutMs) {
+                m_states.SetSlaveTimeout(slave.position, slave.stateTimeoutMs);
+            }
+        }
+        m_bDcActive = false;
+        return m_states.BringUp(*m_pTransport, m_packer, m_slaveCount, ECAT_STATE_OP, [&](uint8_t state) {
+            if (state == ECAT_STATE_PREOP) {
+                if (SlaveConfigurator::HasInitCommands(config, ECAT_TRANSITION_IP)) {
+                    return m_configurator.RunInitCommands(*m_pTransport, m_packer, config, ECAT_TRANSITION_IP);
+                }
+                return m_configurator.ConfigureMailboxes(*m_pTransport, m_packer, config, m_slaveInfo);
+            }
+            if (state == ECAT_STATE_OP) {
+                return m_configurator.RunInitCommands(*m_pTransport, m_packer, config, ECAT_TRANSITION_SO);
+            }
+            if (state != ECAT_STATE_SAFEOP) {
+                return true;
+            }
+            if (!RunCoeCommands(config, ECAT_TRANSITION_PS)) {
+                LogError() << "Error: CoE init commands failed";
+                return false;
+            }
+            bool bConfigured = SlaveConfigurator::HasInitCommands(config, ECAT_TRANSITION_PS)
+                             ? m_configurator.RunInitCommands(*m_pTransport, m_packer, config, ECAT_TRANSITION_PS)
+                             : m_configurator.ConfigureProcessData(*m_pTransport, m_packer, config, m_slaveInfo);
+            if (!bConfigured) {
+                return false;
+            }
+            if (config.dcEnabled) {
+                DistributedClocks::Settings dcSettings;
+                dcSettings.cycleTimeNs = static_cast<uint32_t>(config.cycleTimeUs * 1000);
+                dcSettings.shiftNs = static_cast<uint32_t>(config.dcShiftUs * 1000);
+                m_bDcActive = m_clocks.Configure(*m_pTransport, m_packer, m_slaveCount, dcSettings);
+            }
+            return true;
+        });
+    }
+
+    // Exchanges the process image with one LRW per cycle, as segment index
+    // of the coordinator; runs until the coordinator is stopped. The write
+    // stage sends the LRW, the next cycle's read stage collects it, so the
+    // wire time overlaps the sleep. The application works on the
+    // coordinator's merged image from another thread. With distributed
+    // clocks the same frame carries the ARMW on the reference clock, and
+    // each cycle's wake-up is pulled into phase with SYNC0.
+    // Mailbox traffic rides along within a fixed budget: as a check, each
+    // slave's serial number (0x1018:04) is read over CoE during the run.
+    // With <Recorder> configured every cycle's image is recorded as well.
+    // The live image is shared with local processes (ecat_image); with
+    // <SharedImage AcceptOutputs="true"> one of them may drive the outputs.
+    bool RunProcessData(const EtherCATConfig& config, SegmentCoordinator& coordinator, size_t index) {
+        // Images and cycle frames in locked, pre-faulted memory: three
+        // copies of each area, the LRW span, and per frame its data, a
+        // resend copy and room for plenty of datagrams
+        size_t batchFrames = (config.inputSize + config.outputSize) / ProcessImage::kMaxLrwData + 4;
+        size_t datagrams = batchFrames * 32;
+        if (!m_arena.GetStats().reserved) {
+            m_arena.Reserve(4 * (config.inputSize + config.outputSize + 4 * 64) +
+                            batchFrames * (2 * ECAT_MAX_ETH_FRAME + 32 * 64));
+        }
+        m_image.SetArena(&m_arena);
+        if (!m_image.Configure(config.inputAddress, config.inputSize,
+                               config.outputAddress, config.outputSize, config.expectedWkc)) {
+            coordinator.Join(index, nullptr);
+            return false;
+        }
+        // An image larger than one frame goes out as several LRWs, all in
+        // flight together, split where one slave's data ends
+        std::vector<uint32_t> boundaries = { config.inputAddress, config.outputAddress };
+        uint32_t nextInput = config.inputAddress;
+        uint32_t nextOutput = config.outputAddress;
+        for (const EtherCATSlaveConfig& slave : config.slaves) {
+            boundaries.push_back(nextInput += slave.inputSize);
+            boundaries.push_back(nextOutput += slave.outputSize);
+        }
+        m_image.SetFrameBoundaries(boundaries);
+        m_packer.SetArena(&m_arena, datagrams, batchFrames * ECAT_MAX_PAYLOAD, batchFrames);
+
+        LogInfo() << "\n=== Process Data (" << m_selectedAdapter << ", LRW 0x" << std::hex
+                  << m_image.GetLogicalAddress() << std::dec << ", " << m_image.GetLogicalSize() << " bytes"
+                  << (m_image.GetFrameCount() > 1 ? " in " + std::to_string(m_image.GetFrameCount()) + " frames" : "")
+                  << ", " << config.cycleTimeUs << " us) ===";
+
+        bool bDc = m_bDcActive;
+        std::vector<size_t> serials(m_slaveInfo.size(), SIZE_MAX);
+        for (uint16_t position = 0; position < m_slaveInfo.size(); position++) {
+            if (m_mailbox.AddSlave(position, m_slaveInfo[position])) {
+                serials[position] = m_mailbox.Upload(position, 0x1018, 4);
+            }
+        }
+        bool bMailbox = m_mailbox.GetSlaveCount() > 0;
+
+        // Per-cycle records for ecat_trace, readable while the loop runs
+        CycleTrace trace;
+        bool bPending = false;
+        size_t exchange = 0;
+        size_t sync = 0;
+        int64_t txNs = 0;
+        CyclicExecutor executor;
+        std::string name = index ? "DirectEtherCATMaster_" + std::to_string(index) : "DirectEtherCATMaster";
+        if (trace.Create(name, static_cast<int64_t>(config.cycleTimeUs) * 1000)) {
+            executor.SetTrace(&trace);
+        }
+        uint64_t exchanged = 0;
+        SharedProcessImage shared;
+        if (shared.Create(name, m_image.GetLogicalAddress(),
+                          static_cast<uint32_t>(m_image.GetLogicalSize()), config.inputAddress, config.inputSize,
+                          config.outputAddress, config.outputSize, static_cast<int64_t>(config.cycleTimeUs) * 1000,
+                          config.sharedImageOutputs)) {
+            LogInfo() << "Process image shared as '" << name << "'"
+                      << (config.sharedImageOutputs ? " (outputs accepted)" : "");
+        }
+        ProcessRecorder recorder;
+        if (!config.recorderDirectory.empty()) {
+            ProcessRecorder::Settings recording;
+            recording.directory = config.recorderDirectory;
+            recording.files = config.recorderFiles;
+            recording.fileBytes = static_cast<size_t>(config.recorderFileMB) << 20;
+            ProcessRecorder::Layout layout = { m_image.GetLogicalAddress(),
+                                               static_cast<uint32_t>(m_image.GetLogicalSize()),
+                                               config.inputAddress, config.inputSize,
+                                               config.outputAddress, config.outputSize };
+            if (!recorder.Open(recording, layout)) {
+                coordinator.Join(index, nullptr);
+                return false;
+            }
+        }
+        executor.SetStage(CyclicExecutor::READ_INPUTS, [&]() {
+            coordinator.MarkCycle(index, executor.GetDeadlineNs());
+            if (bPending) {
+                if (!m_packer.Receive(*m_pTransport, 0)) {
+                    trace.MarkFrameLost();
+                }
+                trace.MarkRx();
+                m_image.CompleteExchange(m_packer, exchange);
+                int64_t rxNs = CycleTrace::NowNs();
+                const uint8_t* pSpan = m_image.GetExchangeData();
+                shared.Publish(exchanged, rxNs, m_image.GetLastWkc(), m_image.GetExpectedWkc(), pSpan);
+                recorder.Record(exchanged++, rxNs, m_image.GetLastWkc(), pSpan);
+                if (bMailbox) {
+                    m_mailbox.Complete(m_packer);
+                }
+                trace.SetWkc(m_image.GetLastWkc(), m_image.GetExpectedWkc());
+                if (bDc) {
+                    executor.AdjustNextDeadline(m_clocks.CompleteSync(m_packer, sync, txNs, executor.GetDeadlineNs()));
+                }
+                bPending = false;
+            }
+        });
+        executor.SetStage(CyclicExecutor::WRITE_OUTPUTS, [&]() {
+            m_packer.Clear();
+            if (bDc) {
+                sync = m_clocks.QueueSync(m_packer);
+            }
+            exchange = m_image.QueueExchange(m_packer);
+            if (const uint8_t* pOutputs = shared.PollOutputs()) {
+                m_image.SetExchangeOutputs(pOutputs);
+            }
+            if (bMailbox) {
+                m_mailbox.Queue(m_packer);
+            }
+            bPending = m_packer.Send(*m_pTransport);
+            txNs = CycleTrace::NowNs();
+            trace.MarkTx();
+        });
+
+        CyclicExecutor::Settings settings;
+        settings.cycleTimeUs = config.cycleTimeUs;
+        settings.priority = config.priority;
+        settings.cpuAffinity = config.cpuAffinity;
+        settings.lockMemory = true;
+        settings.startNs = coordinator.Join(index, &m_image);
+        if (!settings.startNs) {
+            return false;
+        }
+        if (!executor.Start(settings)) {
+            coordinator.Stop();
+        }
+        coordinator.WaitForStop();
+        executor.Stop();
+        recorder.Close();
+
+        coordinator.BeginReport(index);
+        LogInfo() << "Exchanges: " << m_image.GetExchangeCount()
+                  << ", Working counter: " << m_image.GetLastWkc() << "/" << m_image.GetExpectedWkc()
+                  << ", WKC errors: " << m_image.GetWkcErrorCount();
+        const EtherCATDatagramPacker::Stats& frames = m_packer.GetStats();
+        LogInfo() << "Frames since start: " << frames.framesSent << " sent, " << frames.framesLost << " lost, "
+                  << frames.framesLate << " late, " << frames.framesResent << " resent, " << frames.framesUnexpected
+                  << " unexpected";
+        executor.PrintStats();
+        if (shared.GetOwnersDropped()) {
+            LogWarning() << "Warning: Outputs of " << shared.GetOwnersDropped()
+                         << " exited shared image writer(s) were dropped";
+        }
+        RtArena::Stats arena = m_arena.GetStats();
+        LogInfo() << "Cycle arena: " << arena.used / 1024 << "/" << arena.reserved / 1024 << " KB used, "
+                  << (arena.bHugePages ? "huge pages" : "normal pages") << (arena.bLocked ? ", locked" : ", not locked")
+                  << ", " << arena.fallbacks << " heap fallbacks";
+        if (recorder.GetStats().recorded) {
+            ProcessRecorder::Stats stats = recorder.GetStats();
+            LogInfo() << "Recorder: " << stats.written << " cycles in " << stats.segments << " segments, "
+                      << stats.dropped << " dropped, " << stats.rawBytes << " bytes encoded to "
+                      << stats.encodedBytes;
+        }
+        if (bDc) {
+            m_clocks.PrintStats(*m_pTransport, m_packer);
+        }
+        if (bMailbox) {
+            size_t read = 0;
+            size_t matching = 0;
+            for (uint16_t position = 0; position < serials.size(); position++) {
+                if (serials[position] == SIZE_MAX) {
+                    continue;
+                }
+                const CoeMailbox::Request& request = m_mailbox.GetRequest(serials[position]);
+                if (request.status == CoeMailbox::SDO_DONE && request.data.size() == 4) {
+                    read++;
+                    matching += EcatGet32(request.data.data()) == m_slaveInfo[position].identity.serial;
+                }
+            }
+            const CoeMailbox::Stats& stats = m_mailbox.GetStats();
+            LogInfo() << "Mailbox: " << read << "/" << m_mailbox.GetSlaveCount() << " serial numbers read in the cycle, "
+                      << matching << " match the EEPROM; " << stats.mailsSent << " mails sent, " << stats.mailsReceived
+                      << " received, " << stats.repeats << " reads repeated, " << stats.emergencies << " emergencies";
+        }
+        coordinator.EndReport();
+        // A late frame after an overrun costs one cycle's WKC; a line that
+        // ends short of slaves or keeps missing cycles fails the run
+        bool bWkcOk = m_image.GetLastWkc() == m_image.GetExpectedWkc() &&
+                      m_image.GetWkcErrorCount() * 100 <= m_image.GetExchangeCount();
+        if (!bWkcOk) {
+            LogError() << "Error: Working counter " << m_image.GetLastWkc() << "/" << m_image.GetExpectedWkc()
+                       << " at the end, " << m_image.GetWkcErrorCount() << " WKC errors in "
+                       << m_image.GetExchangeCount() << " exchanges";
+        }
+        return bWkcOk;
+    }
+#endif
+
     void ShowEtherCATConfiguration() {
-        std::cout << "\\n=== EtherCAT Configuration Requirements ===" << std::endl;
-        std::cout << "For a real EtherCAT master, you need:" << std::endl;
-        std::cout << "\\n1. Hardware Requirements:" << std::endl;
-        std::cout << "   - Dedicated Ethernet port (1 Gbps recommended)" << std::endl;
-        std::cout << "   - Real-time capable network adapter" << std::endl;
-        std::cout << "   - No sharing with regular network traffic" << std::endl;
-        std::cout << "\\n2. Software Requirements:" << std::endl;
-        std::cout << "   - Raw socket access (administrative privileges)" << std::endl;
-        std::cout << "   - Real-time operating system or RT kernel" << std::endl;
-        std::cout << "   - EtherCAT master stack (e.g., SOEM, IGH, TwinCAT)" << std::endl;
-        std::cout << "\\n3. Network Configuration:" << std::endl;
-        std::cout << "   - Disable Windows network protocols on EtherCAT adapter" << std::endl;
-        std::cout << "   - Configure adapter for optimal performance" << std::endl;
-        std::cout << "   - Set appropriate buffer sizes and interrupt settings" << std::endl;
+        LogInfo() << "\\n=== EtherCAT Configuration Requirements ===";
+        LogInfo() << "For a real EtherCAT master, you need:";
+        LogInfo() << "\\n1. Hardware Requirements:";
+        LogInfo() << "   - Dedicated Ethernet port (1 Gbps recommended)";
+        LogInfo() << "   - Real-time capable network adapter";
+        LogInfo() << "   - No sharing with regular network traffic";
+        LogInfo() << "\\n2. Software Requirements:";
+        LogInfo() << "   - Raw socket access (administrative privileges)";
+        LogInfo() << "   - Real-time operating system or RT kernel";
+        LogInfo() << "   - EtherCAT master stack (e.g., SOEM, IGH, TwinCAT)";
+        LogInfo() << "\\n3. Network Configuration:";
+        LogInfo() << "   - Disable Windows network protocols on EtherCAT adapter";
+        LogInfo() << "   - Configure adapter for optimal performance";
+        LogInfo() << "   - Set appropriate buffer sizes and interrupt settings";
     }
 };
 
-int main() {
-    std::cout << "=== Direct EtherCAT Master - Network Configuration ===" << std::endl;
+#ifndef _WIN32
+// Brings up the lines of <Segments>, each on its own adapter with its own
+// configuration file, after the first one. They share its cycle time.
+static bool AddSegments(const EtherCATConfig& config, const std::string& configPath,
+                        std::vector<std::unique_ptr<DirectEtherCATMaster>>& lines,
+                        std::vector<DirectEtherCATMaster*>& segments, std::vector<EtherCATConfig>& configs) {
+    for (size_t i = 0; i < config.segments.size(); i++) {
+        const EtherCATSegmentConfig& segment = config.segments[i];
+        std::string path = (std::filesystem::path(configPath).parent_path() / segment.config).string();
+        LogInfo() << "\n=== Segment " << i + 1 << ": " << segment.adapter << " (" << path << ") ===";
+        EtherCATConfig line;
+        if (!ConfigSnapshot::LoadConfig(path, line)) {
+            return false;
+        }
+        if (line.cycleTimeUs != config.cycleTimeUs) {
+            LogError() << "Error: Segment " << i + 1 << " cycles every " << line.cycleTimeUs << " us, the first every "
+                       << config.cycleTimeUs << " us";
+            return false;
+        }
+        for (size_t other = 0; other < configs.size(); other++) {
+            if (line.cpuAffinity >= 0 && line.cpuAffinity == configs[other].cpuAffinity) {
+                LogWarning() << "Warning: Segments " << other << " and " << i + 1 << " are both pinned to CPU "
+                             << line.cpuAffinity;
+            }
+        }
+
+        lines.emplace_back(new DirectEtherCATMaster());
+        DirectEtherCATMaster& master = *lines.back();
+        bool bSelected = (segment.adapter == "sim") ? master.SelectSimulator(line)
+                                                    : master.SelectAdapter(segment.adapter);
+        master.SetFrameLoss(line);
+        if (!bSelected || !master.InitializeEtherCAT() || !master.ScanSlaves(line) || !master.BringUp(line)) {
+            return false;
+        }
+        segments.push_back(&master);
+        configs.push_back(line);
+    }
+    return true;
+}
+
+// Cycles every segment on its own thread for the given number of cycles
+// and plays the application on the merged image meanwhile: each line's
+// first input byte is copied to its first output byte, only when it
+// changed.
+static bool RunSegments(const std::vector<DirectEtherCATMaster*>& segments, const std::vector<EtherCATConfig>& configs,
+                        unsigned long cycles) {
+    SegmentCoordinator coordinator;
+    coordinator.Configure(segments.size(), configs[0].cycleTimeUs);
+    std::vector<char> results(segments.size(), 0);
+    std::vector<std::thread> threads;
+    for (size_t i = 0; i < segments.size(); i++) {
+        threads.emplace_back([&, i]() {
+            results[i] = segments[i]->RunProcessData(configs[i], coordinator, i);
+        });
+    }
+
+    ChangeDetector changes;
+    bool bStarted = coordinator.WaitForStart();
+    if (bStarted) {
+        changes.Configure(coordinator.GetInputSize());
+        for (size_t i = 0; i < segments.size(); i++) {
+            ProcessVariable<uint8_t> input = { 0 };
+            ProcessVariable<uint8_t> output = { 0 };
+            if (configs[i].inputSize && configs[i].outputSize &&
+                coordinator.MapInput(i, configs[i].inputAddress, input) &&
+                coordinator.MapOutput(i, configs[i].outputAddress, output)) {
+                changes.Subscribe(input, [&coordinator, output](uint8_t, uint8_t value) {
+                    coordinator.SetOutput(output, value);
+                    coordinator.PublishOutputs();
+                });
+            }
+        }
+        while (coordinator.GetCycles() < cycles) {
+            Sleep(10);
+            if (coordinator.UpdateInputs()) {
+                changes.Update(coordinator.GetInputData());
+            }
+        }
+        coordinator.Stop();
+    }
+    for (std::thread& thread : threads) {
+        thread.join();
+    }
+    if (!bStarted) {
+        return false;
+    }
+
+    if (segments.size() > 1) {
+        LogInfo() << "\n=== Segments (" << segments.size() << " lines, one cycle thread each) ===";
+        coordinator.PrintStats();
+    }
+    const ChangeDetector::Stats& changeStats = changes.GetStats();
+    if (changeStats.updates) {
+        LogInfo() << "Change detection (" << ChangeDetector::IsaName(changes.GetIsa()) << "): "
+                  << changeStats.changedUpdates << "/" << changeStats.updates << " snapshots changed, "
+                  << changeStats.changedBytes << " of " << changeStats.updates * coordinator.GetInputSize()
+                  << " bytes in " << changeStats.ranges << " ranges, " << changeStats.events << " events";
+    }
+    return std::find(results.begin(), results.end(), 0) == results.end();
+}
+#endif
+
+int main(int argc, char* argv[]) {
+    LogInfo() << "=== Direct EtherCAT Master - Network Configuration ===";
     
     DirectEtherCATMaster master;
+
+    // An adapter given on the command line is used directly
+    if (argc > 1) {
+#ifndef _WIN32
+        // "sim" runs against the in-process segment simulator
+        EtherCATConfig config;
+        std::string configPath = argc > 2 ? argv[2] : "ethercat_config.xml";
+        bool bConfig = ConfigSnapshot::LoadConfig(configPath, config);
+        if (bConfig && !config.logFile.empty() && !Logger::Instance().SetFile(config.logFile)) {
+            LogWarning() << "Warning: Cannot open log file '" << config.logFile << "'";
+        }
+#ifdef ECAT_GENERATED_PDO
+        // The build generated typed accessors from PDO_CONFIG; say whether they fit this configuration
+        if (bConfig) {
+            EtherCATConfigPdo::Check(config);
+        }
+#endif
+        bool bSelected = (std::string(argv[1]) == "sim") ? bConfig && master.SelectSimulator(config)
+                                                          : master.SelectAdapter(argv[1]);
+        master.SetFrameLoss(config);
+        if (!bSelected || !master.InitializeEtherCAT()) {
+            return -1;
+        }
+        // <Segments> adds further lines, each cycled by its own thread. A
+        // failed scan or bring-up, or a run with WKC errors, is a failed run
+        // for scripts and CI: the exit code is non-zero.
+        std::vector<std::unique_ptr<DirectEtherCATMaster>> lines;
+        std::vector<DirectEtherCATMaster*> segments(1, &master);
+        std::vector<EtherCATConfig> configs(1, config);
+        if (bConfig && (config.inputSize || config.outputSize)) {
+            bool bOk = master.ScanSlaves(config) && master.BringUp(config) &&
+                       AddSegments(config, configPath, lines, segments, configs) &&
+                       RunSegments(segments, configs, 1000);
+            if (!bOk) {
+                LogError() << "Error: Bring-up or the process data run failed";
+                return -1;
+            }
+        }
+#else
+        if (!master.SelectAdapter(argv[1]) || !master.InitializeEtherCAT()) {
+            return -1;
+        }
+#endif
+        return 0;
+    }
     
     // Show available network adapters
     master.PrintAvailableAdapters();
@@ -151,34 +858,35 @@ int main() {
     master.ShowEtherCATConfiguration();
     
     // Example: Select an adapter (you would typically prompt user or use config file)
-    std::cout << "\\n=== Adapter Selection Example ===" << std::endl;
-    std::cout << "In a real application, you would:" << std::endl;
-    std::cout << "1. Read from configuration file" << std::endl;
-    std::cout << "2. Prompt user to select adapter" << std::endl;
-    std::cout << "3. Auto-detect based on criteria" << std::endl;
+    LogInfo() << "\\n=== Adapter Selection Example ===";
+    LogInfo() << "In a real application, you would:";
+    LogInfo() << "1. Read from configuration file";
+    LogInfo() << "2. Prompt user to select adapter";
+    LogInfo() << "3. Auto-detect based on criteria";
     
     // Try to select first Ethernet adapter
     auto adapters = master.ListNetworkAdapters();
     for (const auto& adapter : adapters) {
         if (adapter.isEthernetCapable && adapter.description.find("Virtual") == std::string::npos) {
-            std::cout << "\\nExample: Selecting " << adapter.description << std::endl;
+            LogInfo() << "\\nExample: Selecting " << adapter.description;
             master.SelectAdapter(adapter.name);
             master.InitializeEtherCAT();
             break;
         }
     }
     
-    std::cout << "\\n=== TwinCAT vs Direct EtherCAT ===" << std::endl;
-    std::cout << "TwinCAT Approach (our main app):" << std::endl;
-    std::cout << "- TwinCAT handles Ethernet port selection" << std::endl;
-    std::cout << "- Configured in TwinCAT System Manager" << std::endl;
-    std::cout << "- Your app connects via ADS (TCP/IP)" << std::endl;
-    std::cout << "\\nDirect EtherCAT Approach (this example):" << std::endl;
-    std::cout << "- Your app directly controls Ethernet port" << std::endl;
-    std::cout << "- Must handle real-time requirements" << std::endl;
-    std::cout << "- More complex but more control" << std::endl;
+    LogInfo() << "\\n=== TwinCAT vs Direct EtherCAT ===";
+    LogInfo() << "TwinCAT Approach (our main app):";
+    LogInfo() << "- TwinCAT handles Ethernet port selection";
+    LogInfo() << "- Configured in TwinCAT System Manager";
+    LogInfo() << "- Your app connects via ADS (TCP/IP)";
+    LogInfo() << "\\nDirect EtherCAT Approach (this example):";
+    LogInfo() << "- Your app directly controls Ethernet port";
+    LogInfo() << "- Must handle real-time requirements";
+    LogInfo() << "- More complex but more control";
     
-    std::cout << "\\nPress any key to continue..." << std::endl;
+    LogInfo() << "\\nPress any key to continue...";
+    Logger::Instance().Flush();
     std::cin.get();
     
     return 0;
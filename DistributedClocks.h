@@ -0,0 +1,292 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+#include "CyclicExecutor.h"
+#include "EscRegisters.h"
+#include "EtherCATDatagramPacker.h"
+#include "FrameTransport.h"
+#include "Logger.h"
+
+// Distributed clocks for a line topology (frames enter on port 0 and leave
+// on port 1). Configure() runs once before the cycle starts:
+//   1. latch receive times (BWR 0x0900) and read them back
+//   2. propagation delay of every DC slave from the reference clock (the
+//      first DC slave) -> 0x0928
+//   3. system time offset, so every slave's system time starts at the
+//      master's -> 0x0920
+//   4. static drift compensation: a burst of ARMW 0x0910
+//   5. SYNC0 cycle and start time, then activation
+// In the cycle, QueueSync() adds an ARMW on 0x0910 to the process data
+// frame: the reference clock reads its time into it and every slave after
+// it adjusts its own clock to that. CompleteSync() turns the returned time
+// into a correction of the master's next wake-up, so the master follows
+// the line instead of the line drifting away from the PC clock.
+class DistributedClocks {
+public:
+    // DC system time starts 2000-01-01; the Unix epoch is 30 years earlier
+    static const int64_t kUnixTo2000Ns = 946684800LL * 1000000000LL;
+    static const uint64_t kSettleCycles = 200;     // not counted in the phase statistics
+
+    struct Settings {
+        uint32_t cycleTimeNs;
+        uint32_t shiftNs;            // SYNC0 this long after the master's cycle start
+        unsigned driftFrames;        // static drift compensation
+        long timeoutUs;              // per configuration frame
+
+        Settings() : cycleTimeNs(1000000), shiftNs(0), driftFrames(1000), timeoutUs(100000) {}
+    };
+
+    struct Stats {
+        uint64_t syncs;
+        uint64_t missed;             // ARMW did not come back
+        int64_t offsetNs;            // reference clock - master clock, last sync
+        int64_t firstOffsetNs;
+        int64_t firstOffsetHostNs;
+        int64_t lastOffsetHostNs;
+    };
+
+private:
+    Settings m_settings;
+    std::vector<uint16_t> m_positions;     // DC slaves in line order
+    std::vector<uint32_t> m_delays;        // propagation delay from the reference
+    int64_t m_epochNs;                     // DC system time - master clock
+    uint64_t m_syncStartNs;                // first SYNC0, system time
+    int64_t m_integralNs;
+    Stats m_stats;
+    JitterHistogram m_phaseError;
+
+    uint16_t Reference() const {
+        return m_positions.front();
+    }
+
+    static uint32_t AutoIncrement(uint16_t position, uint16_t offset) {
+        return EcatPhysicalAddress(static_cast<uint16_t>(-static_cast<int>(position)), offset);
+    }
+
+    static int64_t MasterNowNs() {
+        return CycleTrace::NowNs();
+    }
+
+    bool Exchange(FrameTransport& transport, EtherCATDatagramPacker& packer, const char* what) {
+        if (!packer.Send(transport) || !packer.Receive(transport, m_settings.timeoutUs)) {
+            LogError() << "Error: DC " << what << " frame lost";
+            return false;
+        }
+        return true;
+    }
+
+    // Phase of a master time within the SYNC0 cycle, as seen by the
+    // reference clock, in [-cycle/2, cycle/2); 0 = SYNC0 minus shift
+    int64_t PhaseErrorNs(int64_t masterNs) const {
+        int64_t cycle = m_settings.cycleTimeNs;
+        int64_t reference = masterNs + m_epochNs + m_stats.offsetNs;
+        int64_t phase = (reference - static_cast<int64_t>(m_syncStartNs - m_settings.shiftNs)) % cycle;
+        if (phase < 0) {
+            phase += cycle;
+        }
+        return phase >= cycle / 2 ? phase - cycle : phase;
+    }
+
+public:
+    DistributedClocks() : m_epochNs(0), m_syncStartNs(0), m_integralNs(0) {
+        memset(&m_stats, 0, sizeof(m_stats));
+    }
+
+    bool Configure(FrameTransport& transport, EtherCATDatagramPacker& packer, uint16_t slaveCount,
+                   const Settings& settings) {
+        m_settings = settings;
+        m_positions.clear();
+        m_delays.clear();
+        m_integralNs = 0;
+        memset(&m_stats, 0, sizeof(m_stats));
+        m_phaseError.Reset();
+
+        // Which slaves have a DC unit
+        packer.Clear();
+        for (uint16_t position = 0; position < slaveCount; position++) {
+            packer.Add(ECAT_APRD, AutoIncrement(position, ESC_REG_FEATURES), 2);
+        }
+        if (!Exchange(transport, packer, "feature")) {
+            return false;
+        }
+        for (uint16_t position = 0; position < slaveCount; position++) {
+            if (packer.GetWkc(position) == 1 && (EcatGet16(packer.GetData(position)) & ESC_FEATURE_DC)) {
+                m_positions.push_back(position);
+            }
+        }
+        if (m_positions.empty()) {
+            LogWarning() << "Warning: No slave supports distributed clocks";
+            return false;
+        }
+
+        // Every slave latches the time the frame passes each of its ports
+        packer.Clear();
+        packer.Add(ECAT_BWR, EcatPhysicalAddress(0, ESC_REG_DC_RECEIVE_TIME), 4);
+        m_epochNs = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                        std::chrono::system_clock::now().time_since_epoch()).count() - kUnixTo2000Ns - MasterNowNs();
+        int64_t latchNs = MasterNowNs();
+        if (!Exchange(transport, packer, "receive time latch")) {
+            return false;
+        }
+
+        packer.Clear();
+        for (uint16_t position : m_positions) {
+            packer.Add(ECAT_APRD, AutoIncrement(position, ESC_REG_DC_RECEIVE_TIME), 8);
+            packer.Add(ECAT_APRD, AutoIncrement(position, ESC_REG_DC_RECEIVE_TIME_PU), 8);
+        }
+        if (!Exchange(transport, packer, "receive time")) {
+            return false;
+        }
+
+        // Port 1 minus port 0 is the time the frame spent behind the slave;
+        // half the difference to the reference's is the delay in between.
+        // The last slave of the line has port 1 closed.
+        std::vector<int64_t> loops(m_positions.size());
+        std::vector<int64_t> local(m_positions.size());
+        for (size_t i = 0; i < m_positions.size(); i++) {
+            const uint8_t* pPorts = packer.GetData(2 * i);
+            bool bLast = m_positions[i] == slaveCount - 1;
+            loops[i] = bLast ? 0 : static_cast<uint32_t>(EcatGet32(pPorts + 4) - EcatGet32(pPorts));
+            local[i] = static_cast<int64_t>(EcatGet64(packer.GetData(2 * i + 1)));
+        }
+        packer.Clear();
+        for (size_t i = 0; i < m_positions.size(); i++) {
+            m_delays.push_back(static_cast<uint32_t>(std::max<int64_t>(0, (loops[0] - loops[i]) / 2)));
+        }
+        // Register values in wire order: 8-byte offset, then 4-byte delay
+        std::vector<uint8_t> values(m_positions.size() * 12);
+        for (size_t i = 0; i < m_positions.size(); i++) {
+            uint8_t* pValue = &values[i * 12];
+            EcatPut64(pValue, static_cast<uint64_t>(latchNs + m_epochNs + m_delays[i] - local[i]));
+            EcatPut32(pValue + 8, m_delays[i]);
+            packer.Add(ECAT_APWR, AutoIncrement(m_positions[i], ESC_REG_DC_TIME_OFFSET), 8, pValue);
+            packer.Add(ECAT_APWR, AutoIncrement(m_positions[i], ESC_REG_DC_TIME_DELAY), 4, pValue + 8);
+        }
+        if (!Exchange(transport, packer, "offset")) {
+            return false;
+        }
+
+        // Static drift compensation: the slaves trim their clock speed to
+        // the reference before the cycle starts
+        uint64_t referenceNs = 0;
+        for (unsigned i = 0; i < m_settings.driftFrames + 1; i++) {
+            packer.Clear();
+            size_t id = packer.Add(ECAT_ARMW, AutoIncrement(Reference(), ESC_REG_DC_SYSTEM_TIME), 8);
+            if (!Exchange(transport, packer, "drift compensation")) {
+                return false;
+            }
+            referenceNs = EcatGet64(packer.GetData(id));
+        }
+
+        // SYNC0 on a cycle boundary 100 ms ahead, plus the shift
+        uint64_t cycle = m_settings.cycleTimeNs;
+        m_syncStartNs = (referenceNs + 100000000ULL) / cycle * cycle + m_settings.shiftNs;
+        uint8_t off = 0;
+        uint8_t on = ESC_DC_ACTIVATE_CYCLIC | ESC_DC_ACTIVATE_SYNC0;
+        uint8_t cycleTime[4];
+        uint8_t syncStart[8];
+        EcatPut32(cycleTime, m_settings.cycleTimeNs);
+        EcatPut64(syncStart, m_syncStartNs);
+        packer.Clear();
+        for (uint16_t position : m_positions) {
+            packer.Add(ECAT_APWR, AutoIncrement(position, ESC_REG_DC_ACTIVATION), 1, &off);
+            packer.Add(ECAT_APWR, AutoIncrement(position, ESC_REG_DC_SYNC0_CYCLE), 4, cycleTime);
+            packer.Add(ECAT_APWR, AutoIncrement(position, ESC_REG_DC_SYNC0_START), 8, syncStart);
+            packer.Add(ECAT_APWR, AutoIncrement(position, ESC_REG_DC_ACTIVATION), 1, &on);
+        }
+        if (!Exchange(transport, packer, "SYNC0")) {
+            return false;
+        }
+
+        m_stats.offsetNs = static_cast<int64_t>(referenceNs) - (MasterNowNs() + m_epochNs);
+        LogInfo() << "\n=== Distributed Clocks ===";
+        LogInfo() << "Reference clock: slave " << Reference() << ", " << m_positions.size()
+                  << " DC slaves, propagation delay up to " << m_delays.back() << " ns";
+        LogInfo() << "Static drift compensation: " << m_settings.driftFrames << " frames, SYNC0 every "
+                  << cycle / 1000 << " us, " << m_settings.shiftNs / 1000 << " us after the cycle start";
+        return true;
+    }
+
+    bool IsConfigured() const {
+        return !m_positions.empty() && m_syncStartNs != 0;
+    }
+
+    // --- Cycle thread ---
+
+    // The reference clock's system time, read and distributed along the line
+    size_t QueueSync(EtherCATDatagramPacker& packer) {
+        return packer.Add(ECAT_ARMW, AutoIncrement(Reference(), ESC_REG_DC_SYSTEM_TIME), 8);
+    }
+
+    // txNs: master time the frame was sent at. Returns the correction for
+    // the next deadline that moves deadlineNs toward SYNC0 minus shift on
+    // the reference clock (PI control, at most an eighth of a cycle).
+    int64_t CompleteSync(const EtherCATDatagramPacker& packer, size_t id, int64_t txNs, int64_t deadlineNs) {
+        if (!packer.IsReceived(id) || packer.GetWkc(id) == 0) {
+            m_stats.missed++;
+            return 0;
+        }
+        m_stats.offsetNs = static_cast<int64_t>(EcatGet64(packer.GetData(id))) - (txNs + m_epochNs);
+        if (m_stats.syncs++ == 0) {
+            m_stats.firstOffsetNs = m_stats.offsetNs;
+            m_stats.firstOffsetHostNs = txNs;
+        }
+        m_stats.lastOffsetHostNs = txNs;
+
+        int64_t error = PhaseErrorNs(deadlineNs);
+        if (m_stats.syncs > kSettleCycles) {
+            m_phaseError.Record(error < 0 ? -error : error);
+        }
+        // The integral is clamped so a stall or a step does not wind it up
+        // and keep the correction pinned at the limit after the error is gone
+        int64_t limit = m_settings.cycleTimeNs / 8;
+        m_integralNs = std::max(-limit * 64, std::min(limit * 64, m_integralNs + error));
+        int64_t correction = -(error / 4 + m_integralNs / 64);
+        return std::max(-limit, std::min(limit, correction));
+    }
+
+    // --- After the cycle ---
+
+    const Stats& GetStats() const {
+        return m_stats;
+    }
+
+    // Rate of the reference clock against the master's, over the run
+    double GetDriftPpm() const {
+        int64_t elapsed = m_stats.lastOffsetHostNs - m_stats.firstOffsetHostNs;
+        return elapsed > 0 ? (m_stats.offsetNs - m_stats.firstOffsetNs) * 1e6 / elapsed : 0.0;
+    }
+
+    // Largest |system time difference| (0x092C) any slave saw at its last
+    // sync, i.e. how far the clocks were apart before correction
+    bool ReadMaxDeviation(FrameTransport& transport, EtherCATDatagramPacker& packer, uint32_t* pMaxNs) {
+        packer.Clear();
+        for (uint16_t position : m_positions) {
+            packer.Add(ECAT_APRD, AutoIncrement(position, ESC_REG_DC_TIME_DIFF), 4);
+        }
+        if (!Exchange(transport, packer, "deviation")) {
+            return false;
+        }
+        *pMaxNs = 0;
+        for (size_t i = 1; i < m_positions.size(); i++) {
+            *pMaxNs = std::max(*pMaxNs, EcatGet32(packer.GetData(i)) & 0x7FFFFFFF);
+        }
+        return true;
+    }
+
+    void PrintStats(FrameTransport& transport, EtherCATDatagramPacker& packer) {
+        JitterHistogram::Summary phase = m_phaseError.Summarize();
+        LogInfo() << "Reference clock vs. master clock: " << GetDriftPpm() << " ppm, followed by the cycle";
+        LogInfo() << "DC syncs: " << m_stats.syncs << ", missed: " << m_stats.missed
+                  << ", phase error (us): p50 " << phase.p50Ns / 1000.0 << ", p99 " << phase.p99Ns / 1000.0
+                  << ", max " << phase.maxNs / 1000.0;
+        uint32_t deviation = 0;
+        if (ReadMaxDeviation(transport, packer, &deviation)) {
+            LogInfo() << "Slave clock deviation from the reference: max " << deviation << " ns";
+        }
+    }
+};
@@ -0,0 +1,217 @@
+#pragma once
+
+// EtherCAT slave controller (ESC) register map (ETG.1000.4 / ET1100
+// datasheet), as seen through physical addressing (APxx/FPxx/BRD/ARMW).
+
+#include <cstdint>
+
+static const uint16_t ESC_REG_TYPE            = 0x0000;   // 1 byte, read-only
+static const uint16_t ESC_REG_REVISION        = 0x0001;
+static const uint16_t ESC_REG_FMMU_COUNT      = 0x0004;
+static const uint16_t ESC_REG_SM_COUNT        = 0x0005;
+static const uint16_t ESC_REG_RAM_SIZE        = 0x0006;   // process data RAM, KB
+static const uint16_t ESC_REG_FEATURES        = 0x0008;   // 2 bytes, ESC_FEATURE_*
+static const uint16_t ESC_REG_STATION_ADDRESS = 0x0010;   // configured station address (FPxx)
+static const uint16_t ESC_REG_STATION_ALIAS   = 0x0012;
+static const uint16_t ESC_REG_AL_CONTROL      = 0x0120;
+static const uint16_t ESC_REG_AL_STATUS       = 0x0130;   // read-only for the master
+static const uint16_t ESC_REG_AL_STATUS_CODE  = 0x0134;
+static const uint16_t ESC_REG_SII_CONFIG      = 0x0500;   // 1 byte, 0 = EtherCAT has the EEPROM
+static const uint16_t ESC_REG_SII_CONTROL     = 0x0502;   // 2 bytes, ESC_SII_*
+static const uint16_t ESC_REG_SII_ADDRESS     = 0x0504;   // 4 bytes, word address
+static const uint16_t ESC_REG_SII_DATA        = 0x0508;   // 4 or 8 bytes, see ESC_SII_READ_8
+static const uint16_t ESC_REG_FMMU0           = 0x0600;   // 16 bytes per FMMU
+static const uint16_t ESC_REG_SM0             = 0x0800;   // 8 bytes per SyncManager
+static const uint16_t ESC_REG_PDRAM           = 0x1000;   // start of process data RAM
+
+// Distributed clocks. Receive times are local time, the rest system time
+// (ns since 2000-01-01) unless noted.
+static const uint16_t ESC_REG_DC_RECEIVE_TIME    = 0x0900;  // 4 x 4 bytes, ports 0-3; a write latches all
+static const uint16_t ESC_REG_DC_SYSTEM_TIME     = 0x0910;  // 8 bytes; a write runs the time control loop
+static const uint16_t ESC_REG_DC_RECEIVE_TIME_PU = 0x0918;  // 8 bytes, port 0 receive time, local
+static const uint16_t ESC_REG_DC_TIME_OFFSET     = 0x0920;  // 8 bytes, system time - local time
+static const uint16_t ESC_REG_DC_TIME_DELAY      = 0x0928;  // 4 bytes, propagation delay from the reference
+static const uint16_t ESC_REG_DC_TIME_DIFF       = 0x092C;  // 4 bytes, last control deviation, bit 31 = local behind
+static const uint16_t ESC_REG_DC_ACTIVATION      = 0x0981;  // 1 byte, ESC_DC_ACTIVATE_*
+static const uint16_t ESC_REG_DC_SYNC0_START     = 0x0990;  // 8 bytes, first SYNC0 event
+static const uint16_t ESC_REG_DC_SYNC0_CYCLE     = 0x09A0;  // 4 bytes, ns
+
+static const uint16_t ESC_FEATURE_DC    = 0x0004;  // distributed clocks available
+static const uint16_t ESC_FEATURE_DC_64 = 0x0008;  // 64-bit system time
+
+static const uint8_t ESC_DC_ACTIVATE_CYCLIC = 0x01;
+static const uint8_t ESC_DC_ACTIVATE_SYNC0  = 0x02;
+
+// SII EEPROM control/status (0x0502)
+static const uint16_t ESC_SII_READ_8    = 0x0040;  // a read returns 8 bytes, else 4
+static const uint16_t ESC_SII_CMD_READ  = 0x0100;
+static const uint16_t ESC_SII_ERROR_CMD = 0x2000;  // command error
+static const uint16_t ESC_SII_BUSY      = 0x8000;
+
+// SII EEPROM contents (ETG.2010), in 16-bit word addresses
+static const uint16_t SII_VENDOR_ID      = 0x0008;  // 2 words each
+static const uint16_t SII_PRODUCT_CODE   = 0x000A;
+static const uint16_t SII_REVISION       = 0x000C;
+static const uint16_t SII_SERIAL         = 0x000E;
+static const uint16_t SII_FIRST_CATEGORY = 0x0040;  // then type word, size in words, data
+
+static const uint16_t SII_CAT_STRINGS = 10;
+static const uint16_t SII_CAT_GENERAL = 30;
+static const uint16_t SII_CAT_FMMU    = 40;
+static const uint16_t SII_CAT_SYNCM   = 41;
+static const uint16_t SII_CAT_TXPDO   = 50;         // slave inputs
+static const uint16_t SII_CAT_RXPDO   = 51;         // slave outputs
+static const uint16_t SII_CAT_END     = 0xFFFF;
+
+static const uint16_t ESC_FMMU_SIZE = 16;
+static const uint16_t ESC_SM_SIZE = 8;
+
+// Offsets within one SyncManager entry
+static const uint16_t ESC_SM_START    = 0x00;     // 2 bytes
+static const uint16_t ESC_SM_LENGTH   = 0x02;     // 2 bytes
+static const uint16_t ESC_SM_CONTROL  = 0x04;
+static const uint16_t ESC_SM_STATUS   = 0x05;     // read-only
+static const uint16_t ESC_SM_ACTIVATE = 0x06;
+static const uint16_t ESC_SM_PDI_CONTROL = 0x07;  // read-only for the master
+
+static const uint8_t ESC_SM_MAILBOX_FULL = 0x08;  // SM status, mailbox mode
+static const uint8_t ESC_SM_ENABLE = 0x01;        // SM activate
+static const uint8_t ESC_SM_REPEAT = 0x02;        // SM activate: repeat request; PDI control: repeat ack
+
+// SII sync manager category: type byte of each entry
+static const uint8_t SII_SM_MAILBOX_OUT = 1;      // master -> slave
+static const uint8_t SII_SM_MAILBOX_IN  = 2;      // slave -> master
+static const uint8_t SII_SM_OUTPUTS     = 3;      // process data, master -> slave
+static const uint8_t SII_SM_INPUTS      = 4;      // process data, slave -> master
+
+// SII general category, byte 5: CoE details
+static const uint8_t SII_COE_SDO             = 0x01;
+static const uint8_t SII_COE_COMPLETE_ACCESS = 0x20;
+
+// Offsets within one FMMU entry
+static const uint16_t ESC_FMMU_LOGICAL_START  = 0x00;     // 4 bytes
+static const uint16_t ESC_FMMU_LENGTH         = 0x04;     // 2 bytes
+static const uint16_t ESC_FMMU_LOGICAL_END_BIT = 0x07;
+static const uint16_t ESC_FMMU_PHYSICAL_START = 0x08;     // 2 bytes
+static const uint16_t ESC_FMMU_TYPE           = 0x0B;     // ESC_FMMU_READ / ESC_FMMU_WRITE
+static const uint16_t ESC_FMMU_ACTIVATE       = 0x0C;
+
+static const uint8_t ESC_FMMU_READ  = 0x01;   // master reads (slave inputs)
+static const uint8_t ESC_FMMU_WRITE = 0x02;   // master writes (slave outputs)
+
+// Mailbox (ETG.1000.6): a 6-byte header, then the protocol's data. The
+// whole sync manager area is written or read at once; an access to a full
+// write mailbox or an empty read mailbox is not answered (WKC 0).
+static const uint16_t ECAT_MBX_HEADER_SIZE = 6;   // length, address, channel, type | counter << 4
+static const uint8_t ECAT_MBX_TYPE_COE = 0x03;
+
+// CoE header (2 bytes after the mailbox header): number, service << 12
+static const uint16_t COE_SERVICE_EMERGENCY    = 1;
+static const uint16_t COE_SERVICE_SDO_REQUEST  = 2;
+static const uint16_t COE_SERVICE_SDO_RESPONSE = 3;
+
+// SDO command byte: command specifier in bits 5-7
+static const uint8_t SDO_CCS_DOWNLOAD_SEGMENT  = 0x00;
+static const uint8_t SDO_CCS_DOWNLOAD          = 0x20;
+static const uint8_t SDO_CCS_UPLOAD            = 0x40;
+static const uint8_t SDO_CCS_UPLOAD_SEGMENT    = 0x60;
+static const uint8_t SDO_CCS_ABORT             = 0x80;
+static const uint8_t SDO_SCS_UPLOAD_SEGMENT    = 0x00;   // server responses
+static const uint8_t SDO_SCS_DOWNLOAD_SEGMENT  = 0x20;
+static const uint8_t SDO_SCS_UPLOAD            = 0x40;
+static const uint8_t SDO_SCS_DOWNLOAD          = 0x60;
+static const uint8_t SDO_COMMAND_MASK          = 0xE0;
+static const uint8_t SDO_SIZE_INDICATED        = 0x01;   // initiate: size in the data
+static const uint8_t SDO_EXPEDITED             = 0x02;   // initiate: data in the 4 bytes
+static const uint8_t SDO_COMPLETE_ACCESS       = 0x10;   // initiate: all subindexes
+static const uint8_t SDO_LAST_SEGMENT          = 0x01;   // segment
+static const uint8_t SDO_TOGGLE                = 0x10;   // segment
+
+static const uint32_t SDO_ABORT_TOGGLE         = 0x05030000;
+static const uint32_t SDO_ABORT_TIMEOUT        = 0x05040000;
+static const uint32_t SDO_ABORT_COMMAND        = 0x05040001;
+static const uint32_t SDO_ABORT_NO_OBJECT      = 0x06020000;
+static const uint32_t SDO_ABORT_LENGTH         = 0x06070010;
+static const uint32_t SDO_ABORT_NO_SUBINDEX    = 0x06090011;
+static const uint32_t SDO_ABORT_GENERAL        = 0x08000000;
+
+inline const char* CoeAbortName(uint32_t code) {
+    switch (code) {
+    case 0x05030000: return "toggle bit not changed";
+    case 0x05040000: return "SDO protocol timeout";
+    case 0x05040001: return "command specifier not valid or unknown";
+    case 0x05040005: return "out of memory";
+    case 0x06010000: return "unsupported access to an object";
+    case 0x06010001: return "attempt to read a write-only object";
+    case 0x06010002: return "attempt to write a read-only object";
+    case 0x06010003: return "subindex cannot be written, SI0 must be 0 for write access";
+    case 0x06010004: return "complete access not supported";
+    case 0x06020000: return "object does not exist";
+    case 0x06040041: return "object cannot be mapped to the PDO";
+    case 0x06040042: return "mapped objects exceed the PDO length";
+    case 0x06060000: return "access failed due to a hardware error";
+    case 0x06070010: return "data type does not match, length of service parameter does not match";
+    case 0x06090011: return "subindex does not exist";
+    case 0x06090030: return "value range of parameter exceeded";
+    case 0x08000000: return "general error";
+    case 0x08000020: return "data cannot be transferred or stored to the application";
+    case 0x08000022: return "data cannot be transferred because of the present device state";
+    default: return "vendor or unknown code";
+    }
+}
+
+// AL states as written to AL control and reported in AL status
+enum EcatState : uint8_t {
+    ECAT_STATE_NONE   = 0x00,
+    ECAT_STATE_INIT   = 0x01,
+    ECAT_STATE_PREOP  = 0x02,
+    ECAT_STATE_BOOT   = 0x03,
+    ECAT_STATE_SAFEOP = 0x04,
+    ECAT_STATE_OP     = 0x08
+};
+
+static const uint8_t ECAT_STATE_MASK = 0x0F;
+static const uint8_t ECAT_AL_ERROR = 0x10;      // AL status: error indication; AL control: acknowledge
+
+// AL status codes (0x0134)
+static const uint16_t ECAT_AL_CODE_NONE            = 0x0000;
+static const uint16_t ECAT_AL_CODE_INVALID_CHANGE  = 0x0011;   // invalid requested state change
+static const uint16_t ECAT_AL_CODE_UNKNOWN_STATE   = 0x0012;   // unknown requested state
+static const uint16_t ECAT_AL_CODE_INVALID_MAILBOX = 0x0016;   // invalid mailbox configuration
+static const uint16_t ECAT_AL_CODE_INVALID_OUTPUTS = 0x001D;   // invalid output configuration
+static const uint16_t ECAT_AL_CODE_INVALID_INPUTS  = 0x001E;   // invalid input configuration
+
+inline const char* EcatAlCodeName(uint16_t code) {
+    switch (code) {
+    case 0x0000: return "no error";
+    case 0x0001: return "unspecified error";
+    case 0x0011: return "invalid requested state change";
+    case 0x0012: return "unknown requested state";
+    case 0x0013: return "bootstrap not supported";
+    case 0x0014: return "no valid firmware";
+    case 0x0016: return "invalid mailbox configuration";
+    case 0x0017: return "invalid sync manager configuration";
+    case 0x0018: return "no valid inputs available";
+    case 0x0019: return "no valid outputs";
+    case 0x001A: return "synchronization error";
+    case 0x001B: return "sync manager watchdog";
+    case 0x001D: return "invalid output configuration";
+    case 0x001E: return "invalid input configuration";
+    case 0x0024: return "invalid process data mapping";
+    case 0x002C: return "fatal sync error";
+    case 0x0030: return "invalid DC sync configuration";
+    case 0x0035: return "invalid sync cycle time";
+    default: return "vendor or unknown code";
+    }
+}
+
+inline const char* EcatStateName(uint8_t state) {
+    switch (state & ECAT_STATE_MASK) {
+    case ECAT_STATE_INIT: return "INIT";
+    case ECAT_STATE_PREOP: return "PREOP";
+    case ECAT_STATE_BOOT: return "BOOT";
+    case ECAT_STATE_SAFEOP: return "SAFEOP";
+    case ECAT_STATE_OP: return "OP";
+    default: return "UNKNOWN";
+    }
+}
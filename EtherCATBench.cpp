@@ -0,0 +1,615 @@
+// ecat_bench: repeatable performance numbers without TwinCAT or hardware.
+//
+//   ads_read_variable / ads_write_variable
+//       ReadVariable()/WriteVariable() path: one cached-handle round trip
+//       to an in-process AdsStandInServer
+//   ads_read_batch       sum read of N tags, rate in tags/s
+//   ads_pool_read        32 caller threads reading single tags through an
+//                        AdsClientPool of N (items) workers from a target
+//                        answering after 1 ms; rate in tags/s
+//   frame_build_parse    N datagrams packed, returned by an empty line and
+//                        matched back; rate in frames/s
+//   cycle_latency        send-to-complete time of the process image
+//                        exchange per cycle on the CyclicExecutor against
+//                        the simulated segment, N (items) LRW frames
+//   cycle_wakeup         wake-up jitter of the same cycle thread
+//   change_detect_scalar / change_detect_sse2 / change_detect_avx2
+//                        ChangeDetector::Update() on a 4 KB input image
+//                        with N (items) bytes changed per update, one
+//                        subscriber per 4 bytes; rate in updates/s
+//   sdo_download_serial / sdo_download_parallel
+//                        N (items) expedited SDO downloads to each of 60
+//                        slaves answering after 500 us, one slave at a
+//                        time and all at once; rate in SDOs/s
+//
+//   ecat_bench [--format json|csv] [--output FILE] [--quick]
+//              [--priority N] [--cpu N]
+//
+// Results go to stdout or FILE, one record per measurement, so runs of two
+// releases can be diffed. Progress goes to stderr.
+
+#include <algorithm>
+#include <cctype>
+#include <chrono>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <vector>
+#include "AdsClientPool.h"
+#include "AdsStandInServer.h"
+#include "AdsSymbolCache.h"
+#include "ChangeDetector.h"
+#include "CoeMailbox.h"
+#include "CyclicExecutor.h"
+#include "EtherCATDatagramPacker.h"
+#include "Logger.h"
+#include "ProcessImage.h"
+#include "SiiReader.h"
+#include "SimulatedTransport.h"
+
+struct BenchResult {
+    std::string name;
+    unsigned long cycleUs;       // 0 outside the cycle measurements
+    unsigned long slaves;
+    unsigned long items;         // tags or datagrams per operation
+    uint64_t samples;
+    double meanUs;
+    double p50Us;
+    double p99Us;
+    double maxUs;
+    double ratePerSec;
+    uint64_t overruns;
+    uint64_t errors;
+};
+
+struct BenchOptions {
+    unsigned long adsIterations;
+    unsigned long frameIterations;
+    unsigned long cycles;
+    unsigned long sdosPerSlave;
+    int priority;
+    int cpuAffinity;
+};
+
+static int64_t NowNs() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// Raw samples, sorted for the percentiles: bench timings run from under a
+// microsecond to tens of milliseconds, far past JitterHistogram's 2 ms
+class SampleSet {
+private:
+    std::vector<int64_t> m_samples;
+    size_t m_count;
+
+    // Sorted samples only
+    int64_t Percentile(double fraction) const {
+        size_t index = static_cast<size_t>(fraction * static_cast<double>(m_count));
+        return m_samples[index < m_count ? index : m_count - 1];
+    }
+
+public:
+    explicit SampleSet(size_t capacity) : m_samples(capacity), m_count(0) {}
+
+    // Never allocates, so it can run on the cycle thread; samples beyond
+    // the capacity are dropped
+    void Record(int64_t ns) {
+        if (m_count < m_samples.size()) {
+            m_samples[m_count++] = ns < 0 ? 0 : ns;
+        }
+    }
+
+    JitterHistogram::Summary Summarize() {
+        JitterHistogram::Summary summary = {};
+        if (!m_count) {
+            return summary;
+        }
+        std::sort(m_samples.begin(), m_samples.begin() + m_count);
+        int64_t sumNs = 0;
+        for (size_t i = 0; i < m_count; i++) {
+            sumNs += m_samples[i];
+        }
+        summary.samples = m_count;
+        summary.minNs = m_samples[0];
+        summary.maxNs = m_samples[m_count - 1];
+        summary.meanNs = sumNs / static_cast<int64_t>(m_count);
+        summary.p50Ns = Percentile(0.5);
+        summary.p99Ns = Percentile(0.99);
+        summary.p999Ns = Percentile(0.999);
+        return summary;
+    }
+};
+
+static BenchResult MakeResult(const std::string& name, const JitterHistogram::Summary& summary,
+                              double ratePerSec) {
+    BenchResult result = {};
+    result.name = name;
+    result.samples = summary.samples;
+    result.meanUs = summary.meanNs / 1000.0;
+    result.p50Us = summary.p50Ns / 1000.0;
+    result.p99Us = summary.p99Ns / 1000.0;
+    result.maxUs = summary.maxNs / 1000.0;
+    result.ratePerSec = ratePerSec;
+    return result;
+}
+
+static bool BenchAds(const BenchOptions& options, std::vector<BenchResult>& results) {
+    const size_t kTags = 1000;
+    AdsStandInServer server;
+    server.AddSymbol("MAIN.nValue", 4);
+    for (size_t i = 0; i < kTags; i++) {
+        server.AddSymbol("GVL.nTag[" + std::to_string(i) + "]", 4);
+    }
+    uint16_t tcpPort = server.Start(0);
+    if (!tcpPort) {
+        std::cerr << "Error: Cannot start the ADS stand-in" << std::endl;
+        return false;
+    }
+    AmsRouter::Instance().SetTcpPort(tcpPort);
+
+    AmsAddr addr;
+    addr.netId.b[0] = 127;
+    addr.netId.b[1] = 0;
+    addr.netId.b[2] = 0;
+    addr.netId.b[3] = 1;
+    addr.netId.b[4] = 1;
+    addr.netId.b[5] = 1;
+    addr.port = 851;
+    long nPort = AdsPortOpenEx();
+
+    bool bOk = true;
+    {
+        AdsSymbolCache symbols;
+        symbols.Attach(nPort, addr);
+        AdsSymbolCache::Symbol* pValue = symbols.Resolve("MAIN.nValue");
+        std::vector<std::string> names;
+        for (size_t i = 0; i < kTags; i++) {
+            names.push_back("GVL.nTag[" + std::to_string(i) + "]");
+        }
+        std::vector<AdsSymbolCache::Symbol*> tags;
+        if (!pValue || symbols.ResolveAll(names, tags)) {
+            std::cerr << "Error: Cannot resolve the benchmark symbols" << std::endl;
+            bOk = false;
+        }
+
+        for (int write = 0; bOk && write < 2; write++) {
+            std::cerr << "ADS " << (write ? "write" : "read") << " round trip..." << std::endl;
+            SampleSet samples(options.adsIterations);
+            uint32_t value = 0;
+            unsigned long bytesRead = 0;
+            uint64_t errors = 0;
+            int64_t start = NowNs();
+            for (unsigned long i = 0; i < options.adsIterations; i++) {
+                int64_t t0 = NowNs();
+                long nErr = write ? symbols.Write(pValue, &value, sizeof(value))
+                                  : symbols.Read(pValue, &value, sizeof(value), &bytesRead);
+                samples.Record(NowNs() - t0);
+                errors += (nErr != 0);
+            }
+            double seconds = (NowNs() - start) / 1e9;
+            BenchResult result = MakeResult(write ? "ads_write_variable" : "ads_read_variable",
+                                            samples.Summarize(), options.adsIterations / seconds);
+            result.items = 1;
+            result.errors = errors;
+            results.push_back(result);
+        }
+
+        const size_t batchSizes[] = { 10, 100, 1000 };
+        for (size_t b = 0; bOk && b < sizeof(batchSizes) / sizeof(batchSizes[0]); b++) {
+            size_t count = batchSizes[b];
+            std::cerr << "ADS batch read of " << count << " tags..." << std::endl;
+            std::vector<uint32_t> values(count);
+            std::vector<AdsSymbolCache::Access> batch(count);
+            for (size_t i = 0; i < count; i++) {
+                batch[i] = AdsSymbolCache::Access{ tags[i], &values[i], sizeof(values[i]), 0 };
+            }
+
+            uint64_t errors = 0;
+            unsigned long iterations = options.adsIterations / 10 + 1;
+            SampleSet samples(iterations);
+            int64_t start = NowNs();
+            for (unsigned long i = 0; i < iterations; i++) {
+                int64_t t0 = NowNs();
+                errors += (symbols.ReadBatch(batch.data(), batch.size()) != 0);
+                samples.Record(NowNs() - t0);
+            }
+            double seconds = (NowNs() - start) / 1e9;
+            BenchResult result = MakeResult("ads_read_batch", samples.Summarize(),
+                                            iterations * count / seconds);
+            result.items = static_cast<unsigned long>(count);
+            result.errors = errors;
+            results.push_back(result);
+        }
+        symbols.ReleaseAll();
+    }
+
+    AdsPortCloseEx(nPort);
+    server.Stop();
+    return bOk;
+}
+
+// Gateway load: many callers, each waiting for its own tag, against a
+// target 1 ms away. One port serialises them; the pool's workers overlap
+// their round trips.
+static bool BenchAdsPool(const BenchOptions& options, std::vector<BenchResult>& results) {
+    const size_t kTags = 64;
+    const size_t kCallers = 32;
+    AdsStandInServer server;
+    for (size_t i = 0; i < kTags; i++) {
+        server.AddSymbol("GVL.nTag[" + std::to_string(i) + "]", 4);
+    }
+    server.SetLatency(std::chrono::milliseconds(1));
+    uint16_t tcpPort = server.Start(0);
+    if (!tcpPort) {
+        std::cerr << "Error: Cannot start the ADS stand-in" << std::endl;
+        return false;
+    }
+    AmsRouter::Instance().SetTcpPort(tcpPort);
+
+    bool bOk = true;
+    unsigned long readsPerCaller = options.adsIterations / 50 + 1;
+    const size_t workerCounts[] = { 1, 4, 16 };
+    for (size_t workers : workerCounts) {
+        std::cerr << "ADS pool, " << workers << " workers, " << kCallers << " callers..." << std::endl;
+        AdsClientPool pool;
+        AdsClientPool::Settings settings;
+        settings.workers = workers;
+        pool.SetSettings(settings);
+        size_t plc = pool.AddTarget("plc", AdsClientPool::Address("127.0.0.1.1.1", 851));
+        if (!pool.Start()) {
+            bOk = false;
+            break;
+        }
+
+        std::mutex lock;
+        SampleSet samples(kCallers * readsPerCaller);
+        std::atomic<uint64_t> errors(0);
+        std::vector<std::thread> callers;
+        int64_t start = NowNs();
+        for (size_t c = 0; c < kCallers; c++) {
+            callers.emplace_back([&, c]() {
+                std::string name = "GVL.nTag[" + std::to_string(c % kTags) + "]";
+                uint32_t value = 0;
+                for (unsigned long i = 0; i < readsPerCaller; i++) {
+                    int64_t t0 = NowNs();
+                    long nErr = pool.Read(plc, name, &value, sizeof(value));
+                    int64_t elapsed = NowNs() - t0;
+                    std::lock_guard<std::mutex> guard(lock);
+                    samples.Record(elapsed);
+                    errors += (nErr != 0);
+                }
+            });
+        }
+        for (std::thread& caller : callers) {
+            caller.join();
+        }
+        double seconds = (NowNs() - start) / 1e9;
+        pool.Stop();
+
+        BenchResult result = MakeResult("ads_pool_read", samples.Summarize(),
+                                        kCallers * readsPerCaller / seconds);
+        result.items = static_cast<unsigned long>(workers);
+        result.errors = errors;
+        results.push_back(result);
+    }
+    server.Stop();
+    return bOk;
+}
+
+// Packer cost per frame: a line without slaves hands every frame straight
+// back, so only building, transport bookkeeping and parsing remain
+static void BenchFrames(const BenchOptions& options, std::vector<BenchResult>& results) {
+    SimulatedSegment segment;
+    SimulatedSegment::Settings settings = segment.GetSettings();
+    settings.forwardingDelayNs = 0;
+    settings.linkMbps = 1000000;
+    segment.SetSettings(settings);
+    SimulatedTransport transport(segment);
+    EtherCATDatagramPacker packer;
+
+    const size_t datagramCounts[] = { 1, 120, 1000 };
+    for (size_t d = 0; d < sizeof(datagramCounts) / sizeof(datagramCounts[0]); d++) {
+        size_t count = datagramCounts[d];
+        std::cerr << "Frame build/parse, " << count << " datagrams..." << std::endl;
+        SampleSet samples(options.frameIterations);
+        uint64_t errors = 0;
+        uint64_t frames = 0;
+        int64_t start = NowNs();
+        for (unsigned long i = 0; i < options.frameIterations; i++) {
+            int64_t t0 = NowNs();
+            packer.Clear();
+            for (size_t n = 0; n < count; n++) {
+                packer.Add(ECAT_APRD, EcatPhysicalAddress(static_cast<uint16_t>(0 - n), ESC_REG_AL_STATUS), 2);
+            }
+            bool bOk = packer.Send(transport) && packer.Receive(transport, 1000);
+            samples.Record(NowNs() - t0);
+            errors += !bOk;
+            frames += packer.GetFrameCount();
+        }
+        double seconds = (NowNs() - start) / 1e9;
+        BenchResult result = MakeResult("frame_build_parse", samples.Summarize(), frames / seconds);
+        result.items = static_cast<unsigned long>(count);
+        result.errors = errors;
+        results.push_back(result);
+    }
+}
+
+// The process image exchange per cycle, sent and collected within the
+// cycle, against a line of slaves with 2 input and 2 output bytes each;
+// large lines take several LRW frames in flight together
+static bool BenchCycle(const BenchOptions& options, unsigned long cycleUs, unsigned long slaves,
+                       std::vector<BenchResult>& results) {
+    std::cerr << "Cycle " << cycleUs << " us, " << slaves << " slaves..." << std::endl;
+    SimulatedSegment segment;
+    SimulatedSegment::Settings settings = segment.GetSettings();
+    settings.initialState = ECAT_STATE_OP;
+    segment.SetSettings(settings);
+    segment.AddSyntheticSlaves(slaves, 2, 2);
+    const uint32_t inputAddress = 0x10000;
+    const uint32_t outputAddress = inputAddress + static_cast<uint32_t>(slaves) * 2;
+    uint16_t expectedWkc = segment.MapProcessData(inputAddress, outputAddress);
+
+    SimulatedTransport transport(segment);
+    EtherCATDatagramPacker packer;
+    ProcessImage image;
+    if (!image.Configure(inputAddress, slaves * 2, outputAddress, slaves * 2, expectedWkc)) {
+        return false;
+    }
+    std::vector<uint32_t> boundaries;
+    for (unsigned long i = 0; i <= slaves; i++) {
+        boundaries.push_back(inputAddress + static_cast<uint32_t>(i) * 2);
+        boundaries.push_back(outputAddress + static_cast<uint32_t>(i) * 2);
+    }
+    image.SetFrameBoundaries(boundaries);
+
+    SampleSet latency(options.cycles + options.cycles / 10 + 1000);   // cycles run on while the loop polls
+    CyclicExecutor executor;
+    executor.SetStage(CyclicExecutor::READ_INPUTS, [&]() {
+        int64_t t0 = NowNs();
+        packer.Clear();
+        size_t id = image.QueueExchange(packer);
+        if (packer.Send(transport)) {
+            packer.Receive(transport, static_cast<long>(cycleUs));
+        }
+        image.CompleteExchange(packer, id);
+        latency.Record(NowNs() - t0);
+    });
+
+    CyclicExecutor::Settings executorSettings;
+    executorSettings.cycleTimeUs = cycleUs;
+    executorSettings.priority = options.priority;
+    executorSettings.cpuAffinity = options.cpuAffinity;
+    executorSettings.lockMemory = options.priority > 0;
+    int64_t start = NowNs();
+    if (!executor.Start(executorSettings)) {
+        return false;
+    }
+    while (executor.GetStats().cycles < options.cycles) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    executor.Stop();
+
+    // Cycles actually run per second: below nominal when overruns skip deadlines
+    CyclicExecutor::Stats stats = executor.GetStats();
+    double seconds = (NowNs() - start) / 1e9;
+    BenchResult result = MakeResult("cycle_latency", latency.Summarize(), stats.cycles / seconds);
+    result.cycleUs = cycleUs;
+    result.slaves = slaves;
+    result.items = image.GetFrameCount();
+    result.overruns = stats.overruns;
+    result.errors = image.GetWkcErrorCount();
+    results.push_back(result);
+
+    BenchResult wakeup = MakeResult("cycle_wakeup", stats.wakeup, stats.cycles / seconds);
+    wakeup.cycleUs = cycleUs;
+    wakeup.slaves = slaves;
+    wakeup.overruns = stats.overruns;
+    results.push_back(wakeup);
+    return true;
+}
+
+// A drive line's parameter download at startup: every slave gets
+// Compare-and-dispatch cost per update for each instruction set the CPU
+// has; the changed bytes are spread over the image
+static void BenchChanges(const BenchOptions& options, std::vector<BenchResult>& results) {
+    const size_t kImageBytes = 4096;
+    const size_t changedCounts[] = { 0, 4, 64 };
+    const ChangeDetector::Isa isas[] = { ChangeDetector::ISA_SCALAR, ChangeDetector::ISA_SSE2,
+                                         ChangeDetector::ISA_AVX2 };
+    std::vector<uint8_t> image(kImageBytes, 0);
+    for (ChangeDetector::Isa isa : isas) {
+        if (isa > ChangeDetector::BestIsa()) {
+            continue;
+        }
+        for (size_t changed : changedCounts) {
+            std::string name = std::string("change_detect_") + ChangeDetector::IsaName(isa);
+            std::transform(name.begin(), name.end(), name.begin(),
+                           [](char c) { return static_cast<char>(tolower(c)); });
+            std::cerr << "Change detection, " << ChangeDetector::IsaName(isa) << ", " << changed
+                      << " bytes changed..." << std::endl;
+            ChangeDetector detector;
+            detector.Configure(kImageBytes, isa);
+            uint64_t events = 0;
+            for (size_t offset = 0; offset < kImageBytes; offset += 4) {
+                detector.Subscribe(offset, 4, [&events](const ChangeDetector::Change&) { events++; });
+            }
+            detector.Update(image.data());
+
+            // Batches of updates, as single ones are below the clock's resolution
+            const unsigned long kBatch = 1000;
+            std::vector<int64_t> batchNs;
+            uint64_t errors = 0;
+            int64_t start = NowNs();
+            for (unsigned long b = 0; b < options.frameIterations / 10 + 1; b++) {
+                int64_t t0 = NowNs();
+                for (unsigned long i = 0; i < kBatch; i++) {
+                    for (size_t c = 0; c < changed; c++) {
+                        image[(c * 4099 + i * 61) % kImageBytes]++;
+                    }
+                    size_t ranges = detector.Update(image.data());
+                    errors += (changed == 0) != (ranges == 0);
+                }
+                batchNs.push_back((NowNs() - t0) / static_cast<int64_t>(kBatch));
+            }
+            double seconds = (NowNs() - start) / 1e9;
+            std::sort(batchNs.begin(), batchNs.end());
+            JitterHistogram::Summary summary = {};
+            summary.samples = batchNs.size() * kBatch;
+            summary.p50Ns = batchNs[batchNs.size() / 2];
+            summary.p99Ns = batchNs[batchNs.size() * 99 / 100];
+            summary.maxNs = batchNs.back();
+            for (int64_t ns : batchNs) {
+                summary.meanNs += ns;
+            }
+            summary.meanNs /= static_cast<int64_t>(batchNs.size());
+            BenchResult result = MakeResult(name, summary, summary.samples / seconds);
+            result.items = static_cast<unsigned long>(changed);
+            result.errors = errors;
+            results.push_back(result);
+        }
+    }
+}
+
+// sdosPerSlave 4-byte downloads, first with one slave's mailbox busy at a
+// time, then with every mailbox working in parallel
+static bool BenchSdo(const BenchOptions& options, std::vector<BenchResult>& results) {
+    const uint16_t slaves = 60;
+    SimulatedSegment segment;
+    SimulatedSegment::Settings settings = segment.GetSettings();
+    settings.initialState = ECAT_STATE_PREOP;
+    segment.SetSettings(settings);
+    segment.AddSyntheticSlaves(slaves, 2, 2);
+    segment.MapProcessData(0x10000, 0x20000);     // mailbox sync managers, as a master would in INIT
+    SimulatedTransport transport(segment);
+    EtherCATDatagramPacker packer;
+
+    SiiReader sii;
+    std::vector<SlaveInfo> infos;
+    if (!sii.TakeAccess(transport, packer) || !sii.ReadAll(transport, packer, slaves, infos)) {
+        return false;
+    }
+
+    const uint16_t concurrency[] = { 1, 0 };
+    for (uint16_t maxActive : concurrency) {
+        std::cerr << "SDO download, " << slaves << " slaves x " << options.sdosPerSlave
+                  << (maxActive ? " SDOs, one slave at a time..." : " SDOs, all slaves at once...") << std::endl;
+        CoeMailbox mailbox;
+        CoeMailbox::Settings mailboxSettings;
+        mailboxSettings.maxActiveSlaves = maxActive;
+        mailbox.SetSettings(mailboxSettings);
+        for (uint16_t position = 0; position < slaves; position++) {
+            mailbox.AddSlave(position, infos[position]);
+            for (unsigned long n = 0; n < options.sdosPerSlave; n++) {
+                uint32_t value = static_cast<uint32_t>(position << 16 | n);
+                mailbox.Download(position, static_cast<uint16_t>(0x2000 + n % 0x100), 1, &value, sizeof(value));
+            }
+        }
+        int64_t start = NowNs();
+        bool bOk = mailbox.Run(transport, packer);
+        int64_t elapsedNs = NowNs() - start;
+
+        JitterHistogram::Summary summary = {};
+        summary.samples = 1;
+        summary.meanNs = summary.p50Ns = summary.p99Ns = summary.maxNs = elapsedNs;
+        BenchResult result = MakeResult(maxActive ? "sdo_download_serial" : "sdo_download_parallel", summary, mailbox.GetStats().transfers / (elapsedNs / 1e9));
+        result.slaves = slaves;
+        result.items = options.sdosPerSlave;
+        result.errors = mailbox.GetStats().failed + !bOk;
+        results.push_back(result);
+    }
+    return true;
+}
+
+static void WriteCsv(std::ostream& out, const std::vector<BenchResult>& results) {
+    out << "name,cycle_us,slaves,items,samples,mean_us,p50_us,p99_us,max_us,rate_per_s,overruns,errors\n";
+    for (const BenchResult& r : results) {
+        out << r.name << "," << r.cycleUs << "," << r.slaves << "," << r.items << "," << r.samples << ","
+            << r.meanUs << "," << r.p50Us << "," << r.p99Us << "," << r.maxUs << "," << r.ratePerSec << ","
+            << r.overruns << "," << r.errors << "\n";
+    }
+}
+
+static void WriteJson(std::ostream& out, const std::vector<BenchResult>& results) {
+    out << "{\n  \"benchmark\": \"ecat_bench\",\n  \"results\": [\n";
+    for (size_t i = 0; i < results.size(); i++) {
+        const BenchResult& r = results[i];
+        out << "    {\"name\": \"" << r.name << "\", \"cycle_us\": " << r.cycleUs
+            << ", \"slaves\": " << r.slaves << ", \"items\": " << r.items << ", \"samples\": " << r.samples
+            << ", \"mean_us\": " << r.meanUs << ", \"p50_us\": " << r.p50Us << ", \"p99_us\": " << r.p99Us
+            << ", \"max_us\": " << r.maxUs << ", \"rate_per_s\": " << r.ratePerSec
+            << ", \"overruns\": " << r.overruns << ", \"errors\": " << r.errors << "}"
+            << (i + 1 < results.size() ? "," : "") << "\n";
+    }
+    out << "  ]\n}\n";
+}
+
+int main(int argc, char* argv[]) {
+    std::string format = "json";
+    std::string outputPath;
+    BenchOptions options = { 5000, 20000, 2000, 50, 0, -1 };
+
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        bool hasValue = (i + 1 < argc);
+        if (arg == "--format" && hasValue) {
+            format = argv[++i];
+        } else if (arg == "--output" && hasValue) {
+            outputPath = argv[++i];
+        } else if (arg == "--quick") {
+            options.adsIterations = 500;
+            options.frameIterations = 2000;
+            options.cycles = 200;
+            options.sdosPerSlave = 5;
+        } else if (arg == "--priority" && hasValue) {
+            options.priority = atoi(argv[++i]);
+        } else if (arg == "--cpu" && hasValue) {
+            options.cpuAffinity = atoi(argv[++i]);
+        } else {
+            format.clear();
+            break;
+        }
+    }
+    if (format != "json" && format != "csv") {
+        std::cout << "Usage: " << argv[0]
+                  << " [--format json|csv] [--output FILE] [--quick] [--priority N] [--cpu N]\n";
+        return 1;
+    }
+
+    // Results own stdout; the engines' info lines would mix into them
+    Logger::Instance().SetLevel(LOG_LEVEL_WARNING);
+
+    std::vector<BenchResult> results;
+    bool bOk = BenchAds(options, results);
+    bOk = BenchAdsPool(options, results) && bOk;
+    BenchFrames(options, results);
+    BenchChanges(options, results);
+
+    const unsigned long cycleTimes[] = { 250, 500, 1000 };
+    const unsigned long slaveCounts[] = { 10, 100, 300, 1000 };
+    for (unsigned long cycleUs : cycleTimes) {
+        for (unsigned long slaves : slaveCounts) {
+            bOk = BenchCycle(options, cycleUs, slaves, results) && bOk;
+        }
+    }
+
+    bOk = BenchSdo(options, results) && bOk;
+
+    std::ofstream file;
+    if (!outputPath.empty()) {
+        file.open(outputPath);
+        if (!file) {
+            std::cerr << "Error: Cannot write '" << outputPath << "'" << std::endl;
+            return 1;
+        }
+    }
+    std::ostream& out = outputPath.empty() ? std::cout : file;
+    if (format == "csv") {
+        WriteCsv(out, results);
+    } else {
+        WriteJson(out, results);
+    }
+    return bOk ? 0 : 1;
+}
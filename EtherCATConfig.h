@@ -0,0 +1,590 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <fstream>
+#include <string>
+#include <vector>
+#include "Logger.h"
+#include "XmlReader.h"
+
+// State transitions an init command runs in (ENI <Transition>)
+static const uint16_t ECAT_TRANSITION_IP = 0x0001;
+static const uint16_t ECAT_TRANSITION_PS = 0x0002;
+static const uint16_t ECAT_TRANSITION_SO = 0x0004;
+static const uint16_t ECAT_TRANSITION_OS = 0x0008;
+static const uint16_t ECAT_TRANSITION_SP = 0x0010;
+static const uint16_t ECAT_TRANSITION_PI = 0x0020;
+static const uint16_t ECAT_TRANSITION_SI = 0x0040;
+static const uint16_t ECAT_TRANSITION_OI = 0x0080;
+static const uint16_t ECAT_TRANSITION_OP = 0x0100;
+static const uint16_t ECAT_TRANSITION_IB = 0x0200;
+static const uint16_t ECAT_TRANSITION_BI = 0x0400;
+static const uint16_t ECAT_TRANSITION_II = 0x0800;
+static const uint16_t ECAT_TRANSITION_PP = 0x1000;
+static const uint16_t ECAT_TRANSITION_SS = 0x2000;
+
+// One <Slave> entry, in line order
+struct EtherCATSlaveConfig {
+    uint16_t position;
+    std::string name;
+    uint32_t vendorId;           // VendorId, Beckhoff (2) if absent
+    uint32_t productCode;
+    uint16_t inputSize;          // InputSize, process data bytes the slave sends
+    uint16_t outputSize;         // OutputSize, process data bytes the slave receives
+    uint32_t stateTimeoutMs;     // StateTimeout, per state change, 0 = master default
+    uint32_t revision;           // ENI RevisionNo, 0 = any
+    uint16_t stationAddress;     // ENI PhysAddr, 0 = not assigned
+};
+
+// One PDO (ENI <RxPdo>/<TxPdo>); its entries are
+// pdoEntries[firstEntry, firstEntry + entryCount)
+struct EtherCATPdoConfig {
+    uint16_t slave;              // index into slaves
+    uint16_t index;              // 0x16xx outputs, 0x1Axx inputs
+    bool bInput;                 // TxPdo
+    int8_t syncManager;          // Sm attribute (ours: 2 outputs, 3 inputs), -1 = not assigned
+    std::string name;
+    uint32_t firstEntry;
+    uint32_t entryCount;
+};
+
+struct EtherCATPdoEntryConfig {
+    uint16_t index;              // 0 = padding
+    uint8_t subIndex;
+    uint8_t bitLength;
+    std::string name;
+    std::string dataType;
+};
+
+// One ENI <InitCmd>; its data is initData[dataOffset, dataOffset + dataLength)
+struct EtherCATInitCommand {
+    int32_t slave;               // index into slaves, -1 = master command
+    uint16_t transitions;        // ECAT_TRANSITION_*
+    uint8_t command;             // EcatCommand
+    uint16_t adp;
+    uint16_t ado;
+    uint32_t dataOffset;
+    uint16_t dataLength;
+    uint16_t expectedWkc;        // <Cnt>
+    uint16_t retries;
+    uint32_t timeoutMs;
+};
+
+// One CoE SDO transfer run on a state change (ENI <Mailbox><CoE><InitCmd>,
+// <Sdo> in our <Slave>); its data is initData[dataOffset, dataOffset + dataLength)
+struct EtherCATCoeCommand {
+    uint16_t slave;              // index into slaves
+    uint16_t transitions;        // ECAT_TRANSITION_*
+    bool bUpload;                // <Ccs> 2, otherwise a download
+    bool bCompleteAccess;
+    uint16_t index;
+    uint8_t subIndex;
+    uint32_t dataOffset;
+    uint32_t dataLength;
+    uint32_t timeoutMs;          // 0 = master default
+};
+
+// One <Segment> in <Segments>: another EtherCAT line on its own port,
+// cycled by its own thread in phase with the line this file configures
+struct EtherCATSegmentConfig {
+    std::string adapter;         // Adapter, interface name or "sim"
+    std::string config;          // Config, that line's configuration file, relative to this one
+};
+
+// Settings read from ethercat_config.xml or from an ENI file (EtherCAT
+// Network Information, ETG.2100) exported by a configurator; the root
+// element tells which. Either is read in one streaming pass, so file size
+// only costs time, not memory. Anything missing keeps its default.
+//
+// From an ENI the cycle time, slaves, PDOs and init commands (register
+// and CoE) are taken; our format can list CoE downloads as
+// <Sdo Index= SubIndex= Data="hex" CompleteAccess= Timeout=/> in a
+// <Slave>, run on PREOP->SAFEOP, and its PDOs as <TxPdo Index= Name=>
+// (inputs) or <RxPdo> with <Entry Index= SubIndex= BitLength= Name=
+// DataType=/> inside; they size a slave that gives no InputSize/OutputSize.
+// The cyclic logical commands give the process image: LRD and LWR keep
+// their own addresses, an LRW is split into outputs followed by inputs
+// as sized by <ProcessImage>; the expected LRW working counter is the
+// LRD count plus twice the LWR count.
+struct EtherCATConfig {
+    // <MasterConfiguration>
+    unsigned long cycleTimeUs;   // <CycleTime>, microseconds
+    int priority;                // <Priority>, SCHED_FIFO priority (1-99)
+    int cpuAffinity;             // <CPUAffinity>, core for the cycle thread, -1 = any
+    std::string logFile;         // <LogFile>, log copy with timestamps, empty = console only
+    std::string topologyCache;   // <TopologyCache>, scanned slaves kept between runs, empty = scan every start
+    bool dcEnabled;              // <DistributedClocks Enabled=...>
+    unsigned long dcShiftUs;     // <DistributedClocks ShiftTime=...>, SYNC0 after the cycle start
+    std::string recorderDirectory;   // <Recorder Directory=...>, process data recording, empty = off
+    unsigned long recorderFiles;     // <Recorder Files=...>, segment files in the ring
+    unsigned long recorderFileMB;    // <Recorder FileSize=...>, MB per segment file
+    bool sharedImageOutputs;         // <SharedImage AcceptOutputs=...>, one local process may write outputs
+    unsigned long frameTimeoutUs;    // <FrameLoss Timeout=...>, per frame outside the cycle, 0 = per exchange
+    unsigned long frameRetries;      // <FrameLoss Retries=...>, resends of a lost frame, 0 = give it up
+
+    // <ProcessData>: logical (FMMU) addresses of the process image
+    uint32_t inputAddress;       // <Inputs StartAddress=...>
+    uint32_t inputSize;          // <Inputs Size=...>
+    uint32_t outputAddress;
+    uint32_t outputSize;
+    uint16_t expectedWkc;        // <ProcessData ExpectedWKC=...>, LRW working counter
+
+    std::vector<EtherCATSlaveConfig> slaves;   // <Slaves>
+    std::vector<EtherCATSegmentConfig> segments;   // <Segments>, further lines run alongside
+
+    std::vector<EtherCATPdoConfig> pdos;              // ENI, <TxPdo>/<RxPdo> in a <Slave>
+    std::vector<EtherCATPdoEntryConfig> pdoEntries;
+
+    // ENI only
+    std::vector<EtherCATInitCommand> initCommands;
+    std::vector<uint8_t> initData;
+
+    std::vector<EtherCATCoeCommand> coeCommands;    // ENI, <Sdo>
+
+    EtherCATConfig()
+        : cycleTimeUs(1000), priority(99), cpuAffinity(-1), dcEnabled(false), dcShiftUs(0), recorderFiles(8),
+          recorderFileMB(16), sharedImageOutputs(false), frameTimeoutUs(0), frameRetries(0),
+          inputAddress(0), inputSize(0), outputAddress(0), outputSize(0), expectedWkc(0) {}
+
+    bool Load(const std::string& path) {
+        std::ifstream file(path, std::ios::binary);
+        if (!file) {
+            LogError() << "Error: Cannot open configuration file '" << path << "'";
+            return false;
+        }
+        *this = EtherCATConfig();
+        Handler handler(*this);
+        XmlReader reader;
+        if (!reader.Parse(file, handler)) {
+            LogError() << "Error: '" << path << "' " << reader.GetError();
+            return false;
+        }
+        if (!handler.Finish(path)) {
+            return false;
+        }
+
+        if (cycleTimeUs == 0) {
+            LogError() << "Error: <CycleTime> must be greater than 0";
+            return false;
+        }
+        return true;
+    }
+
+    static uint32_t ParseNumber(const std::string& text) {
+        // ENI writes hex as #x1A00
+        if (text.size() > 2 && text[0] == '#' && (text[1] == 'x' || text[1] == 'X')) {
+            return strtoul(text.c_str() + 2, nullptr, 16);
+        }
+        return strtoul(text.c_str(), nullptr, 0);
+    }
+
+private:
+    // Builds the tables while the reader walks the document
+    class Handler : public XmlHandler {
+    private:
+        EtherCATConfig& m_config;
+        bool m_bEni;
+        bool m_bMaster;              // <MasterConfiguration> seen
+        uint32_t m_sendBits;         // per ENI slave
+        uint32_t m_recvBits;
+        uint32_t m_readCount;        // cyclic LRD/LRW working counters
+        uint32_t m_writeCount;       // cyclic LWR working counters
+        uint32_t m_imageInputs;      // <ProcessImage> sizes
+        uint32_t m_imageOutputs;
+        bool m_bLrw;
+        uint32_t m_lrwAddress;
+        uint32_t m_lrwLength;
+        uint8_t m_cyclicCommand;     // of the <Cmd> being read
+        uint32_t m_cyclicAddress;
+        uint32_t m_cyclicLength;
+        uint32_t m_cyclicCount;
+
+        static bool Is(const std::vector<std::string>& path, size_t depth, const char* name) {
+            return path.size() == depth + 1 && path[depth] == name;
+        }
+
+        static uint16_t Transition(const std::string& text) {
+            static const char* const kNames[] = { "IP", "PS", "SO", "OS", "SP", "PI", "SI", "OI",
+                                                  "OP", "IB", "BI", "II", "PP", "SS" };
+            for (size_t i = 0; i < sizeof(kNames) / sizeof(kNames[0]); i++) {
+                if (text == kNames[i]) {
+                    return static_cast<uint16_t>(1u << i);
+                }
+            }
+            return 0;
+        }
+
+        void AppendHex(const std::string& text) {
+            for (size_t i = 0; i + 1 < text.size(); i += 2) {
+                m_config.initData.push_back(static_cast<uint8_t>(strtoul(text.substr(i, 2).c_str(), nullptr, 16)));
+            }
+        }
+
+        void StartOwn(const std::vector<std::string>& path, const XmlAttributes& attributes) {
+            const std::string* pValue;
+            if (Is(path, 1, "MasterConfiguration")) {
+                m_bMaster = true;
+            } else if (Is(path, 2, "DistributedClocks") && path[1] == "MasterConfiguration") {
+                m_config.dcEnabled = (pValue = attributes.Find("Enabled")) && *pValue == "true";
+                m_config.dcShiftUs = (pValue = attributes.Find("ShiftTime")) ? ParseNumber(*pValue) : 0;
+            } else if (Is(path, 2, "Recorder") && path[1] == "MasterConfiguration") {
+                m_config.recorderDirectory = (pValue = attributes.Find("Directory")) ? *pValue : std::string();
+                if ((pValue = attributes.Find("Files"))) {
+                    m_config.recorderFiles = ParseNumber(*pValue);
+                }
+                if ((pValue = attributes.Find("FileSize"))) {
+                    m_config.recorderFileMB = ParseNumber(*pValue);
+                }
+            } else if (Is(path, 2, "SharedImage") && path[1] == "MasterConfiguration") {
+                m_config.sharedImageOutputs = (pValue = attributes.Find("AcceptOutputs")) && *pValue == "true";
+            } else if (Is(path, 2, "FrameLoss") && path[1] == "MasterConfiguration") {
+                m_config.frameTimeoutUs = (pValue = attributes.Find("Timeout")) ? ParseNumber(*pValue) : 0;
+                m_config.frameRetries = (pValue = attributes.Find("Retries")) ? ParseNumber(*pValue) : 0;
+            } else if (Is(path, 1, "ProcessData")) {
+                if ((pValue = attributes.Find("ExpectedWKC"))) {
+                    m_config.expectedWkc = static_cast<uint16_t>(ParseNumber(*pValue));
+                }
+            } else if ((Is(path, 2, "Inputs") || Is(path, 2, "Outputs")) && path[1] == "ProcessData") {
+                bool bInputs = (path[2] == "Inputs");
+                uint32_t& address = bInputs ? m_config.inputAddress : m_config.outputAddress;
+                uint32_t& size = bInputs ? m_config.inputSize : m_config.outputSize;
+                address = (pValue = attributes.Find("StartAddress")) ? ParseNumber(*pValue) : 0;
+                size = (pValue = attributes.Find("Size")) ? ParseNumber(*pValue) : 0;
+            } else if (Is(path, 2, "Segment") && path[1] == "Segments") {
+                EtherCATSegmentConfig segment;
+                segment.adapter = (pValue = attributes.Find("Adapter")) ? *pValue : std::string();
+                segment.config = (pValue = attributes.Find("Config")) ? *pValue : std::string();
+                m_config.segments.push_back(segment);
+            } else if (Is(path, 2, "Slave") && path[1] == "Slaves") {
+                EtherCATSlaveConfig slave = { static_cast<uint16_t>(m_config.slaves.size()), std::string(),
+                                              2, 0, 0, 0, 0, 0, 0 };
+                if ((pValue = attributes.Find("Position"))) {
+                    slave.position = static_cast<uint16_t>(ParseNumber(*pValue));
+                }
+                if ((pValue = attributes.Find("Name"))) {
+                    slave.name = *pValue;
+                }
+                if ((pValue = attributes.Find("VendorId"))) {
+                    slave.vendorId = ParseNumber(*pValue);
+                }
+                if ((pValue = attributes.Find("ProductCode"))) {
+                    slave.productCode = ParseNumber(*pValue);
+                }
+                if ((pValue = attributes.Find("InputSize"))) {
+                    slave.inputSize = static_cast<uint16_t>(ParseNumber(*pValue));
+                }
+                if ((pValue = attributes.Find("OutputSize"))) {
+                    slave.outputSize = static_cast<uint16_t>(ParseNumber(*pValue));
+                }
+                if ((pValue = attributes.Find("StateTimeout"))) {
+                    slave.stateTimeoutMs = ParseNumber(*pValue);
+                }
+                m_config.slaves.push_back(slave);
+            } else if (Is(path, 3, "Sdo") && path[2] == "Slave" && !m_config.slaves.empty()) {
+                EtherCATCoeCommand command = { static_cast<uint16_t>(m_config.slaves.size() - 1), ECAT_TRANSITION_PS,
+                                               false, false, 0, 0, static_cast<uint32_t>(m_config.initData.size()), 0,
+                                               0 };
+                command.bCompleteAccess = (pValue = attributes.Find("CompleteAccess")) && *pValue == "true";
+                if ((pValue = attributes.Find("Index"))) {
+                    command.index = static_cast<uint16_t>(ParseNumber(*pValue));
+                }
+                if ((pValue = attributes.Find("SubIndex"))) {
+                    command.subIndex = static_cast<uint8_t>(ParseNumber(*pValue));
+                }
+                if ((pValue = attributes.Find("Data"))) {
+                    AppendHex(*pValue);
+                }
+                if ((pValue = attributes.Find("Timeout"))) {
+                    command.timeoutMs = ParseNumber(*pValue);
+                }
+                command.dataLength = static_cast<uint32_t>(m_config.initData.size() - command.dataOffset);
+                m_config.coeCommands.push_back(command);
+            } else if ((Is(path, 3, "TxPdo") || Is(path, 3, "RxPdo")) && path[2] == "Slave" &&
+                       !m_config.slaves.empty()) {
+                bool bInput = (path[3] == "TxPdo");
+                EtherCATPdoConfig pdo = { static_cast<uint16_t>(m_config.slaves.size() - 1), 0, bInput,
+                                          static_cast<int8_t>(bInput ? 3 : 2), std::string(),
+                                          static_cast<uint32_t>(m_config.pdoEntries.size()), 0 };
+                if ((pValue = attributes.Find("Index"))) {
+                    pdo.index = static_cast<uint16_t>(ParseNumber(*pValue));
+                }
+                if ((pValue = attributes.Find("Name"))) {
+                    pdo.name = *pValue;
+                }
+                m_config.pdos.push_back(pdo);
+            } else if (Is(path, 4, "Entry") && (path[3] == "TxPdo" || path[3] == "RxPdo") && !m_config.pdos.empty()) {
+                EtherCATPdoEntryConfig entry = { 0, 0, 0, std::string(), std::string() };
+                if ((pValue = attributes.Find("Index"))) {
+                    entry.index = static_cast<uint16_t>(ParseNumber(*pValue));
+                }
+                if ((pValue = attributes.Find("SubIndex"))) {
+                    entry.subIndex = static_cast<uint8_t>(ParseNumber(*pValue));
+                }
+                if ((pValue = attributes.Find("BitLength"))) {
+                    entry.bitLength = static_cast<uint8_t>(ParseNumber(*pValue));
+                }
+                if ((pValue = attributes.Find("Name"))) {
+                    entry.name = *pValue;
+                }
+                if ((pValue = attributes.Find("DataType"))) {
+                    entry.dataType = *pValue;
+                }
+                m_config.pdoEntries.push_back(entry);
+                m_config.pdos.back().entryCount++;
+            }
+        }
+
+        void EndOwn(const std::vector<std::string>& path, const std::string& text) {
+            if (path.size() != 3 || path[1] != "MasterConfiguration") {
+                return;
+            }
+            if (path[2] == "CycleTime") {
+                m_config.cycleTimeUs = ParseNumber(text);
+            } else if (path[2] == "Priority") {
+                m_config.priority = atoi(text.c_str());
+            } else if (path[2] == "CPUAffinity") {
+                m_config.cpuAffinity = atoi(text.c_str());
+            } else if (path[2] == "LogFile") {
+                m_config.logFile = text;
+            } else if (path[2] == "TopologyCache") {
+                m_config.topologyCache = text;
+            }
+        }
+
+        // ENI: EtherCATConfig/Config/{Master,Slave,Cyclic,ProcessImage}
+        void StartEni(const std::vector<std::string>& path, const XmlAttributes& attributes) {
+            if (path.size() < 3 || path[1] != "Config") {
+                return;
+            }
+            if (Is(path, 2, "Slave")) {
+                EtherCATSlaveConfig slave = { static_cast<uint16_t>(m_config.slaves.size()), std::string(),
+                                              0, 0, 0, 0, 0, 0, 0 };
+                m_config.slaves.push_back(slave);
+                m_sendBits = 0;
+                m_recvBits = 0;
+            } else if (path.size() == 5 && path[2] == "Slave" && path[3] == "ProcessData" &&
+                       (path[4] == "RxPdo" || path[4] == "TxPdo")) {
+                const std::string* pSm = attributes.Find("Sm");
+                EtherCATPdoConfig pdo = { static_cast<uint16_t>(m_config.slaves.size() - 1), 0, path[4] == "TxPdo",
+                                          static_cast<int8_t>(pSm ? ParseNumber(*pSm) : -1), std::string(),
+                                          static_cast<uint32_t>(m_config.pdoEntries.size()), 0 };
+                m_config.pdos.push_back(pdo);
+            } else if (path.size() == 6 && path[2] == "Slave" && path[3] == "ProcessData" && path[5] == "Entry" &&
+                       !m_config.pdos.empty()) {
+                m_config.pdoEntries.push_back(EtherCATPdoEntryConfig{ 0, 0, 0, std::string(), std::string() });
+                m_config.pdos.back().entryCount++;
+            } else if (path.size() == 5 && path[4] == "InitCmd" && path[3] == "InitCmds" &&
+                       (path[2] == "Slave" || path[2] == "Master")) {
+                int32_t slave = (path[2] == "Slave") ? static_cast<int32_t>(m_config.slaves.size()) - 1 : -1;
+                m_config.initCommands.push_back(EtherCATInitCommand{
+                    slave, 0, 0, 0, 0, static_cast<uint32_t>(m_config.initData.size()), 0, 0, 0, 0 });
+            } else if (path.size() == 7 && path[2] == "Slave" && path[3] == "Mailbox" && path[4] == "CoE" &&
+                       path[6] == "InitCmd") {
+                const std::string* pAccess = attributes.Find("CompleteAccess");
+                m_config.coeCommands.push_back(EtherCATCoeCommand{
+                    static_cast<uint16_t>(m_config.slaves.size() - 1), 0, false,
+                    pAccess && (*pAccess == "true" || *pAccess == "1"), 0, 0,
+                    static_cast<uint32_t>(m_config.initData.size()), 0, 0 });
+            } else if (path.size() == 5 && path[2] == "Cyclic" && path[3] == "Frame" && path[4] == "Cmd") {
+                m_cyclicCommand = 0;
+                m_cyclicAddress = 0;
+                m_cyclicLength = 0;
+                m_cyclicCount = 0;
+            }
+        }
+
+        void EndEni(const std::vector<std::string>& path, const std::string& text) {
+            if (path.size() < 3 || path[1] != "Config") {
+                return;
+            }
+            const std::string& name = path.back();
+            if (path[2] == "Slave" && !m_config.slaves.empty()) {
+                EtherCATSlaveConfig& slave = m_config.slaves.back();
+                if (path.size() == 3) {
+                    slave.inputSize = static_cast<uint16_t>((m_recvBits + 7) / 8);
+                    slave.outputSize = static_cast<uint16_t>((m_sendBits + 7) / 8);
+                } else if (path.size() == 5 && path[3] == "Info") {
+                    if (name == "Name") {
+                        slave.name = text;
+                    } else if (name == "VendorId") {
+                        slave.vendorId = ParseNumber(text);
+                    } else if (name == "ProductCode") {
+                        slave.productCode = ParseNumber(text);
+                    } else if (name == "RevisionNo") {
+                        slave.revision = ParseNumber(text);
+                    } else if (name == "PhysAddr") {
+                        slave.stationAddress = static_cast<uint16_t>(ParseNumber(text));
+                    } else if (name == "AutoIncAddr") {
+                        slave.position = static_cast<uint16_t>(0 - ParseNumber(text));
+                    }
+                } else if (path.size() == 6 && path[3] == "ProcessData" && name == "BitLength") {
+                    (path[4] == "Send" ? m_sendBits : m_recvBits) += ParseNumber(text);
+                } else if (path.size() == 6 && path[3] == "ProcessData" && !m_config.pdos.empty()) {
+                    EtherCATPdoConfig& pdo = m_config.pdos.back();
+                    if (name == "Index") {
+                        pdo.index = static_cast<uint16_t>(ParseNumber(text));
+                    } else if (name == "Name") {
+                        pdo.name = text;
+                    }
+                } else if (path.size() == 7 && path[5] == "Entry" && !m_config.pdoEntries.empty()) {
+                    EtherCATPdoEntryConfig& entry = m_config.pdoEntries.back();
+                    if (name == "Index") {
+                        entry.index = static_cast<uint16_t>(ParseNumber(text));
+                    } else if (name == "SubIndex") {
+                        entry.subIndex = static_cast<uint8_t>(ParseNumber(text));
+                    } else if (name == "BitLen") {
+                        entry.bitLength = static_cast<uint8_t>(ParseNumber(text));
+                    } else if (name == "Name") {
+                        entry.name = text;
+                    } else if (name == "DataType") {
+                        entry.dataType = text;
+                    }
+                }
+            }
+            if (path.size() == 6 && path[4] == "InitCmd" && !m_config.initCommands.empty()) {
+                EtherCATInitCommand& command = m_config.initCommands.back();
+                if (name == "Transition") {
+                    command.transitions |= Transition(text);
+                } else if (name == "Cmd") {
+                    command.command = static_cast<uint8_t>(ParseNumber(text));
+                } else if (name == "Adp") {
+                    command.adp = static_cast<uint16_t>(ParseNumber(text));
+                } else if (name == "Ado") {
+                    command.ado = static_cast<uint16_t>(ParseNumber(text));
+                } else if (name == "Data") {
+                    AppendHex(text);
+                    command.dataLength = static_cast<uint16_t>(m_config.initData.size() - command.dataOffset);
+                } else if (name == "DataLength" && command.dataLength == 0) {
+                    command.dataLength = static_cast<uint16_t>(ParseNumber(text));
+                    m_config.initData.resize(command.dataOffset + command.dataLength, 0);
+                } else if (name == "Cnt") {
+                    command.expectedWkc = static_cast<uint16_t>(ParseNumber(text));
+                } else if (name == "Retries") {
+                    command.retries = static_cast<uint16_t>(ParseNumber(text));
+                } else if (name == "Timeout") {
+                    command.timeoutMs = ParseNumber(text);
+                }
+            }
+            if (path.size() == 8 && path[6] == "InitCmd" && path[4] == "CoE" && !m_config.coeCommands.empty()) {
+                EtherCATCoeCommand& command = m_config.coeCommands.back();
+                if (name == "Transition") {
+                    command.transitions |= Transition(text);
+                } else if (name == "Ccs") {
+                    command.bUpload = (ParseNumber(text) == 2);
+                } else if (name == "Index") {
+                    command.index = static_cast<uint16_t>(ParseNumber(text));
+                } else if (name == "SubIndex") {
+                    command.subIndex = static_cast<uint8_t>(ParseNumber(text));
+                } else if (name == "Data") {
+                    AppendHex(text);
+                    command.dataLength = static_cast<uint32_t>(m_config.initData.size() - command.dataOffset);
+                } else if (name == "Timeout") {
+                    command.timeoutMs = ParseNumber(text);
+                } else if (name == "CompleteAccess") {
+                    command.bCompleteAccess = (text == "true" || text == "1");
+                }
+            }
+            if (path[2] == "Cyclic") {
+                if (path.size() == 4 && name == "CycleTime") {
+                    m_config.cycleTimeUs = ParseNumber(text);
+                } else if (path.size() == 6 && path[4] == "Cmd") {
+                    if (name == "Cmd") {
+                        m_cyclicCommand = static_cast<uint8_t>(ParseNumber(text));
+                    } else if (name == "Addr") {
+                        m_cyclicAddress = ParseNumber(text);
+                    } else if (name == "DataLength") {
+                        m_cyclicLength = ParseNumber(text);
+                    } else if (name == "Cnt") {
+                        m_cyclicCount = ParseNumber(text);
+                    }
+                } else if (path.size() == 5 && name == "Cmd") {
+                    EndCyclicCommand();
+                }
+            }
+            if (path.size() == 5 && path[2] == "ProcessImage" && name == "ByteSize") {
+                (path[3] == "Inputs" ? m_imageInputs : m_imageOutputs) = ParseNumber(text);
+            }
+        }
+
+        // ENI command numbers: LRD 10, LWR 11, LRW 12
+        void EndCyclicCommand() {
+            if (m_cyclicCommand == 10) {
+                m_config.inputAddress = m_cyclicAddress;
+                m_config.inputSize = m_cyclicLength;
+                m_readCount += m_cyclicCount;
+            } else if (m_cyclicCommand == 11) {
+                m_config.outputAddress = m_cyclicAddress;
+                m_config.outputSize = m_cyclicLength;
+                m_writeCount += m_cyclicCount;
+            } else if (m_cyclicCommand == 12) {
+                m_bLrw = true;
+                m_lrwAddress = m_cyclicAddress;
+                m_lrwLength = m_cyclicLength;
+                m_readCount += m_cyclicCount;
+            }
+        }
+
+    public:
+        explicit Handler(EtherCATConfig& config)
+            : m_config(config), m_bEni(false), m_bMaster(false), m_sendBits(0), m_recvBits(0),
+              m_readCount(0), m_writeCount(0), m_imageInputs(0), m_imageOutputs(0), m_bLrw(false),
+              m_lrwAddress(0), m_lrwLength(0), m_cyclicCommand(0), m_cyclicAddress(0), m_cyclicLength(0),
+              m_cyclicCount(0) {}
+
+        void OnStart(const std::vector<std::string>& path, const XmlAttributes& attributes) override {
+            if (path.size() == 1) {
+                m_bEni = (path[0] == "EtherCATConfig");
+            } else if (m_bEni) {
+                StartEni(path, attributes);
+            } else {
+                StartOwn(path, attributes);
+            }
+        }
+
+        void OnEnd(const std::vector<std::string>& path, const std::string& text) override {
+            if (m_bEni) {
+                EndEni(path, text);
+            } else {
+                EndOwn(path, text);
+            }
+        }
+
+        bool Finish(const std::string& path) {
+            if (!m_bEni) {
+                if (!m_bMaster) {
+                    LogError() << "Error: No <MasterConfiguration> in '" << path << "'";
+                    return false;
+                }
+                // A slave with PDOs but no InputSize/OutputSize gets what its entries take
+                std::vector<uint32_t> inputBits(m_config.slaves.size(), 0);
+                std::vector<uint32_t> outputBits(m_config.slaves.size(), 0);
+                for (const EtherCATPdoConfig& pdo : m_config.pdos) {
+                    for (uint32_t e = pdo.firstEntry; e < pdo.firstEntry + pdo.entryCount; e++) {
+                        (pdo.bInput ? inputBits : outputBits)[pdo.slave] += m_config.pdoEntries[e].bitLength;
+                    }
+                }
+                for (size_t i = 0; i < m_config.slaves.size(); i++) {
+                    EtherCATSlaveConfig& slave = m_config.slaves[i];
+                    if (!slave.inputSize) {
+                        slave.inputSize = static_cast<uint16_t>((inputBits[i] + 7) / 8);
+                    }
+                    if (!slave.outputSize) {
+                        slave.outputSize = static_cast<uint16_t>((outputBits[i] + 7) / 8);
+                    }
+                }
+                return true;
+            }
+            if (m_bLrw) {
+                uint32_t outputs = std::min(m_imageOutputs, m_lrwLength);
+                m_config.outputAddress = m_lrwAddress;
+                m_config.outputSize = outputs;
+                m_config.inputAddress = m_lrwAddress + outputs;
+                m_config.inputSize = m_lrwLength - outputs;
+            }
+            m_config.expectedWkc = static_cast<uint16_t>(m_readCount + 2 * m_writeCount);
+            return true;
+        }
+    };
+};
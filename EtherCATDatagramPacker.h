@@ -0,0 +1,416 @@
+#pragma once
+
+#include <chrono>
+#include <cstring>
+#include <vector>
+#include "EtherCATFrame.h"
+#include "FrameTransport.h"
+#include "RtMemory.h"
+
+// Packs EtherCAT datagrams (BRD, APRD, FPRD, FPWR, LRW, ARMW...) into as few
+// frames as fit the 1498-byte payload, sends them with one kick and hands
+// each datagram's data and working counter back to its caller. Every frame
+// carries its own datagram index, so all frames of a batch are in flight
+// at once and replies are matched even if frames return out of order or a
+// stale frame from an earlier cycle shows up.
+//
+// Each frame may get its own timeout. A frame not back by then is lost:
+// with LOSS_SKIP it is given up, with LOSS_RESEND it is sent again under a
+// new index while the batch's Receive() time allows another timeout. A
+// given-up frame that still arrives later is counted as late, not
+// unexpected, and ignored.
+//
+//   packer.Clear();
+//   size_t id = packer.Add(ECAT_APRD, EcatPhysicalAddress(-pos, 0x0130), 2);
+//   packer.Send(transport);
+//   packer.Receive(transport, 1000);
+//   uint16_t wkc = packer.GetWkc(id);
+class EtherCATDatagramPacker {
+public:
+    static const size_t kMaxFramesInFlight = 256;   // one datagram index per frame
+
+    enum LossPolicy {
+        LOSS_SKIP,                       // give a lost frame up; its datagrams stay unreceived
+        LOSS_RESEND                      // send it again, up to the retry limit
+    };
+
+    struct Stats {
+        unsigned long framesSent;        // resends included
+        unsigned long framesLost;        // given up: not returned in time after all attempts
+        unsigned long framesLate;        // returned after being given up or resent
+        unsigned long framesResent;
+        unsigned long framesUnexpected;  // unknown index or malformed
+    };
+
+private:
+    struct Datagram {
+        EcatCommand command;
+        uint32_t address;
+        uint16_t length;
+        const void* pWriteData;   // copied into the frame by Send()
+        void* pReadData;          // filled by Receive(); internal buffer if null
+        size_t dataOffset;        // slot in m_data when pReadData is null
+        uint16_t wkc;
+        bool received;
+    };
+
+    struct Frame {
+        uint8_t index;
+        size_t first;             // first datagram in m_datagrams
+        size_t count;
+        bool received;
+        bool lost;                // given up
+        unsigned attempts;
+        int64_t deadlineNs;       // per-frame timeout, 0 = none
+        size_t length;            // Ethernet frame bytes, copy at m_copies[slot * ECAT_MAX_ETH_FRAME]
+    };
+
+    RtVector<Datagram> m_datagrams;
+    RtVector<Frame> m_frames;
+    RtVector<uint8_t> m_data;
+    RtVector<uint8_t> m_copies;                 // sent frames, for LOSS_RESEND
+    short m_frameByIndex[kMaxFramesInFlight];   // datagram index -> m_frames slot, -1 = none
+    bool m_bGivenUp[kMaxFramesInFlight];        // index of a frame given up, until reused
+    uint8_t m_nextIndex;
+    size_t m_outstanding;
+    LossPolicy m_policy;
+    long m_frameTimeoutUs;
+    unsigned m_retries;
+    Stats m_stats;
+
+    static size_t DatagramBytes(uint16_t length) {
+        return ECAT_DATAGRAM_HEADER_SIZE + length + ECAT_WKC_SIZE;
+    }
+
+    static int64_t NowNs() {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
+    uint8_t TakeIndex() {
+        uint8_t index = m_nextIndex++;
+        m_bGivenUp[index] = false;
+        return index;
+    }
+
+    void GiveUp(Frame& frame) {
+        m_frameByIndex[frame.index] = -1;
+        m_bGivenUp[frame.index] = true;
+    }
+
+    // Sends a lost frame's copy again under a new index; false if no TX
+    // buffer is free
+    bool Resend(FrameTransport& transport, size_t slot, int64_t nowNs) {
+        Frame& frame = m_frames[slot];
+        size_t capacity = 0;
+        uint8_t* pFrame = transport.AcquireTx(&capacity);
+        if (!pFrame || capacity < frame.length) {
+            return false;
+        }
+        GiveUp(frame);
+        frame.index = TakeIndex();
+        m_frameByIndex[frame.index] = static_cast<short>(slot);
+        memcpy(pFrame, &m_copies[slot * ECAT_MAX_ETH_FRAME], frame.length);
+        for (uint8_t* p = pFrame + ECAT_PAYLOAD_OFFSET; p < pFrame + frame.length; ) {
+            p[1] = frame.index;
+            if (!(EcatGet16(p + 6) & ECAT_DATAGRAM_MORE)) {
+                break;
+            }
+            p += DatagramBytes(EcatGet16(p + 6) & 0x07FF);
+        }
+        transport.CommitTx(frame.length);
+        frame.attempts++;
+        frame.deadlineNs = nowNs + m_frameTimeoutUs * 1000;
+        m_stats.framesSent++;
+        m_stats.framesResent++;
+        return true;
+    }
+
+    // Deals with every frame whose own timeout has passed: resend while
+    // the policy and the time left until batchDeadlineNs allow, otherwise
+    // give it up. Returns the earliest deadline still pending, or 0.
+    int64_t ExpireFrames(FrameTransport& transport, int64_t nowNs, int64_t batchDeadlineNs) {
+        int64_t nextNs = 0;
+        bool bResent = false;
+        for (size_t slot = 0; slot < m_frames.size(); slot++) {
+            Frame& frame = m_frames[slot];
+            if (frame.received || frame.lost || !frame.deadlineNs) {
+                continue;
+            }
+            if (frame.deadlineNs <= nowNs) {
+                bool bRetry = m_policy == LOSS_RESEND && frame.attempts <= m_retries &&
+                              nowNs + m_frameTimeoutUs * 1000 <= batchDeadlineNs;
+                if (bRetry && Resend(transport, slot, nowNs)) {
+                    bResent = true;
+                } else {
+                    GiveUp(frame);
+                    frame.lost = true;
+                    m_outstanding--;
+                    m_stats.framesLost++;
+                    continue;
+                }
+            }
+            nextNs = (!nextNs || frame.deadlineNs < nextNs) ? frame.deadlineNs : nextNs;
+        }
+        if (bResent) {
+            transport.Kick();
+        }
+        return nextNs;
+    }
+
+    void Dispatch(const uint8_t* pFrame, size_t length) {
+        if (!EcatIsEtherCATFrame(pFrame, length)) {
+            m_stats.framesUnexpected++;
+            return;
+        }
+        const uint8_t* p = pFrame + ECAT_PAYLOAD_OFFSET;
+        const uint8_t* pEnd = p + EcatGetFrameLength(pFrame);
+        if (p + ECAT_DATAGRAM_HEADER_SIZE > pEnd) {
+            m_stats.framesUnexpected++;
+            return;
+        }
+
+        short slot = m_frameByIndex[p[1]];
+        if (slot < 0 && m_bGivenUp[p[1]]) {
+            m_bGivenUp[p[1]] = false;
+            m_stats.framesLate++;
+            return;
+        }
+        if (slot < 0 || m_frames[slot].received) {
+            m_stats.framesUnexpected++;
+            return;
+        }
+        Frame& frame = m_frames[slot];
+
+        // Datagrams come back in the order they were sent. Every header is
+        // checked before any data is taken, so a malformed reply leaves its
+        // datagrams untouched and the frame still outstanding.
+        const uint8_t* pCheck = p;
+        for (size_t i = 0; i < frame.count; i++) {
+            const Datagram& datagram = m_datagrams[frame.first + i];
+            if (pCheck + DatagramBytes(datagram.length) > pEnd || pCheck[0] != datagram.command ||
+                pCheck[1] != frame.index || (EcatGet16(pCheck + 6) & 0x07FF) != datagram.length) {
+                m_stats.framesUnexpected++;
+                return;
+            }
+            pCheck += DatagramBytes(datagram.length);
+        }
+        for (size_t i = 0; i < frame.count; i++) {
+            Datagram& datagram = m_datagrams[frame.first + i];
+            void* pTarget = datagram.pReadData ? datagram.pReadData : m_data.data() + datagram.dataOffset;
+            memcpy(pTarget, p + ECAT_DATAGRAM_HEADER_SIZE, datagram.length);
+            datagram.wkc = EcatGet16(p + ECAT_DATAGRAM_HEADER_SIZE + datagram.length);
+            datagram.received = true;
+            p += DatagramBytes(datagram.length);
+        }
+
+        frame.received = true;
+        m_outstanding--;
+    }
+
+public:
+    EtherCATDatagramPacker()
+        : m_nextIndex(0), m_outstanding(0), m_policy(LOSS_SKIP), m_frameTimeoutUs(0), m_retries(0) {
+        memset(&m_stats, 0, sizeof(m_stats));
+        memset(m_bGivenUp, 0, sizeof(m_bGivenUp));
+        Clear();
+    }
+
+    // frameTimeoutUs: how long each frame may take, 0 = only the Receive()
+    // timeout. retries: resends per frame with LOSS_RESEND.
+    void SetLossPolicy(LossPolicy policy, long frameTimeoutUs, unsigned retries) {
+        m_policy = policy;
+        m_frameTimeoutUs = frameTimeoutUs;
+        m_retries = retries;
+    }
+
+    // Moves the buffers to an arena, sized for batches of up to datagrams
+    // datagrams, dataBytes of internal data and frames frames, so that
+    // Add() and Send() do not allocate on the cycle path. Between batches.
+    void SetArena(RtArena* pArena, size_t datagrams, size_t dataBytes, size_t frames) {
+        Clear();
+        m_datagrams = RtVector<Datagram>(RtAllocator<Datagram>(pArena));
+        m_datagrams.reserve(datagrams);
+        m_frames = RtVector<Frame>(RtAllocator<Frame>(pArena));
+        m_frames.reserve(frames);
+        m_data = RtVector<uint8_t>(RtAllocator<uint8_t>(pArena));
+        m_data.reserve(dataBytes);
+        m_copies = RtVector<uint8_t>(RtAllocator<uint8_t>(pArena));
+        m_copies.reserve(frames * ECAT_MAX_ETH_FRAME);
+    }
+
+    // Starts a new batch; buffers keep their capacity between cycles.
+    // Frames of the last batch still out are given up.
+    void Clear() {
+        for (Frame& frame : m_frames) {
+            if (!frame.received && !frame.lost) {
+                GiveUp(frame);
+            }
+        }
+        m_datagrams.clear();
+        m_frames.clear();
+        m_data.clear();
+        m_outstanding = 0;
+        for (size_t i = 0; i < kMaxFramesInFlight; i++) {
+            m_frameByIndex[i] = -1;
+        }
+    }
+
+    // Queues a datagram and returns its id. pWriteData (length bytes, or
+    // zeros if null) must stay valid until Send(); pReadData, if given,
+    // receives the returned data, otherwise use GetData().
+    size_t Add(EcatCommand command, uint32_t address, uint16_t length,
+               const void* pWriteData = nullptr, void* pReadData = nullptr) {
+        Datagram datagram = { command, address, length, pWriteData, pReadData, 0, 0, false };
+        if (!pReadData) {
+            datagram.dataOffset = m_data.size();
+            m_data.resize(m_data.size() + length);
+        }
+        m_datagrams.push_back(datagram);
+        return m_datagrams.size() - 1;
+    }
+
+    // Builds the frames directly in the transport's TX buffers and kicks
+    // them out together. Fails if a datagram cannot fit a frame or the
+    // transport runs out of TX buffers; frames built up to that point are
+    // still sent.
+    bool Send(FrameTransport& transport) {
+        bool bAllQueued = true;
+        int64_t deadlineNs = m_frameTimeoutUs > 0 ? NowNs() + m_frameTimeoutUs * 1000 : 0;
+        size_t i = 0;
+        while (i < m_datagrams.size()) {
+            size_t capacity = 0;
+            uint8_t* pFrame = nullptr;
+            if (m_frames.size() >= kMaxFramesInFlight ||
+                DatagramBytes(m_datagrams[i].length) > ECAT_MAX_PAYLOAD ||
+                !(pFrame = transport.AcquireTx(&capacity)) || capacity < ECAT_MAX_ETH_FRAME) {
+                bAllQueued = false;
+                break;
+            }
+
+            Frame frame = { TakeIndex(), i, 0, false, false, 1, deadlineNs, 0 };
+            EcatPutEthernetHeader(pFrame, transport.GetMacAddress());
+            uint8_t* p = pFrame + ECAT_PAYLOAD_OFFSET;
+            uint8_t* pLast = nullptr;
+            size_t used = 0;
+
+            while (i < m_datagrams.size() && used + DatagramBytes(m_datagrams[i].length) <= ECAT_MAX_PAYLOAD) {
+                const Datagram& datagram = m_datagrams[i];
+                EcatPutDatagramHeader(p, datagram.command, frame.index, datagram.address, datagram.length, true);
+                if (datagram.pWriteData) {
+                    memcpy(p + ECAT_DATAGRAM_HEADER_SIZE, datagram.pWriteData, datagram.length);
+                }
+                pLast = p;
+                p += DatagramBytes(datagram.length);
+                used += DatagramBytes(datagram.length);
+                frame.count++;
+                i++;
+            }
+
+            // Last datagram in the frame clears the "more follows" flag
+            EcatPut16(pLast + 6, EcatGet16(pLast + 6) & ~ECAT_DATAGRAM_MORE);
+            EcatPutFrameHeader(pFrame + ECAT_ETH_HEADER_SIZE, static_cast<uint16_t>(used));
+            frame.length = ECAT_PAYLOAD_OFFSET + used;
+            if (m_policy == LOSS_RESEND) {
+                m_copies.resize((m_frames.size() + 1) * ECAT_MAX_ETH_FRAME);
+                memcpy(&m_copies[m_frames.size() * ECAT_MAX_ETH_FRAME], pFrame, frame.length);
+            }
+            transport.CommitTx(frame.length);
+
+            m_frameByIndex[frame.index] = static_cast<short>(m_frames.size());
+            m_frames.push_back(frame);
+            m_outstanding++;
+            m_stats.framesSent++;
+        }
+        return transport.Kick() && bAllQueued;
+    }
+
+    // Collects replies until every frame of the batch is back or given up,
+    // or timeoutUs has passed; frames still out then are given up too.
+    // Returns true if all frames returned.
+    bool Receive(FrameTransport& transport, long timeoutUs) {
+        int64_t deadlineNs = NowNs() + static_cast<int64_t>(timeoutUs) * 1000;
+        while (m_outstanding > 0) {
+            size_t length = 0;
+            while (const uint8_t* pFrame = transport.PollRx(&length)) {
+                Dispatch(pFrame, length);
+                transport.ReleaseRx();
+            }
+            if (m_outstanding == 0) {
+                break;
+            }
+
+            int64_t nowNs = NowNs();
+            int64_t waitUntilNs = deadlineNs;
+            if (m_frameTimeoutUs > 0) {
+                int64_t frameNs = ExpireFrames(transport, nowNs, deadlineNs);
+                if (frameNs && frameNs < waitUntilNs) {
+                    waitUntilNs = frameNs;
+                }
+                if (m_outstanding == 0) {
+                    break;
+                }
+            }
+            if (nowNs >= deadlineNs) {
+                break;
+            }
+            // A frame timeout passing while we wait is not an error
+            bool bRx = transport.WaitRx(static_cast<long>((waitUntilNs - nowNs + 999) / 1000));
+            if (!bRx && waitUntilNs == deadlineNs) {
+                break;
+            }
+        }
+        for (Frame& frame : m_frames) {
+            if (!frame.received && !frame.lost) {
+                GiveUp(frame);
+                frame.lost = true;
+                m_stats.framesLost++;
+            }
+        }
+        bool bComplete = true;
+        for (const Frame& frame : m_frames) {
+            bComplete = bComplete && frame.received;
+        }
+        m_outstanding = 0;
+        return bComplete;
+    }
+
+    uint16_t GetWkc(size_t id) const {
+        return m_datagrams[id].wkc;
+    }
+
+    bool IsReceived(size_t id) const {
+        return m_datagrams[id].received;
+    }
+
+    // Copies of the datagram's frame that went out, 0 if none. After a
+    // resend a read that empties something (an SM1 mailbox) may have been
+    // answered to a copy that never came back.
+    unsigned GetAttempts(size_t id) const {
+        for (const Frame& frame : m_frames) {
+            if (id >= frame.first && id < frame.first + frame.count) {
+                return frame.attempts;
+            }
+        }
+        return 0;
+    }
+
+    const uint8_t* GetData(size_t id) const {
+        const Datagram& datagram = m_datagrams[id];
+        return datagram.pReadData ? static_cast<const uint8_t*>(datagram.pReadData)
+                                  : m_data.data() + datagram.dataOffset;
+    }
+
+    size_t GetDatagramCount() const {
+        return m_datagrams.size();
+    }
+
+    // Frames used by the last Send()
+    size_t GetFrameCount() const {
+        return m_frames.size();
+    }
+
+    const Stats& GetStats() const {
+        return m_stats;
+    }
+};
@@ -0,0 +1,89 @@
+#pragma once
+
+// EtherCAT frame layout (ETG.1000.4): Ethernet header with EtherType 0x88A4,
+// a 2-byte EtherCAT header, then one or more datagrams. All EtherCAT fields
+// are little-endian; the Ethernet header is big-endian.
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+static const uint16_t ETHERCAT_ETHERTYPE = 0x88A4;
+
+static const size_t ECAT_ETH_HEADER_SIZE = 14;
+static const size_t ECAT_FRAME_HEADER_SIZE = 2;
+static const size_t ECAT_MAX_ETH_FRAME = 1514;     // without FCS
+static const size_t ECAT_MIN_ETH_FRAME = 60;       // shorter frames are padded
+static const size_t ECAT_MAX_PAYLOAD = ECAT_MAX_ETH_FRAME - ECAT_ETH_HEADER_SIZE - ECAT_FRAME_HEADER_SIZE;
+static const size_t ECAT_PAYLOAD_OFFSET = ECAT_ETH_HEADER_SIZE + ECAT_FRAME_HEADER_SIZE;
+
+// Datagram: header (10 bytes), data, working counter (2 bytes)
+static const size_t ECAT_DATAGRAM_HEADER_SIZE = 10;
+static const size_t ECAT_WKC_SIZE = 2;
+static const uint16_t ECAT_DATAGRAM_MORE = 0x8000;    // another datagram follows
+
+enum EcatCommand : uint8_t {
+    ECAT_NOP  = 0,
+    ECAT_APRD = 1,      // auto-increment physical read
+    ECAT_APWR = 2,
+    ECAT_APRW = 3,
+    ECAT_FPRD = 4,      // configured-address physical read
+    ECAT_FPWR = 5,
+    ECAT_FPRW = 6,
+    ECAT_BRD  = 7,      // broadcast read
+    ECAT_BWR  = 8,
+    ECAT_BRW  = 9,
+    ECAT_LRD  = 10,     // logical read
+    ECAT_LWR  = 11,
+    ECAT_LRW  = 12,
+    ECAT_ARMW = 13,     // auto-increment read, multiple write
+    ECAT_FRMW = 14
+};
+
+inline void EcatPut16(uint8_t* p, uint16_t v) { memcpy(p, &v, 2); }
+inline void EcatPut32(uint8_t* p, uint32_t v) { memcpy(p, &v, 4); }
+inline uint16_t EcatGet16(const uint8_t* p) { uint16_t v; memcpy(&v, p, 2); return v; }
+inline uint32_t EcatGet32(const uint8_t* p) { uint32_t v; memcpy(&v, p, 4); return v; }
+inline void EcatPut64(uint8_t* p, uint64_t v) { memcpy(p, &v, 8); }
+inline uint64_t EcatGet64(const uint8_t* p) { uint64_t v; memcpy(&v, p, 8); return v; }
+
+// Broadcast destination; slaves forward every frame regardless
+inline void EcatPutEthernetHeader(uint8_t* p, const uint8_t* pSourceMac) {
+    memset(p, 0xFF, 6);
+    memcpy(p + 6, pSourceMac, 6);
+    p[12] = static_cast<uint8_t>(ETHERCAT_ETHERTYPE >> 8);
+    p[13] = static_cast<uint8_t>(ETHERCAT_ETHERTYPE & 0xFF);
+}
+
+// Header type 1 = EtherCAT datagrams; length is the datagram bytes that follow
+inline void EcatPutFrameHeader(uint8_t* p, uint16_t datagramBytes) {
+    EcatPut16(p, static_cast<uint16_t>((datagramBytes & 0x07FF) | (1 << 12)));
+}
+
+inline uint16_t EcatGetFrameLength(const uint8_t* pFrame) {
+    return EcatGet16(pFrame + ECAT_ETH_HEADER_SIZE) & 0x07FF;
+}
+
+inline bool EcatIsEtherCATFrame(const uint8_t* pFrame, size_t length) {
+    return length >= ECAT_PAYLOAD_OFFSET &&
+           pFrame[12] == static_cast<uint8_t>(ETHERCAT_ETHERTYPE >> 8) &&
+           pFrame[13] == static_cast<uint8_t>(ETHERCAT_ETHERTYPE & 0xFF) &&
+           (EcatGet16(pFrame + ECAT_ETH_HEADER_SIZE) >> 12) == 1 &&
+           ECAT_PAYLOAD_OFFSET + EcatGetFrameLength(pFrame) <= length;
+}
+
+// Writes one datagram header at p and zeroes its data and working counter.
+// address is ADP (low 16 bits) and ADO (high 16 bits), or a logical address.
+inline void EcatPutDatagramHeader(uint8_t* p, EcatCommand command, uint8_t index,
+                                  uint32_t address, uint16_t length, bool more) {
+    p[0] = command;
+    p[1] = index;
+    EcatPut32(p + 2, address);
+    EcatPut16(p + 6, static_cast<uint16_t>((length & 0x07FF) | (more ? ECAT_DATAGRAM_MORE : 0)));
+    EcatPut16(p + 8, 0);
+    memset(p + ECAT_DATAGRAM_HEADER_SIZE, 0, length + ECAT_WKC_SIZE);
+}
+
+inline uint32_t EcatPhysicalAddress(uint16_t station, uint16_t offset) {
+    return static_cast<uint32_t>(station) | (static_cast<uint32_t>(offset) << 16);
+}
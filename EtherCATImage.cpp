@@ -0,0 +1,127 @@
+// ecat_image: shows the live process image a running master shares in
+// memory, and optionally drives its outputs.
+//
+//   ecat_image [name] [--follow] [--write OFFSET HEX] [--hold SEC]
+//
+// name is the segment the master created (default DirectEtherCATMaster).
+// --write claims the outputs (the master needs <SharedImage
+// AcceptOutputs="true">), writes the HEX bytes at OFFSET into the output
+// image, keeps them for --hold seconds (default 1) and hands the outputs
+// back. Inputs and outputs are shown in hex, at most 32 bytes each.
+
+#include <algorithm>
+#include <chrono>
+#include <csignal>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+#include "SharedProcessImage.h"
+
+static volatile sig_atomic_t g_bStop = 0;
+
+static void OnSignal(int) {
+    g_bStop = 1;
+}
+
+static std::string Hex(const uint8_t* p, size_t length) {
+    static const char kDigits[] = "0123456789abcdef";
+    std::string text;
+    for (size_t i = 0; i < length && i < 32; i++) {
+        text += kDigits[p[i] >> 4];
+        text += kDigits[p[i] & 0x0F];
+    }
+    return length > 32 ? text + "..." : text;
+}
+
+static void PrintSnapshot(const SharedProcessImage& image, const SharedProcessImage::Snapshot& snapshot) {
+    const SharedImageHeader* pHeader = image.GetHeader();
+    std::cout << "cycle " << snapshot.cycle << "  wkc " << snapshot.wkc << "/" << snapshot.expectedWkc
+              << "  in " << Hex(image.GetInputs(snapshot), pHeader->inputSize)
+              << "  out " << Hex(image.GetOutputs(snapshot), pHeader->outputSize) << "\n";
+}
+
+int main(int argc, char* argv[]) {
+    std::string name = "DirectEtherCATMaster";
+    bool bFollow = false;
+    bool bWrite = false;
+    size_t writeOffset = 0;
+    std::vector<uint8_t> writeData;
+    double holdSeconds = 1.0;
+
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "--follow") {
+            bFollow = true;
+        } else if (arg == "--write" && i + 2 < argc) {
+            bWrite = true;
+            writeOffset = strtoul(argv[++i], nullptr, 0);
+            std::string hex = argv[++i];
+            for (size_t n = 0; n + 1 < hex.size(); n += 2) {
+                writeData.push_back(static_cast<uint8_t>(strtoul(hex.substr(n, 2).c_str(), nullptr, 16)));
+            }
+        } else if (arg == "--hold" && i + 1 < argc) {
+            holdSeconds = atof(argv[++i]);
+        } else if (arg[0] != '-') {
+            name = arg;
+        } else {
+            std::cout << "Usage: " << argv[0] << " [name] [--follow] [--write OFFSET HEX] [--hold SEC]\n";
+            return 1;
+        }
+    }
+
+    SharedProcessImage image;
+    if (!image.Open(name, bWrite)) {
+        std::cerr << "Error: No process image '" << name << "' - is the master running?" << std::endl;
+        return 1;
+    }
+    const SharedImageHeader* pHeader = image.GetHeader();
+    int32_t owner = pHeader->outputOwner.load();
+    std::cout << "Image '" << name << "' (pid " << pHeader->pid << ", " << pHeader->cycleTimeNs / 1000
+              << " us cycle), inputs 0x" << std::hex << pHeader->inputAddress << std::dec << "+" << pHeader->inputSize
+              << ", outputs 0x" << std::hex << pHeader->outputAddress << std::dec << "+" << pHeader->outputSize
+              << ", outputs "
+              << (!(pHeader->flags & SharedProcessImage::FLAG_ACCEPT_OUTPUTS) ? std::string("from the master only")
+                  : owner > 0 ? "held by process " + std::to_string(owner)
+                  : owner < 0 ? "being claimed by process " + std::to_string(-owner) : std::string("free"))
+              << "\n";
+
+    SharedProcessImage::Snapshot snapshot;
+    if (!image.Read(snapshot)) {
+        std::cerr << "Error: Nothing published yet" << std::endl;
+        return 1;
+    }
+    PrintSnapshot(image, snapshot);
+
+    signal(SIGINT, OnSignal);
+    signal(SIGTERM, OnSignal);
+    if (bWrite) {
+        if (writeOffset + writeData.size() > pHeader->outputSize) {
+            std::cerr << "Error: " << writeData.size() << " bytes at " << writeOffset << " exceed the "
+                      << pHeader->outputSize << " output bytes" << std::endl;
+            return 1;
+        }
+        if (!image.ClaimOutputs()) {
+            return 1;
+        }
+        std::vector<uint8_t> outputs(image.GetOutputs(snapshot), image.GetOutputs(snapshot) + pHeader->outputSize);
+        std::copy(writeData.begin(), writeData.end(), outputs.begin() + writeOffset);
+        image.WriteOutputs(outputs.data());
+        auto until = std::chrono::steady_clock::now() + std::chrono::duration<double>(holdSeconds);
+        while (!g_bStop && std::chrono::steady_clock::now() < until) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(100));
+        }
+        if (image.Read(snapshot)) {
+            PrintSnapshot(image, snapshot);
+        }
+        image.ReleaseOutputs();
+    }
+    while (bFollow && !g_bStop) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+        if (image.Read(snapshot)) {
+            PrintSnapshot(image, snapshot);
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,297 @@
+// ecat_pdo: generates typed process data accessors from a configuration.
+//
+//   ecat_pdo CONFIG [HEADER] [--name NAME]
+//
+// CONFIG is our XML (ethercat_config.xml, PDOs as <TxPdo>/<RxPdo> in a
+// <Slave>) or an ENI. HEADER (default: standard output) gets one struct
+// NAME (default: HEADER's file name) with a nested struct per slave
+// holding a PdoSignal constant per PDO entry, InputByte<N>/OutputByte<N>
+// for the slave's raw bytes, and packed InputData/OutputData structs; the
+// whole areas are NAME::Inputs and NAME::Outputs. An unchanged header is
+// not rewritten, so the build only recompiles when the layout changed.
+// The CMake build runs this for ethercat_config.xml (PDO_CONFIG).
+
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <set>
+#include <sstream>
+#include <string>
+#include <vector>
+#include "PdoLayout.h"
+
+static std::string Hex(uint64_t value) {
+    std::ostringstream text;
+    text << "0x" << std::hex << value;
+    return text.str();
+}
+
+// A C++ identifier from a configured name, not yet in used; adds it
+static std::string Identifier(const std::string& name, const std::string& fallback, std::set<std::string>& used) {
+    static const char* const kReserved[] = { "bool", "case", "char", "class", "default", "delete", "do", "double",
+                                             "else", "enum", "float", "for", "if", "int", "long", "new", "return",
+                                             "short", "signed", "static", "struct", "switch", "this", "unsigned",
+                                             "void", "while", "Check", "InputByte", "OutputByte", "InputData",
+                                             "OutputData", "Inputs", "Outputs" };
+    std::string text;
+    for (char c : name) {
+        bool bWord = (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9');
+        if (bWord) {
+            text += c;
+        } else if (!text.empty() && text.back() != '_') {
+            text += '_';
+        }
+    }
+    while (!text.empty() && text.back() == '_') {
+        text.pop_back();
+    }
+    if (text.empty()) {
+        text = fallback;
+    } else if (text[0] >= '0' && text[0] <= '9') {
+        text = "_" + text;
+    }
+    for (const char* pReserved : kReserved) {
+        if (text == pReserved) {
+            text += '_';
+        }
+    }
+    std::string unique = text;
+    for (int n = 2; !used.insert(unique).second; n++) {
+        unique = text + "_" + std::to_string(n);
+    }
+    return unique;
+}
+
+static size_t TypeSize(const std::string& type) {
+    return type == "bool" || type == "int8_t" || type == "uint8_t" ? 1
+         : type == "int16_t" || type == "uint16_t" ? 2
+         : type == "int32_t" || type == "uint32_t" || type == "float" ? 4 : 8;
+}
+
+// A whole-type signal on a byte boundary becomes a struct member
+static bool IsMember(const PdoLayout::Signal& signal) {
+    return signal.bitOffset % 8 == 0 && signal.bits == TypeSize(signal.type) * 8 && signal.bits >= 8;
+}
+
+// Packed struct of one slave's bytes in one direction: members for the
+// whole-type signals, plain bytes for bit fields and padding in between
+static void WriteData(std::ostream& out, const char* name, uint32_t offset, uint32_t size,
+                      const std::vector<const PdoLayout::Signal*>& signals, const std::vector<std::string>& names) {
+    out << "        struct " << name << " {\n";
+    uint32_t cursor = 0;
+    for (size_t i = 0; i < signals.size(); i++) {
+        if (!IsMember(*signals[i])) {
+            continue;
+        }
+        uint32_t at = signals[i]->bitOffset / 8 - offset;
+        if (at < cursor) {
+            continue;
+        }
+        if (at > cursor) {
+            out << "            uint8_t bytes" << cursor << "[" << at - cursor << "];\n";
+        }
+        out << "            " << signals[i]->type << " " << names[i] << ";\n";
+        cursor = at + static_cast<uint32_t>(TypeSize(signals[i]->type));
+    }
+    if (cursor < size) {
+        out << "            uint8_t bytes" << cursor << "[" << size - cursor << "];\n";
+    }
+    out << "        };\n";
+}
+
+static std::string Generate(const EtherCATConfig& config, const PdoLayout& layout, const std::string& configPath,
+                            const std::string& name, const std::string& header) {
+    std::ostringstream out;
+    out << "// Generated by ecat_pdo from " << configPath << " - do not edit.\n"
+        << "//\n"
+        << "// Typed process data of " << config.slaves.size() << " slaves, inputs " << Hex(config.inputAddress)
+        << "+" << config.inputSize << ", outputs " << Hex(config.outputAddress) << "+" << config.outputSize
+        << " (see\n// PdoLayout.h). Call " << name << "::Check(config) at startup before using it.\n"
+        << "#pragma once\n\n"
+        << "#include <cstddef>\n"
+        << "#include <cstdint>\n"
+        << "#include \"PdoLayout.h\"\n\n"
+        << "struct " << name << " {\n"
+        << "    static constexpr uint64_t kLayoutHash = " << Hex(layout.GetHash()) << "ULL;\n"
+        << "    static constexpr uint32_t kInputAddress = " << Hex(config.inputAddress) << ";\n"
+        << "    static constexpr uint32_t kInputSize = " << config.inputSize << ";\n"
+        << "    static constexpr uint32_t kOutputAddress = " << Hex(config.outputAddress) << ";\n"
+        << "    static constexpr uint32_t kOutputSize = " << config.outputSize << ";\n\n"
+        << "    static bool Check(const EtherCATConfig& config) {\n"
+        << "        return PdoLayout::Check(config, kLayoutHash, \"" << header << "\");\n"
+        << "    }\n";
+
+    std::set<std::string> slaveNames;
+    std::vector<std::string> slaveIds;
+    std::ostringstream asserts;
+    for (size_t s = 0; s < config.slaves.size(); s++) {
+        const EtherCATSlaveConfig& slave = config.slaves[s];
+        const PdoLayout::Slave& place = layout.GetSlaves()[s];
+        std::string id = Identifier(slave.name, "Slave" + std::to_string(s), slaveNames);
+        slaveIds.push_back(id);
+
+        out << "\n    // " << slave.position << ": " << (slave.name.empty() ? "(no name)" : slave.name) << ", vendor "
+            << Hex(slave.vendorId) << ", product " << Hex(slave.productCode) << ", inputs "
+            << place.inputOffset << "+" << slave.inputSize << ", outputs " << place.outputOffset << "+"
+            << slave.outputSize << "\n"
+            << "    struct " << id << " {\n"
+            << "        static constexpr uint16_t kPosition = " << slave.position << ";\n"
+            << "        static constexpr uint32_t kInputOffset = " << place.inputOffset << ";\n"
+            << "        static constexpr uint32_t kInputSize = " << slave.inputSize << ";\n"
+            << "        static constexpr uint32_t kOutputOffset = " << place.outputOffset << ";\n"
+            << "        static constexpr uint32_t kOutputSize = " << slave.outputSize << ";\n";
+        if (slave.inputSize) {
+            out << "        template <uint32_t N>\n"
+                << "        static constexpr PdoByte<kInputOffset, kInputSize, N, true> InputByte{};\n";
+        }
+        if (slave.outputSize) {
+            out << "        template <uint32_t N>\n"
+                << "        static constexpr PdoByte<kOutputOffset, kOutputSize, N, false> OutputByte{};\n";
+        }
+
+        std::set<std::string> signalNames;
+        std::vector<const PdoLayout::Signal*> inputs;
+        std::vector<const PdoLayout::Signal*> outputs;
+        std::vector<std::string> inputNames;
+        std::vector<std::string> outputNames;
+        for (const PdoLayout::Signal& signal : layout.GetSignals()) {
+            if (signal.slave != s) {
+                continue;
+            }
+            std::string signalId = Identifier(signal.name, "Entry" + std::to_string(signal.bitOffset), signalNames);
+            out << "        // " << Hex(signal.index) << ":" << (signal.subIndex < 16 ? "0" : "")
+                << std::hex << static_cast<unsigned>(signal.subIndex) << std::dec << " "
+                << (signal.dataType.empty() ? std::string("(no type)") : signal.dataType) << ", "
+                << static_cast<unsigned>(signal.bits) << " bit" << (signal.bits > 1 ? "s" : "")
+                << ((signal.dataType == "REAL" || signal.dataType == "LREAL") && signal.bitOffset % 8
+                        ? ", raw bits: not on a byte boundary" : "") << "\n"
+                << "        static constexpr PdoSignal<" << signal.type << ", " << signal.bitOffset / 8 << ", "
+                << signal.bitOffset % 8 << ", " << static_cast<unsigned>(signal.bits) << ", "
+                << (signal.bInput ? "true" : "false") << "> " << signalId << "{};\n";
+            (signal.bInput ? inputs : outputs).push_back(&signal);
+            (signal.bInput ? inputNames : outputNames).push_back(signalId);
+        }
+
+        if (slave.inputSize || slave.outputSize) {
+            out << "\n#pragma pack(push, 1)\n";
+            if (slave.inputSize) {
+                WriteData(out, "InputData", place.inputOffset, slave.inputSize, inputs, inputNames);
+            }
+            if (slave.outputSize) {
+                WriteData(out, "OutputData", place.outputOffset, slave.outputSize, outputs, outputNames);
+            }
+            out << "#pragma pack(pop)\n";
+        }
+        out << "    };\n";
+
+        std::string scope = name + "::" + id;
+        for (int direction = 0; direction < 2; direction++) {
+            const std::vector<const PdoLayout::Signal*>& signals = direction ? outputs : inputs;
+            const std::vector<std::string>& names = direction ? outputNames : inputNames;
+            const char* data = direction ? "OutputData" : "InputData";
+            if (!(direction ? slave.outputSize : slave.inputSize)) {
+                continue;
+            }
+            asserts << "static_assert(sizeof(" << scope << "::" << data << ") == " << scope << "::k"
+                    << (direction ? "Output" : "Input") << "Size, \"" << id << " " << data << "\");\n";
+            uint32_t cursor = 0;
+            for (size_t i = 0; i < signals.size(); i++) {
+                uint32_t at = signals[i]->bitOffset / 8 - (direction ? place.outputOffset : place.inputOffset);
+                if (IsMember(*signals[i]) && at >= cursor) {
+                    asserts << "static_assert(offsetof(" << scope << "::" << data << ", " << names[i] << ") == "
+                            << scope << "::" << names[i] << ".kByteOffset - " << scope << "::k"
+                            << (direction ? "Output" : "Input") << "Offset, \"" << id << "::" << names[i]
+                            << "\");\n";
+                    cursor = at + static_cast<uint32_t>(TypeSize(signals[i]->type));
+                }
+            }
+        }
+    }
+
+    // The areas as a whole: every slave's bytes in line order
+    out << "\n#pragma pack(push, 1)\n";
+    for (int direction = 0; direction < 2; direction++) {
+        uint32_t size = direction ? config.outputSize : config.inputSize;
+        out << "    struct " << (direction ? "Outputs" : "Inputs") << " {\n";
+        uint32_t cursor = 0;
+        for (size_t s = 0; s < config.slaves.size(); s++) {
+            uint16_t bytes = direction ? config.slaves[s].outputSize : config.slaves[s].inputSize;
+            if (bytes) {
+                out << "        " << name << "::" << slaveIds[s] << "::" << (direction ? "OutputData " : "InputData ")
+                    << slaveIds[s] << ";\n";
+                cursor += bytes;
+            }
+        }
+        if (cursor < size) {
+            out << "        uint8_t reserved" << cursor << "[" << size - cursor << "];\n";
+        }
+        out << "    };\n";
+    }
+    out << "#pragma pack(pop)\n"
+        << "};\n\n"
+        << asserts.str()
+        << "static_assert(sizeof(" << name << "::Inputs) == " << name << "::kInputSize, \"Inputs\");\n"
+        << "static_assert(sizeof(" << name << "::Outputs) == " << name << "::kOutputSize, \"Outputs\");\n";
+    return out.str();
+}
+
+int main(int argc, char* argv[]) {
+    std::string configPath;
+    std::string headerPath;
+    std::string name;
+    bool bUsage = false;
+    for (int i = 1; i < argc && !bUsage; i++) {
+        std::string arg = argv[i];
+        if (arg == "--name" && i + 1 < argc) {
+            name = argv[++i];
+        } else if (arg[0] == '-') {
+            bUsage = true;
+        } else if (configPath.empty()) {
+            configPath = arg;
+        } else if (headerPath.empty()) {
+            headerPath = arg;
+        } else {
+            bUsage = true;
+        }
+    }
+    if (bUsage || configPath.empty()) {
+        std::cout << "Usage: " << argv[0] << " CONFIG [HEADER] [--name NAME]\n";
+        return 1;
+    }
+
+    std::string header = headerPath.substr(headerPath.find_last_of("/\\") + 1);
+    if (header.empty()) {
+        header = "ProcessDataPdo.h";
+    }
+    if (name.empty()) {
+        std::set<std::string> none;
+        name = Identifier(header.substr(0, header.find('.')), "ProcessDataPdo", none);
+    }
+
+    EtherCATConfig config;
+    PdoLayout layout;
+    if (!config.Load(configPath) || !layout.Build(config)) {
+        Logger::Instance().Flush();
+        return 1;
+    }
+    std::string text = Generate(config, layout, configPath.substr(configPath.find_last_of("/\\") + 1), name, header);
+    if (headerPath.empty()) {
+        std::cout << text;
+        return 0;
+    }
+
+    std::ifstream existing(headerPath, std::ios::binary);
+    std::ostringstream previous;
+    previous << existing.rdbuf();
+    if (existing && previous.str() == text) {
+        return 0;
+    }
+    std::ofstream file(headerPath, std::ios::binary | std::ios::trunc);
+    if (!(file << text) || !file.flush()) {
+        std::cerr << "Error: Cannot write '" << headerPath << "'" << std::endl;
+        return 1;
+    }
+    std::cout << "Wrote " << headerPath << ": " << config.slaves.size() << " slaves, " << layout.GetSignals().size()
+              << " PDO entries, layout hash " << Hex(layout.GetHash()) << std::endl;
+    return 0;
+}
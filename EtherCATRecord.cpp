@@ -0,0 +1,135 @@
+// ecat_record: inspects a process data recording written by the master
+// (<Recorder Directory=...> in the configuration).
+//
+//   ecat_record info DIR
+//   ecat_record dump DIR [--from SEC] [--count N] [--csv]
+//
+// info lists the segments with their time span and how well the images
+// compressed. dump prints the decoded records from SEC seconds after the
+// first record (negative: before the last one), inputs and outputs in hex.
+
+#include <cstdlib>
+#include <ctime>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include "ProcessRecorder.h"
+
+static std::string WallTime(int64_t ns) {
+    time_t seconds = static_cast<time_t>(ns / 1000000000LL);
+    tm local;
+    localtime_r(&seconds, &local);
+    char text[32];
+    strftime(text, sizeof(text), "%Y-%m-%d %H:%M:%S", &local);
+    char fraction[8];
+    snprintf(fraction, sizeof(fraction), ".%03d", static_cast<int>((ns / 1000000) % 1000));
+    return std::string(text) + fraction;
+}
+
+static std::string Hex(const uint8_t* p, size_t length) {
+    static const char kDigits[] = "0123456789abcdef";
+    std::string text;
+    text.reserve(length * 2);
+    for (size_t i = 0; i < length; i++) {
+        text += kDigits[p[i] >> 4];
+        text += kDigits[p[i] & 0x0F];
+    }
+    return text;
+}
+
+static int Info(ProcessRecordReader& reader) {
+    uint64_t bytes = 0;
+    uint64_t raw = 0;
+    std::cout << std::setw(9) << "sequence" << std::setw(10) << "records" << std::setw(7) << "keys"
+              << std::setw(11) << "bytes" << "  span (LRW)      first                    last\n";
+    for (size_t i = 0; i < reader.GetSegmentCount(); i++) {
+        const ProcessRecordReader::SegmentInfo& segment = reader.GetSegment(i);
+        uint64_t used = segment.usedBytes - ProcessRecorder::kDataStart;
+        bytes += used;
+        raw += static_cast<uint64_t>(segment.records) * segment.layout.spanSize;
+        std::cout << std::setw(9) << segment.sequence << std::setw(10) << segment.records << std::setw(7)
+                  << segment.keys << std::setw(11) << used << "  0x" << std::hex << std::setw(8)
+                  << std::setfill('0') << segment.layout.spanAddress << std::dec << std::setfill(' ') << "+"
+                  << std::left << std::setw(6) << segment.layout.spanSize << std::right << " "
+                  << WallTime(segment.firstNs) << "  " << WallTime(segment.lastNs) << "\n";
+    }
+    uint64_t records = reader.GetRecordCount();
+    double seconds = (reader.GetLastNs() - reader.GetFirstNs()) / 1e9;
+    std::cout << records << " records over " << std::fixed << std::setprecision(3) << seconds << " s";
+    if (seconds > 0) {
+        std::cout << " (" << std::setprecision(0) << records / seconds << " per second)";
+    }
+    if (records) {
+        std::cout << ", " << std::setprecision(1) << static_cast<double>(bytes) / records << " bytes per record, "
+                  << std::setprecision(1) << (bytes ? static_cast<double>(raw) / bytes : 0.0)
+                  << "x smaller than the raw images";
+    }
+    std::cout << std::endl;
+    return 0;
+}
+
+static int Dump(ProcessRecordReader& reader, double fromSeconds, bool bFrom, unsigned long count, bool bCsv) {
+    int64_t startNs = reader.GetFirstNs();
+    if (bFrom) {
+        int64_t offsetNs = static_cast<int64_t>(fromSeconds * 1e9);
+        if (!reader.Seek(offsetNs < 0 ? reader.GetLastNs() + offsetNs : startNs + offsetNs)) {
+            std::cerr << "Error: Nothing recorded that late" << std::endl;
+            return 1;
+        }
+    }
+    if (bCsv) {
+        std::cout << "time_s,cycle,wkc,inputs,outputs\n";
+    }
+    ProcessRecordReader::Record record;
+    for (unsigned long shown = 0; shown < count && reader.Next(record); shown++) {
+        const ProcessRecorder::Layout& layout = *record.pLayout;
+        std::string inputs = Hex(record.pSpan + (layout.inputAddress - layout.spanAddress), layout.inputSize);
+        std::string outputs = Hex(record.pSpan + (layout.outputAddress - layout.spanAddress), layout.outputSize);
+        double time = (record.timeNs - startNs) / 1e9;
+        if (bCsv) {
+            std::cout << std::fixed << std::setprecision(6) << time << "," << record.cycle << "," << record.wkc
+                      << "," << inputs << "," << outputs << "\n";
+        } else {
+            std::cout << std::fixed << std::setprecision(6) << std::setw(12) << time << std::setw(10) << record.cycle
+                      << std::setw(5) << record.wkc << (record.bKey ? " K " : "   ") << "in " << inputs
+                      << "  out " << outputs << "\n";
+        }
+    }
+    return 0;
+}
+
+int main(int argc, char* argv[]) {
+    std::string command = argc > 1 ? argv[1] : "";
+    std::string directory = argc > 2 ? argv[2] : "";
+    double fromSeconds = 0.0;
+    bool bFrom = false;
+    unsigned long count = 20;
+    bool bCsv = false;
+    bool bUsage = (command != "info" && command != "dump") || directory.empty();
+
+    for (int i = 3; i < argc && !bUsage; i++) {
+        std::string arg = argv[i];
+        bool hasValue = (i + 1 < argc);
+        if (arg == "--from" && hasValue) {
+            fromSeconds = atof(argv[++i]);
+            bFrom = true;
+        } else if (arg == "--count" && hasValue) {
+            count = strtoul(argv[++i], nullptr, 10);
+        } else if (arg == "--csv") {
+            bCsv = true;
+        } else {
+            bUsage = true;
+        }
+    }
+    if (bUsage) {
+        std::cout << "Usage: " << argv[0] << " info DIR\n"
+                  << "       " << argv[0] << " dump DIR [--from SEC] [--count N] [--csv]\n";
+        return 1;
+    }
+
+    ProcessRecordReader reader;
+    if (!reader.Open(directory)) {
+        return 1;
+    }
+    return command == "info" ? Info(reader) : Dump(reader, fromSeconds, bFrom, count, bCsv);
+}
@@ -0,0 +1,202 @@
+// ecat_sim: runs SimulatedSegment behind a network interface, so a master
+// on the other end of a veth pair (or a TAP device) drives a virtual line
+// through its real raw socket.
+//
+//   ip link add ecat0 type veth peer name ecat1
+//   ip link set ecat0 up && ip link set ecat1 up
+//   ecat_sim ecat1 [config] [--slaves N] [--inputs B] [--outputs B]
+//                  [--delay-ns N] [--state-delay-us N] [--drift-ppm N] [--sii-delay-us N]
+//                  [--sdo-delay-us N] [--lose-every N] [--op] [--replay DIR]
+//   DirectEtherCATMaster ecat0 [config]
+//
+// Slaves come from <Slaves> in the config (default ethercat_config.xml);
+// --slaves adds N synthetic slaves with B input/output bytes each after
+// them. Replies are held back by the modelled return delay. Each slave's
+// DC clock runs up to --drift-ppm off the host clock; CoE SDO requests
+// are answered --sdo-delay-us after they arrive. --replay feeds the inputs
+// of a process data recording to the slaves instead of their own samples,
+// paced as recorded from the first frame on. --lose-every N drops every
+// Nth process data frame after the slaves handled it, to exercise the
+// master's loss handling.
+
+#include <chrono>
+#include <csignal>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include "ConfigSnapshot.h"
+#include "PacketMmapTransport.h"
+#include "ProcessRecorder.h"
+#include "SimulatedSegment.h"
+
+static volatile sig_atomic_t g_bStop = 0;
+
+static void OnSignal(int) {
+    g_bStop = 1;
+}
+
+int main(int argc, char* argv[]) {
+    std::string ifname;
+    std::string configPath = "ethercat_config.xml";
+    std::string replayPath;
+    unsigned long synthetic = 0;
+    uint16_t inputSize = 2;
+    uint16_t outputSize = 2;
+
+    SimulatedSegment segment;
+    SimulatedSegment::Settings settings = segment.GetSettings();
+
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        bool hasValue = (i + 1 < argc);
+        if (arg == "--slaves" && hasValue) {
+            synthetic = strtoul(argv[++i], nullptr, 10);
+        } else if (arg == "--inputs" && hasValue) {
+            inputSize = static_cast<uint16_t>(strtoul(argv[++i], nullptr, 10));
+        } else if (arg == "--outputs" && hasValue) {
+            outputSize = static_cast<uint16_t>(strtoul(argv[++i], nullptr, 10));
+        } else if (arg == "--delay-ns" && hasValue) {
+            settings.forwardingDelayNs = strtoul(argv[++i], nullptr, 10);
+        } else if (arg == "--state-delay-us" && hasValue) {
+            settings.stateChangeDelayUs = strtoul(argv[++i], nullptr, 10);
+        } else if (arg == "--drift-ppm" && hasValue) {
+            settings.maxDriftPpm = strtoul(argv[++i], nullptr, 10);
+        } else if (arg == "--sii-delay-us" && hasValue) {
+            settings.siiReadDelayUs = strtoul(argv[++i], nullptr, 10);
+        } else if (arg == "--sdo-delay-us" && hasValue) {
+            settings.sdoDelayUs = static_cast<uint32_t>(strtoul(argv[++i], nullptr, 10));
+        } else if (arg == "--lose-every" && hasValue) {
+            settings.loseEvery = static_cast<uint32_t>(strtoul(argv[++i], nullptr, 10));
+        } else if (arg == "--replay" && hasValue) {
+            replayPath = argv[++i];
+        } else if (arg == "--op") {
+            settings.initialState = ECAT_STATE_OP;
+        } else if (arg[0] != '-' && ifname.empty()) {
+            ifname = arg;
+        } else if (arg[0] != '-') {
+            configPath = arg;
+        } else {
+            ifname.clear();
+            break;
+        }
+    }
+    if (ifname.empty()) {
+        std::cout << "Usage: " << argv[0] << " <interface> [config] [--slaves N] [--inputs B] [--outputs B]"
+                  << " [--delay-ns N] [--state-delay-us N] [--drift-ppm N] [--sii-delay-us N]"
+                  << " [--sdo-delay-us N] [--lose-every N] [--op] [--replay DIR]\n";
+        return 1;
+    }
+
+    EtherCATConfig config;
+    if (!ConfigSnapshot::LoadConfig(configPath, config)) {
+        return 1;
+    }
+    segment.SetSettings(settings);
+    for (const EtherCATSlaveConfig& slave : config.slaves) {
+        if (!segment.AddSlave(slave.name, slave.vendorId, slave.productCode, slave.inputSize, slave.outputSize)) {
+            return 1;
+        }
+    }
+    segment.AddSyntheticSlaves(synthetic, inputSize, outputSize);
+    // Slaves starting in INIT wait for the master to configure them; ones
+    // started further up must already be mapped
+    uint16_t expectedWkc = segment.GetExpectedWkc();
+    if (settings.initialState != ECAT_STATE_INIT) {
+        segment.MapProcessData(config.inputAddress, config.outputAddress);
+    }
+
+    ProcessRecordReader replay;
+    ProcessRecordReader::Record record = {};
+    bool bReplay = !replayPath.empty();
+    if (bReplay && (!replay.Open(replayPath) || !replay.Next(record))) {
+        return 1;
+    }
+    std::chrono::steady_clock::time_point replayStart;
+    int64_t replayFirstNs = record.timeNs;
+    bool bReplayStarted = false;
+
+    PacketMmapTransport transport;
+    if (!transport.Open(ifname)) {
+        return 1;
+    }
+
+    signal(SIGINT, OnSignal);
+    signal(SIGTERM, OnSignal);
+
+    size_t inputBytes = 0;
+    size_t outputBytes = 0;
+    for (const EtherCATSlaveConfig& slave : config.slaves) {
+        inputBytes += slave.inputSize;
+        outputBytes += slave.outputSize;
+    }
+    inputBytes += synthetic * inputSize;
+    outputBytes += synthetic * outputSize;
+    std::cout << "Simulating " << segment.GetSlaveCount() << " slaves on " << ifname
+              << " (" << settings.forwardingDelayNs << " ns forwarding delay, start in "
+              << EcatStateName(settings.initialState) << ")" << std::endl;
+    std::cout << "Process data: inputs 0x" << std::hex << config.inputAddress << std::dec << "+" << inputBytes
+              << ", outputs 0x" << std::hex << config.outputAddress << std::dec << "+" << outputBytes
+              << ", expected LRW WKC " << expectedWkc << std::endl;
+    if (bReplay) {
+        std::cout << "Replaying " << replay.GetRecordCount() << " recorded cycles from " << replayPath << std::endl;
+    }
+
+    // A frame goes back out when its modelled return delay has passed
+    while (!g_bStop) {
+        if (!transport.WaitRx(100000)) {
+            continue;
+        }
+        size_t length = 0;
+        const uint8_t* pRx = transport.PollRx(&length);
+        if (!pRx) {
+            continue;
+        }
+        if (!EcatIsEtherCATFrame(pRx, length)) {
+            transport.ReleaseRx();      // IPv6 and other traffic on the link
+            continue;
+        }
+        auto now = std::chrono::steady_clock::now();
+        auto due = now + std::chrono::nanoseconds(segment.GetReturnDelayNs(length));
+        if (bReplay) {
+            if (!bReplayStarted) {
+                replayStart = now;
+                bReplayStarted = true;
+            }
+            int64_t elapsedNs = std::chrono::duration_cast<std::chrono::nanoseconds>(now - replayStart).count();
+            while (bReplay && record.timeNs - replayFirstNs <= elapsedNs) {
+                const ProcessRecorder::Layout& layout = *record.pLayout;
+                if (layout.inputSize) {
+                    segment.SetInputs(layout.inputAddress, record.pSpan + (layout.inputAddress - layout.spanAddress),
+                                      layout.inputSize);
+                }
+                bReplay = replay.Next(record);
+            }
+            if (!bReplay) {
+                std::cout << "Replay finished, the inputs keep their last recorded values" << std::endl;
+            }
+        }
+
+        size_t capacity = 0;
+        uint8_t* pTx = transport.AcquireTx(&capacity);
+        bool bReply = pTx && length <= capacity;
+        if (bReply) {
+            memcpy(pTx, pRx, length);
+        }
+        transport.ReleaseRx();
+        if (!bReply || !segment.ProcessFrame(pTx, length)) {
+            continue;
+        }
+
+        while (std::chrono::steady_clock::now() < due) {
+        }
+        transport.CommitTx(length);
+        transport.Kick();
+    }
+
+    const SimulatedSegment::Stats& stats = segment.GetStats();
+    std::cout << "Processed " << stats.frames << " frames, " << stats.datagrams << " datagrams ("
+              << stats.malformed << " malformed, " << stats.stateChanges << " state changes, " << stats.framesLost
+              << " lost), " << stats.mailboxRequests << " mailbox requests, " << stats.mailboxRepeats << " repeated"
+              << std::endl;
+    return 0;
+}
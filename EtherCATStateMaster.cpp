@@ -1,12 +1,13 @@
-#include <iostream>
-#include <windows.h>
-#include <conio.h>
-#include <TcAdsDef.h>
-#include <TcAdsApi.h>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
 #include <vector>
 #include <string>
-
-#pragma comment(lib, "TcAdsDll.lib")
+#include "AdsApi.h"
+#include "ConsoleCompat.h"
+#include "AdsNotificationClient.h"
+#include "AdsSumCommand.h"
+#include "Logger.h"
 
 // EtherCAT state definitions
 enum EtherCATState {
@@ -29,15 +30,24 @@ enum TwinCATState {
 
 class EtherCATStateMaster {
 private:
+    static constexpr unsigned long kStatePollMs = 10;
+    static constexpr long kStateChangeTimeoutMs = 10000;
+
     long m_nPort;
     AmsAddr m_Addr;
     bool m_bConnected;
     
     // EtherCAT Master port (different from PLC port)
     AmsAddr m_EcMasterAddr;
+
+    AdsNotificationClient m_Notifications;
+    AdsSumCommand m_SumCommand;
+
+    // A flapping router reports every stop; one line per 5 s is enough
+    LogRateLimit m_ConnectionLostLog;
     
 public:
-    EtherCATStateMaster() : m_nPort(0), m_bConnected(false) {
+    EtherCATStateMaster() : m_nPort(0), m_bConnected(false), m_ConnectionLostLog(1, 5000) {
         // Initialize AMS address for PLC connection
         m_Addr.netId.b[0] = 127;
         m_Addr.netId.b[1] = 0;
@@ -60,7 +70,7 @@ public:
         // Open communication port
         m_nPort = AdsPortOpen();
         if (m_nPort == 0) {
-            std::cerr << "Error: Failed to open ADS port!" << std::endl;
+            LogError() << "Error: Failed to open ADS port!";
             return false;
         }
 
@@ -70,26 +80,30 @@ public:
         long nErr = AdsSyncReadStateReq(&m_Addr, &nAdsState, &nDeviceState);
         
         if (nErr) {
-            std::cerr << "Error: ADS connection failed! Error code: 0x" 
-                      << std::hex << nErr << std::endl;
+            LogError() << "Error: ADS connection failed! Error code: 0x" 
+                       << std::hex << nErr;
             AdsPortClose();
             return false;
         }
 
         m_bConnected = true;
-        std::cout << "Successfully connected to TwinCAT!" << std::endl;
-        std::cout << "TwinCAT State: " << GetTwinCATStateName(nAdsState) 
-                  << " (" << nAdsState << ")" << std::endl;
+        m_Notifications.Attach(m_nPort, m_Addr);
+        AdsNotificationClient::EnableRouterEvents();
+        LogInfo() << "Successfully connected to TwinCAT!";
+        LogInfo() << "TwinCAT State: " << GetTwinCATStateName(nAdsState) 
+                  << " (" << nAdsState << ")";
         return true;
     }
 
     void Disconnect() {
         if (m_nPort != 0) {
+            m_Notifications.UnsubscribeAll();
+            AdsNotificationClient::DisableRouterEvents();
             AdsPortClose();
             m_nPort = 0;
         }
         m_bConnected = false;
-        std::cout << "Disconnected from TwinCAT." << std::endl;
+        LogInfo() << "Disconnected from TwinCAT.";
     }
 
     std::string GetTwinCATStateName(unsigned short state) {
@@ -117,47 +131,55 @@ public:
 
     bool SetTwinCATState(unsigned short targetState) {
         if (!m_bConnected) {
-            std::cerr << "Error: Not connected to TwinCAT!" << std::endl;
+            LogError() << "Error: Not connected to TwinCAT!";
             return false;
         }
 
-        std::cout << "Setting TwinCAT state to: " << GetTwinCATStateName(targetState) << std::endl;
+        LogInfo() << "Setting TwinCAT state to: " << GetTwinCATStateName(targetState);
         
         long nErr = AdsSyncWriteControlReq(&m_Addr, targetState, 0, 0, nullptr);
         
         if (nErr) {
-            std::cerr << "Error setting TwinCAT state: 0x" << std::hex << nErr << std::endl;
+            LogError() << "Error setting TwinCAT state: 0x" << std::hex << nErr;
             return false;
         }
 
-        // Wait for state change
-        Sleep(1000);
-        
-        // Verify state change
-        unsigned short currentState, deviceState;
-        nErr = AdsSyncReadStateReq(&m_Addr, &currentState, &deviceState);
-        
-        if (nErr) {
-            std::cerr << "Error reading TwinCAT state: 0x" << std::hex << nErr << std::endl;
-            return false;
+        // Poll until the state is reached instead of waiting a fixed time;
+        // a restart to RUN usually completes well within a second
+        auto start = std::chrono::steady_clock::now();
+        unsigned short currentState = ADSSTATE_INVALID, deviceState;
+        for (;;) {
+            nErr = AdsSyncReadStateReq(&m_Addr, &currentState, &deviceState);
+            if (nErr) {
+                LogError() << "Error reading TwinCAT state: 0x" << std::hex << nErr;
+                return false;
+            }
+            if (currentState == targetState ||
+                std::chrono::steady_clock::now() - start >= std::chrono::milliseconds(kStateChangeTimeoutMs)) {
+                break;
+            }
+            Sleep(kStatePollMs);
         }
 
-        std::cout << "TwinCAT state is now: " << GetTwinCATStateName(currentState) << std::endl;
+        long elapsedMs = static_cast<long>(std::chrono::duration_cast<std::chrono::milliseconds>(
+            std::chrono::steady_clock::now() - start).count());
+        LogInfo() << "TwinCAT state is now: " << GetTwinCATStateName(currentState)
+                  << " (after " << elapsedMs << " ms)";
         return (currentState == targetState);
     }
 
     bool ReadEtherCATMasterState() {
         if (!m_bConnected) {
-            std::cerr << "Error: Not connected to TwinCAT!" << std::endl;
+            LogError() << "Error: Not connected to TwinCAT!";
             return false;
         }
 
-        std::cout << "\n=== EtherCAT Master State Information ===" << std::endl;
+        LogInfo() << "\n=== EtherCAT Master State Information ===";
         
         // Try to read EtherCAT master state
         // Index Group: 0x9000 (EtherCAT master)
         // Index Offset: 0x0000 (Master state)
-        unsigned long masterState;
+        uint32_t masterState;
         unsigned long bytesRead;
         
         long nErr = AdsSyncReadReqEx2(m_nPort, &m_EcMasterAddr, 
@@ -165,23 +187,23 @@ public:
                                       sizeof(masterState), &masterState, &bytesRead);
         
         if (nErr) {
-            std::cout << "Cannot read EtherCAT master state directly (Error: 0x" 
-                      << std::hex << nErr << ")" << std::endl;
-            std::cout << "This is normal - EtherCAT state is managed by TwinCAT System Manager" << std::endl;
+            LogInfo() << "Cannot read EtherCAT master state directly (Error: 0x" 
+                      << std::hex << nErr << ")";
+            LogInfo() << "This is normal - EtherCAT state is managed by TwinCAT System Manager";
             return false;
         }
 
-        std::cout << "EtherCAT Master State: 0x" << std::hex << masterState << std::endl;
+        LogInfo() << "EtherCAT Master State: 0x" << std::hex << masterState;
         return true;
     }
 
     bool ReadEtherCATSlaveStates() {
         if (!m_bConnected) {
-            std::cerr << "Error: Not connected to TwinCAT!" << std::endl;
+            LogError() << "Error: Not connected to TwinCAT!";
             return false;
         }
 
-        std::cout << "\n=== EtherCAT Slave States ===" << std::endl;
+        LogInfo() << "\n=== EtherCAT Slave States ===";
         
         // Try to read number of slaves
         unsigned short slaveCount;
@@ -192,23 +214,32 @@ public:
                                       sizeof(slaveCount), &slaveCount, &bytesRead);
         
         if (nErr) {
-            std::cout << "Cannot read EtherCAT slave information directly" << std::endl;
-            std::cout << "EtherCAT configuration is managed by TwinCAT System Manager" << std::endl;
+            LogInfo() << "Cannot read EtherCAT slave information directly";
+            LogInfo() << "EtherCAT configuration is managed by TwinCAT System Manager";
             return false;
         }
 
-        std::cout << "Number of EtherCAT slaves: " << slaveCount << std::endl;
+        LogInfo() << "Number of EtherCAT slaves: " << slaveCount;
         
-        // Read individual slave states
-        for (int i = 0; i < slaveCount && i < 10; i++) { // Limit to 10 slaves for demo
-            unsigned char slaveState;
-            nErr = AdsSyncReadReqEx2(m_nPort, &m_EcMasterAddr, 
-                                     0x9000, 0x0010 + i, 
-                                     sizeof(slaveState), &slaveState, &bytesRead);
-            
-            if (!nErr) {
-                std::cout << "Slave " << i << " state: " 
-                          << GetEtherCATStateName(slaveState) << std::endl;
+        // All slave states in one ADS sum read instead of one round trip
+        // per slave
+        std::vector<unsigned char> slaveStates(slaveCount);
+        std::vector<AdsSumItem> items(slaveCount);
+        for (unsigned short i = 0; i < slaveCount; i++) {
+            items[i] = AdsSumItem{ 0x9000, 0x0010u + i, sizeof(unsigned char), &slaveStates[i],
+                                   0, nullptr, 0, 0 };
+        }
+
+        nErr = m_SumCommand.Read(m_nPort, &m_EcMasterAddr, items.data(), items.size());
+        if (nErr) {
+            LogError() << "Error reading EtherCAT slave states: 0x" << std::hex << nErr << std::dec;
+            return false;
+        }
+
+        for (unsigned short i = 0; i < slaveCount; i++) {
+            if (!items[i].result) {
+                LogInfo() << "Slave " << i << " state: " 
+                          << GetEtherCATStateName(slaveStates[i]);
             }
         }
         
@@ -216,65 +247,76 @@ public:
     }
 
     bool StartEtherCATSystem() {
-        std::cout << "\n=== Starting EtherCAT System ===" << std::endl;
-        
+        LogInfo() << "\n=== Starting EtherCAT System ===";
+        auto start = std::chrono::steady_clock::now();
+
         // Step 1: Ensure TwinCAT is running
         unsigned short currentState, deviceState;
         long nErr = AdsSyncReadStateReq(&m_Addr, &currentState, &deviceState);
         
         if (nErr) {
-            std::cerr << "Cannot read TwinCAT state!" << std::endl;
+            LogError() << "Cannot read TwinCAT state!";
             return false;
         }
 
-        std::cout << "Current TwinCAT state: " << GetTwinCATStateName(currentState) << std::endl;
+        LogInfo() << "Current TwinCAT state: " << GetTwinCATStateName(currentState);
 
         // Step 2: If not running, try to start TwinCAT
         if (currentState != ADSSTATE_RUN) {
-            std::cout << "TwinCAT is not in RUN mode. Attempting to start..." << std::endl;
+            LogInfo() << "TwinCAT is not in RUN mode. Attempting to start...";
             
             if (!SetTwinCATState(ADSSTATE_RUN)) {
-                std::cerr << "Failed to start TwinCAT!" << std::endl;
-                std::cout << "\nTo manually start TwinCAT:" << std::endl;
-                std::cout << "1. Open TwinCAT System Manager" << std::endl;
-                std::cout << "2. Right-click on System" << std::endl;
-                std::cout << "3. Select 'Set TwinCAT to Run Mode'" << std::endl;
+                LogError() << "Failed to start TwinCAT!";
+                LogInfo() << "\nTo manually start TwinCAT:";
+                LogInfo() << "1. Open TwinCAT System Manager";
+                LogInfo() << "2. Right-click on System";
+                LogInfo() << "3. Select 'Set TwinCAT to Run Mode'";
                 return false;
             }
         }
 
         // Step 3: Check if EtherCAT is operational
-        std::cout << "\nChecking EtherCAT status..." << std::endl;
+        LogInfo() << "\nChecking EtherCAT status...";
         ReadEtherCATMasterState();
         ReadEtherCATSlaveStates();
 
+        LogInfo() << "EtherCAT system start took " << std::chrono::duration_cast<std::chrono::milliseconds>(
+            std::chrono::steady_clock::now() - start).count() << " ms";
         return true;
     }
 
     void MonitorEtherCATStatus() {
-        std::cout << "\n=== EtherCAT Status Monitor ===" << std::endl;
-        std::cout << "Monitoring TwinCAT and EtherCAT status..." << std::endl;
-        std::cout << "Press 'q' to quit, 's' to start system, 'r' to read status" << std::endl;
+        LogInfo() << "\n=== EtherCAT Status Monitor ===";
+        LogInfo() << "Monitoring TwinCAT and EtherCAT status...";
+        LogInfo() << "Press 'q' to quit, 's' to start system, 'r' to read status";
+
+        // TwinCAT pushes every state change, so state is reported within
+        // milliseconds and nothing is sent while the system is idle
+        long nErr = 0;
+        unsigned long stateSubscription = m_Notifications.SubscribeAdsState(&nErr);
+        if (nErr) {
+            LogError() << "Error subscribing to TwinCAT state: 0x" << std::hex << nErr;
+        }
 
         char input = 0;
         int counter = 0;
 
         while (input != 'q') {
-            if (counter % 10 == 0) { // Every 10 seconds, show status
-                unsigned short adsState, deviceState;
-                long nErr = AdsSyncReadStateReq(&m_Addr, &adsState, &deviceState);
-                
-                if (!nErr) {
-                    std::cout << "\nCycle " << counter << " - TwinCAT State: " 
-                              << GetTwinCATStateName(adsState) << std::endl;
-                } else {
-                    std::cout << "\nCycle " << counter << " - Connection lost!" << std::endl;
+            if (m_Notifications.WaitForEvents(50)) {
+                m_Notifications.Poll([&](const AdsNotificationEvent& event) {
+                    if (event.subscription == stateSubscription) {
+                        unsigned short adsState;
+                        memcpy(&adsState, event.data, sizeof(adsState));
+                        LogInfo() << "\nEvent " << ++counter << " - TwinCAT State: " 
+                                  << GetTwinCATStateName(adsState);
+                    }
+                });
+
+                if (AdsNotificationClient::PollRouterEvent() == AMSEVENT_ROUTERSTOP) {
+                    LogError(m_ConnectionLostLog) << "\nEvent " << ++counter << " - Connection lost!";
                 }
             }
 
-            Sleep(1000);
-            counter++;
-
             // Check for user input
             if (_kbhit()) {
                 input = _getch();
@@ -288,9 +330,10 @@ public:
                         ReadEtherCATSlaveStates();
                         break;
                     case 'q':
+                        m_Notifications.Unsubscribe(stateSubscription);
                         break;
                     default:
-                        std::cout << "Commands: 's'=start system, 'r'=read status, 'q'=quit" << std::endl;
+                        LogInfo() << "Commands: 's'=start system, 'r'=read status, 'q'=quit";
                         break;
                 }
             }
@@ -298,31 +341,31 @@ public:
     }
 
     void ShowEtherCATRequirements() {
-        std::cout << "\n=== EtherCAT OP Mode Requirements ===" << std::endl;
-        std::cout << "To reach EtherCAT OP mode, you need:" << std::endl;
-        std::cout << "\n1. TwinCAT System Configuration:" << std::endl;
-        std::cout << "   - EtherCAT Master configured in System Manager" << std::endl;
-        std::cout << "   - Ethernet adapter assigned to EtherCAT" << std::endl;
-        std::cout << "   - EtherCAT slaves scanned and configured" << std::endl;
-        std::cout << "\n2. PLC Program:" << std::endl;
-        std::cout << "   - PLC project with I/O mapping" << std::endl;
-        std::cout << "   - Variables linked to EtherCAT I/O" << std::endl;
-        std::cout << "   - Program compiled and downloaded" << std::endl;
-        std::cout << "\n3. System Activation:" << std::endl;
-        std::cout << "   - Activate Configuration in System Manager" << std::endl;
-        std::cout << "   - Set TwinCAT to RUN mode" << std::endl;
-        std::cout << "   - EtherCAT will automatically go to OP mode" << std::endl;
-        std::cout << "\n4. This Application:" << std::endl;
-        std::cout << "   - Connects via ADS to monitor/control" << std::endl;
-        std::cout << "   - Can start/stop TwinCAT system" << std::endl;
-        std::cout << "   - Monitors EtherCAT status through TwinCAT" << std::endl;
+        LogInfo() << "\n=== EtherCAT OP Mode Requirements ===";
+        LogInfo() << "To reach EtherCAT OP mode, you need:";
+        LogInfo() << "\n1. TwinCAT System Configuration:";
+        LogInfo() << "   - EtherCAT Master configured in System Manager";
+        LogInfo() << "   - Ethernet adapter assigned to EtherCAT";
+        LogInfo() << "   - EtherCAT slaves scanned and configured";
+        LogInfo() << "\n2. PLC Program:";
+        LogInfo() << "   - PLC project with I/O mapping";
+        LogInfo() << "   - Variables linked to EtherCAT I/O";
+        LogInfo() << "   - Program compiled and downloaded";
+        LogInfo() << "\n3. System Activation:";
+        LogInfo() << "   - Activate Configuration in System Manager";
+        LogInfo() << "   - Set TwinCAT to RUN mode";
+        LogInfo() << "   - EtherCAT will automatically go to OP mode";
+        LogInfo() << "\n4. This Application:";
+        LogInfo() << "   - Connects via ADS to monitor/control";
+        LogInfo() << "   - Can start/stop TwinCAT system";
+        LogInfo() << "   - Monitors EtherCAT status through TwinCAT";
     }
 };
 
 int main() {
-    std::cout << "=== EtherCAT State-Aware Master Application ===" << std::endl;
-    std::cout << "TwinCAT3 C++ EtherCAT State Control Demo" << std::endl;
-    std::cout << "===========================================" << std::endl;
+    LogInfo() << "=== EtherCAT State-Aware Master Application ===";
+    LogInfo() << "TwinCAT3 C++ EtherCAT State Control Demo";
+    LogInfo() << "===========================================";
 
     EtherCATStateMaster master;
 
@@ -331,11 +374,11 @@ int main() {
 
     // Connect to TwinCAT
     if (!master.Connect()) {
-        std::cerr << "Failed to connect to TwinCAT system!" << std::endl;
-        std::cout << "\nMake sure:" << std::endl;
-        std::cout << "1. TwinCAT3 is installed" << std::endl;
-        std::cout << "2. TwinCAT System Service is running" << std::endl;
-        std::cout << "3. You have administrator privileges" << std::endl;
+        LogError() << "Failed to connect to TwinCAT system!";
+        LogInfo() << "\nMake sure:";
+        LogInfo() << "1. TwinCAT3 is installed";
+        LogInfo() << "2. TwinCAT System Service is running";
+        LogInfo() << "3. You have administrator privileges";
         return -1;
     }
 
@@ -345,7 +388,7 @@ int main() {
     // Monitor system status
     master.MonitorEtherCATStatus();
 
-    std::cout << "\nShutting down EtherCAT State Master..." << std::endl;
+    LogInfo() << "\nShutting down EtherCAT State Master...";
     master.Disconnect();
 
     return 0;
@@ -0,0 +1,135 @@
+// ecat_trace: reads the per-cycle trace ring of a running master from
+// shared memory. The master's cycle thread is never blocked by it.
+//
+//   ecat_trace [name] [--last N] [--follow] [--spikes-us N] [--csv]
+//
+// name is the trace the master created: DirectEtherCATMaster (default) or
+// EtherCATMaster. --spikes-us shows only cycles whose wake-up jitter or
+// execution time exceeds N us, or that overran, lost a frame or had a
+// working-counter error. Times are relative to the cycle's wake-up.
+
+#include <chrono>
+#include <csignal>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <thread>
+#include "CycleTrace.h"
+
+static volatile sig_atomic_t g_bStop = 0;
+
+static void OnSignal(int) {
+    g_bStop = 1;
+}
+
+static double OffsetUs(int64_t ns, int64_t baseNs) {
+    return ns ? (ns - baseNs) / 1000.0 : -1.0;
+}
+
+static bool IsSpike(const CycleTraceRecord& record, double spikeUs) {
+    return record.flags != 0 ||
+           (record.wakeupNs - record.deadlineNs) / 1000.0 > spikeUs ||
+           (record.endNs - record.wakeupNs) / 1000.0 > spikeUs;
+}
+
+static void PrintRecord(const CycleTraceRecord& record, bool bCsv) {
+    double jitter = (record.wakeupNs - record.deadlineNs) / 1000.0;
+    double tx = OffsetUs(record.txNs, record.wakeupNs);
+    double rx = OffsetUs(record.rxNs, record.wakeupNs);
+    double exec = (record.endNs - record.wakeupNs) / 1000.0;
+    std::string flags;
+    flags += (record.flags & CycleTrace::FLAG_OVERRUN) ? 'O' : '-';
+    flags += (record.flags & CycleTrace::FLAG_WKC_ERROR) ? 'W' : '-';
+    flags += (record.flags & CycleTrace::FLAG_FRAME_LOST) ? 'L' : '-';
+
+    if (bCsv) {
+        std::cout << record.cycle << std::fixed << std::setprecision(3) << "," << jitter << "," << tx << ","
+                  << rx << "," << exec << "," << record.wkc << "," << record.expectedWkc << "," << flags << "\n";
+    } else {
+        std::cout << std::setw(10) << record.cycle << std::fixed << std::setprecision(1)
+                  << std::setw(11) << jitter << std::setw(9) << tx << std::setw(9) << rx << std::setw(9) << exec
+                  << std::setw(6) << record.wkc << "/" << std::left << std::setw(5) << record.expectedWkc
+                  << std::right << " " << flags << "\n";
+    }
+}
+
+int main(int argc, char* argv[]) {
+    std::string name = "DirectEtherCATMaster";
+    unsigned long last = 20;
+    bool bFollow = false;
+    bool bCsv = false;
+    double spikeUs = -1.0;
+
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        bool hasValue = (i + 1 < argc);
+        if (arg == "--last" && hasValue) {
+            last = strtoul(argv[++i], nullptr, 10);
+        } else if (arg == "--follow") {
+            bFollow = true;
+        } else if (arg == "--spikes-us" && hasValue) {
+            spikeUs = atof(argv[++i]);
+        } else if (arg == "--csv") {
+            bCsv = true;
+        } else if (arg[0] != '-') {
+            name = arg;
+        } else {
+            std::cout << "Usage: " << argv[0] << " [name] [--last N] [--follow] [--spikes-us N] [--csv]\n";
+            return 1;
+        }
+    }
+
+    CycleTrace trace;
+    if (!trace.Open(name)) {
+        std::cerr << "Error: No trace '" << name << "' - is the master running?" << std::endl;
+        return 1;
+    }
+
+    if (bCsv) {
+        std::cout << "cycle,jitter_us,tx_us,rx_us,exec_us,wkc,expected_wkc,flags\n";
+    } else {
+        std::cout << "Trace '" << name << "' (pid " << trace.GetWriterPid() << ", "
+                  << trace.GetCycleTimeNs() / 1000 << " us cycle, " << trace.GetCapacity() << " records)\n";
+        std::cout << std::setw(10) << "cycle" << std::setw(11) << "jitter_us" << std::setw(9) << "tx_us"
+                  << std::setw(9) << "rx_us" << std::setw(9) << "exec_us" << std::setw(12) << "wkc" << " flags\n";
+    }
+
+    uint64_t written = trace.GetWritten();
+    uint64_t oldest = written > trace.GetCapacity() ? written - trace.GetCapacity() : 0;
+    uint64_t next = (spikeUs < 0 && written - oldest > last) ? written - last : oldest;
+
+    uint64_t shown = 0;
+    uint64_t skipped = 0;
+    signal(SIGINT, OnSignal);
+    signal(SIGTERM, OnSignal);
+    while (!g_bStop) {
+        written = trace.GetWritten();
+        if (written - next > trace.GetCapacity()) {
+            // Fell behind the writer by a full ring
+            skipped += written - trace.GetCapacity() - next;
+            next = written - trace.GetCapacity();
+        }
+        for (; next < written; next++) {
+            CycleTraceRecord record;
+            if (!trace.Read(next, record)) {
+                skipped++;
+                continue;
+            }
+            if (spikeUs < 0 || IsSpike(record, spikeUs)) {
+                PrintRecord(record, bCsv);
+                shown++;
+            }
+        }
+        if (!bFollow) {
+            break;
+        }
+        std::cout.flush();
+        std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    }
+
+    if (!bCsv) {
+        std::cout << shown << " records shown, " << skipped << " overwritten before they could be read" << std::endl;
+    }
+    return 0;
+}
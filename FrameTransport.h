@@ -0,0 +1,41 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+// Raw Ethernet frame I/O for a master that drives the EtherCAT segment
+// itself. Frames are built and read in place in transport-owned buffers:
+//
+//   uint8_t* p = transport.AcquireTx(&capacity);  // compose frame at p
+//   transport.CommitTx(length);
+//   ...                                            // more frames
+//   transport.Kick();                              // one syscall per cycle
+//   while (const uint8_t* pRx = transport.PollRx(&length)) {
+//       ...                                        // parse in place
+//       transport.ReleaseRx();
+//   }
+//
+// A transport is used from one thread at a time.
+class FrameTransport {
+public:
+    virtual ~FrameTransport() {}
+
+    // Next free TX buffer, or nullptr if every buffer is still queued
+    virtual uint8_t* AcquireTx(size_t* pCapacity) = 0;
+
+    // Queues the buffer returned by AcquireTx() with the given frame length
+    virtual void CommitTx(size_t length) = 0;
+
+    // Hands all committed frames to the wire
+    virtual bool Kick() = 0;
+
+    // Oldest received frame, or nullptr; valid until ReleaseRx()
+    virtual const uint8_t* PollRx(size_t* pLength) = 0;
+
+    virtual void ReleaseRx() = 0;
+
+    // Blocks until a frame is available or timeoutUs passes
+    virtual bool WaitRx(long timeoutUs) = 0;
+
+    virtual const uint8_t* GetMacAddress() const = 0;
+};
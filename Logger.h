@@ -0,0 +1,458 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <ctime>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <type_traits>
+#include "MpscQueue.h"
+
+enum LogLevel {
+    LOG_LEVEL_DEBUG,
+    LOG_LEVEL_INFO,
+    LOG_LEVEL_WARNING,
+    LOG_LEVEL_ERROR
+};
+
+inline const char* LogLevelName(int level) {
+    switch (level) {
+        case LOG_LEVEL_DEBUG:   return "DEBUG";
+        case LOG_LEVEL_INFO:    return "INFO";
+        case LOG_LEVEL_WARNING: return "WARNING";
+        case LOG_LEVEL_ERROR:   return "ERROR";
+        default:          return "?";
+    }
+}
+
+// One log line as the caller left it: the arguments in binary form (tag
+// byte + value), turned into text by the writer thread. Strings are copied
+// in, so nothing points back into the caller's memory.
+struct LogRecord {
+    enum Arg : uint8_t {
+        ARG_TEXT,         // uint16 length + bytes
+        ARG_INT,          // int64
+        ARG_UINT,         // uint64
+        ARG_DOUBLE,
+        ARG_CHAR,
+        ARG_HEX,          // std::hex
+        ARG_DEC           // std::dec
+    };
+
+    static const size_t kPayloadSize = 240;
+
+    int64_t timeNs;       // system clock
+    uint8_t level;
+    uint8_t truncated;
+    uint16_t size;        // payload bytes used
+    uint32_t reserved;
+    uint8_t payload[kPayloadSize];
+};
+
+// Lets at most `burst` lines per interval through from one source and
+// counts the rest; the next line that passes says how many were held back.
+// A limiter belongs to one call site and is used from one thread.
+class LogRateLimit {
+private:
+    int64_t m_intervalNs;
+    unsigned m_burst;
+    unsigned m_passed;
+    int64_t m_windowStartNs;
+    unsigned long m_suppressed;
+
+public:
+    explicit LogRateLimit(unsigned burst = 1, unsigned long intervalMs = 1000)
+        : m_intervalNs(static_cast<int64_t>(intervalMs) * 1000000), m_burst(burst), m_passed(0),
+          m_windowStartNs(0), m_suppressed(0) {}
+
+    // True if the line may be logged; *pSuppressed receives the number of
+    // lines dropped since the last one that passed
+    bool Allow(unsigned long* pSuppressed) {
+        int64_t now = std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+        if (m_passed == 0 || now - m_windowStartNs >= m_intervalNs) {
+            m_windowStartNs = now;
+            m_passed = 0;
+        }
+        if (m_passed >= m_burst) {
+            m_suppressed++;
+            return false;
+        }
+        m_passed++;
+        *pSuppressed = m_suppressed;
+        m_suppressed = 0;
+        return true;
+    }
+
+    unsigned long GetSuppressed() const {
+        return m_suppressed;
+    }
+};
+
+// Process-wide asynchronous log. Callers only encode their line into a
+// LogRecord and push it into a lock-free queue; a background thread
+// formats the records and writes them to the console (and a file, if one
+// is set), flushing once per batch instead of once per line. When the
+// queue is full the line is dropped and counted: logging never waits.
+//
+//   LogInfo() << "Slaves responding: " << slaves;
+//   LogError(m_sendErrors) << "Error sending frames: " << strerror(errno);
+class Logger {
+public:
+    static const size_t kQueueSize = 1024;
+    static const unsigned kIdleSleepMs = 2;
+
+private:
+    MpscQueue<LogRecord, kQueueSize> m_queue;
+    std::atomic<int> m_level;
+    std::atomic<uint64_t> m_pushed;
+    std::atomic<uint64_t> m_written;
+    std::atomic<uint64_t> m_dropped;
+    std::atomic<bool> m_bRunning;
+    std::mutex m_fileMutex;           // writer thread vs. SetFile, never a caller
+    std::ofstream m_file;
+    std::thread m_writer;
+
+    Logger() : m_level(LOG_LEVEL_INFO), m_pushed(0), m_written(0), m_dropped(0), m_bRunning(true) {
+        m_writer = std::thread(&Logger::WriterLoop, this);
+    }
+
+    static void Format(const LogRecord& record, std::ostringstream& text) {
+        const uint8_t* p = record.payload;
+        const uint8_t* pEnd = record.payload + record.size;
+        while (p < pEnd) {
+            uint8_t tag = *p++;
+            switch (tag) {
+                case LogRecord::ARG_TEXT: {
+                    uint16_t length;
+                    memcpy(&length, p, sizeof(length));
+                    text.write(reinterpret_cast<const char*>(p + sizeof(length)), length);
+                    p += sizeof(length) + length;
+                    break;
+                }
+                case LogRecord::ARG_INT: {
+                    int64_t value;
+                    memcpy(&value, p, sizeof(value));
+                    text << value;
+                    p += sizeof(value);
+                    break;
+                }
+                case LogRecord::ARG_UINT: {
+                    uint64_t value;
+                    memcpy(&value, p, sizeof(value));
+                    text << value;
+                    p += sizeof(value);
+                    break;
+                }
+                case LogRecord::ARG_DOUBLE: {
+                    double value;
+                    memcpy(&value, p, sizeof(value));
+                    text << value;
+                    p += sizeof(value);
+                    break;
+                }
+                case LogRecord::ARG_CHAR:
+                    text << static_cast<char>(*p++);
+                    break;
+                case LogRecord::ARG_HEX:
+                    text << std::hex;
+                    break;
+                case LogRecord::ARG_DEC:
+                    text << std::dec;
+                    break;
+                default:
+                    p = pEnd;
+                    break;
+            }
+        }
+        if (record.truncated) {
+            text << "...";
+        }
+    }
+
+    void Write(int level, int64_t timeNs, const std::string& line) {
+        // Console output stays as it was before the logger: plain lines,
+        // warnings and errors on stderr
+        (level >= LOG_LEVEL_WARNING ? std::cerr : std::cout) << line << '\n';
+        if (!m_file.is_open()) {
+            return;
+        }
+        time_t seconds = static_cast<time_t>(timeNs / 1000000000);
+        tm local;
+#ifdef _WIN32
+        localtime_s(&local, &seconds);
+#else
+        localtime_r(&seconds, &local);
+#endif
+        m_file << std::put_time(&local, "%Y-%m-%d %H:%M:%S") << '.' << std::setw(6) << std::setfill('0')
+               << (timeNs / 1000) % 1000000 << std::setfill(' ') << ' ' << std::left << std::setw(8)
+               << LogLevelName(level) << std::right;
+        // Section breaks start with a newline on the console; keep the
+        // file one line per record
+        size_t start = line.find_first_not_of('\n');
+        m_file << (start == std::string::npos ? std::string() : line.substr(start)) << '\n';
+    }
+
+    void WriterLoop() {
+        std::ostringstream text;
+        std::ios_base::fmtflags defaultFlags = text.flags();
+        LogRecord record;
+        uint64_t droppedReported = 0;
+        for (;;) {
+            bool bStop = !m_bRunning.load(std::memory_order_acquire);
+            uint64_t count = 0;
+            bool bOutput = false;
+            {
+                std::lock_guard<std::mutex> lock(m_fileMutex);
+                while (m_queue.TryPop(record)) {
+                    text.str("");
+                    text.flags(defaultFlags);
+                    Format(record, text);
+                    Write(record.level, record.timeNs, text.str());
+                    count++;
+                }
+                uint64_t dropped = m_dropped.load(std::memory_order_relaxed);
+                if (dropped != droppedReported) {
+                    text.str("");
+                    text.flags(defaultFlags);
+                    text << "Warning: " << dropped - droppedReported << " log lines dropped, queue full";
+                    Write(LOG_LEVEL_WARNING, std::chrono::duration_cast<std::chrono::nanoseconds>(
+                              std::chrono::system_clock::now().time_since_epoch()).count(), text.str());
+                    droppedReported = dropped;
+                    bOutput = true;
+                }
+                if (count || bOutput) {
+                    std::cout.flush();
+                    std::cerr.flush();
+                    if (m_file.is_open()) {
+                        m_file.flush();
+                    }
+                }
+            }
+            m_written.fetch_add(count, std::memory_order_release);
+            if (bStop) {
+                break;
+            }
+            if (!count) {
+                std::this_thread::sleep_for(std::chrono::milliseconds(static_cast<long>(kIdleSleepMs)));
+            }
+        }
+    }
+
+public:
+    ~Logger() {
+        m_bRunning.store(false, std::memory_order_release);
+        if (m_writer.joinable()) {
+            m_writer.join();
+        }
+    }
+
+    Logger(const Logger&) = delete;
+    Logger& operator=(const Logger&) = delete;
+
+    static Logger& Instance() {
+        static Logger logger;
+        return logger;
+    }
+
+    void SetLevel(LogLevel level) {
+        m_level.store(level, std::memory_order_relaxed);
+    }
+
+    bool IsEnabled(LogLevel level) const {
+        return level >= m_level.load(std::memory_order_relaxed);
+    }
+
+    // Also writes every line, timestamped, to path. Empty path: console only.
+    bool SetFile(const std::string& path) {
+        std::lock_guard<std::mutex> lock(m_fileMutex);
+        if (m_file.is_open()) {
+            m_file.close();
+        }
+        if (path.empty()) {
+            return true;
+        }
+        m_file.open(path, std::ios::app);
+        return m_file.is_open();
+    }
+
+    // Never blocks: a full queue drops the line and counts it
+    void Push(const LogRecord& record) {
+        if (m_queue.TryPush(record)) {
+            m_pushed.fetch_add(1, std::memory_order_release);
+        } else {
+            m_dropped.fetch_add(1, std::memory_order_relaxed);
+        }
+    }
+
+    // Waits until everything logged so far is written. For console prompts
+    // and shutdown only - never from a cycle thread.
+    void Flush() {
+        uint64_t target = m_pushed.load(std::memory_order_acquire);
+        while (m_written.load(std::memory_order_acquire) < target) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+    }
+
+    uint64_t GetDropped() const {
+        return m_dropped.load(std::memory_order_relaxed);
+    }
+};
+
+// Builds one record on the caller's stack and pushes it when the statement
+// ends. Integers and doubles are stored as binary; only std::hex and
+// std::dec are understood as manipulators.
+class LogLine {
+private:
+    LogRecord m_record;
+    bool m_bActive;
+    unsigned long m_suppressed;
+
+    uint8_t* Reserve(uint8_t tag, size_t bytes) {
+        if (!m_bActive) {
+            return nullptr;
+        }
+        if (m_record.size + 1 + bytes > LogRecord::kPayloadSize) {
+            m_record.truncated = 1;
+            return nullptr;
+        }
+        uint8_t* p = m_record.payload + m_record.size;
+        *p = tag;
+        m_record.size = static_cast<uint16_t>(m_record.size + 1 + bytes);
+        return p + 1;
+    }
+
+    template <typename T>
+    void PutValue(uint8_t tag, T value) {
+        uint8_t* p = Reserve(tag, sizeof(value));
+        if (p) {
+            memcpy(p, &value, sizeof(value));
+        }
+    }
+
+    void PutText(const char* pText, size_t length) {
+        if (!m_bActive || m_record.truncated) {
+            return;
+        }
+        // Long text is cut to what fits rather than dropped
+        size_t room = LogRecord::kPayloadSize - m_record.size;
+        if (room < 1 + sizeof(uint16_t) + 1) {
+            m_record.truncated = 1;
+            return;
+        }
+        if (length > room - 1 - sizeof(uint16_t)) {
+            length = room - 1 - sizeof(uint16_t);
+            m_record.truncated = 1;
+        }
+        uint16_t stored = static_cast<uint16_t>(length);
+        uint8_t* p = Reserve(LogRecord::ARG_TEXT, sizeof(stored) + length);
+        memcpy(p, &stored, sizeof(stored));
+        memcpy(p + sizeof(stored), pText, length);
+    }
+
+public:
+    explicit LogLine(LogLevel level, LogRateLimit* pLimit = nullptr)
+        : m_bActive(Logger::Instance().IsEnabled(level)), m_suppressed(0) {
+        if (m_bActive && pLimit) {
+            m_bActive = pLimit->Allow(&m_suppressed);
+        }
+        if (m_bActive) {
+            m_record.timeNs = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                std::chrono::system_clock::now().time_since_epoch()).count();
+            m_record.level = static_cast<uint8_t>(level);
+            m_record.truncated = 0;
+            m_record.size = 0;
+            m_record.reserved = 0;
+        }
+    }
+
+    LogLine(LogLine&& other) : m_record(other.m_record), m_bActive(other.m_bActive),
+                               m_suppressed(other.m_suppressed) {
+        other.m_bActive = false;
+    }
+
+    LogLine(const LogLine&) = delete;
+    LogLine& operator=(const LogLine&) = delete;
+
+    ~LogLine() {
+        if (!m_bActive) {
+            return;
+        }
+        if (m_suppressed) {
+            *this << std::dec << " (" << m_suppressed << " similar messages suppressed)";
+        }
+        Logger::Instance().Push(m_record);
+    }
+
+    LogLine& operator<<(const char* pText) {
+        PutText(pText, strlen(pText));
+        return *this;
+    }
+
+    LogLine& operator<<(const std::string& text) {
+        PutText(text.data(), text.size());
+        return *this;
+    }
+
+    LogLine& operator<<(char c) {
+        PutValue(LogRecord::ARG_CHAR, c);
+        return *this;
+    }
+
+    LogLine& operator<<(double value) {
+        PutValue(LogRecord::ARG_DOUBLE, value);
+        return *this;
+    }
+
+    LogLine& operator<<(std::ios_base& (*manipulator)(std::ios_base&)) {
+        if (manipulator == static_cast<std::ios_base& (*)(std::ios_base&)>(std::hex)) {
+            Reserve(LogRecord::ARG_HEX, 0);
+        } else if (manipulator == static_cast<std::ios_base& (*)(std::ios_base&)>(std::dec)) {
+            Reserve(LogRecord::ARG_DEC, 0);
+        }
+        return *this;
+    }
+
+    // Integers and unscoped enums, printed as numbers like std::ostream does
+    template <typename T>
+    typename std::enable_if<std::is_integral<T>::value || std::is_enum<T>::value, LogLine&>::type
+    operator<<(T value) {
+        if (std::is_signed<T>::value || std::is_enum<T>::value) {
+            PutValue(LogRecord::ARG_INT, static_cast<int64_t>(value));
+        } else {
+            PutValue(LogRecord::ARG_UINT, static_cast<uint64_t>(value));
+        }
+        return *this;
+    }
+};
+
+inline LogLine LogDebug() {
+    return LogLine(LOG_LEVEL_DEBUG);
+}
+
+inline LogLine LogInfo() {
+    return LogLine(LOG_LEVEL_INFO);
+}
+
+inline LogLine LogWarning() {
+    return LogLine(LOG_LEVEL_WARNING);
+}
+
+inline LogLine LogError() {
+    return LogLine(LOG_LEVEL_ERROR);
+}
+
+inline LogLine LogWarning(LogRateLimit& limit) {
+    return LogLine(LOG_LEVEL_WARNING, &limit);
+}
+
+inline LogLine LogError(LogRateLimit& limit) {
+    return LogLine(LOG_LEVEL_ERROR, &limit);
+}
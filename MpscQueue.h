@@ -0,0 +1,77 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+
+// Bounded lock-free multi-producer/single-consumer ring. Any number of
+// threads may call TryPush, one other thread calls TryPop. A full queue
+// makes TryPush fail at once; no call ever blocks or allocates. Capacity
+// must be a power of two.
+//
+// Each slot carries a sequence number: a producer claims a slot by
+// advancing m_tail, fills it and then publishes it by bumping the slot's
+// sequence, so the consumer never reads a slot that is still being filled.
+template <typename T, size_t Capacity>
+class MpscQueue {
+    static_assert(Capacity >= 2 && (Capacity & (Capacity - 1)) == 0,
+                  "MpscQueue capacity must be a power of two");
+
+private:
+    static const size_t kMask = Capacity - 1;
+
+    struct Slot {
+        std::atomic<size_t> sequence;
+        T item;
+    };
+
+    alignas(64) std::atomic<size_t> m_head;     // next slot to pop
+    alignas(64) std::atomic<size_t> m_tail;     // next slot to claim
+    alignas(64) Slot m_slots[Capacity];
+
+public:
+    MpscQueue() : m_head(0), m_tail(0) {
+        for (size_t i = 0; i < Capacity; i++) {
+            m_slots[i].sequence.store(i, std::memory_order_relaxed);
+        }
+    }
+
+    MpscQueue(const MpscQueue&) = delete;
+    MpscQueue& operator=(const MpscQueue&) = delete;
+
+    bool TryPush(const T& item) {
+        size_t tail = m_tail.load(std::memory_order_relaxed);
+        for (;;) {
+            Slot& slot = m_slots[tail & kMask];
+            ptrdiff_t lag = static_cast<ptrdiff_t>(slot.sequence.load(std::memory_order_acquire) - tail);
+            if (lag == 0) {
+                if (m_tail.compare_exchange_weak(tail, tail + 1, std::memory_order_relaxed)) {
+                    slot.item = item;
+                    slot.sequence.store(tail + 1, std::memory_order_release);
+                    return true;
+                }
+            } else if (lag < 0) {
+                return false;       // slot still holds an item from the last lap
+            } else {
+                tail = m_tail.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    // Consumer side only: true when the next slot holds no published item
+    bool Empty() const {
+        size_t head = m_head.load(std::memory_order_relaxed);
+        return m_slots[head & kMask].sequence.load(std::memory_order_acquire) != head + 1;
+    }
+
+    bool TryPop(T& item) {
+        size_t head = m_head.load(std::memory_order_relaxed);
+        Slot& slot = m_slots[head & kMask];
+        if (slot.sequence.load(std::memory_order_acquire) != head + 1) {
+            return false;           // empty, or the producer is still filling it
+        }
+        item = slot.item;
+        slot.sequence.store(head + Capacity, std::memory_order_release);
+        m_head.store(head + 1, std::memory_order_relaxed);
+        return true;
+    }
+};
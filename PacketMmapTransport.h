@@ -0,0 +1,277 @@
+#pragma once
+
+// Linux AF_PACKET transport with PACKET_MMAP TX and RX rings. Frames are
+// composed directly in the TX ring and parsed directly in the RX ring, so
+// the only syscall per cycle is the send() that kicks the TX ring (plus a
+// poll() when waiting for the reply). Needs CAP_NET_RAW.
+
+#include <arpa/inet.h>
+#include <linux/if_packet.h>
+#include <net/ethernet.h>
+#include <net/if.h>
+#include <poll.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstring>
+#include <string>
+#include "EtherCATFrame.h"
+#include "FrameTransport.h"
+#include "Logger.h"
+
+class PacketMmapTransport : public FrameTransport {
+public:
+    static const unsigned int kFrameSize = 2048;    // one slot per Ethernet frame
+    static const unsigned int kBlockSize = 4096;
+    static const unsigned int kDefaultFrames = 256;
+
+    struct Stats {
+        unsigned long txFrames;
+        unsigned long rxFrames;
+        unsigned long kicks;
+        unsigned long txRingFull;
+    };
+
+private:
+    int m_fd;
+    int m_ifIndex;
+    uint8_t m_mac[6];
+    uint8_t* m_pRing;
+    size_t m_ringBytes;
+    unsigned int m_frames;      // slots per ring
+    unsigned int m_rxIndex;
+    unsigned int m_txIndex;
+    bool m_bTxAcquired;
+    Stats m_stats;
+    LogRateLimit m_sendErrorLog;  // Kick() runs every cycle
+
+    // Offset of frame data in a TX slot (TPACKET_V2 without PACKET_TX_HAS_OFF)
+    static size_t TxDataOffset() {
+        return TPACKET_ALIGN(sizeof(tpacket2_hdr));
+    }
+
+    tpacket2_hdr* RxSlot(unsigned int index) const {
+        return reinterpret_cast<tpacket2_hdr*>(m_pRing + static_cast<size_t>(index) * kFrameSize);
+    }
+
+    tpacket2_hdr* TxSlot(unsigned int index) const {
+        return reinterpret_cast<tpacket2_hdr*>(m_pRing + static_cast<size_t>(m_frames + index) * kFrameSize);
+    }
+
+    // tp_status is shared with the kernel
+    static uint32_t LoadStatus(const tpacket2_hdr* pHeader) {
+        return __atomic_load_n(&pHeader->tp_status, __ATOMIC_ACQUIRE);
+    }
+
+    static void StoreStatus(tpacket2_hdr* pHeader, uint32_t status) {
+        __atomic_store_n(&pHeader->tp_status, status, __ATOMIC_RELEASE);
+    }
+
+    bool Fail(const char* what) {
+        LogError() << "Error " << what << ": " << strerror(errno);
+        Close();
+        return false;
+    }
+
+public:
+    PacketMmapTransport()
+        : m_fd(-1), m_ifIndex(0), m_pRing(nullptr), m_ringBytes(0), m_frames(0),
+          m_rxIndex(0), m_txIndex(0), m_bTxAcquired(false) {
+        memset(m_mac, 0, sizeof(m_mac));
+        memset(&m_stats, 0, sizeof(m_stats));
+    }
+
+    ~PacketMmapTransport() {
+        Close();
+    }
+
+    PacketMmapTransport(const PacketMmapTransport&) = delete;
+    PacketMmapTransport& operator=(const PacketMmapTransport&) = delete;
+
+    // frames is the number of slots in each ring, a multiple of 2
+    bool Open(const std::string& interfaceName, unsigned int frames = kDefaultFrames) {
+        Close();
+
+        m_fd = socket(AF_PACKET, SOCK_RAW, htons(ETHERCAT_ETHERTYPE));
+        if (m_fd < 0) {
+            return Fail("opening raw socket (needs CAP_NET_RAW)");
+        }
+
+        ifreq ifr = {};
+        strncpy(ifr.ifr_name, interfaceName.c_str(), IFNAMSIZ - 1);
+        if (ioctl(m_fd, SIOCGIFINDEX, &ifr) < 0) {
+            return Fail(("finding interface " + interfaceName).c_str());
+        }
+        m_ifIndex = ifr.ifr_ifindex;
+        if (ioctl(m_fd, SIOCGIFHWADDR, &ifr) < 0) {
+            return Fail("reading MAC address");
+        }
+        memcpy(m_mac, ifr.ifr_hwaddr.sa_data, 6);
+
+        int version = TPACKET_V2;
+        if (setsockopt(m_fd, SOL_PACKET, PACKET_VERSION, &version, sizeof(version)) < 0) {
+            return Fail("selecting TPACKET_V2");
+        }
+
+        // Frames leave without passing the qdisc layer, and our own TX
+        // frames are not looped back into the RX ring
+        int one = 1;
+        setsockopt(m_fd, SOL_PACKET, PACKET_QDISC_BYPASS, &one, sizeof(one));
+#ifdef PACKET_IGNORE_OUTGOING
+        setsockopt(m_fd, SOL_PACKET, PACKET_IGNORE_OUTGOING, &one, sizeof(one));
+#endif
+
+        m_frames = (frames + 1) & ~1u;
+        tpacket_req req = {};
+        req.tp_block_size = kBlockSize;
+        req.tp_frame_size = kFrameSize;
+        req.tp_block_nr = m_frames * kFrameSize / kBlockSize;
+        req.tp_frame_nr = m_frames;
+        if (setsockopt(m_fd, SOL_PACKET, PACKET_RX_RING, &req, sizeof(req)) < 0) {
+            return Fail("creating RX ring");
+        }
+        if (setsockopt(m_fd, SOL_PACKET, PACKET_TX_RING, &req, sizeof(req)) < 0) {
+            return Fail("creating TX ring");
+        }
+
+        // RX ring first, TX ring directly behind it in one mapping
+        m_ringBytes = 2 * static_cast<size_t>(req.tp_block_size) * req.tp_block_nr;
+        void* pRing = mmap(nullptr, m_ringBytes, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_LOCKED, m_fd, 0);
+        if (pRing == MAP_FAILED) {
+            // MAP_LOCKED fails without CAP_IPC_LOCK; the ring still works
+            pRing = mmap(nullptr, m_ringBytes, PROT_READ | PROT_WRITE, MAP_SHARED, m_fd, 0);
+        }
+        if (pRing == MAP_FAILED) {
+            m_ringBytes = 0;
+            return Fail("mapping packet rings");
+        }
+        m_pRing = static_cast<uint8_t*>(pRing);
+
+        sockaddr_ll addr = {};
+        addr.sll_family = AF_PACKET;
+        addr.sll_protocol = htons(ETHERCAT_ETHERTYPE);
+        addr.sll_ifindex = m_ifIndex;
+        if (bind(m_fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) < 0) {
+            return Fail("binding raw socket");
+        }
+
+        // Slaves modify the source MAC of returning frames
+        packet_mreq mreq = {};
+        mreq.mr_ifindex = m_ifIndex;
+        mreq.mr_type = PACKET_MR_PROMISC;
+        if (setsockopt(m_fd, SOL_PACKET, PACKET_ADD_MEMBERSHIP, &mreq, sizeof(mreq)) < 0) {
+            return Fail("enabling promiscuous mode");
+        }
+
+        m_rxIndex = 0;
+        m_txIndex = 0;
+        m_bTxAcquired = false;
+        return true;
+    }
+
+    void Close() {
+        if (m_pRing) {
+            munmap(m_pRing, m_ringBytes);
+            m_pRing = nullptr;
+            m_ringBytes = 0;
+        }
+        if (m_fd >= 0) {
+            close(m_fd);
+            m_fd = -1;
+        }
+    }
+
+    bool IsOpen() const {
+        return m_pRing != nullptr;
+    }
+
+    uint8_t* AcquireTx(size_t* pCapacity) override {
+        tpacket2_hdr* pHeader = TxSlot(m_txIndex);
+        uint32_t status = LoadStatus(pHeader);
+        if (status != TP_STATUS_AVAILABLE && status != TP_STATUS_WRONG_FORMAT) {
+            m_stats.txRingFull++;
+            return nullptr;
+        }
+        m_bTxAcquired = true;
+        if (pCapacity) {
+            *pCapacity = kFrameSize - TxDataOffset();
+        }
+        return reinterpret_cast<uint8_t*>(pHeader) + TxDataOffset();
+    }
+
+    void CommitTx(size_t length) override {
+        if (!m_bTxAcquired) {
+            return;
+        }
+        tpacket2_hdr* pHeader = TxSlot(m_txIndex);
+        uint8_t* pFrame = reinterpret_cast<uint8_t*>(pHeader) + TxDataOffset();
+        if (length < ECAT_MIN_ETH_FRAME) {
+            memset(pFrame + length, 0, ECAT_MIN_ETH_FRAME - length);
+            length = ECAT_MIN_ETH_FRAME;
+        }
+        pHeader->tp_len = static_cast<uint32_t>(length);
+        StoreStatus(pHeader, TP_STATUS_SEND_REQUEST);
+        m_txIndex = (m_txIndex + 1) % m_frames;
+        m_bTxAcquired = false;
+        m_stats.txFrames++;
+    }
+
+    bool Kick() override {
+        m_stats.kicks++;
+        if (send(m_fd, nullptr, 0, MSG_DONTWAIT) < 0 && errno != EAGAIN && errno != ENOBUFS) {
+            LogError(m_sendErrorLog) << "Error sending frames: " << strerror(errno);
+            return false;
+        }
+        return true;
+    }
+
+    const uint8_t* PollRx(size_t* pLength) override {
+        for (;;) {
+            tpacket2_hdr* pHeader = RxSlot(m_rxIndex);
+            if (!(LoadStatus(pHeader) & TP_STATUS_USER)) {
+                return nullptr;
+            }
+
+            // Kernels without PACKET_IGNORE_OUTGOING still hand us our own frames
+            const sockaddr_ll* pAddr = reinterpret_cast<const sockaddr_ll*>(
+                reinterpret_cast<const uint8_t*>(pHeader) + TPACKET_ALIGN(sizeof(tpacket2_hdr)));
+            if (pAddr->sll_pkttype == PACKET_OUTGOING) {
+                StoreStatus(pHeader, TP_STATUS_KERNEL);
+                m_rxIndex = (m_rxIndex + 1) % m_frames;
+                continue;
+            }
+
+            if (pLength) {
+                *pLength = pHeader->tp_snaplen;
+            }
+            return reinterpret_cast<const uint8_t*>(pHeader) + pHeader->tp_mac;
+        }
+    }
+
+    void ReleaseRx() override {
+        StoreStatus(RxSlot(m_rxIndex), TP_STATUS_KERNEL);
+        m_rxIndex = (m_rxIndex + 1) % m_frames;
+        m_stats.rxFrames++;
+    }
+
+    bool WaitRx(long timeoutUs) override {
+        if (LoadStatus(RxSlot(m_rxIndex)) & TP_STATUS_USER) {
+            return true;
+        }
+        pollfd pfd = { m_fd, POLLIN, 0 };
+        timespec timeout = { timeoutUs / 1000000, (timeoutUs % 1000000) * 1000 };
+        ppoll(&pfd, 1, timeoutUs < 0 ? nullptr : &timeout, nullptr);
+        return (LoadStatus(RxSlot(m_rxIndex)) & TP_STATUS_USER) != 0;
+    }
+
+    const uint8_t* GetMacAddress() const override {
+        return m_mac;
+    }
+
+    const Stats& GetStats() const {
+        return m_stats;
+    }
+};
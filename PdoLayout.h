@@ -0,0 +1,248 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <type_traits>
+#include <vector>
+#include "EtherCATConfig.h"
+#include "Logger.h"
+
+// Typed process data at places fixed at compile time. ecat_pdo turns the
+// <Slaves> of a configuration (with their <TxPdo>/<RxPdo> entries, or an
+// ENI's PDOs) into a header of PdoSignal constants and packed structs, so
+//
+//   bool bLimit = image.GetInput(Cell::Drive_X::Limit_Switch);
+//   image.SetOutput(Cell::Drive_X::Target_Velocity, int32_t(1200));
+//
+// compile to one load or store at a constant offset (and a mask for
+// signals that do not fill whole bytes). The header also carries a hash of
+// the layout it was generated from; PdoLayout::Check() compares it with
+// the configuration actually loaded, so a stale header is found at
+// startup instead of by reading the wrong bytes.
+//
+// Slaves occupy the input and output areas in line order from the start
+// addresses of <ProcessData>; the entries of a slave's assigned PDOs
+// follow each other bit by bit in its part, entries with index 0 being
+// padding.
+
+// A signal ByteOffset bytes and BitOffset bits into the input (Input) or
+// output area, Bits wide. Whole-type signals on a byte boundary are copied
+// as they are; anything else is masked out of the bytes it touches.
+template <typename T, uint32_t ByteOffset, uint8_t BitOffset, uint8_t Bits, bool Input>
+struct PdoSignal {
+    typedef T Type;
+
+    static constexpr bool kInput = Input;
+    static constexpr uint32_t kByteOffset = ByteOffset;
+    static constexpr uint8_t kBitOffset = BitOffset;
+    static constexpr uint8_t kBits = Bits;
+    static constexpr bool kWhole = BitOffset == 0 && Bits == sizeof(T) * 8;
+    static constexpr size_t kBytes = (BitOffset + Bits + 7) / 8;
+    static constexpr uint64_t kMask = (Bits >= 64 ? ~0ULL : (1ULL << Bits) - 1) << BitOffset;
+
+    static_assert(BitOffset < 8 && Bits > 0 && BitOffset + Bits <= 64, "PdoSignal must fit 8 bytes");
+    static_assert(kWhole || std::is_integral<T>::value, "Only integer signals may be bit fields");
+
+    static T Read(const uint8_t* pArea) {
+        T value;
+        if constexpr (kWhole) {
+            memcpy(&value, pArea + ByteOffset, sizeof(T));
+        } else {
+            uint64_t raw = 0;
+            memcpy(&raw, pArea + ByteOffset, kBytes);
+            value = static_cast<T>((raw & kMask) >> BitOffset);
+        }
+        return value;
+    }
+
+    static void Write(uint8_t* pArea, T value) {
+        if constexpr (kWhole) {
+            memcpy(pArea + ByteOffset, &value, sizeof(T));
+        } else {
+            uint64_t raw = 0;
+            memcpy(&raw, pArea + ByteOffset, kBytes);
+            raw = (raw & ~kMask) | ((static_cast<uint64_t>(value) << BitOffset) & kMask);
+            memcpy(pArea + ByteOffset, &raw, kBytes);
+        }
+    }
+};
+
+// Byte N of a slave's Size bytes at Offset, for slaves without PDO entries
+template <uint32_t Offset, uint32_t Size, uint32_t N, bool Input>
+struct PdoByte : PdoSignal<uint8_t, Offset + N, 0, 8, Input> {
+    static_assert(N < Size, "PdoByte beyond the slave's process data");
+};
+
+class PdoLayout {
+public:
+    // One PDO entry placed in the image
+    struct Signal {
+        uint16_t slave;              // index into EtherCATConfig::slaves
+        bool bInput;
+        uint32_t bitOffset;          // from the start of the input or output area
+        uint8_t bits;
+        uint16_t index;
+        uint8_t subIndex;
+        std::string name;
+        std::string dataType;
+        const char* type;            // C++ type of the accessor
+    };
+
+    // A slave's part of the areas
+    struct Slave {
+        uint32_t inputOffset;
+        uint32_t outputOffset;
+    };
+
+private:
+    std::vector<Slave> m_slaves;
+    std::vector<Signal> m_signals;
+    uint64_t m_hash;
+
+    static void HashIn(uint64_t& hash, uint64_t value) {
+        for (int i = 0; i < 8; i++) {
+            hash = (hash ^ ((value >> (i * 8)) & 0xFF)) * 0x100000001B3ULL;   // FNV-1a
+        }
+    }
+
+    // Whole-byte types keep their ETG.1020 meaning only when they are as
+    // wide as declared; everything else is the smallest unsigned type. A
+    // REAL or LREAL off a byte boundary cannot be a masked bit field, so it
+    // is read as its raw bits (memcpy them into a float to use it).
+    static const char* TypeOf(const std::string& dataType, uint8_t bits, uint32_t bitOffset) {
+        static const struct {
+            const char* name;
+            uint8_t bits;
+            const char* type;
+        } kTypes[] = {
+            { "BOOL", 1, "bool" }, { "BIT", 1, "bool" }, { "SINT", 8, "int8_t" }, { "USINT", 8, "uint8_t" },
+            { "BYTE", 8, "uint8_t" }, { "INT", 16, "int16_t" }, { "UINT", 16, "uint16_t" },
+            { "WORD", 16, "uint16_t" }, { "DINT", 32, "int32_t" }, { "UDINT", 32, "uint32_t" },
+            { "DWORD", 32, "uint32_t" }, { "REAL", 32, "float" }, { "LINT", 64, "int64_t" },
+            { "ULINT", 64, "uint64_t" }, { "LWORD", 64, "uint64_t" }, { "LREAL", 64, "double" }
+        };
+        for (const auto& known : kTypes) {
+            if (dataType == known.name && bits == known.bits) {
+                bool bFloat = strcmp(known.type, "float") == 0 || strcmp(known.type, "double") == 0;
+                return !bFloat || bitOffset % 8 == 0 ? known.type : bits == 32 ? "uint32_t" : "uint64_t";
+            }
+        }
+        return bits == 1 ? "bool" : bits <= 8 ? "uint8_t" : bits <= 16 ? "uint16_t" : bits <= 32 ? "uint32_t"
+                                                                                                : "uint64_t";
+    }
+
+public:
+    PdoLayout() : m_hash(0) {}
+
+    // Places every slave and PDO entry of the configuration; false if a
+    // slave's entries or the slaves together do not fit their areas
+    bool Build(const EtherCATConfig& config) {
+        m_slaves.assign(config.slaves.size(), Slave{ 0, 0 });
+        m_signals.clear();
+        uint32_t inputs = 0;
+        uint32_t outputs = 0;
+        for (size_t i = 0; i < config.slaves.size(); i++) {
+            m_slaves[i].inputOffset = inputs;
+            m_slaves[i].outputOffset = outputs;
+            inputs += config.slaves[i].inputSize;
+            outputs += config.slaves[i].outputSize;
+        }
+        if (inputs > config.inputSize || outputs > config.outputSize) {
+            LogError() << "Error: The slaves' process data (" << inputs << "/" << outputs
+                       << " input/output bytes) exceeds <ProcessData> (" << config.inputSize << "/"
+                       << config.outputSize << ")";
+            return false;
+        }
+
+        std::vector<uint32_t> inputBits(config.slaves.size(), 0);
+        std::vector<uint32_t> outputBits(config.slaves.size(), 0);
+        for (const EtherCATPdoConfig& pdo : config.pdos) {
+            if (pdo.slave >= config.slaves.size() || pdo.syncManager < 0) {
+                continue;     // not assigned: not in the image
+            }
+            uint32_t& used = pdo.bInput ? inputBits[pdo.slave] : outputBits[pdo.slave];
+            uint32_t start = (pdo.bInput ? m_slaves[pdo.slave].inputOffset : m_slaves[pdo.slave].outputOffset) * 8;
+            uint32_t end = std::min<uint32_t>(pdo.firstEntry + pdo.entryCount,
+                                              static_cast<uint32_t>(config.pdoEntries.size()));
+            for (uint32_t e = pdo.firstEntry; e < end; e++) {
+                const EtherCATPdoEntryConfig& entry = config.pdoEntries[e];
+                if (entry.index != 0 && entry.bitLength > 0) {
+                    uint32_t bit = start + used;
+                    if (entry.bitLength > 64 || (bit % 8) + entry.bitLength > 64) {
+                        LogError() << "Error: PDO entry '" << entry.name << "' of slave " << pdo.slave
+                                   << (entry.bitLength > 64 ? " is wider than 64 bits"
+                                                            : " spans more than 8 bytes from its bit offset");
+                        return false;
+                    }
+                    m_signals.push_back(Signal{ pdo.slave, pdo.bInput, bit, entry.bitLength, entry.index,
+                                                entry.subIndex, entry.name, entry.dataType,
+                                                TypeOf(entry.dataType, entry.bitLength, bit) });
+                }
+                used += entry.bitLength;
+            }
+        }
+        for (size_t i = 0; i < config.slaves.size(); i++) {
+            if (inputBits[i] > config.slaves[i].inputSize * 8u || outputBits[i] > config.slaves[i].outputSize * 8u) {
+                LogError() << "Error: The PDO entries of slave " << i << " '" << config.slaves[i].name << "' ("
+                           << inputBits[i] << "/" << outputBits[i] << " input/output bits) exceed its "
+                           << config.slaves[i].inputSize << "/" << config.slaves[i].outputSize << " bytes";
+                return false;
+            }
+        }
+
+        // Everything that moves a byte, names aside
+        m_hash = 0xCBF29CE484222325ULL;
+        HashIn(m_hash, config.inputAddress);
+        HashIn(m_hash, config.inputSize);
+        HashIn(m_hash, config.outputAddress);
+        HashIn(m_hash, config.outputSize);
+        for (const EtherCATSlaveConfig& slave : config.slaves) {
+            HashIn(m_hash, slave.vendorId);
+            HashIn(m_hash, slave.productCode);
+            HashIn(m_hash, slave.inputSize);
+            HashIn(m_hash, slave.outputSize);
+        }
+        for (const Signal& signal : m_signals) {
+            HashIn(m_hash, signal.slave);
+            HashIn(m_hash, signal.bInput);
+            HashIn(m_hash, signal.bitOffset);
+            HashIn(m_hash, signal.bits);
+            for (const char* p = signal.type; *p; p++) {
+                HashIn(m_hash, static_cast<uint8_t>(*p));
+            }
+        }
+        return true;
+    }
+
+    const std::vector<Slave>& GetSlaves() const {
+        return m_slaves;
+    }
+
+    const std::vector<Signal>& GetSignals() const {
+        return m_signals;
+    }
+
+    uint64_t GetHash() const {
+        return m_hash;
+    }
+
+    // At startup: true if the configuration has the layout a generated
+    // header was made from (its kLayoutHash)
+    static bool Check(const EtherCATConfig& config, uint64_t generatedHash, const char* header) {
+        PdoLayout layout;
+        if (!layout.Build(config)) {
+            return false;
+        }
+        if (layout.GetHash() != generatedHash) {
+            LogWarning() << "Warning: The process data layout (hash 0x" << std::hex << layout.GetHash()
+                         << ") is not the one " << header << " was generated from (0x" << generatedHash
+                         << std::dec << "); regenerate it with ecat_pdo before using its accessors";
+            return false;
+        }
+        LogInfo() << "Process data layout matches " << header << " (" << layout.GetSignals().size()
+                  << " PDO entries, hash 0x" << std::hex << generatedHash << std::dec << ")";
+        return true;
+    }
+};
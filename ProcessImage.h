@@ -0,0 +1,341 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <vector>
+#include "EtherCATDatagramPacker.h"
+#include "Logger.h"
+#include "TripleBuffer.h"
+
+// Location of a typed value in the input or output area, resolved once by
+// ProcessImage::MapInput()/MapOutput()
+template <typename T>
+struct ProcessVariable {
+    size_t offset;
+};
+
+struct ProcessBit {
+    size_t offset;
+    uint8_t mask;
+};
+
+// Input and output process data at their FMMU logical addresses, exchanged
+// with the segment by one LRW datagram per cycle. The cycle thread and one
+// application thread each work on their own triple-buffered copy, so the
+// application always sees a consistent input snapshot and publishes
+// outputs atomically without either side taking a lock. A span that does
+// not fit one frame goes out as several LRWs, all in flight together.
+//
+//   cycle thread:        id = image.QueueExchange(packer); ... send/receive ...
+//                        image.CompleteExchange(packer, id);
+//   application thread:  image.UpdateInputs(); image.GetInput(var);
+//                        image.SetOutput(var, value); image.PublishOutputs();
+//
+// var is a mapped ProcessVariable or a generated PdoSignal constant.
+class ProcessImage {
+public:
+    static const size_t kMaxLrwData = ECAT_MAX_PAYLOAD - ECAT_DATAGRAM_HEADER_SIZE - ECAT_WKC_SIZE;
+
+private:
+    struct Chunk {
+        size_t offset;              // in the span
+        size_t length;
+    };
+
+    uint32_t m_inputAddress;
+    uint32_t m_outputAddress;
+    uint32_t m_spanAddress;         // start of the LRW, lowest of the two areas
+    size_t m_inputSize;
+    size_t m_outputSize;
+    uint16_t m_expectedWkc;
+
+    TripleBuffer m_inputs;          // cycle thread -> application
+    TripleBuffer m_outputs;         // application -> cycle thread
+    RtVector<uint8_t> m_outputShadow;      // application-side working copy
+    RtVector<uint8_t> m_lrw;               // LRW data for the cycle thread
+    std::vector<Chunk> m_chunks;           // one LRW each
+    std::vector<uint32_t> m_boundaries;    // logical addresses an LRW may end at
+    RtArena* m_pArena;                     // where Configure() puts the images, null = heap
+
+    std::atomic<uint16_t> m_lastWkc;
+    std::atomic<unsigned long> m_exchanges;
+    std::atomic<unsigned long> m_wkcErrors;
+
+    static bool Contains(uint32_t start, size_t size, uint32_t address, size_t length) {
+        return address >= start && static_cast<uint64_t>(address) + length <= static_cast<uint64_t>(start) + size;
+    }
+
+    // Full LRWs, each ending at the last boundary that still fits
+    void Split() {
+        m_chunks.clear();
+        size_t offset = 0;
+        while (offset < m_lrw.size()) {
+            size_t length = m_lrw.size() - offset;
+            if (length > kMaxLrwData) {
+                length = kMaxLrwData;
+                uint64_t start = static_cast<uint64_t>(m_spanAddress) + offset;
+                auto it = std::upper_bound(m_boundaries.begin(), m_boundaries.end(), start + length);
+                if (it != m_boundaries.begin() && *(it - 1) > start) {
+                    length = static_cast<size_t>(*(it - 1) - start);
+                }
+            }
+            m_chunks.push_back(Chunk{ offset, length });
+            offset += length;
+        }
+    }
+
+public:
+    ProcessImage()
+        : m_inputAddress(0), m_outputAddress(0), m_spanAddress(0), m_inputSize(0), m_outputSize(0),
+          m_expectedWkc(0), m_pArena(nullptr), m_lastWkc(0), m_exchanges(0), m_wkcErrors(0) {}
+
+    // Before Configure(): take the image buffers from an arena
+    void SetArena(RtArena* pArena) {
+        m_pArena = pArena;
+    }
+
+    // expectedWkc: 1 per slave reading inputs plus 2 per slave writing outputs
+    bool Configure(uint32_t inputAddress, size_t inputSize, uint32_t outputAddress, size_t outputSize,
+                   uint16_t expectedWkc) {
+        bool bOverlap = inputSize && outputSize &&
+                        inputAddress < outputAddress + outputSize && outputAddress < inputAddress + inputSize;
+        if (bOverlap) {
+            LogError() << "Error: Input and output process data overlap";
+            return false;
+        }
+
+        uint32_t start = (inputSize && (!outputSize || inputAddress < outputAddress)) ? inputAddress : outputAddress;
+        uint64_t end = std::max<uint64_t>(inputSize ? inputAddress + inputSize : 0,
+                                          outputSize ? outputAddress + outputSize : 0);
+        size_t span = static_cast<size_t>(end - start);
+        if (span > kMaxLrwData * (EtherCATDatagramPacker::kMaxFramesInFlight / 2)) {
+            LogError() << "Error: Process data span of " << span << " bytes needs more than "
+                       << EtherCATDatagramPacker::kMaxFramesInFlight / 2 << " frames";
+            return false;
+        }
+
+        m_inputAddress = inputAddress;
+        m_outputAddress = outputAddress;
+        m_spanAddress = start;
+        m_inputSize = inputSize;
+        m_outputSize = outputSize;
+        m_expectedWkc = expectedWkc;
+        m_inputs.Resize(inputSize, m_pArena);
+        m_outputs.Resize(outputSize, m_pArena);
+        m_outputShadow = RtVector<uint8_t>(RtAllocator<uint8_t>(m_pArena));
+        m_outputShadow.assign(outputSize, 0);
+        m_lrw = RtVector<uint8_t>(RtAllocator<uint8_t>(m_pArena));
+        m_lrw.assign(span, 0);
+        m_boundaries.clear();
+        Split();
+        return true;
+    }
+
+    // After Configure(): logical addresses where one slave's data ends and
+    // the next one's starts, so a span over several frames is split there.
+    // A slave whose data is split counts in the working counter of both
+    // LRWs, so without boundaries ExpectedWKC may have to count it twice.
+    void SetFrameBoundaries(std::vector<uint32_t> addresses) {
+        std::sort(addresses.begin(), addresses.end());
+        m_boundaries.swap(addresses);
+        Split();
+    }
+
+    template <typename T>
+    bool MapInput(uint32_t logicalAddress, ProcessVariable<T>& variable) const {
+        if (!Contains(m_inputAddress, m_inputSize, logicalAddress, sizeof(T))) {
+            LogError() << "Error: Input 0x" << std::hex << logicalAddress << std::dec
+                       << " is outside the input process data";
+            return false;
+        }
+        variable.offset = logicalAddress - m_inputAddress;
+        return true;
+    }
+
+    template <typename T>
+    bool MapOutput(uint32_t logicalAddress, ProcessVariable<T>& variable) const {
+        if (!Contains(m_outputAddress, m_outputSize, logicalAddress, sizeof(T))) {
+            LogError() << "Error: Output 0x" << std::hex << logicalAddress << std::dec
+                       << " is outside the output process data";
+            return false;
+        }
+        variable.offset = logicalAddress - m_outputAddress;
+        return true;
+    }
+
+    bool MapInputBit(uint32_t logicalAddress, unsigned bit, ProcessBit& variable) const {
+        ProcessVariable<uint8_t> byte;
+        if (bit > 7 || !MapInput(logicalAddress, byte)) {
+            return false;
+        }
+        variable.offset = byte.offset;
+        variable.mask = static_cast<uint8_t>(1u << bit);
+        return true;
+    }
+
+    bool MapOutputBit(uint32_t logicalAddress, unsigned bit, ProcessBit& variable) const {
+        ProcessVariable<uint8_t> byte;
+        if (bit > 7 || !MapOutput(logicalAddress, byte)) {
+            return false;
+        }
+        variable.offset = byte.offset;
+        variable.mask = static_cast<uint8_t>(1u << bit);
+        return true;
+    }
+
+    // --- Cycle thread ---
+
+    // Queues the LRWs carrying the newest published outputs; returns the
+    // id of the first, the others follow it
+    size_t QueueExchange(EtherCATDatagramPacker& packer) {
+        m_outputs.Update();
+        if (m_outputSize) {
+            memcpy(m_lrw.data() + (m_outputAddress - m_spanAddress), m_outputs.Front(), m_outputSize);
+        }
+        size_t id = 0;
+        for (size_t i = 0; i < m_chunks.size(); i++) {
+            uint8_t* pData = m_lrw.data() + m_chunks[i].offset;
+            size_t added = packer.Add(ECAT_LRW, m_spanAddress + static_cast<uint32_t>(m_chunks[i].offset),
+                                      static_cast<uint16_t>(m_chunks[i].length), pData, pData);
+            id = i ? id : added;
+        }
+        return id;
+    }
+
+    // Replaces the outputs of the LRW queued by QueueExchange() before it
+    // is sent, e.g. with those of a SharedProcessImage output writer
+    void SetExchangeOutputs(const uint8_t* pOutputs) {
+        if (m_outputSize) {
+            memcpy(m_lrw.data() + (m_outputAddress - m_spanAddress), pOutputs, m_outputSize);
+        }
+    }
+
+    // Publishes the returned inputs. Inputs are only published when the
+    // working counter, summed over the LRWs, shows every slave took part;
+    // returns false otherwise.
+    bool CompleteExchange(const EtherCATDatagramPacker& packer, size_t id) {
+        uint16_t wkc = 0;
+        for (size_t i = 0; i < m_chunks.size(); i++) {
+            wkc = static_cast<uint16_t>(wkc + (packer.IsReceived(id + i) ? packer.GetWkc(id + i) : 0));
+        }
+        m_lastWkc.store(wkc, std::memory_order_relaxed);
+        m_exchanges.fetch_add(1, std::memory_order_relaxed);
+        if (wkc != m_expectedWkc) {
+            m_wkcErrors.fetch_add(1, std::memory_order_relaxed);
+            return false;
+        }
+        if (m_inputSize) {
+            memcpy(m_inputs.Back(), m_lrw.data() + (m_inputAddress - m_spanAddress), m_inputSize);
+            m_inputs.Publish();
+        }
+        return true;
+    }
+
+    // LRW data of the last exchange: outputs as sent, inputs as returned
+    // (stale if the frame was lost). Valid until the next QueueExchange().
+    const uint8_t* GetExchangeData() const {
+        return m_lrw.data();
+    }
+
+    // --- Application thread ---
+
+    // Switches to the newest input snapshot; true if it changed
+    bool UpdateInputs() {
+        return m_inputs.Update();
+    }
+
+    // The current input snapshot as a whole, e.g. for a ChangeDetector
+    const uint8_t* GetInputData() const {
+        return m_inputs.Front();
+    }
+
+    size_t GetInputSize() const {
+        return m_inputSize;
+    }
+
+    template <typename T>
+    T GetInput(const ProcessVariable<T>& variable) const {
+        T value;
+        memcpy(&value, m_inputs.Front() + variable.offset, sizeof(T));
+        return value;
+    }
+
+    bool GetInputBit(const ProcessBit& variable) const {
+        return (m_inputs.Front()[variable.offset] & variable.mask) != 0;
+    }
+
+    template <typename T>
+    void SetOutput(const ProcessVariable<T>& variable, T value) {
+        memcpy(m_outputShadow.data() + variable.offset, &value, sizeof(T));
+    }
+
+    void SetOutputBit(const ProcessBit& variable, bool value) {
+        uint8_t& byte = m_outputShadow[variable.offset];
+        byte = value ? static_cast<uint8_t>(byte | variable.mask) : static_cast<uint8_t>(byte & ~variable.mask);
+    }
+
+    // Generated signals (PdoLayout.h, ecat_pdo): offset and mask are
+    // compile-time constants, valid once the header's Check() passed
+    template <typename Signal>
+    typename Signal::Type GetInput(const Signal&) const {
+        static_assert(Signal::kInput, "Not an input signal");
+        return Signal::Read(m_inputs.Front());
+    }
+
+    template <typename Signal>
+    void SetOutput(const Signal&, typename Signal::Type value) {
+        static_assert(!Signal::kInput, "Not an output signal");
+        Signal::Write(m_outputShadow.data(), value);
+    }
+
+    // Replaces all outputs at once, e.g. with a slice of a merged image
+    void SetOutputData(const uint8_t* pOutputs) {
+        if (m_outputSize) {
+            memcpy(m_outputShadow.data(), pOutputs, m_outputSize);
+        }
+    }
+
+    size_t GetOutputSize() const {
+        return m_outputSize;
+    }
+
+    // Makes all outputs set since the last call visible to the cycle thread
+    void PublishOutputs() {
+        if (m_outputSize) {
+            memcpy(m_outputs.Back(), m_outputShadow.data(), m_outputSize);
+            m_outputs.Publish();
+        }
+    }
+
+    // --- Diagnostics, any thread ---
+
+    uint16_t GetLastWkc() const {
+        return m_lastWkc.load(std::memory_order_relaxed);
+    }
+
+    uint16_t GetExpectedWkc() const {
+        return m_expectedWkc;
+    }
+
+    unsigned long GetExchangeCount() const {
+        return m_exchanges.load(std::memory_order_relaxed);
+    }
+
+    unsigned long GetWkcErrorCount() const {
+        return m_wkcErrors.load(std::memory_order_relaxed);
+    }
+
+    uint32_t GetLogicalAddress() const {
+        return m_spanAddress;
+    }
+
+    size_t GetLogicalSize() const {
+        return m_lrw.size();
+    }
+
+    // LRWs, and so frames at least, per exchange
+    size_t GetFrameCount() const {
+        return m_chunks.size();
+    }
+};
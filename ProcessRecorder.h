@@ -0,0 +1,710 @@
+#pragma once
+
+// Linux process data recorder: every cycle's LRW image (outputs as sent,
+// inputs as returned) goes into a ring of memory-mapped segment files, so
+// the last minutes of I/O survive for a post-mortem. The cycle thread only
+// copies the image into a preallocated slot ring; a background thread
+// XORs it against the previous cycle, run-length encodes the zero runs
+// that leaves, and appends the result to the current segment. Key records
+// (encoded against zeros) start every segment and recur every
+// keyInterval records; the segment's key index maps timestamps to them,
+// so ProcessRecordReader seeks without decoding from the start.
+//
+//   before the cycle:  recorder.Open(settings, layout);
+//   cycle thread:      recorder.Record(cycle, CycleTrace::NowNs(), wkc, pSpan);
+//   after the cycle:   recorder.Close();
+//
+// Segment file, little-endian:
+//   header   magic "ECRC", version, sequence (64-bit), span address and
+//            size, input address and size, output address and size, wall
+//            clock offset (64-bit, realtime - monotonic), used bytes,
+//            record count, key count, key interval, first and last
+//            timestamp (64-bit, monotonic)
+//   index    kIndexEntries x (timestamp (64-bit), offset, record number)
+//   records  length, flags, WKC, cycle (64-bit), timestamp (64-bit), then
+//            the encoded span: (zero run, literal length) varint pairs,
+//            each followed by its literal XOR bytes
+// The used bytes and record count are updated after each record, so a
+// segment cut short by a crash still reads up to its last whole record.
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <string>
+#include <thread>
+#include <vector>
+#include "EtherCATFrame.h"
+#include "Logger.h"
+
+class ProcessRecorder {
+public:
+    static const uint32_t kMagic = 0x43524345;     // "ECRC"
+    static const uint32_t kVersion = 1;
+    static const size_t kHeaderBytes = 128;
+    static const size_t kIndexEntries = 8192;
+    static const size_t kIndexEntryBytes = 16;
+    static const size_t kDataStart = kHeaderBytes + kIndexEntries * kIndexEntryBytes;
+    static const size_t kRecordHeaderBytes = 24;
+    static const uint16_t RECORD_KEY = 0x0001;
+
+    // Header field offsets
+    static const size_t kOffsetSequence = 8;
+    static const size_t kOffsetLayout = 16;        // six words, see Layout
+    static const size_t kOffsetWallClock = 40;
+    static const size_t kOffsetUsedBytes = 48;
+    static const size_t kOffsetRecordCount = 52;
+    static const size_t kOffsetKeyCount = 56;
+    static const size_t kOffsetKeyInterval = 60;
+    static const size_t kOffsetFirstTime = 64;
+    static const size_t kOffsetLastTime = 72;
+
+    struct Settings {
+        std::string directory;
+        size_t files;             // segments in the ring, rec_000.ecr ...
+        size_t fileBytes;         // size of each segment file
+        size_t queueSlots;        // cycles the writer may fall behind, power of two
+        uint32_t keyInterval;     // records between key records
+
+        Settings() : files(8), fileBytes(16 << 20), queueSlots(4096), keyInterval(1000) {}
+    };
+
+    // Where inputs and outputs lie in the recorded span
+    struct Layout {
+        uint32_t spanAddress;
+        uint32_t spanSize;
+        uint32_t inputAddress;
+        uint32_t inputSize;
+        uint32_t outputAddress;
+        uint32_t outputSize;
+    };
+
+    struct Stats {
+        unsigned long recorded;     // accepted by Record()
+        unsigned long dropped;      // slot ring full or writer failed
+        unsigned long written;
+        unsigned long segments;
+        uint64_t rawBytes;
+        uint64_t encodedBytes;      // record headers included
+    };
+
+private:
+    static const size_t kSlotHeaderBytes = 24;     // cycle, timestamp, WKC
+
+    Settings m_settings;
+    Layout m_layout;
+    int64_t m_wallOffsetNs;
+
+    // Slot ring between the cycle thread and the writer, same scheme as
+    // SpscQueue but with a runtime slot size
+    std::vector<uint8_t> m_slots;
+    size_t m_slotStride;
+    size_t m_slotMask;
+    alignas(64) std::atomic<size_t> m_head;     // next slot to write out
+    alignas(64) std::atomic<size_t> m_tail;     // next slot to fill
+    alignas(64) std::atomic<unsigned long> m_recorded;
+    std::atomic<unsigned long> m_dropped;
+
+    // Writer thread
+    std::thread m_thread;
+    std::atomic<bool> m_bStop;
+    bool m_bOpen;
+    bool m_bFailed;
+    uint64_t m_sequence;
+    uint8_t* m_pMap;
+    size_t m_used;
+    uint32_t m_records;
+    uint32_t m_keys;
+    uint32_t m_sinceKey;
+    std::vector<uint8_t> m_previous;
+    std::vector<uint8_t> m_encoded;
+    std::atomic<unsigned long> m_written;
+    std::atomic<unsigned long> m_segments;
+    std::atomic<uint64_t> m_rawBytes;
+    std::atomic<uint64_t> m_encodedBytes;
+
+    static size_t PutVarint(uint8_t* p, size_t value) {
+        size_t length = 0;
+        while (value >= 0x80) {
+            p[length++] = static_cast<uint8_t>(value | 0x80);
+            value >>= 7;
+        }
+        p[length++] = static_cast<uint8_t>(value);
+        return length;
+    }
+
+    std::string SegmentPath(uint64_t sequence) const {
+        char name[32];
+        snprintf(name, sizeof(name), "rec_%03u.ecr", static_cast<unsigned>(sequence % m_settings.files));
+        return (std::filesystem::path(m_settings.directory) / name).string();
+    }
+
+    // Highest sequence number among the segments already in the directory
+    uint64_t LastSequence() const {
+        uint64_t last = 0;
+        std::error_code error;
+        for (const auto& entry : std::filesystem::directory_iterator(m_settings.directory, error)) {
+            if (entry.path().extension() != ".ecr") {
+                continue;
+            }
+            std::ifstream file(entry.path(), std::ios::binary);
+            uint8_t header[16];
+            if (file.read(reinterpret_cast<char*>(header), sizeof(header)) && EcatGet32(header) == kMagic) {
+                last = std::max<uint64_t>(last, EcatGet64(header + kOffsetSequence));
+            }
+        }
+        return last;
+    }
+
+    void UnmapSegment() {
+        if (m_pMap) {
+            munmap(m_pMap, m_settings.fileBytes);
+            m_pMap = nullptr;
+        }
+    }
+
+    // Starts the next segment of the ring, overwriting its oldest file.
+    // The magic goes in last, after the header says the segment is empty.
+    bool NextSegment() {
+        UnmapSegment();
+        m_sequence++;
+        std::string path = SegmentPath(m_sequence);
+        int fd = open(path.c_str(), O_RDWR | O_CREAT, 0644);
+        if (fd < 0) {
+            LogError() << "Error: Cannot create recorder segment '" << path << "'";
+            return false;
+        }
+        bool bSized = ftruncate(fd, static_cast<off_t>(m_settings.fileBytes)) == 0;
+        void* pMap = bSized ? mmap(nullptr, m_settings.fileBytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0)
+                            : MAP_FAILED;
+        close(fd);
+        if (pMap == MAP_FAILED) {
+            LogError() << "Error: Cannot map recorder segment '" << path << "'";
+            return false;
+        }
+        m_pMap = static_cast<uint8_t*>(pMap);
+        memset(m_pMap, 0, kHeaderBytes);
+        EcatPut32(m_pMap + 4, kVersion);
+        EcatPut64(m_pMap + kOffsetSequence, m_sequence);
+        const uint32_t layout[6] = { m_layout.spanAddress, m_layout.spanSize, m_layout.inputAddress,
+                                     m_layout.inputSize, m_layout.outputAddress, m_layout.outputSize };
+        for (size_t i = 0; i < 6; i++) {
+            EcatPut32(m_pMap + kOffsetLayout + i * 4, layout[i]);
+        }
+        EcatPut64(m_pMap + kOffsetWallClock, static_cast<uint64_t>(m_wallOffsetNs));
+        EcatPut32(m_pMap + kOffsetUsedBytes, static_cast<uint32_t>(kDataStart));
+        EcatPut32(m_pMap + kOffsetKeyInterval, m_settings.keyInterval);
+        std::atomic_thread_fence(std::memory_order_release);
+        EcatPut32(m_pMap, kMagic);
+
+        m_used = kDataStart;
+        m_records = 0;
+        m_keys = 0;
+        m_segments.fetch_add(1, std::memory_order_relaxed);
+        return true;
+    }
+
+    // Writer thread: one slot into the current segment
+    void WriteSlot(const uint8_t* pSlot) {
+        if (m_bFailed) {
+            m_dropped.fetch_add(1, std::memory_order_relaxed);
+            return;
+        }
+        size_t span = m_layout.spanSize;
+        if (m_used + kRecordHeaderBytes + m_encoded.size() > m_settings.fileBytes && !NextSegment()) {
+            m_bFailed = true;
+            m_dropped.fetch_add(1, std::memory_order_relaxed);
+            return;
+        }
+        uint64_t cycle = EcatGet64(pSlot);
+        int64_t timestampNs = static_cast<int64_t>(EcatGet64(pSlot + 8));
+        const uint8_t* pImage = pSlot + kSlotHeaderBytes;
+
+        bool bKey = m_records == 0 || (m_sinceKey >= m_settings.keyInterval && m_keys < kIndexEntries);
+        size_t length = Encode(pImage, bKey ? nullptr : m_previous.data(), span, m_encoded.data());
+        uint8_t* pRecord = m_pMap + m_used;
+        EcatPut32(pRecord, static_cast<uint32_t>(length));
+        EcatPut16(pRecord + 4, bKey ? RECORD_KEY : 0);
+        EcatPut16(pRecord + 6, EcatGet16(pSlot + 16));
+        EcatPut64(pRecord + 8, cycle);
+        EcatPut64(pRecord + 16, static_cast<uint64_t>(timestampNs));
+        memcpy(pRecord + kRecordHeaderBytes, m_encoded.data(), length);
+        if (bKey) {
+            uint8_t* pEntry = m_pMap + kHeaderBytes + m_keys * kIndexEntryBytes;
+            EcatPut64(pEntry, static_cast<uint64_t>(timestampNs));
+            EcatPut32(pEntry + 8, static_cast<uint32_t>(m_used));
+            EcatPut32(pEntry + 12, m_records);
+            m_keys++;
+            m_sinceKey = 0;
+        }
+        m_sinceKey++;
+        m_used += kRecordHeaderBytes + length;
+        m_records++;
+        memcpy(m_previous.data(), pImage, span);
+
+        if (m_records == 1) {
+            EcatPut64(m_pMap + kOffsetFirstTime, static_cast<uint64_t>(timestampNs));
+        }
+        EcatPut64(m_pMap + kOffsetLastTime, static_cast<uint64_t>(timestampNs));
+        EcatPut32(m_pMap + kOffsetKeyCount, m_keys);
+        std::atomic_thread_fence(std::memory_order_release);
+        EcatPut32(m_pMap + kOffsetUsedBytes, static_cast<uint32_t>(m_used));
+        EcatPut32(m_pMap + kOffsetRecordCount, m_records);
+
+        m_written.fetch_add(1, std::memory_order_relaxed);
+        m_rawBytes.fetch_add(span, std::memory_order_relaxed);
+        m_encodedBytes.fetch_add(kRecordHeaderBytes + length, std::memory_order_relaxed);
+    }
+
+    void WriterLoop() {
+        while (true) {
+            bool bStopping = m_bStop.load(std::memory_order_acquire);
+            size_t head = m_head.load(std::memory_order_relaxed);
+            size_t tail = m_tail.load(std::memory_order_acquire);
+            if (head == tail) {
+                if (bStopping) {
+                    break;
+                }
+                std::this_thread::sleep_for(std::chrono::milliseconds(1));
+                continue;
+            }
+            for (; head != tail; head++) {
+                WriteSlot(&m_slots[(head & m_slotMask) * m_slotStride]);
+                m_head.store(head + 1, std::memory_order_release);
+            }
+        }
+    }
+
+public:
+    ProcessRecorder()
+        : m_layout(), m_wallOffsetNs(0), m_slotStride(0), m_slotMask(0), m_head(0), m_tail(0), m_recorded(0),
+          m_dropped(0), m_bStop(false), m_bOpen(false), m_bFailed(false), m_sequence(0), m_pMap(nullptr),
+          m_used(0), m_records(0), m_keys(0), m_sinceKey(0), m_written(0), m_segments(0), m_rawBytes(0),
+          m_encodedBytes(0) {}
+
+    ~ProcessRecorder() {
+        Close();
+    }
+
+    ProcessRecorder(const ProcessRecorder&) = delete;
+    ProcessRecorder& operator=(const ProcessRecorder&) = delete;
+
+    // XOR of the image against pPrevious (zeros for a key record), as
+    // (zero run, literal length, literal bytes) groups. A literal only
+    // ends at two equal bytes in a row, so the output is at most
+    // MaxEncodedSize(size) bytes.
+    static size_t Encode(const uint8_t* pImage, const uint8_t* pPrevious, size_t size, uint8_t* pOut) {
+        size_t out = 0;
+        size_t i = 0;
+        while (i < size) {
+            size_t start = i;
+            while (i < size && pImage[i] == (pPrevious ? pPrevious[i] : 0)) {
+                i++;
+            }
+            out += PutVarint(pOut + out, i - start);
+            size_t literal = i;
+            while (i < size) {
+                bool bSame = pImage[i] == (pPrevious ? pPrevious[i] : 0);
+                bool bNextSame = i + 1 >= size || pImage[i + 1] == (pPrevious ? pPrevious[i + 1] : 0);
+                if (bSame && bNextSame) {
+                    break;
+                }
+                i++;
+            }
+            out += PutVarint(pOut + out, i - literal);
+            for (size_t j = literal; j < i; j++) {
+                pOut[out++] = static_cast<uint8_t>(pImage[j] ^ (pPrevious ? pPrevious[j] : 0));
+            }
+        }
+        return out;
+    }
+
+    // Applies an encoded record to pImage in place (zeroed first for a
+    // key record). False if the data does not describe exactly size bytes.
+    static bool Decode(const uint8_t* pData, size_t length, uint8_t* pImage, size_t size) {
+        size_t in = 0;
+        size_t i = 0;
+        auto varint = [&](size_t& value) {
+            value = 0;
+            for (unsigned shift = 0; in < length && shift < 35; shift += 7) {
+                uint8_t byte = pData[in++];
+                value |= static_cast<size_t>(byte & 0x7F) << shift;
+                if (!(byte & 0x80)) {
+                    return true;
+                }
+            }
+            return false;
+        };
+        while (i < size) {
+            size_t zeros = 0;
+            size_t literal = 0;
+            if (!varint(zeros) || zeros > size - i) {
+                return false;
+            }
+            i += zeros;
+            if (!varint(literal) || literal > size - i || literal > length - in) {
+                return false;
+            }
+            for (size_t j = 0; j < literal; j++) {
+                pImage[i++] ^= pData[in++];
+            }
+        }
+        return in == length;
+    }
+
+    static size_t MaxEncodedSize(size_t size) {
+        return 3 * size + 16;
+    }
+
+    // Realtime minus monotonic clock, to turn record timestamps into wall time
+    static int64_t WallClockOffsetNs() {
+        timespec realtime;
+        timespec monotonic;
+        clock_gettime(CLOCK_REALTIME, &realtime);
+        clock_gettime(CLOCK_MONOTONIC, &monotonic);
+        return (static_cast<int64_t>(realtime.tv_sec) - monotonic.tv_sec) * 1000000000LL +
+               (realtime.tv_nsec - monotonic.tv_nsec);
+    }
+
+    // Creates the directory if needed, continues the ring after the newest
+    // segment already there and starts the writer. Call before the cycle
+    // thread starts: all memory is allocated here.
+    bool Open(const Settings& settings, const Layout& layout) {
+        Close();
+        size_t slots = 2;
+        while (slots < settings.queueSlots) {
+            slots <<= 1;
+        }
+        m_settings = settings;
+        m_settings.files = std::max<size_t>(settings.files, 2);
+        m_settings.keyInterval = std::max<uint32_t>(settings.keyInterval, 1);
+        m_layout = layout;
+        size_t worst = kRecordHeaderBytes + MaxEncodedSize(layout.spanSize);
+        if (m_settings.fileBytes < kDataStart + worst || m_settings.fileBytes > UINT32_MAX) {
+            LogError() << "Error: Recorder segments of " << m_settings.fileBytes << " bytes cannot hold a "
+                       << layout.spanSize << " byte image";
+            return false;
+        }
+        std::error_code error;
+        std::filesystem::create_directories(m_settings.directory, error);
+        if (error) {
+            LogError() << "Error: Cannot create recorder directory '" << m_settings.directory << "'";
+            return false;
+        }
+
+        m_slotStride = (kSlotHeaderBytes + layout.spanSize + 63) & ~static_cast<size_t>(63);
+        m_slotMask = slots - 1;
+        m_slots.assign(slots * m_slotStride, 0);
+        m_previous.assign(layout.spanSize, 0);
+        m_encoded.assign(MaxEncodedSize(layout.spanSize), 0);
+        m_head.store(0);
+        m_tail.store(0);
+        m_recorded.store(0);
+        m_dropped.store(0);
+        m_written.store(0);
+        m_segments.store(0);
+        m_rawBytes.store(0);
+        m_encodedBytes.store(0);
+        m_wallOffsetNs = WallClockOffsetNs();
+        m_sequence = LastSequence();
+        m_sinceKey = 0;
+        m_bFailed = false;
+        if (!NextSegment()) {
+            return false;
+        }
+        m_bStop.store(false);
+        m_thread = std::thread(&ProcessRecorder::WriterLoop, this);
+        m_bOpen = true;
+        LogInfo() << "Recording process data to '" << m_settings.directory << "' (" << m_settings.files
+                  << " x " << (m_settings.fileBytes >> 20) << " MB, segment " << m_sequence << ")";
+        return true;
+    }
+
+    // Cycle thread: copies the span into the next slot. Never blocks; a
+    // full ring drops the cycle and counts it.
+    bool Record(uint64_t cycle, int64_t timestampNs, uint16_t wkc, const uint8_t* pSpan) {
+        if (!m_bOpen) {
+            return false;
+        }
+        size_t tail = m_tail.load(std::memory_order_relaxed);
+        if (tail - m_head.load(std::memory_order_acquire) > m_slotMask) {
+            m_dropped.fetch_add(1, std::memory_order_relaxed);
+            return false;
+        }
+        uint8_t* pSlot = &m_slots[(tail & m_slotMask) * m_slotStride];
+        EcatPut64(pSlot, cycle);
+        EcatPut64(pSlot + 8, static_cast<uint64_t>(timestampNs));
+        EcatPut16(pSlot + 16, wkc);
+        memcpy(pSlot + kSlotHeaderBytes, pSpan, m_layout.spanSize);
+        m_tail.store(tail + 1, std::memory_order_release);
+        m_recorded.fetch_add(1, std::memory_order_relaxed);
+        return true;
+    }
+
+    // Writes out what is still queued, then stops the writer
+    void Close() {
+        if (!m_bOpen) {
+            return;
+        }
+        m_bStop.store(true, std::memory_order_release);
+        m_thread.join();
+        UnmapSegment();
+        m_bOpen = false;
+    }
+
+    bool IsOpen() const {
+        return m_bOpen;
+    }
+
+    Stats GetStats() const {
+        Stats stats;
+        stats.recorded = m_recorded.load(std::memory_order_relaxed);
+        stats.dropped = m_dropped.load(std::memory_order_relaxed);
+        stats.written = m_written.load(std::memory_order_relaxed);
+        stats.segments = m_segments.load(std::memory_order_relaxed);
+        stats.rawBytes = m_rawBytes.load(std::memory_order_relaxed);
+        stats.encodedBytes = m_encodedBytes.load(std::memory_order_relaxed);
+        return stats;
+    }
+};
+
+// Reads a recorder directory: segments are taken in sequence order as they
+// were at Open(), records come back decoded in full. Times are wall clock
+// nanoseconds since the epoch.
+//
+//   reader.Open(directory); reader.Seek(timeNs);
+//   while (reader.Next(record)) { ... record.pSpan ... }
+class ProcessRecordReader {
+public:
+    struct SegmentInfo {
+        std::string path;
+        uint64_t sequence;
+        ProcessRecorder::Layout layout;
+        uint32_t records;
+        uint32_t keys;
+        uint32_t usedBytes;
+        int64_t firstNs;
+        int64_t lastNs;
+    };
+
+    struct Record {
+        uint64_t cycle;
+        int64_t timeNs;
+        uint16_t wkc;
+        bool bKey;
+        const ProcessRecorder::Layout* pLayout;
+        const uint8_t* pSpan;       // valid until the next call
+    };
+
+private:
+    struct Segment {
+        SegmentInfo info;
+        const uint8_t* pData;
+        size_t bytes;
+        int64_t wallOffsetNs;
+    };
+
+    std::vector<Segment> m_segments;
+    std::vector<uint8_t> m_image;
+    size_t m_segment;
+    size_t m_offset;
+    uint32_t m_record;
+
+    bool MapSegment(const std::string& path, Segment& segment) {
+        int fd = open(path.c_str(), O_RDONLY);
+        if (fd < 0) {
+            return false;
+        }
+        struct stat info;
+        void* pMap = MAP_FAILED;
+        if (fstat(fd, &info) == 0 && static_cast<size_t>(info.st_size) >= ProcessRecorder::kDataStart) {
+            pMap = mmap(nullptr, static_cast<size_t>(info.st_size), PROT_READ, MAP_SHARED, fd, 0);
+        }
+        close(fd);
+        if (pMap == MAP_FAILED) {
+            return false;
+        }
+        const uint8_t* p = static_cast<const uint8_t*>(pMap);
+        segment.pData = p;
+        segment.bytes = static_cast<size_t>(info.st_size);
+        SegmentInfo& header = segment.info;
+        header.path = path;
+        header.sequence = EcatGet64(p + ProcessRecorder::kOffsetSequence);
+        const uint8_t* pLayout = p + ProcessRecorder::kOffsetLayout;
+        header.layout.spanAddress = EcatGet32(pLayout);
+        header.layout.spanSize = EcatGet32(pLayout + 4);
+        header.layout.inputAddress = EcatGet32(pLayout + 8);
+        header.layout.inputSize = EcatGet32(pLayout + 12);
+        header.layout.outputAddress = EcatGet32(pLayout + 16);
+        header.layout.outputSize = EcatGet32(pLayout + 20);
+        segment.wallOffsetNs = static_cast<int64_t>(EcatGet64(p + ProcessRecorder::kOffsetWallClock));
+        header.usedBytes = EcatGet32(p + ProcessRecorder::kOffsetUsedBytes);
+        header.records = EcatGet32(p + ProcessRecorder::kOffsetRecordCount);
+        header.keys = std::min<uint32_t>(EcatGet32(p + ProcessRecorder::kOffsetKeyCount),
+                                         static_cast<uint32_t>(ProcessRecorder::kIndexEntries));
+        header.firstNs = static_cast<int64_t>(EcatGet64(p + ProcessRecorder::kOffsetFirstTime)) + segment.wallOffsetNs;
+        header.lastNs = static_cast<int64_t>(EcatGet64(p + ProcessRecorder::kOffsetLastTime)) + segment.wallOffsetNs;
+        bool bValid = EcatGet32(p) == ProcessRecorder::kMagic && EcatGet32(p + 4) == ProcessRecorder::kVersion &&
+                      header.records > 0 && header.usedBytes <= segment.bytes && header.keys > 0;
+        if (!bValid) {
+            munmap(pMap, segment.bytes);
+        }
+        return bValid;
+    }
+
+    void StartSegment(size_t index) {
+        m_segment = index;
+        m_offset = ProcessRecorder::kDataStart;
+        m_record = 0;
+        if (index < m_segments.size()) {
+            m_image.assign(m_segments[index].info.layout.spanSize, 0);
+        }
+    }
+
+    const uint8_t* KeyEntry(const Segment& segment, uint32_t key) const {
+        return segment.pData + ProcessRecorder::kHeaderBytes + key * ProcessRecorder::kIndexEntryBytes;
+    }
+
+public:
+    ProcessRecordReader() : m_segment(0), m_offset(0), m_record(0) {}
+
+    ~ProcessRecordReader() {
+        Close();
+    }
+
+    ProcessRecordReader(const ProcessRecordReader&) = delete;
+    ProcessRecordReader& operator=(const ProcessRecordReader&) = delete;
+
+    bool Open(const std::string& directory) {
+        Close();
+        std::error_code error;
+        for (const auto& entry : std::filesystem::directory_iterator(directory, error)) {
+            Segment segment;
+            if (entry.path().extension() == ".ecr" && MapSegment(entry.path().string(), segment)) {
+                m_segments.push_back(segment);
+            }
+        }
+        if (m_segments.empty()) {
+            LogError() << "Error: No recorded process data in '" << directory << "'";
+            return false;
+        }
+        std::sort(m_segments.begin(), m_segments.end(), [](const Segment& a, const Segment& b) {
+            return a.info.sequence < b.info.sequence;
+        });
+        StartSegment(0);
+        return true;
+    }
+
+    void Close() {
+        for (const Segment& segment : m_segments) {
+            munmap(const_cast<uint8_t*>(segment.pData), segment.bytes);
+        }
+        m_segments.clear();
+        StartSegment(0);
+    }
+
+    size_t GetSegmentCount() const {
+        return m_segments.size();
+    }
+
+    const SegmentInfo& GetSegment(size_t index) const {
+        return m_segments[index].info;
+    }
+
+    int64_t GetFirstNs() const {
+        return m_segments.empty() ? 0 : m_segments.front().info.firstNs;
+    }
+
+    int64_t GetLastNs() const {
+        return m_segments.empty() ? 0 : m_segments.back().info.lastNs;
+    }
+
+    uint64_t GetRecordCount() const {
+        uint64_t count = 0;
+        for (const Segment& segment : m_segments) {
+            count += segment.info.records;
+        }
+        return count;
+    }
+
+    // Positions before the first record at or after timeNs: finds the
+    // segment, jumps to the last key record not after timeNs through the
+    // index and decodes forward from there. False if no record is that late.
+    bool Seek(int64_t timeNs) {
+        size_t index = 0;
+        while (index < m_segments.size() && m_segments[index].info.lastNs < timeNs) {
+            index++;
+        }
+        StartSegment(index);
+        if (index == m_segments.size()) {
+            return false;
+        }
+        const Segment& segment = m_segments[index];
+        uint32_t low = 0;
+        uint32_t high = segment.info.keys;
+        while (high - low > 1) {
+            uint32_t middle = (low + high) / 2;
+            int64_t keyNs = static_cast<int64_t>(EcatGet64(KeyEntry(segment, middle))) + segment.wallOffsetNs;
+            if (keyNs <= timeNs) {
+                low = middle;
+            } else {
+                high = middle;
+            }
+        }
+        m_offset = EcatGet32(KeyEntry(segment, low) + 8);
+        m_record = EcatGet32(KeyEntry(segment, low) + 12);
+
+        Record record;
+        while (m_segment == index && m_record < segment.info.records &&
+               m_offset + ProcessRecorder::kRecordHeaderBytes <= segment.info.usedBytes) {
+            int64_t recordNs = static_cast<int64_t>(EcatGet64(segment.pData + m_offset + 16)) + segment.wallOffsetNs;
+            if (recordNs >= timeNs || !Next(record)) {
+                break;
+            }
+        }
+        return true;
+    }
+
+    // Decodes the next record. A damaged record ends its segment.
+    bool Next(Record& record) {
+        while (m_segment < m_segments.size()) {
+            const Segment& segment = m_segments[m_segment];
+            const uint8_t* p = segment.pData + m_offset;
+            bool bHeader = m_record < segment.info.records &&
+                           m_offset + ProcessRecorder::kRecordHeaderBytes <= segment.info.usedBytes;
+            uint32_t length = bHeader ? EcatGet32(p) : 0;
+            if (!bHeader || length > segment.info.usedBytes - m_offset - ProcessRecorder::kRecordHeaderBytes) {
+                StartSegment(m_segment + 1);
+                continue;
+            }
+            record.bKey = (EcatGet16(p + 4) & ProcessRecorder::RECORD_KEY) != 0;
+            if (record.bKey) {
+                std::fill(m_image.begin(), m_image.end(), 0);
+            }
+            if (!ProcessRecorder::Decode(p + ProcessRecorder::kRecordHeaderBytes, length, m_image.data(),
+                                         m_image.size())) {
+                LogWarning() << "Warning: Damaged record " << m_record << " in '" << segment.info.path << "'";
+                StartSegment(m_segment + 1);
+                continue;
+            }
+            record.wkc = EcatGet16(p + 6);
+            record.cycle = EcatGet64(p + 8);
+            record.timeNs = static_cast<int64_t>(EcatGet64(p + 16)) + segment.wallOffsetNs;
+            record.pLayout = &segment.info.layout;
+            record.pSpan = m_image.data();
+            m_offset += ProcessRecorder::kRecordHeaderBytes + length;
+            m_record++;
+            return true;
+        }
+        return false;
+    }
+};
@@ -0,0 +1,355 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#include <type_traits>
+#include <vector>
+#include "Logger.h"
+
+#ifdef _WIN32
+#include <windows.h>
+#include <io.h>
+#else
+#include <execinfo.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+// Memory for the cycle path. An RtArena is reserved once at startup, on
+// huge pages where the system has them (fewer TLB misses over frames and
+// images), locked and touched page by page, so nothing on the cycle path
+// page-faults or waits for malloc. Allocation is a bump of an atomic
+// offset; memory only goes back with the arena. Containers get it through
+// RtAllocator, sized before the cycle starts.
+//
+//   setup:   arena.Reserve(4 << 20); image.SetArena(&arena); packer.SetArena(&arena, frames);
+//   cycle:   RtHeapGuard::Scope scope;   // CyclicExecutor does this around its stages
+//
+// Built with ECAT_TRAP_CYCLE_ALLOCATIONS (cmake -DECAT_TRAP_CYCLE_ALLOCATIONS=ON),
+// global operator new/delete are replaced and any heap allocation or
+// release inside an RtHeapGuard::Scope prints a message and a backtrace
+// and aborts, so the culprit shows up at once. The replacements live in
+// this header: define the macro only for a program that includes it from
+// a single translation unit, as every program here does.
+class RtArena {
+public:
+    static const size_t kHugePageSize = 2 * 1024 * 1024;
+
+    struct Stats {
+        size_t reserved;
+        size_t used;
+        unsigned long fallbacks;     // allocations the arena could not hold, taken from the heap
+        bool bHugePages;
+        bool bLocked;
+    };
+
+private:
+    uint8_t* m_pBase;
+    size_t m_size;
+    std::atomic<size_t> m_used;
+    std::atomic<unsigned long> m_fallbacks;
+    bool m_bHugePages;
+    bool m_bLocked;
+
+public:
+    RtArena() : m_pBase(nullptr), m_size(0), m_used(0), m_fallbacks(0), m_bHugePages(false), m_bLocked(false) {}
+
+    ~RtArena() {
+        Release();
+    }
+
+    RtArena(const RtArena&) = delete;
+    RtArena& operator=(const RtArena&) = delete;
+
+    // Maps, locks and pre-faults at least bytes. Huge pages and locking are
+    // best effort (they need a hugetlbfs pool and CAP_IPC_LOCK or a large
+    // enough memlock limit); false only if no memory could be mapped.
+    bool Reserve(size_t bytes) {
+        Release();
+        size_t size = (bytes + kHugePageSize - 1) / kHugePageSize * kHugePageSize;
+#ifdef _WIN32
+        void* p = VirtualAlloc(nullptr, size, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE);
+        if (!p) {
+            LogError() << "Error: Cannot reserve " << size << " bytes for the cycle arena";
+            return false;
+        }
+        m_bLocked = VirtualLock(p, size) != 0;
+#else
+        void* p = MAP_FAILED;
+#ifdef MAP_HUGETLB
+        p = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+        m_bHugePages = (p != MAP_FAILED);
+#endif
+        if (p == MAP_FAILED) {
+            p = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+            if (p == MAP_FAILED) {
+                LogError() << "Error: Cannot map " << size << " bytes for the cycle arena";
+                return false;
+            }
+#ifdef MADV_HUGEPAGE
+            madvise(p, size, MADV_HUGEPAGE);     // transparent huge pages, if enabled
+#endif
+        }
+        m_bLocked = mlock(p, size) == 0;
+#endif
+        // Touch every page now, not in the first cycles
+        volatile uint8_t* pTouch = static_cast<uint8_t*>(p);
+        for (size_t offset = 0; offset < size; offset += 4096) {
+            pTouch[offset] = 0;
+        }
+        m_pBase = static_cast<uint8_t*>(p);
+        m_size = size;
+        m_used.store(0);
+        m_fallbacks.store(0);
+        if (!m_bLocked) {
+            LogWarning() << "Warning: Could not lock the " << size / 1024 << " KB cycle arena in memory";
+        }
+        return true;
+    }
+
+    // Everything allocated from the arena must be gone by now
+    void Release() {
+        if (!m_pBase) {
+            return;
+        }
+#ifdef _WIN32
+        VirtualFree(m_pBase, 0, MEM_RELEASE);
+#else
+        munmap(m_pBase, m_size);
+#endif
+        m_pBase = nullptr;
+        m_size = 0;
+        m_bHugePages = false;
+        m_bLocked = false;
+    }
+
+    // From any thread. When the arena is full the block comes from the
+    // heap instead and is counted as a fallback.
+    void* Allocate(size_t bytes, size_t alignment = 64) {
+        size_t used = m_used.load(std::memory_order_relaxed);
+        for (;;) {
+            size_t start = (used + alignment - 1) & ~(alignment - 1);
+            if (!m_pBase || start + bytes > m_size) {
+                m_fallbacks.fetch_add(1, std::memory_order_relaxed);
+                return ::operator new(bytes, std::align_val_t(alignment));
+            }
+            if (m_used.compare_exchange_weak(used, start + bytes, std::memory_order_relaxed)) {
+                return m_pBase + start;
+            }
+        }
+    }
+
+    // Arena blocks stay allocated until Release(); heap fallbacks are freed
+    // (with the alignment they were allocated with)
+    void Deallocate(void* p, size_t alignment = 64) {
+        if (!Contains(p)) {
+            ::operator delete(p, std::align_val_t(alignment));
+        }
+    }
+
+    bool Contains(const void* p) const {
+        const uint8_t* pByte = static_cast<const uint8_t*>(p);
+        return m_pBase && pByte >= m_pBase && pByte < m_pBase + m_size;
+    }
+
+    Stats GetStats() const {
+        Stats stats = { m_size, m_used.load(std::memory_order_relaxed), m_fallbacks.load(std::memory_order_relaxed),
+                        m_bHugePages, m_bLocked };
+        return stats;
+    }
+};
+
+// Standard allocator over an RtArena; without one it is the plain heap.
+// The allocator moves with the container on assignment and swap, so
+// container = RtVector<T>(RtAllocator<T>(&arena)) moves it to the arena.
+template <typename T>
+class RtAllocator {
+public:
+    typedef T value_type;
+    typedef std::true_type propagate_on_container_copy_assignment;
+    typedef std::true_type propagate_on_container_move_assignment;
+    typedef std::true_type propagate_on_container_swap;
+
+    RtArena* m_pArena;
+
+    RtAllocator() noexcept : m_pArena(nullptr) {}
+
+    explicit RtAllocator(RtArena* pArena) noexcept : m_pArena(pArena) {}
+
+    template <typename U>
+    RtAllocator(const RtAllocator<U>& other) noexcept : m_pArena(other.m_pArena) {}
+
+    static constexpr size_t kAlignment = alignof(T) > 16 ? alignof(T) : 16;
+
+    T* allocate(size_t count) {
+        if (m_pArena) {
+            return static_cast<T*>(m_pArena->Allocate(count * sizeof(T), kAlignment));
+        }
+        return static_cast<T*>(::operator new(count * sizeof(T), std::align_val_t(kAlignment)));
+    }
+
+    void deallocate(T* p, size_t) noexcept {
+        if (m_pArena) {
+            m_pArena->Deallocate(p, kAlignment);
+        } else {
+            ::operator delete(p, std::align_val_t(kAlignment));
+        }
+    }
+
+    template <typename U>
+    bool operator==(const RtAllocator<U>& other) const noexcept {
+        return m_pArena == other.m_pArena;
+    }
+
+    template <typename U>
+    bool operator!=(const RtAllocator<U>& other) const noexcept {
+        return m_pArena != other.m_pArena;
+    }
+};
+
+template <typename T>
+using RtVector = std::vector<T, RtAllocator<T>>;
+
+// Marks code that must not touch the heap: the running thread is on the
+// cycle path while a Scope exists. Only builds with
+// ECAT_TRAP_CYCLE_ALLOCATIONS look at it.
+class RtHeapGuard {
+public:
+    class Scope {
+    public:
+        Scope() {
+            Depth()++;
+        }
+
+        ~Scope() {
+            Depth()--;
+        }
+
+        Scope(const Scope&) = delete;
+        Scope& operator=(const Scope&) = delete;
+    };
+
+    // Lifts the guard for code that only stands in for hardware, such as
+    // the simulated line run from a transport's Kick()
+    class Exempt {
+    private:
+        int m_depth;
+
+    public:
+        Exempt() : m_depth(Depth()) {
+            Depth() = 0;
+        }
+
+        ~Exempt() {
+            Depth() = m_depth;
+        }
+
+        Exempt(const Exempt&) = delete;
+        Exempt& operator=(const Exempt&) = delete;
+    };
+
+    static int& Depth() {
+        static thread_local int depth = 0;
+        return depth;
+    }
+
+    static bool IsTrapping() {
+#if defined(ECAT_TRAP_CYCLE_ALLOCATIONS) && !defined(_WIN32)
+        return true;
+#else
+        return false;
+#endif
+    }
+
+    // Called by the replaced operators; must not allocate itself
+    static void Trap(const char* what) {
+        static const char kPrefix[] = "FATAL: heap ";
+        static const char kSuffix[] = " on the cycle path (ECAT_TRAP_CYCLE_ALLOCATIONS)\n";
+        Depth() = 0;
+#ifdef _WIN32
+        _write(2, kPrefix, sizeof(kPrefix) - 1);
+        _write(2, what, static_cast<unsigned>(strlen(what)));
+        _write(2, kSuffix, sizeof(kSuffix) - 1);
+#else
+        ssize_t ignored = write(2, kPrefix, sizeof(kPrefix) - 1);
+        ignored = write(2, what, strlen(what));
+        ignored = write(2, kSuffix, sizeof(kSuffix) - 1);
+        (void)ignored;
+        void* frames[32];
+        backtrace_symbols_fd(frames, backtrace(frames, 32), 2);
+#endif
+        abort();
+    }
+};
+
+#if defined(ECAT_TRAP_CYCLE_ALLOCATIONS) && !defined(_WIN32)
+static void* RtHeapAllocate(std::size_t size, std::size_t alignment) {
+    if (RtHeapGuard::Depth() > 0) {
+        RtHeapGuard::Trap("allocation");
+    }
+    void* p = nullptr;
+    if (posix_memalign(&p, alignment < sizeof(void*) ? sizeof(void*) : alignment, size ? size : 1) != 0) {
+        throw std::bad_alloc();
+    }
+    return p;
+}
+
+static void RtHeapFree(void* p) {
+    if (p && RtHeapGuard::Depth() > 0) {
+        RtHeapGuard::Trap("release");
+    }
+    free(p);
+}
+
+void* operator new(std::size_t size) {
+    return RtHeapAllocate(size, __STDCPP_DEFAULT_NEW_ALIGNMENT__);
+}
+
+void* operator new[](std::size_t size) {
+    return RtHeapAllocate(size, __STDCPP_DEFAULT_NEW_ALIGNMENT__);
+}
+
+void* operator new(std::size_t size, std::align_val_t alignment) {
+    return RtHeapAllocate(size, static_cast<std::size_t>(alignment));
+}
+
+void* operator new[](std::size_t size, std::align_val_t alignment) {
+    return RtHeapAllocate(size, static_cast<std::size_t>(alignment));
+}
+
+void operator delete(void* p) noexcept {
+    RtHeapFree(p);
+}
+
+void operator delete[](void* p) noexcept {
+    RtHeapFree(p);
+}
+
+void operator delete(void* p, std::size_t) noexcept {
+    RtHeapFree(p);
+}
+
+void operator delete[](void* p, std::size_t) noexcept {
+    RtHeapFree(p);
+}
+
+void operator delete(void* p, std::align_val_t) noexcept {
+    RtHeapFree(p);
+}
+
+void operator delete[](void* p, std::align_val_t) noexcept {
+    RtHeapFree(p);
+}
+
+void operator delete(void* p, std::size_t, std::align_val_t) noexcept {
+    RtHeapFree(p);
+}
+
+void operator delete[](void* p, std::size_t, std::align_val_t) noexcept {
+    RtHeapFree(p);
+}
+#endif
@@ -0,0 +1,265 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <vector>
+#include "CyclicExecutor.h"
+#include "Logger.h"
+#include "ProcessImage.h"
+
+// Several EtherCAT lines of one machine, each cycled by its own thread on
+// its own core with its own transport and process image, so adding a line
+// adds a core instead of load on a shared cycle. The coordinator gives the
+// segments a common timebase and the application one merged image.
+//
+// The timebase is the grid of wall-clock cycle boundaries: every segment's
+// executor starts on the same grid point and keeps the period, so their
+// cycles start together. The DC system time is the wall clock since 2000,
+// so for cycle times that divide a second, SYNC0 of every DC segment lies
+// on the same grid; each DC segment follows its own reference clock,
+// though, and drifts off the grid as far as that clock drifts.
+//
+// The merged image holds every segment's inputs (and outputs) back to
+// back in segment order; variables are mapped per segment and then used
+// like those of a single ProcessImage.
+//
+//   segment thread i:    set up; epochNs = Join(i, &image) (0: give up);
+//                        executor from epochNs, each cycle MarkCycle(i, deadline);
+//                        WaitForStop(); stop; BeginReport(i); ...; EndReport()
+//   application thread:  WaitForStart(); MapInput(i, ...); UpdateInputs();
+//                        GetInput(); SetOutput(); PublishOutputs(); ... Stop()
+class SegmentCoordinator {
+public:
+    static const int64_t kStartLeadNs = 50000000;   // first cycle at least this long after the last Join()
+
+private:
+    struct Segment {
+        ProcessImage* pImage;
+        size_t inputOffset;          // in the merged image
+        size_t outputOffset;
+        std::atomic<uint64_t> cycles;
+        JitterHistogram phase;       // |deadline - nearest grid point|
+
+        Segment() : pImage(nullptr), inputOffset(0), outputOffset(0), cycles(0) {}
+    };
+
+    std::vector<std::unique_ptr<Segment>> m_segments;
+    int64_t m_periodNs;
+    int64_t m_epochNs;               // first cycle, on the grid
+
+    std::mutex m_mutex;
+    std::condition_variable m_cond;
+    size_t m_joined;
+    bool m_bFailed;
+    bool m_bStopped;
+    size_t m_reportTurn;
+
+    // Application thread
+    std::vector<uint8_t> m_inputs;
+    std::vector<uint8_t> m_outputs;
+
+    static int64_t NowNs() {
+        return CycleTrace::NowNs();
+    }
+
+    // Next grid point at least kStartLeadNs ahead, on the CycleTrace clock
+    int64_t NextGridPoint() const {
+        int64_t nowNs = NowNs();
+        int64_t wallNs = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                             std::chrono::system_clock::now().time_since_epoch()).count();
+        int64_t offsetNs = wallNs - nowNs;
+        int64_t startWallNs = (nowNs + kStartLeadNs + offsetNs) / m_periodNs * m_periodNs + m_periodNs;
+        return startWallNs - offsetNs;
+    }
+
+public:
+    SegmentCoordinator()
+        : m_periodNs(1000000), m_epochNs(0), m_joined(0), m_bFailed(false), m_bStopped(false), m_reportTurn(0) {}
+
+    SegmentCoordinator(const SegmentCoordinator&) = delete;
+    SegmentCoordinator& operator=(const SegmentCoordinator&) = delete;
+
+    // Before any segment thread starts
+    void Configure(size_t segments, unsigned long cycleTimeUs) {
+        m_segments.clear();
+        for (size_t i = 0; i < segments; i++) {
+            m_segments.push_back(std::unique_ptr<Segment>(new Segment()));
+        }
+        m_periodNs = static_cast<int64_t>(cycleTimeUs) * 1000;
+        m_epochNs = 0;
+        m_joined = 0;
+        m_bFailed = false;
+        m_bStopped = false;
+        m_reportTurn = 0;
+    }
+
+    size_t GetSegmentCount() const {
+        return m_segments.size();
+    }
+
+    // --- Segment threads ---
+
+    // Registers a segment whose cycle is ready to start (pImage nullptr: it
+    // failed to get there) and waits for the others. Returns the first
+    // cycle's deadline for CyclicExecutor::Settings::startNs, or 0 if any
+    // segment failed, in which case none of them starts.
+    int64_t Join(size_t index, ProcessImage* pImage) {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_segments[index]->pImage = pImage;
+        m_bFailed = m_bFailed || !pImage;
+        if (++m_joined == m_segments.size()) {
+            size_t inputs = 0;
+            size_t outputs = 0;
+            for (std::unique_ptr<Segment>& segment : m_segments) {
+                segment->inputOffset = inputs;
+                segment->outputOffset = outputs;
+                if (segment->pImage) {
+                    inputs += segment->pImage->GetInputSize();
+                    outputs += segment->pImage->GetOutputSize();
+                }
+            }
+            m_inputs.assign(inputs, 0);
+            m_outputs.assign(outputs, 0);
+            m_epochNs = NextGridPoint();
+            m_cond.notify_all();
+        }
+        m_cond.wait(lock, [this] { return m_joined == m_segments.size(); });
+        return m_bFailed ? 0 : m_epochNs;
+    }
+
+    // From a stage, every cycle: counts it and records how far its
+    // deadline is off the grid. Wait-free.
+    void MarkCycle(size_t index, int64_t deadlineNs) {
+        Segment& segment = *m_segments[index];
+        int64_t offsetNs = (deadlineNs - m_epochNs) % m_periodNs;
+        if (offsetNs < 0) {
+            offsetNs += m_periodNs;
+        }
+        segment.phase.Record(std::min(offsetNs, m_periodNs - offsetNs));
+        segment.cycles.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    void WaitForStop() {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_cond.wait(lock, [this] { return m_bStopped; });
+    }
+
+    // Segments report their statistics one after another, in index order
+    void BeginReport(size_t index) {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_cond.wait(lock, [this, index] { return m_reportTurn == index; });
+        if (m_segments.size() > 1) {
+            LogInfo() << "\n=== Segment " << index << " ===";
+        }
+    }
+
+    void EndReport() {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_reportTurn++;
+        m_cond.notify_all();
+    }
+
+    // --- Application thread ---
+
+    // False if a segment could not start
+    bool WaitForStart() {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_cond.wait(lock, [this] { return m_joined == m_segments.size(); });
+        return !m_bFailed;
+    }
+
+    // Ends the cycle of every segment
+    void Stop() {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_bStopped = true;
+        m_cond.notify_all();
+    }
+
+    // Cycles every segment has run
+    uint64_t GetCycles() const {
+        uint64_t cycles = UINT64_MAX;
+        for (const std::unique_ptr<Segment>& segment : m_segments) {
+            cycles = std::min<uint64_t>(cycles, segment->cycles.load(std::memory_order_relaxed));
+        }
+        return m_segments.empty() ? 0 : cycles;
+    }
+
+    template <typename T>
+    bool MapInput(size_t index, uint32_t logicalAddress, ProcessVariable<T>& variable) const {
+        if (!m_segments[index]->pImage->MapInput(logicalAddress, variable)) {
+            return false;
+        }
+        variable.offset += m_segments[index]->inputOffset;
+        return true;
+    }
+
+    template <typename T>
+    bool MapOutput(size_t index, uint32_t logicalAddress, ProcessVariable<T>& variable) const {
+        if (!m_segments[index]->pImage->MapOutput(logicalAddress, variable)) {
+            return false;
+        }
+        variable.offset += m_segments[index]->outputOffset;
+        return true;
+    }
+
+    // Takes every segment's newest input snapshot; true if any changed
+    bool UpdateInputs() {
+        bool bChanged = false;
+        for (std::unique_ptr<Segment>& segment : m_segments) {
+            ProcessImage& image = *segment->pImage;
+            if (image.UpdateInputs()) {
+                memcpy(m_inputs.data() + segment->inputOffset, image.GetInputData(), image.GetInputSize());
+                bChanged = true;
+            }
+        }
+        return bChanged;
+    }
+
+    // The merged input snapshot, e.g. for a ChangeDetector
+    const uint8_t* GetInputData() const {
+        return m_inputs.data();
+    }
+
+    size_t GetInputSize() const {
+        return m_inputs.size();
+    }
+
+    template <typename T>
+    T GetInput(const ProcessVariable<T>& variable) const {
+        T value;
+        memcpy(&value, m_inputs.data() + variable.offset, sizeof(T));
+        return value;
+    }
+
+    template <typename T>
+    void SetOutput(const ProcessVariable<T>& variable, T value) {
+        memcpy(m_outputs.data() + variable.offset, &value, sizeof(T));
+    }
+
+    // Publishes every segment's slice of the merged outputs
+    void PublishOutputs() {
+        for (std::unique_ptr<Segment>& segment : m_segments) {
+            segment->pImage->SetOutputData(m_outputs.data() + segment->outputOffset);
+            segment->pImage->PublishOutputs();
+        }
+    }
+
+    // --- After Stop() ---
+
+    void PrintStats() const {
+        for (size_t i = 0; i < m_segments.size(); i++) {
+            JitterHistogram::Summary phase = m_segments[i]->phase.Summarize();
+            LogInfo() << "Segment " << i << ": " << m_segments[i]->cycles.load() << " cycles, "
+                      << m_segments[i]->pImage->GetInputSize() << "/" << m_segments[i]->pImage->GetOutputSize()
+                      << " input/output bytes at " << m_segments[i]->inputOffset << "/"
+                      << m_segments[i]->outputOffset << ", phase vs. timebase (us): p50 " << phase.p50Ns / 1000.0
+                      << ", p99 " << phase.p99Ns / 1000.0 << ", max " << phase.maxNs / 1000.0;
+        }
+    }
+};
@@ -0,0 +1,352 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <vector>
+#include "Logger.h"
+#include "SharedSegment.h"
+
+// Start of the shared-memory segment. The LRW span (inputs and outputs at
+// their logical offsets) follows at kSpanOffset, the output request area
+// of the designated writer after it.
+struct SharedImageHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t spanAddress;
+    uint32_t spanSize;
+    uint32_t inputAddress;
+    uint32_t inputSize;
+    uint32_t outputAddress;
+    uint32_t outputSize;
+    int64_t cycleTimeNs;
+    int32_t pid;
+    uint32_t flags;                               // SharedProcessImage::FLAG_*
+
+    // Published image, seqlock: odd while the master writes it
+    alignas(64) std::atomic<uint64_t> sequence;
+    uint64_t cycle;
+    int64_t timestampNs;                          // CycleTrace::NowNs() of the reply
+    uint16_t wkc;
+    uint16_t expectedWkc;
+    uint32_t reserved;
+
+    // Output requests, seqlock written by the process holding outputOwner
+    alignas(64) std::atomic<int32_t> outputOwner; // pid, -pid while claiming, 0 = the master's own outputs
+    std::atomic<uint64_t> outputSequence;
+};
+
+// The master's live process image in named shared memory for local
+// consumers (HMI, historian, vision). The cycle thread publishes each
+// cycle's LRW span under a sequence lock, so publishing never waits and a
+// reader gets a consistent snapshot with one copy and no syscall, retrying
+// only when it raced a publish. One process at a time may claim the
+// outputs; while it holds them its output image replaces the master's own
+// in every exchange, again handed over under a sequence lock.
+//
+//   master, cycle thread:  image.Publish(cycle, timeNs, wkc, expectedWkc, pSpan);
+//                          if ((p = image.PollOutputs())) processImage.SetExchangeOutputs(p);
+//   reader:                image.Open(name); image.Read(snapshot); image.GetInputs(snapshot);
+//   output writer:         image.Open(name, true); image.ClaimOutputs(); image.WriteOutputs(p);
+class SharedProcessImage {
+public:
+    static const uint32_t kMagic = 0x49504345;     // "ECPI"
+    static const uint32_t kVersion = 1;
+    static const size_t kSpanOffset = (sizeof(SharedImageHeader) + 63) & ~static_cast<size_t>(63);
+
+    static const uint32_t FLAG_ACCEPT_OUTPUTS = 0x0001;
+    static const unsigned kOwnerCheckPolls = 256;  // cycles between liveness checks of the output holder
+
+    // A consistent copy of one published cycle
+    struct Snapshot {
+        uint64_t cycle;
+        int64_t timestampNs;
+        uint16_t wkc;
+        uint16_t expectedWkc;
+        std::vector<uint8_t> span;
+    };
+
+private:
+    std::string m_name;
+    SharedSegment m_segment;
+    SharedImageHeader* m_pHeader;
+    uint8_t* m_pSpan;
+    uint8_t* m_pOutputRequest;
+    bool m_bOwner;                  // created the segment
+    bool m_bWritable;
+
+    // Master side: last consistent output request, and the liveness check
+    // of the process holding the outputs
+    std::vector<uint8_t> m_takenOutputs;
+    uint64_t m_takenSequence;
+    unsigned m_pollsSinceCheck;
+    unsigned long m_ownersDropped;
+
+    static std::string SegmentName(const std::string& name) {
+        return SharedSegment::FullName("ecat_image_", name);
+    }
+
+    static size_t Align64(size_t bytes) {
+        return (bytes + 63) & ~static_cast<size_t>(63);
+    }
+
+    void SetAreas() {
+        m_pHeader = static_cast<SharedImageHeader*>(m_segment.GetData());
+        m_pSpan = reinterpret_cast<uint8_t*>(m_pHeader) + kSpanOffset;
+        m_pOutputRequest = m_pSpan + Align64(m_pHeader->spanSize);
+    }
+
+    void WriteRequest(const uint8_t* pOutputs) {
+        uint64_t sequence = m_pHeader->outputSequence.load(std::memory_order_relaxed);
+        sequence += (sequence & 1);       // a writer that died mid-write left it odd
+        m_pHeader->outputSequence.store(sequence + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        memcpy(m_pOutputRequest, pOutputs, m_pHeader->outputSize);
+        m_pHeader->outputSequence.store(sequence + 2, std::memory_order_release);
+    }
+
+public:
+    SharedProcessImage()
+        : m_pHeader(nullptr), m_pSpan(nullptr), m_pOutputRequest(nullptr), m_bOwner(false), m_bWritable(false),
+          m_takenSequence(0), m_pollsSinceCheck(0), m_ownersDropped(0) {}
+
+    ~SharedProcessImage() {
+        Close();
+    }
+
+    SharedProcessImage(const SharedProcessImage&) = delete;
+    SharedProcessImage& operator=(const SharedProcessImage&) = delete;
+
+    // --- Master ---
+
+    // Creates (or replaces) the segment for an LRW span at spanAddress.
+    // Call before the cycle thread starts.
+    bool Create(const std::string& name, uint32_t spanAddress, uint32_t spanSize, uint32_t inputAddress,
+                uint32_t inputSize, uint32_t outputAddress, uint32_t outputSize, int64_t cycleTimeNs,
+                bool bAcceptOutputs) {
+        Close();
+        size_t bytes = kSpanOffset + Align64(spanSize) + Align64(outputSize);
+        if (!m_segment.Create(SegmentName(name), bytes)) {
+            LogWarning() << "Warning: Cannot create process image segment '" << SegmentName(name) << "'";
+            return false;
+        }
+        m_name = name;
+        m_bOwner = true;
+        m_bWritable = true;
+        m_pHeader = static_cast<SharedImageHeader*>(m_segment.GetData());
+        memset(static_cast<void*>(m_pHeader), 0, m_segment.GetSize());
+        m_pHeader->version = kVersion;
+        m_pHeader->spanAddress = spanAddress;
+        m_pHeader->spanSize = spanSize;
+        m_pHeader->inputAddress = inputAddress;
+        m_pHeader->inputSize = inputSize;
+        m_pHeader->outputAddress = outputAddress;
+        m_pHeader->outputSize = outputSize;
+        m_pHeader->cycleTimeNs = cycleTimeNs;
+        m_pHeader->pid = SharedSegment::CurrentPid();
+        m_pHeader->flags = bAcceptOutputs ? FLAG_ACCEPT_OUTPUTS : 0;
+        SetAreas();
+        m_takenOutputs.assign(outputSize, 0);
+        m_takenSequence = 0;
+        m_pollsSinceCheck = 0;
+        m_ownersDropped = 0;
+        std::atomic_thread_fence(std::memory_order_release);
+        m_pHeader->magic = kMagic;
+        return true;
+    }
+
+    // Cycle thread: publishes the span as returned by the LRW
+    void Publish(uint64_t cycle, int64_t timestampNs, uint16_t wkc, uint16_t expectedWkc, const uint8_t* pSpan) {
+        if (!m_pHeader || !m_bOwner) {
+            return;
+        }
+        uint64_t sequence = m_pHeader->sequence.load(std::memory_order_relaxed);
+        m_pHeader->sequence.store(sequence + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        memcpy(m_pSpan, pSpan, m_pHeader->spanSize);
+        m_pHeader->cycle = cycle;
+        m_pHeader->timestampNs = timestampNs;
+        m_pHeader->wkc = wkc;
+        m_pHeader->expectedWkc = expectedWkc;
+        m_pHeader->sequence.store(sequence + 2, std::memory_order_release);
+    }
+
+    // Cycle thread: the claimed output image, or nullptr while no process
+    // holds the outputs. A request caught mid-write keeps the previous one.
+    // Every kOwnerCheckPolls calls the holder is checked: once it has
+    // exited, its claim is dropped and the master's own outputs apply again.
+    const uint8_t* PollOutputs() {
+        if (!m_pHeader || !m_bOwner || !(m_pHeader->flags & FLAG_ACCEPT_OUTPUTS)) {
+            return nullptr;
+        }
+        int32_t owner = m_pHeader->outputOwner.load(std::memory_order_acquire);
+        if (owner == 0) {
+            m_takenSequence = 0;
+            return nullptr;
+        }
+        if (++m_pollsSinceCheck >= kOwnerCheckPolls) {
+            m_pollsSinceCheck = 0;
+            if (!SharedSegment::IsAlive(owner < 0 ? -owner : owner) &&
+                m_pHeader->outputOwner.compare_exchange_strong(owner, 0, std::memory_order_acq_rel)) {
+                m_ownersDropped++;
+                m_takenSequence = 0;
+                return nullptr;
+            }
+        }
+        if (owner < 0) {            // ClaimOutputs() is still filling the request
+            m_takenSequence = 0;
+            return nullptr;
+        }
+        uint64_t before = m_pHeader->outputSequence.load(std::memory_order_acquire);
+        if (before != m_takenSequence && !(before & 1)) {
+            memcpy(m_takenOutputs.data(), m_pOutputRequest, m_takenOutputs.size());
+            std::atomic_thread_fence(std::memory_order_acquire);
+            if (m_pHeader->outputSequence.load(std::memory_order_relaxed) == before) {
+                m_takenSequence = before;
+            }
+        }
+        // Nothing consistent arrived yet: ClaimOutputs() fills the request
+        // before it publishes its pid, so this only happens after a torn copy
+        return m_takenSequence ? m_takenOutputs.data() : nullptr;
+    }
+
+    // Claims PollOutputs() dropped because their process had exited
+    unsigned long GetOwnersDropped() const {
+        return m_ownersDropped;
+    }
+
+    // --- Readers and the output writer ---
+
+    // bWritable: this process wants to claim the outputs
+    bool Open(const std::string& name, bool bWritable = false) {
+        Close();
+        if (!m_segment.Open(SegmentName(name), bWritable, kSpanOffset)) {
+            return false;
+        }
+        m_name = name;
+        m_bOwner = false;
+        m_bWritable = bWritable;
+        m_pHeader = static_cast<SharedImageHeader*>(m_segment.GetData());
+        if (m_pHeader->magic != kMagic || m_pHeader->version != kVersion ||
+            kSpanOffset + Align64(m_pHeader->spanSize) + Align64(m_pHeader->outputSize) > m_segment.GetSize()) {
+            LogError() << "Error: '" << SegmentName(name) << "' is not a compatible process image segment";
+            Close();
+            return false;
+        }
+        SetAreas();
+        return true;
+    }
+
+    // The creator also removes the segment name; a writer gives up the outputs
+    void Close() {
+        if (!m_pHeader) {
+            return;
+        }
+        ReleaseOutputs();
+        m_segment.Close();
+        m_pHeader = nullptr;
+        m_pSpan = nullptr;
+        m_pOutputRequest = nullptr;
+    }
+
+    bool IsOpen() const {
+        return m_pHeader != nullptr;
+    }
+
+    const SharedImageHeader* GetHeader() const {
+        return m_pHeader;
+    }
+
+    // Copies the newest published cycle. False if nothing is published yet
+    // or every attempt raced a publish; the snapshot is sized on first use.
+    bool Read(Snapshot& snapshot, unsigned attempts = 100) const {
+        if (!m_pHeader) {
+            return false;
+        }
+        snapshot.span.resize(m_pHeader->spanSize);
+        for (unsigned attempt = 0; attempt < attempts; attempt++) {
+            uint64_t before = m_pHeader->sequence.load(std::memory_order_acquire);
+            if (before == 0) {
+                return false;
+            }
+            if (before & 1) {
+                continue;
+            }
+            memcpy(snapshot.span.data(), m_pSpan, snapshot.span.size());
+            snapshot.cycle = m_pHeader->cycle;
+            snapshot.timestampNs = m_pHeader->timestampNs;
+            snapshot.wkc = m_pHeader->wkc;
+            snapshot.expectedWkc = m_pHeader->expectedWkc;
+            std::atomic_thread_fence(std::memory_order_acquire);
+            if (m_pHeader->sequence.load(std::memory_order_relaxed) == before) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    const uint8_t* GetInputs(const Snapshot& snapshot) const {
+        return snapshot.span.data() + (m_pHeader->inputAddress - m_pHeader->spanAddress);
+    }
+
+    const uint8_t* GetOutputs(const Snapshot& snapshot) const {
+        return snapshot.span.data() + (m_pHeader->outputAddress - m_pHeader->spanAddress);
+    }
+
+    // Makes this process the output writer, starting from the outputs last
+    // sent. Fails if the master does not accept outputs or another live
+    // process holds them; a holder that died is replaced. The claim is
+    // taken as -pid first, so the request is only written once it is ours
+    // and the master ignores it until the pid goes in.
+    bool ClaimOutputs() {
+        if (!m_pHeader || !m_bWritable || !(m_pHeader->flags & FLAG_ACCEPT_OUTPUTS)) {
+            LogError() << "Error: '" << SegmentName(m_name) << "' does not accept outputs";
+            return false;
+        }
+        int32_t self = SharedSegment::CurrentPid();
+        int32_t owner = m_pHeader->outputOwner.load(std::memory_order_acquire);
+        if (owner == self) {
+            return true;
+        }
+        int32_t holder = owner < 0 ? -owner : owner;
+        if (owner != 0 && holder != self && SharedSegment::IsAlive(holder)) {
+            LogError() << "Error: Outputs of '" << SegmentName(m_name) << "' are held by process " << holder;
+            return false;
+        }
+        if (!m_pHeader->outputOwner.compare_exchange_strong(owner, -self, std::memory_order_acq_rel)) {
+            LogError() << "Error: Outputs of '" << SegmentName(m_name) << "' were claimed by process "
+                       << (owner < 0 ? -owner : owner);
+            return false;
+        }
+        Snapshot current;
+        if (Read(current)) {
+            WriteRequest(GetOutputs(current));
+        }
+        m_pHeader->outputOwner.store(self, std::memory_order_release);
+        return true;
+    }
+
+    bool HoldsOutputs() const {
+        int32_t self = SharedSegment::CurrentPid();
+        return m_pHeader && m_pHeader->outputOwner.load(std::memory_order_acquire) == self;
+    }
+
+    // Output image (outputSize bytes) for the next exchanges
+    bool WriteOutputs(const uint8_t* pOutputs) {
+        if (!HoldsOutputs()) {
+            return false;
+        }
+        WriteRequest(pOutputs);
+        return true;
+    }
+
+    // Hands the outputs back to the master's own application
+    void ReleaseOutputs() {
+        if (!m_pHeader || !m_bWritable || m_bOwner) {
+            return;
+        }
+        int32_t self = SharedSegment::CurrentPid();
+        m_pHeader->outputOwner.compare_exchange_strong(self, 0, std::memory_order_acq_rel);
+    }
+};
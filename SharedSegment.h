@@ -0,0 +1,180 @@
+#pragma once
+
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+// A named shared-memory segment: shm_open() and mmap() on Linux, a paging
+// file mapping on Windows. The creator sizes it and removes the name again
+// on Close(); other processes map it read-only or writable. The cycle
+// trace (ecat_trace) and the shared process image (ecat_image) live in
+// one each.
+//
+//   creator:  segment.Create(SharedSegment::FullName("ecat_trace_", name), bytes);
+//   others:   segment.Open(SharedSegment::FullName("ecat_trace_", name), false, sizeof(Header));
+class SharedSegment {
+private:
+#ifndef _WIN32
+    // Owner and group only: the segment carries live outputs, so a viewer
+    // or output writer has to run as the master's user or in its group
+    static const mode_t kMode = 0660;
+#endif
+
+    std::string m_name;
+    void* m_pData;
+    size_t m_bytes;
+    bool m_bOwner;
+#ifdef _WIN32
+    HANDLE m_hMapping;
+#endif
+
+    bool Map(const std::string& name, size_t bytes, bool bCreate, bool bWritable, size_t minBytes) {
+#ifdef _WIN32
+        m_hMapping = bCreate ? CreateFileMappingA(INVALID_HANDLE_VALUE, nullptr, PAGE_READWRITE, 0,
+                                                  static_cast<DWORD>(bytes), name.c_str())
+                             : OpenFileMappingA(bWritable ? FILE_MAP_ALL_ACCESS : FILE_MAP_READ, FALSE, name.c_str());
+        if (!m_hMapping) {
+            return false;
+        }
+        void* pView = MapViewOfFile(m_hMapping, bWritable ? FILE_MAP_ALL_ACCESS : FILE_MAP_READ, 0, 0, 0);
+        MEMORY_BASIC_INFORMATION info;
+        size_t size = pView && VirtualQuery(pView, &info, sizeof(info)) ? info.RegionSize : bytes;
+        if (!pView || size < minBytes) {
+            if (pView) {
+                UnmapViewOfFile(pView);
+            }
+            CloseHandle(m_hMapping);
+            m_hMapping = nullptr;
+            return false;
+        }
+        m_bytes = size;
+        m_pData = pView;
+#else
+        int fd = bCreate ? shm_open(name.c_str(), O_CREAT | O_RDWR | O_TRUNC, kMode)
+                         : shm_open(name.c_str(), bWritable ? O_RDWR : O_RDONLY, 0);
+        if (fd < 0) {
+            return false;
+        }
+        struct stat info;
+        if ((bCreate && ftruncate(fd, static_cast<off_t>(bytes)) != 0) || fstat(fd, &info) != 0 ||
+            static_cast<size_t>(info.st_size) < minBytes) {
+            close(fd);
+            return false;
+        }
+        size_t size = static_cast<size_t>(info.st_size);
+        void* pMap = mmap(nullptr, size, bWritable ? PROT_READ | PROT_WRITE : PROT_READ, MAP_SHARED, fd, 0);
+        close(fd);
+        if (pMap == MAP_FAILED) {
+            return false;
+        }
+        m_bytes = size;
+        m_pData = pMap;
+#endif
+        m_name = name;
+        m_bOwner = bCreate;
+        return true;
+    }
+
+public:
+    SharedSegment()
+        : m_pData(nullptr), m_bytes(0), m_bOwner(false)
+#ifdef _WIN32
+          , m_hMapping(nullptr)
+#endif
+    {}
+
+    ~SharedSegment() {
+        Close();
+    }
+
+    SharedSegment(const SharedSegment&) = delete;
+    SharedSegment& operator=(const SharedSegment&) = delete;
+
+    // The platform's name for segment prefix + name
+    static std::string FullName(const char* prefix, const std::string& name) {
+#ifdef _WIN32
+        return std::string("Local\\") + prefix + name;
+#else
+        return std::string("/") + prefix + name;
+#endif
+    }
+
+    static int32_t CurrentPid() {
+#ifdef _WIN32
+        return static_cast<int32_t>(GetCurrentProcessId());
+#else
+        return static_cast<int32_t>(getpid());
+#endif
+    }
+
+    // False once the process has exited; a process of another user counts
+    // as alive
+    static bool IsAlive(int32_t pid) {
+#ifdef _WIN32
+        HANDLE hProcess = OpenProcess(SYNCHRONIZE, FALSE, static_cast<DWORD>(pid));
+        if (!hProcess) {
+            return false;
+        }
+        bool bAlive = WaitForSingleObject(hProcess, 0) == WAIT_TIMEOUT;
+        CloseHandle(hProcess);
+        return bAlive;
+#else
+        return kill(pid, 0) == 0 || errno != ESRCH;
+#endif
+    }
+
+    // Creates (or replaces) a writable segment of at least bytes
+    bool Create(const std::string& name, size_t bytes) {
+        Close();
+        return Map(name, bytes, true, true, bytes);
+    }
+
+    // Maps an existing segment; false if it is missing or under minBytes
+    bool Open(const std::string& name, bool bWritable, size_t minBytes) {
+        Close();
+        return Map(name, 0, false, bWritable, minBytes);
+    }
+
+    // The creator also removes the name
+    void Close() {
+        if (!m_pData) {
+            return;
+        }
+#ifdef _WIN32
+        UnmapViewOfFile(m_pData);
+        CloseHandle(m_hMapping);
+        m_hMapping = nullptr;
+#else
+        munmap(m_pData, m_bytes);
+        if (m_bOwner) {
+            shm_unlink(m_name.c_str());
+        }
+#endif
+        m_pData = nullptr;
+        m_bytes = 0;
+        m_bOwner = false;
+    }
+
+    void* GetData() const {
+        return m_pData;
+    }
+
+    size_t GetSize() const {
+        return m_bytes;
+    }
+
+    bool IsOwner() const {
+        return m_bOwner;
+    }
+};
@@ -0,0 +1,343 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <thread>
+#include <vector>
+#include "EscRegisters.h"
+#include "EtherCATDatagramPacker.h"
+#include "FrameTransport.h"
+#include "Logger.h"
+
+// Identity words of the SII EEPROM (0x0008-0x000F)
+struct SlaveIdentity {
+    uint32_t vendorId;
+    uint32_t productCode;
+    uint32_t revision;
+    uint32_t serial;
+
+    bool operator==(const SlaveIdentity& other) const {
+        return vendorId == other.vendorId && productCode == other.productCode &&
+               revision == other.revision && serial == other.serial;
+    }
+
+    bool operator!=(const SlaveIdentity& other) const {
+        return !(*this == other);
+    }
+};
+
+struct SlavePdoEntry {
+    uint16_t index;
+    uint8_t subIndex;
+    uint8_t bitLength;
+};
+
+// One entry of the SII sync manager category; entry i describes SM i
+struct SlaveSyncManager {
+    uint16_t start;
+    uint16_t length;
+    uint8_t control;
+    uint8_t enable;
+    uint8_t type;                // SII_SM_*, 0 = unused
+};
+
+struct SlavePdo {
+    uint16_t index;              // 0x1Axx inputs, 0x16xx outputs
+    uint8_t syncManager;
+    std::vector<SlavePdoEntry> entries;
+};
+
+// What the master knows about a slave from its EEPROM. categories holds
+// the raw category area from word 0x0040 up to and including the end
+// marker; the rest is parsed from it.
+struct SlaveInfo {
+    SlaveIdentity identity;
+    std::vector<uint8_t> categories;
+    std::string name;
+    std::vector<SlavePdo> inputPdos;     // TxPDO category
+    std::vector<SlavePdo> outputPdos;    // RxPDO category
+    uint32_t inputBits;
+    uint32_t outputBits;
+    uint16_t mailboxOutStart;            // sync manager category, 0 size = no mailbox
+    uint16_t mailboxOutSize;
+    uint16_t mailboxInStart;
+    uint16_t mailboxInSize;
+    std::vector<SlaveSyncManager> syncManagers;
+    uint8_t coeDetails;                  // general category, SII_COE_*
+
+    // False if a category runs past the data or the end marker is missing
+    bool ParseCategories() {
+        name.clear();
+        inputPdos.clear();
+        outputPdos.clear();
+        inputBits = 0;
+        outputBits = 0;
+        mailboxOutStart = 0;
+        mailboxOutSize = 0;
+        mailboxInStart = 0;
+        mailboxInSize = 0;
+        syncManagers.clear();
+        coeDetails = 0;
+        std::vector<std::string> strings;
+        uint8_t nameIndex = 0;
+
+        size_t at = 0;
+        while (at + 2 <= categories.size()) {
+            uint16_t type = EcatGet16(&categories[at]);
+            if (type == SII_CAT_END) {
+                if (nameIndex && nameIndex <= strings.size()) {
+                    name = strings[nameIndex - 1];
+                }
+                return true;
+            }
+            if (at + 4 > categories.size()) {
+                break;
+            }
+            size_t size = EcatGet16(&categories[at + 2]) * size_t(2);
+            const uint8_t* pData = &categories[at + 4];
+            if (at + 4 + size > categories.size()) {
+                break;
+            }
+            if (type == SII_CAT_STRINGS && size) {
+                size_t offset = 1;
+                for (uint8_t i = 0; i < pData[0] && offset < size; i++) {
+                    size_t length = std::min<size_t>(pData[offset], size - offset - 1);
+                    strings.emplace_back(reinterpret_cast<const char*>(pData + offset + 1), length);
+                    offset += 1 + length;
+                }
+            } else if (type == SII_CAT_GENERAL && size >= 6) {
+                nameIndex = pData[3];
+                coeDetails = pData[5];
+            } else if (type == SII_CAT_SYNCM) {
+                for (size_t offset = 0; offset + ESC_SM_SIZE <= size; offset += ESC_SM_SIZE) {
+                    const uint8_t* pSm = pData + offset;
+                    SlaveSyncManager sm = { EcatGet16(pSm + ESC_SM_START), EcatGet16(pSm + ESC_SM_LENGTH),
+                                            pSm[ESC_SM_CONTROL], pSm[6], pSm[7] };
+                    syncManagers.push_back(sm);
+                    if (pSm[7] == SII_SM_MAILBOX_OUT) {
+                        mailboxOutStart = EcatGet16(pSm + ESC_SM_START);
+                        mailboxOutSize = EcatGet16(pSm + ESC_SM_LENGTH);
+                    } else if (pSm[7] == SII_SM_MAILBOX_IN) {
+                        mailboxInStart = EcatGet16(pSm + ESC_SM_START);
+                        mailboxInSize = EcatGet16(pSm + ESC_SM_LENGTH);
+                    }
+                }
+            } else if (type == SII_CAT_TXPDO || type == SII_CAT_RXPDO) {
+                std::vector<SlavePdo>& pdos = (type == SII_CAT_TXPDO) ? inputPdos : outputPdos;
+                uint32_t& bits = (type == SII_CAT_TXPDO) ? inputBits : outputBits;
+                size_t offset = 0;
+                while (offset + 8 <= size) {
+                    SlavePdo pdo;
+                    pdo.index = EcatGet16(pData + offset);
+                    pdo.syncManager = pData[offset + 3];
+                    uint8_t count = pData[offset + 2];
+                    offset += 8;
+                    for (uint8_t i = 0; i < count && offset + 8 <= size; i++, offset += 8) {
+                        SlavePdoEntry entry = { EcatGet16(pData + offset), pData[offset + 2], pData[offset + 5] };
+                        pdo.entries.push_back(entry);
+                        bits += entry.bitLength;
+                    }
+                    pdos.push_back(pdo);
+                }
+            }
+            at += 4 + size;
+        }
+        return false;
+    }
+};
+
+// Reads SII EEPROMs through the ESC's EEPROM interface, every slave at
+// once: one frame issues the read command (control and word address in
+// one APWR per slave), the next frames poll control, address and data
+// together (APRD 0x0502, 14 bytes) until no slave is busy. Each slave
+// reads at its own address and in its own read size, so slaves with
+// longer category areas simply take more steps than the others.
+class SiiReader {
+public:
+    struct Settings {
+        long frameTimeoutUs;         // per command or poll frame
+        long busyTimeoutUs;          // per read step
+        uint32_t maxBytes;           // category area limit (16 KB EEPROM)
+
+        Settings() : frameTimeoutUs(100000), busyTimeoutUs(20000), maxBytes(0x4000) {}
+    };
+
+private:
+    // Where one slave's read has got to
+    struct Cursor {
+        uint16_t position;
+        uint32_t word;
+        std::vector<uint8_t>* pBytes;
+    };
+
+    Settings m_settings;
+    unsigned long m_steps;
+    std::vector<uint8_t> m_commands;
+
+    static uint32_t AutoIncrement(uint16_t position, uint16_t offset) {
+        return EcatPhysicalAddress(static_cast<uint16_t>(-static_cast<int>(position)), offset);
+    }
+
+    // True once the end marker has been read
+    static bool IsCategoryAreaComplete(const std::vector<uint8_t>& bytes) {
+        size_t at = 0;
+        while (at + 2 <= bytes.size()) {
+            if (EcatGet16(&bytes[at]) == SII_CAT_END) {
+                return true;
+            }
+            if (at + 4 > bytes.size()) {
+                return false;
+            }
+            at += 4 + EcatGet16(&bytes[at + 2]) * size_t(2);
+        }
+        return false;
+    }
+
+    // One read command for every cursor, then polls until each slave has
+    // its data. Appends 4 or 8 bytes to each cursor and advances it.
+    bool ReadStep(FrameTransport& transport, EtherCATDatagramPacker& packer, std::vector<Cursor>& cursors) {
+        m_commands.assign(cursors.size() * 6, 0);
+        packer.Clear();
+        for (size_t i = 0; i < cursors.size(); i++) {
+            EcatPut16(&m_commands[i * 6], ESC_SII_CMD_READ);
+            EcatPut32(&m_commands[i * 6 + 2], cursors[i].word);
+            packer.Add(ECAT_APWR, AutoIncrement(cursors[i].position, ESC_REG_SII_CONTROL), 6, &m_commands[i * 6]);
+        }
+        m_steps++;
+        if (!packer.Send(transport) || !packer.Receive(transport, m_settings.frameTimeoutUs)) {
+            LogError() << "Error: SII read command frame lost";
+            return false;
+        }
+
+        std::vector<size_t> busy;
+        for (size_t i = 0; i < cursors.size(); i++) {
+            busy.push_back(i);
+        }
+        std::vector<size_t> polled;
+        auto start = std::chrono::steady_clock::now();
+        while (!busy.empty()) {
+            polled.swap(busy);
+            busy.clear();
+            packer.Clear();
+            for (size_t i : polled) {
+                packer.Add(ECAT_APRD, AutoIncrement(cursors[i].position, ESC_REG_SII_CONTROL), 14);
+            }
+            if (!packer.Send(transport)) {
+                return false;
+            }
+            packer.Receive(transport, m_settings.frameTimeoutUs);
+            bool bTimedOut = std::chrono::steady_clock::now() - start >=
+                             std::chrono::microseconds(m_settings.busyTimeoutUs);
+            for (size_t id = 0; id < polled.size(); id++) {
+                Cursor& cursor = cursors[polled[id]];
+                bool bAnswered = packer.IsReceived(id) && packer.GetWkc(id) == 1;
+                uint16_t status = bAnswered ? EcatGet16(packer.GetData(id)) : ESC_SII_BUSY;
+                if ((status & ESC_SII_BUSY) && !bTimedOut) {
+                    busy.push_back(polled[id]);
+                } else if (status & (ESC_SII_BUSY | ESC_SII_ERROR_CMD)) {
+                    LogError() << "Error: Slave " << cursor.position << " SII read at word 0x" << std::hex
+                               << cursor.word << std::dec << ((status & ESC_SII_BUSY) ? " timed out" : " failed");
+                    return false;
+                } else {
+                    size_t bytes = (status & ESC_SII_READ_8) ? 8 : 4;
+                    const uint8_t* pData = packer.GetData(id) + 6;
+                    cursor.pBytes->insert(cursor.pBytes->end(), pData, pData + bytes);
+                    cursor.word += static_cast<uint32_t>(bytes / 2);
+                }
+            }
+            if (!busy.empty()) {
+                std::this_thread::sleep_for(std::chrono::microseconds(20));
+            }
+        }
+        return true;
+    }
+
+public:
+    SiiReader() : m_steps(0) {}
+
+    void SetSettings(const Settings& settings) {
+        m_settings = settings;
+    }
+
+    // Read steps so far, each one command frame plus polls
+    unsigned long GetSteps() const {
+        return m_steps;
+    }
+
+    // Gives the EtherCAT side access to every EEPROM
+    bool TakeAccess(FrameTransport& transport, EtherCATDatagramPacker& packer) {
+        uint8_t config = 0;
+        packer.Clear();
+        packer.Add(ECAT_BWR, EcatPhysicalAddress(0, ESC_REG_SII_CONFIG), 1, &config);
+        if (!packer.Send(transport) || !packer.Receive(transport, m_settings.frameTimeoutUs)) {
+            LogError() << "Error: SII access frame lost";
+            return false;
+        }
+        return true;
+    }
+
+    // Vendor, product, revision and serial of every slave: two steps with
+    // 8-byte reads
+    bool ReadIdentities(FrameTransport& transport, EtherCATDatagramPacker& packer, uint16_t slaveCount,
+                        std::vector<SlaveIdentity>& identities) {
+        std::vector<std::vector<uint8_t>> words(slaveCount);
+        std::vector<Cursor> cursors;
+        for (uint16_t position = 0; position < slaveCount; position++) {
+            cursors.push_back(Cursor{ position, SII_VENDOR_ID, &words[position] });
+        }
+        while (!cursors.empty()) {
+            if (!ReadStep(transport, packer, cursors)) {
+                return false;
+            }
+            cursors.erase(std::remove_if(cursors.begin(), cursors.end(), [](const Cursor& cursor) {
+                return cursor.pBytes->size() >= 16;
+            }), cursors.end());
+        }
+        identities.resize(slaveCount);
+        for (uint16_t position = 0; position < slaveCount; position++) {
+            const uint8_t* p = words[position].data();
+            identities[position] = SlaveIdentity{ EcatGet32(p), EcatGet32(p + 4), EcatGet32(p + 8), EcatGet32(p + 12) };
+        }
+        return true;
+    }
+
+    // Identity and the whole category area of every slave
+    bool ReadAll(FrameTransport& transport, EtherCATDatagramPacker& packer, uint16_t slaveCount,
+                 std::vector<SlaveInfo>& slaves) {
+        std::vector<SlaveIdentity> identities;
+        if (!ReadIdentities(transport, packer, slaveCount, identities)) {
+            return false;
+        }
+        slaves.assign(slaveCount, SlaveInfo());
+        std::vector<Cursor> cursors;
+        for (uint16_t position = 0; position < slaveCount; position++) {
+            slaves[position].identity = identities[position];
+            cursors.push_back(Cursor{ position, SII_FIRST_CATEGORY, &slaves[position].categories });
+        }
+        while (!cursors.empty()) {
+            if (!ReadStep(transport, packer, cursors)) {
+                return false;
+            }
+            for (Cursor& cursor : cursors) {
+                if (cursor.pBytes->size() >= m_settings.maxBytes && !IsCategoryAreaComplete(*cursor.pBytes)) {
+                    LogError() << "Error: Slave " << cursor.position << " SII has no category end within "
+                               << m_settings.maxBytes << " bytes";
+                    return false;
+                }
+            }
+            cursors.erase(std::remove_if(cursors.begin(), cursors.end(), [](const Cursor& cursor) {
+                return IsCategoryAreaComplete(*cursor.pBytes);
+            }), cursors.end());
+        }
+        for (uint16_t position = 0; position < slaveCount; position++) {
+            SlaveInfo& slave = slaves[position];
+            if (!slave.ParseCategories()) {
+                LogWarning() << "Warning: Slave " << position << " SII categories are malformed";
+            }
+        }
+        return true;
+    }
+};
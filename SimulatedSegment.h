@@ -0,0 +1,1249 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <deque>
+#include <map>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "EscRegisters.h"
+#include "EtherCATConfig.h"
+#include "EtherCATFrame.h"
+#include "Logger.h"
+
+// Virtual EtherCAT line: a chain of emulated slave controllers that process
+// frames in place the way real ESCs do on the fly. Each slave has its own
+// register space and process data RAM; the emulation covers
+//   - APxx/FPxx/BRx/LRx/ARMW/FRMW addressing and working-counter rules
+//   - the AL state machine behind AL control/status (0x0120/0x0130/0x0134)
+//   - FMMU logical mapping, active in SAFEOP and OP only
+//   - distributed clocks: drifting local clocks, receive-time latches,
+//     system time offset/delay and the time control loop on 0x0910
+//   - the SII EEPROM behind 0x0500-0x050F, with identity, strings,
+//     general, sync manager and PDO categories and a modelled read time
+//   - mailboxes on SM0/SM1 from PREOP on, with a CoE SDO server
+//     (expedited, normal and segmented transfers, complete access) over
+//     a small object dictionary and a modelled response time; mailbox
+//     counters and the SM1 repeat request
+//   - a return delay from wire time and per-slave forwarding delay
+// SimulatedTransport runs it in-process; ecat_sim puts it behind a veth or
+// TAP peer so an unmodified master drives it over a real socket.
+class SimulatedSegment {
+public:
+    static const uint16_t kMemorySize = 0x1A00;               // registers + PD RAM + mailboxes
+    static const uint16_t kOutputRam = ESC_REG_PDRAM;         // SM2
+    static const uint16_t kInputRam = ESC_REG_PDRAM + 0x400;  // SM3
+    static const uint8_t kOutputControl = 0x64;               // buffered, ECAT writes
+    static const uint8_t kInputControl = 0x20;                // buffered, ECAT reads
+    static const uint16_t kMaxProcessData = 0x400;            // per direction and slave
+    static const uint16_t kMailboxOut = 0x1800;               // SM0
+    static const uint16_t kMailboxIn = 0x1900;                // SM1
+    static const uint16_t kMailboxSize = 128;
+    static const uint8_t kMailboxOutControl = 0x26;           // mailbox, ECAT writes
+    static const uint8_t kMailboxInControl = 0x22;            // mailbox, ECAT reads
+
+    struct Settings {
+        uint32_t forwardingDelayNs;   // per slave, both directions together
+        uint32_t linkMbps;            // wire time of the frame itself
+        uint8_t initialState;         // AL state after power-up
+        uint32_t stateChangeDelayUs;  // time a slave takes to confirm a transition
+        uint32_t maxDriftPpm;         // DC crystal tolerance, spread over the slaves
+        uint32_t siiReadDelayUs;      // EEPROM busy time per read command
+        uint32_t sdoDelayUs;          // time a slave takes to answer a mailbox request
+        uint32_t loseEvery;           // every Nth process data frame never returns (0: none)
+    };
+
+    struct Stats {
+        unsigned long frames;
+        unsigned long datagrams;
+        unsigned long malformed;
+        unsigned long stateChanges;
+        unsigned long mailboxRequests;
+        unsigned long mailboxRepeats;   // SM1 repeat requests served
+        unsigned long framesLost;
+    };
+
+private:
+    // Normal SDO transfer in progress: a download collects segments, an
+    // upload hands them out
+    struct SdoTransfer {
+        bool bActive;
+        bool bUpload;
+        bool bCompleteAccess;
+        uint16_t index;
+        uint8_t subIndex;
+        uint8_t toggle;
+        uint32_t size;
+        std::vector<uint8_t> data;
+        size_t offset;
+    };
+
+    struct Slave {
+        std::string name;
+        uint32_t vendorId;
+        uint32_t productCode;
+        uint32_t revision;
+        uint32_t serial;
+        uint16_t inputSize;
+        uint16_t outputSize;
+        uint32_t inputCounter;        // slave application: counts process data reads
+        uint8_t pendingState;         // requested, not yet confirmed
+        std::chrono::steady_clock::time_point pendingDue;
+        std::vector<uint8_t> memory;
+        std::vector<uint8_t> eeprom;
+        bool bSiiBusy;
+        std::chrono::steady_clock::time_point siiDue;
+
+        // Mailbox: a request sits in SM0 until the slave has answered it;
+        // answers wait in line for SM1. objects is the CoE object
+        // dictionary, (index << 8 | subindex) -> value.
+        bool bMailboxOutFull;
+        std::chrono::steady_clock::time_point mailboxDue;
+        std::deque<std::vector<uint8_t>> replies;
+        bool bMailboxInFull;
+        std::vector<uint8_t> lastReply;   // last one read from SM1, for a repeat request
+        uint8_t replyCounter;             // mailbox header counter of the last reply, 1-7
+        uint8_t requestCounter;           // of the last request served; a repeat is dropped
+        std::map<uint32_t, std::vector<uint8_t>> objects;
+        SdoTransfer transfer;
+
+        // Distributed clock: local time = clockBaseLocalNs + (host time -
+        // clockBaseHostNs) * clockRate. The control loop trims the rate
+        // within +-100 ppm of the crystal's own.
+        double drift;
+        double clockRate;
+        int64_t clockBaseHostNs;
+        int64_t clockBaseLocalNs;
+        int64_t lastSyncHostNs;
+    };
+
+    Settings m_settings;
+    Stats m_stats;
+    std::vector<Slave> m_slaves;
+    std::vector<uint8_t> m_scratch;
+    std::unordered_map<uint16_t, size_t> m_stationIndex;   // station address -> position
+    bool m_bStationsDirty;
+    size_t m_pendingChanges;
+    int64_t m_frameHostNs;        // when the running frame left the master
+    size_t m_pendingMailboxes;
+    bool m_bExternalInputs;       // SetInputs() replaced the counter samples
+    unsigned long m_processFrames;  // frames with logical datagrams, for loseEvery
+
+    static int64_t HostNowNs() {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
+    // The frame passes slave i on the way out after i hops and on the way
+    // back after 2 * (count - 1) - i; a hop is half the forwarding delay
+    int64_t OutboundNs(const Slave& slave) const {
+        return m_frameHostNs + (&slave - m_slaves.data()) * (m_settings.forwardingDelayNs / 2);
+    }
+
+    int64_t ReturnNs(const Slave& slave) const {
+        int64_t hops = 2 * (static_cast<int64_t>(m_slaves.size()) - 1) - (&slave - m_slaves.data());
+        return m_frameHostNs + hops * (m_settings.forwardingDelayNs / 2);
+    }
+
+    static int64_t LocalTimeNs(const Slave& slave, int64_t hostNs) {
+        return slave.clockBaseLocalNs + static_cast<int64_t>((hostNs - slave.clockBaseHostNs) * slave.clockRate);
+    }
+
+    static int64_t SystemTimeNs(const Slave& slave, int64_t hostNs) {
+        return LocalTimeNs(slave, hostNs) + static_cast<int64_t>(EcatGet64(&slave.memory[ESC_REG_DC_TIME_OFFSET]));
+    }
+
+    // Write to 0x0900: port 0 and port 1 (the returning frame) receive
+    // times; the last slave closes the line, so its port 1 stays unused
+    void LatchReceiveTimes(Slave& slave) {
+        int64_t port0 = LocalTimeNs(slave, OutboundNs(slave));
+        EcatPut32(&slave.memory[ESC_REG_DC_RECEIVE_TIME], static_cast<uint32_t>(port0));
+        EcatPut32(&slave.memory[ESC_REG_DC_RECEIVE_TIME + 4],
+                  (&slave == &m_slaves.back()) ? 0 : static_cast<uint32_t>(LocalTimeNs(slave, ReturnNs(slave))));
+        EcatPut64(&slave.memory[ESC_REG_DC_RECEIVE_TIME_PU], static_cast<uint64_t>(port0));
+    }
+
+    // Write to 0x0910: compare with the own system time, delay-corrected,
+    // and correct half the deviation at once and the rest through speed
+    void OnSystemTimeWrite(Slave& slave, uint16_t length) {
+        int64_t now = OutboundNs(slave);
+        int64_t own = SystemTimeNs(slave, now);
+        uint64_t received = EcatGet64(&slave.memory[ESC_REG_DC_SYSTEM_TIME]);
+        if (length < 8) {
+            received = (static_cast<uint64_t>(own) & 0xFFFFFFFF00000000ULL) | static_cast<uint32_t>(received);
+        }
+        int64_t diff = static_cast<int64_t>(received) + EcatGet32(&slave.memory[ESC_REG_DC_TIME_DELAY]) - own;
+        uint32_t magnitude = static_cast<uint32_t>(std::min<int64_t>(diff < 0 ? -diff : diff, 0x7FFFFFFF));
+        EcatPut32(&slave.memory[ESC_REG_DC_TIME_DIFF], magnitude | (diff > 0 ? 0x80000000u : 0));
+
+        slave.clockBaseLocalNs = LocalTimeNs(slave, now) + diff / 2;
+        slave.clockBaseHostNs = now;
+        if (slave.lastSyncHostNs && now > slave.lastSyncHostNs) {
+            double trim = slave.clockRate - (1.0 + slave.drift) + 0.25 * diff / (now - slave.lastSyncHostNs);
+            slave.clockRate = 1.0 + slave.drift + std::max(-1e-4, std::min(1e-4, trim));
+        }
+        slave.lastSyncHostNs = now;
+    }
+
+    static void PutCategory(std::vector<uint8_t>& image, uint16_t type, const std::vector<uint8_t>& data) {
+        size_t at = image.size();
+        image.resize(at + 4 + data.size() + (data.size() & 1), 0);
+        EcatPut16(&image[at], type);
+        EcatPut16(&image[at + 2], static_cast<uint16_t>((data.size() + 1) / 2));
+        std::copy(data.begin(), data.end(), image.begin() + at + 4);
+    }
+
+    // One PDO category: PDOs of up to 32 entries, 32-bit entries while at
+    // least 4 bytes are left, then bytes
+    static std::vector<uint8_t> PdoCategory(uint16_t pdoIndex, uint16_t entryIndex, uint8_t syncManager,
+                                            uint16_t bytes) {
+        std::vector<uint8_t> data;
+        uint8_t subIndex = 1;
+        while (bytes) {
+            size_t header = data.size();
+            data.resize(header + 8, 0);
+            EcatPut16(&data[header], pdoIndex++);
+            data[header + 3] = syncManager;
+            uint8_t entries = 0;
+            while (bytes && entries < 32) {
+                uint8_t width = bytes >= 4 ? 4 : 1;
+                uint8_t entry[8] = { 0 };
+                EcatPut16(entry, entryIndex);
+                entry[2] = subIndex++;
+                entry[4] = width == 4 ? 0x07 : 0x05;        // UDINT / USINT
+                entry[5] = static_cast<uint8_t>(width * 8);
+                data.insert(data.end(), entry, entry + sizeof(entry));
+                bytes = static_cast<uint16_t>(bytes - width);
+                entries++;
+            }
+            data[header + 2] = entries;
+        }
+        return data;
+    }
+
+    // EEPROM contents of a slave as its vendor would have flashed them
+    static void BuildEeprom(Slave& slave) {
+        std::vector<uint8_t>& image = slave.eeprom;
+        image.assign(SII_FIRST_CATEGORY * 2, 0);
+        EcatPut32(&image[SII_VENDOR_ID * 2], slave.vendorId);
+        EcatPut32(&image[SII_PRODUCT_CODE * 2], slave.productCode);
+        EcatPut32(&image[SII_REVISION * 2], slave.revision);
+        EcatPut32(&image[SII_SERIAL * 2], slave.serial);
+        EcatPut16(&image[0x0018 * 2], kMailboxOut);        // standard mailbox
+        EcatPut16(&image[0x0019 * 2], kMailboxSize);
+        EcatPut16(&image[0x001A * 2], kMailboxIn);
+        EcatPut16(&image[0x001B * 2], kMailboxSize);
+        EcatPut16(&image[0x001C * 2], 0x0004);             // protocols: CoE
+        EcatPut16(&image[0x003E * 2], 0x0007);             // 1 KB EEPROM
+        EcatPut16(&image[0x003F * 2], 0x0001);             // SII version
+
+        std::vector<uint8_t> strings(1, 1);
+        strings.push_back(static_cast<uint8_t>(std::min<size_t>(slave.name.size(), 255)));
+        strings.insert(strings.end(), slave.name.begin(), slave.name.begin() + strings.back());
+        PutCategory(image, SII_CAT_STRINGS, strings);
+
+        std::vector<uint8_t> general(32, 0);
+        general[3] = 1;                                    // name: string 1
+        general[5] = SII_COE_SDO | SII_COE_COMPLETE_ACCESS;
+        PutCategory(image, SII_CAT_GENERAL, general);
+
+        std::vector<uint8_t> syncManagers(4 * ESC_SM_SIZE, 0);
+        EcatPut16(&syncManagers[0], kMailboxOut);
+        EcatPut16(&syncManagers[2], kMailboxSize);
+        syncManagers[4] = kMailboxOutControl;
+        syncManagers[6] = 0x01;
+        syncManagers[7] = SII_SM_MAILBOX_OUT;
+        EcatPut16(&syncManagers[ESC_SM_SIZE], kMailboxIn);
+        EcatPut16(&syncManagers[ESC_SM_SIZE + 2], kMailboxSize);
+        syncManagers[ESC_SM_SIZE + 4] = kMailboxInControl;
+        syncManagers[ESC_SM_SIZE + 6] = 0x01;
+        syncManagers[ESC_SM_SIZE + 7] = SII_SM_MAILBOX_IN;
+        EcatPut16(&syncManagers[2 * ESC_SM_SIZE], kOutputRam);
+        EcatPut16(&syncManagers[2 * ESC_SM_SIZE + 2], slave.outputSize);
+        syncManagers[2 * ESC_SM_SIZE + 4] = kOutputControl;
+        syncManagers[2 * ESC_SM_SIZE + 6] = slave.outputSize ? 0x01 : 0x00;
+        syncManagers[2 * ESC_SM_SIZE + 7] = SII_SM_OUTPUTS;
+        EcatPut16(&syncManagers[3 * ESC_SM_SIZE], kInputRam);
+        EcatPut16(&syncManagers[3 * ESC_SM_SIZE + 2], slave.inputSize);
+        syncManagers[3 * ESC_SM_SIZE + 4] = kInputControl;
+        syncManagers[3 * ESC_SM_SIZE + 6] = slave.inputSize ? 0x01 : 0x00;
+        syncManagers[3 * ESC_SM_SIZE + 7] = SII_SM_INPUTS;
+        PutCategory(image, SII_CAT_SYNCM, syncManagers);
+
+        if (slave.inputSize) {
+            PutCategory(image, SII_CAT_TXPDO, PdoCategory(0x1A00, 0x6000, 3, slave.inputSize));
+        }
+        if (slave.outputSize) {
+            PutCategory(image, SII_CAT_RXPDO, PdoCategory(0x1600, 0x7000, 2, slave.outputSize));
+        }
+        image.push_back(0xFF);
+        image.push_back(0xFF);
+    }
+
+    // Write to 0x0502: only reads are supported; the data shows up when
+    // the EEPROM is done
+    void OnSiiCommand(Slave& slave) {
+        uint16_t command = EcatGet16(&slave.memory[ESC_REG_SII_CONTROL]);
+        if (!(command & ESC_SII_CMD_READ)) {
+            EcatPut16(&slave.memory[ESC_REG_SII_CONTROL],
+                      static_cast<uint16_t>(ESC_SII_READ_8 | ((command & 0x0700) ? ESC_SII_ERROR_CMD : 0)));
+            return;
+        }
+        EcatPut16(&slave.memory[ESC_REG_SII_CONTROL], static_cast<uint16_t>(ESC_SII_READ_8 | ESC_SII_BUSY));
+        slave.bSiiBusy = true;
+        slave.siiDue = std::chrono::steady_clock::now() + std::chrono::microseconds(m_settings.siiReadDelayUs);
+    }
+
+    void CompleteSiiRead(Slave& slave) {
+        size_t address = EcatGet32(&slave.memory[ESC_REG_SII_ADDRESS]) * size_t(2);
+        for (size_t i = 0; i < 8; i++) {
+            slave.memory[ESC_REG_SII_DATA + i] = address + i < slave.eeprom.size() ? slave.eeprom[address + i] : 0xFF;
+        }
+        EcatPut16(&slave.memory[ESC_REG_SII_CONTROL], ESC_SII_READ_8);
+        slave.bSiiBusy = false;
+    }
+
+    static uint32_t ObjectKey(uint16_t index, uint8_t subIndex) {
+        return static_cast<uint32_t>(index) << 8 | subIndex;
+    }
+
+    static void SetObject(Slave& slave, uint16_t index, uint8_t subIndex, uint32_t value, size_t size) {
+        std::vector<uint8_t>& object = slave.objects[ObjectKey(index, subIndex)];
+        object.resize(size);
+        for (size_t i = 0; i < size; i++) {
+            object[i] = static_cast<uint8_t>(value >> (8 * i));
+        }
+    }
+
+    // Device type, name, identity and PDO assignment; downloads to any
+    // other object create it, as vendor parameters would be there
+    static void BuildObjectDictionary(Slave& slave) {
+        SetObject(slave, 0x1000, 0, 0x00001389, 4);
+        slave.objects[ObjectKey(0x1008, 0)].assign(slave.name.begin(), slave.name.end());
+        SetObject(slave, 0x1018, 0, 4, 1);
+        SetObject(slave, 0x1018, 1, slave.vendorId, 4);
+        SetObject(slave, 0x1018, 2, slave.productCode, 4);
+        SetObject(slave, 0x1018, 3, slave.revision, 4);
+        SetObject(slave, 0x1018, 4, slave.serial, 4);
+        SetObject(slave, 0x1C12, 0, slave.outputSize ? 1 : 0, 1);
+        SetObject(slave, 0x1C12, 1, 0x1600, 2);
+        SetObject(slave, 0x1C13, 0, slave.inputSize ? 1 : 0, 1);
+        SetObject(slave, 0x1C13, 1, 0x1A00, 2);
+    }
+
+    // Complete access: subindex 0 padded to two bytes (if included), then
+    // subindex 1 up to the value of subindex 0
+    static bool ReadComplete(const Slave& slave, uint16_t index, uint8_t subIndex, std::vector<uint8_t>& data) {
+        auto count = slave.objects.find(ObjectKey(index, 0));
+        if (count == slave.objects.end() || count->second.empty() || subIndex > 1) {
+            return false;
+        }
+        data.clear();
+        if (subIndex == 0) {
+            data.push_back(count->second[0]);
+            data.push_back(0);
+        }
+        for (unsigned sub = 1; sub <= count->second[0]; sub++) {
+            auto entry = slave.objects.find(ObjectKey(index, static_cast<uint8_t>(sub)));
+            if (entry != slave.objects.end()) {
+                data.insert(data.end(), entry->second.begin(), entry->second.end());
+            }
+        }
+        return true;
+    }
+
+    // Splits the data by the sizes of the existing subindexes; new ones
+    // share what is left evenly
+    static void WriteComplete(Slave& slave, uint16_t index, uint8_t subIndex, const std::vector<uint8_t>& data) {
+        size_t at = 0;
+        unsigned count = 0;
+        if (subIndex == 0 && data.size() >= 2) {
+            count = data[0];
+            slave.objects[ObjectKey(index, 0)].assign(1, data[0]);
+            at = 2;
+        } else {
+            auto existing = slave.objects.find(ObjectKey(index, 0));
+            count = (existing != slave.objects.end() && !existing->second.empty()) ? existing->second[0] : 1;
+        }
+        for (unsigned sub = 1; sub <= count && at < data.size(); sub++) {
+            std::vector<uint8_t>& entry = slave.objects[ObjectKey(index, static_cast<uint8_t>(sub))];
+            size_t width = entry.empty() ? std::max<size_t>(1, (data.size() - at) / (count - sub + 1)) : entry.size();
+            width = std::min(width, data.size() - at);
+            entry.assign(data.begin() + at, data.begin() + at + width);
+            at += width;
+        }
+    }
+
+    // 0 or the abort code
+    static uint32_t StoreObject(Slave& slave, uint16_t index, uint8_t subIndex, bool bCompleteAccess,
+                                const std::vector<uint8_t>& data) {
+        if (index == 0x1000 || index == 0x1008 || index == 0x1018) {
+            return 0x06010002;          // read-only
+        }
+        if (bCompleteAccess) {
+            if (subIndex > 1) {
+                return SDO_ABORT_NO_SUBINDEX;
+            }
+            WriteComplete(slave, index, subIndex, data);
+            return 0;
+        }
+        auto entry = slave.objects.find(ObjectKey(index, subIndex));
+        if (entry != slave.objects.end() && entry->second.size() != data.size()) {
+            return SDO_ABORT_LENGTH;
+        }
+        slave.objects[ObjectKey(index, subIndex)] = data;
+        return 0;
+    }
+
+    // 0 or the abort code
+    static uint32_t FetchObject(const Slave& slave, uint16_t index, uint8_t subIndex, bool bCompleteAccess,
+                                std::vector<uint8_t>& data) {
+        if (bCompleteAccess) {
+            return ReadComplete(slave, index, subIndex, data) ? 0 : SDO_ABORT_NO_OBJECT;
+        }
+        auto entry = slave.objects.find(ObjectKey(index, subIndex));
+        if (entry == slave.objects.end()) {
+            auto any = slave.objects.lower_bound(ObjectKey(index, 0));
+            bool bIndexExists = any != slave.objects.end() && (any->first >> 8) == index;
+            return bIndexExists ? SDO_ABORT_NO_SUBINDEX : SDO_ABORT_NO_OBJECT;
+        }
+        data = entry->second;
+        return 0;
+    }
+
+    void LoadReply(Slave& slave) {
+        std::copy(slave.replies.front().begin(), slave.replies.front().end(), slave.memory.begin() + kMailboxIn);
+        slave.bMailboxInFull = true;
+        slave.memory[ESC_REG_SM0 + ESC_SM_SIZE + ESC_SM_STATUS] |= ESC_SM_MAILBOX_FULL;
+    }
+
+    // A CoE SDO response of sdoLength bytes, queued for SM1
+    uint8_t* PostSdoResponse(Slave& slave, size_t sdoLength) {
+        slave.replies.emplace_back(static_cast<size_t>(kMailboxSize), 0);
+        std::vector<uint8_t>& reply = slave.replies.back();
+        EcatPut16(&reply[0], static_cast<uint16_t>(2 + sdoLength));
+        slave.replyCounter = static_cast<uint8_t>(slave.replyCounter % 7 + 1);
+        reply[5] = static_cast<uint8_t>(ECAT_MBX_TYPE_COE | (slave.replyCounter << 4));
+        EcatPut16(&reply[6], static_cast<uint16_t>(COE_SERVICE_SDO_RESPONSE << 12));
+        return &reply[8];
+    }
+
+    void ShowReply(Slave& slave) {
+        if (!slave.bMailboxInFull) {
+            LoadReply(slave);
+        }
+    }
+
+    void SdoAbort(Slave& slave, uint16_t index, uint8_t subIndex, uint32_t code) {
+        slave.transfer.bActive = false;
+        uint8_t* pSdo = PostSdoResponse(slave, 8);
+        pSdo[0] = SDO_CCS_ABORT;
+        EcatPut16(pSdo + 1, index);
+        pSdo[3] = subIndex;
+        EcatPut32(pSdo + 4, code);
+        ShowReply(slave);
+    }
+
+    void SdoDownload(Slave& slave, const uint8_t* pSdo, size_t sdoLength) {
+        uint8_t command = pSdo[0];
+        uint16_t index = EcatGet16(pSdo + 1);
+        uint8_t subIndex = pSdo[3];
+        bool bCompleteAccess = (command & SDO_COMPLETE_ACCESS) != 0;
+        SdoTransfer& transfer = slave.transfer;
+        transfer.bActive = false;
+        std::vector<uint8_t> data;
+        if (command & SDO_EXPEDITED) {
+            size_t size = (command & SDO_SIZE_INDICATED) ? 4 - ((command >> 2) & 0x03) : 4;
+            data.assign(pSdo + 4, pSdo + 4 + size);
+        } else {
+            uint32_t size = EcatGet32(pSdo + 4);
+            size_t bytes = std::min<size_t>(sdoLength - 8, size);
+            data.assign(pSdo + 8, pSdo + 8 + bytes);
+            if (bytes < size) {
+                transfer = SdoTransfer{ true, false, bCompleteAccess, index, subIndex, 0, size, data, 0 };
+            }
+        }
+        if (!transfer.bActive) {
+            if (uint32_t abort = StoreObject(slave, index, subIndex, bCompleteAccess, data)) {
+                SdoAbort(slave, index, subIndex, abort);
+                return;
+            }
+        }
+        uint8_t* pReply = PostSdoResponse(slave, 8);
+        pReply[0] = SDO_SCS_DOWNLOAD;
+        EcatPut16(pReply + 1, index);
+        pReply[3] = subIndex;
+        ShowReply(slave);
+    }
+
+    void SdoDownloadSegment(Slave& slave, const uint8_t* pSdo, size_t sdoLength) {
+        uint8_t command = pSdo[0];
+        SdoTransfer& transfer = slave.transfer;
+        if (!transfer.bActive || transfer.bUpload) {
+            SdoAbort(slave, 0, 0, SDO_ABORT_COMMAND);
+            return;
+        }
+        if ((command & SDO_TOGGLE) != transfer.toggle) {
+            SdoAbort(slave, transfer.index, transfer.subIndex, SDO_ABORT_TOGGLE);
+            return;
+        }
+        // A minimal (7-byte) segment says how much of it is used
+        size_t bytes = (sdoLength == 8) ? 7 - ((command >> 1) & 0x07) : sdoLength - 1;
+        bytes = std::min<size_t>(bytes, transfer.size - transfer.data.size());
+        transfer.data.insert(transfer.data.end(), pSdo + 1, pSdo + 1 + bytes);
+        bool bLast = (command & SDO_LAST_SEGMENT) || transfer.data.size() >= transfer.size;
+        if (bLast) {
+            transfer.bActive = false;
+            if (uint32_t abort = StoreObject(slave, transfer.index, transfer.subIndex, transfer.bCompleteAccess,
+                                             transfer.data)) {
+                SdoAbort(slave, transfer.index, transfer.subIndex, abort);
+                return;
+            }
+        }
+        uint8_t* pReply = PostSdoResponse(slave, 8);
+        pReply[0] = static_cast<uint8_t>(SDO_SCS_DOWNLOAD_SEGMENT | transfer.toggle);
+        transfer.toggle ^= SDO_TOGGLE;
+        ShowReply(slave);
+    }
+
+    void SdoUpload(Slave& slave, const uint8_t* pSdo) {
+        uint8_t command = pSdo[0];
+        uint16_t index = EcatGet16(pSdo + 1);
+        uint8_t subIndex = pSdo[3];
+        bool bCompleteAccess = (command & SDO_COMPLETE_ACCESS) != 0;
+        slave.transfer.bActive = false;
+        std::vector<uint8_t> data;
+        if (uint32_t abort = FetchObject(slave, index, subIndex, bCompleteAccess, data)) {
+            SdoAbort(slave, index, subIndex, abort);
+            return;
+        }
+        if (!data.empty() && data.size() <= 4 && !bCompleteAccess) {
+            uint8_t* pReply = PostSdoResponse(slave, 8);
+            pReply[0] = static_cast<uint8_t>(SDO_SCS_UPLOAD | SDO_EXPEDITED | SDO_SIZE_INDICATED |
+                                             ((4 - data.size()) << 2));
+            EcatPut16(pReply + 1, index);
+            pReply[3] = subIndex;
+            std::copy(data.begin(), data.end(), pReply + 4);
+            ShowReply(slave);
+            return;
+        }
+        size_t chunk = std::min<size_t>(data.size(), kMailboxSize - ECAT_MBX_HEADER_SIZE - 10);
+        uint8_t* pReply = PostSdoResponse(slave, 8 + chunk);
+        pReply[0] = static_cast<uint8_t>(SDO_SCS_UPLOAD | SDO_SIZE_INDICATED | (bCompleteAccess ? SDO_COMPLETE_ACCESS : 0));
+        EcatPut16(pReply + 1, index);
+        pReply[3] = subIndex;
+        EcatPut32(pReply + 4, static_cast<uint32_t>(data.size()));
+        std::copy(data.begin(), data.begin() + chunk, pReply + 8);
+        if (chunk < data.size()) {
+            slave.transfer = SdoTransfer{ true, true, bCompleteAccess, index, subIndex, 0,
+                                          static_cast<uint32_t>(data.size()), data, chunk };
+        }
+        ShowReply(slave);
+    }
+
+    void SdoUploadSegment(Slave& slave, const uint8_t* pSdo) {
+        uint8_t command = pSdo[0];
+        SdoTransfer& transfer = slave.transfer;
+        if (!transfer.bActive || !transfer.bUpload) {
+            SdoAbort(slave, 0, 0, SDO_ABORT_COMMAND);
+            return;
+        }
+        if ((command & SDO_TOGGLE) != transfer.toggle) {
+            SdoAbort(slave, transfer.index, transfer.subIndex, SDO_ABORT_TOGGLE);
+            return;
+        }
+        size_t chunk = std::min<size_t>(transfer.data.size() - transfer.offset,
+                                        kMailboxSize - ECAT_MBX_HEADER_SIZE - 3);
+        bool bLast = transfer.offset + chunk == transfer.data.size();
+        uint8_t* pReply = PostSdoResponse(slave, std::max<size_t>(8, 1 + chunk));
+        pReply[0] = static_cast<uint8_t>(SDO_SCS_UPLOAD_SEGMENT | transfer.toggle | (bLast ? SDO_LAST_SEGMENT : 0) |
+                                         (chunk < 7 ? (7 - chunk) << 1 : 0));
+        std::copy(transfer.data.begin() + transfer.offset, transfer.data.begin() + transfer.offset + chunk, pReply + 1);
+        transfer.offset += chunk;
+        transfer.toggle ^= SDO_TOGGLE;
+        transfer.bActive = !bLast;
+        ShowReply(slave);
+    }
+
+    // The request in SM0; only CoE SDO requests are served. A request with
+    // the counter of the one before is the master sending it again after
+    // a lost frame and was served already.
+    void OnMailboxRequest(Slave& slave) {
+        const uint8_t* p = &slave.memory[kMailboxOut];
+        size_t length = std::min<size_t>(EcatGet16(p), kMailboxSize - ECAT_MBX_HEADER_SIZE);
+        uint8_t counter = (p[5] >> 4) & 0x07;
+        if (counter && counter == slave.requestCounter) {
+            return;
+        }
+        slave.requestCounter = counter;
+        if ((p[5] & 0x0F) != ECAT_MBX_TYPE_COE || length < 2 + 8 ||
+            (EcatGet16(p + 6) >> 12) != COE_SERVICE_SDO_REQUEST) {
+            return;
+        }
+        const uint8_t* pSdo = p + 8;
+        switch (pSdo[0] & SDO_COMMAND_MASK) {
+        case SDO_CCS_DOWNLOAD: SdoDownload(slave, pSdo, length - 2); break;
+        case SDO_CCS_DOWNLOAD_SEGMENT: SdoDownloadSegment(slave, pSdo, length - 2); break;
+        case SDO_CCS_UPLOAD: SdoUpload(slave, pSdo); break;
+        case SDO_CCS_UPLOAD_SEGMENT: SdoUploadSegment(slave, pSdo); break;
+        case SDO_CCS_ABORT: slave.transfer.bActive = false; break;
+        default: SdoAbort(slave, EcatGet16(pSdo + 1), pSdo[3], SDO_ABORT_COMMAND); break;
+        }
+    }
+
+    void CompleteMailboxRequest(Slave& slave) {
+        OnMailboxRequest(slave);
+        slave.bMailboxOutFull = false;
+        slave.memory[ESC_REG_SM0 + ESC_SM_STATUS] &= static_cast<uint8_t>(~ESC_SM_MAILBOX_FULL);
+    }
+
+    void CompletePendingMailboxes() {
+        auto now = std::chrono::steady_clock::now();
+        for (Slave& slave : m_slaves) {
+            if (slave.bMailboxOutFull && slave.mailboxDue <= now) {
+                CompleteMailboxRequest(slave);
+                m_pendingMailboxes--;
+            }
+        }
+    }
+
+    // SM0 takes a request only while enabled and empty and once written up
+    // to its last byte; SM1 can only be read while enabled and full and is
+    // emptied by reading its last byte. Anything else is not answered, as
+    // on a real ESC.
+    uint16_t MailboxAccess(Slave& slave, uint16_t offset, uint8_t* pData, uint16_t length, bool bRead, bool bWrite) {
+        uint8_t state = slave.memory[ESC_REG_AL_STATUS] & ECAT_STATE_MASK;
+        if (state == ECAT_STATE_INIT || state == ECAT_STATE_BOOT || (bRead && bWrite)) {
+            return 0;
+        }
+        uint16_t sm = Overlaps(offset, length, kMailboxOut, kMailboxSize) ? 0 : 1;
+        if (!(slave.memory[ESC_REG_SM0 + sm * ESC_SM_SIZE + ESC_SM_ACTIVATE] & ESC_SM_ENABLE)) {
+            return 0;
+        }
+        if (Overlaps(offset, length, kMailboxOut, kMailboxSize)) {
+            if (!bWrite || slave.bMailboxOutFull) {
+                return 0;
+            }
+            for (uint16_t i = 0; i < length && offset + i < kMemorySize; i++) {
+                slave.memory[offset + i] = pData[i];
+            }
+            if (offset + length >= kMailboxOut + kMailboxSize) {
+                m_stats.mailboxRequests++;
+                slave.bMailboxOutFull = true;
+                slave.memory[ESC_REG_SM0 + ESC_SM_STATUS] |= ESC_SM_MAILBOX_FULL;
+                if (m_settings.sdoDelayUs == 0) {
+                    CompleteMailboxRequest(slave);
+                } else {
+                    slave.mailboxDue = std::chrono::steady_clock::now() + std::chrono::microseconds(m_settings.sdoDelayUs);
+                    m_pendingMailboxes++;
+                }
+            }
+            return 1;
+        }
+        if (!bRead || !slave.bMailboxInFull) {
+            return 0;
+        }
+        for (uint16_t i = 0; i < length; i++) {
+            pData[i] = offset + i < kMemorySize ? slave.memory[offset + i] : 0;
+        }
+        if (offset + length >= kMailboxIn + kMailboxSize) {
+            slave.bMailboxInFull = false;
+            slave.memory[ESC_REG_SM0 + ESC_SM_SIZE + ESC_SM_STATUS] &= static_cast<uint8_t>(~ESC_SM_MAILBOX_FULL);
+            slave.lastReply.swap(slave.replies.front());
+            slave.replies.pop_front();
+            if (!slave.replies.empty()) {
+                LoadReply(slave);
+            }
+        }
+        return 1;
+    }
+
+    // The master toggled SM1's repeat request (its read of the last reply
+    // got lost): the reply goes back into SM1 unless one is waiting there
+    // anyway, then the repeat ack follows the request
+    void OnMailboxRepeat(Slave& slave) {
+        uint8_t* pSm1 = &slave.memory[ESC_REG_SM0 + ESC_SM_SIZE];
+        if (!((pSm1[ESC_SM_ACTIVATE] ^ pSm1[ESC_SM_PDI_CONTROL]) & ESC_SM_REPEAT)) {
+            return;
+        }
+        if (!slave.bMailboxInFull && !slave.lastReply.empty()) {
+            slave.replies.push_front(slave.lastReply);
+            LoadReply(slave);
+        }
+        pSm1[ESC_SM_PDI_CONTROL] ^= ESC_SM_REPEAT;
+        m_stats.mailboxRepeats++;
+    }
+
+    static bool Overlaps(uint16_t offset, uint16_t length, uint16_t reg, uint16_t regLength) {
+        return offset < reg + regLength && reg < offset + length;
+    }
+
+    static bool IsValidTransition(uint8_t from, uint8_t to) {
+        switch (from) {
+        case ECAT_STATE_INIT: return to == ECAT_STATE_INIT || to == ECAT_STATE_PREOP || to == ECAT_STATE_BOOT;
+        case ECAT_STATE_PREOP: return to != ECAT_STATE_BOOT && to != ECAT_STATE_OP;
+        case ECAT_STATE_SAFEOP:
+        case ECAT_STATE_OP: return to != ECAT_STATE_BOOT;
+        case ECAT_STATE_BOOT: return to == ECAT_STATE_INIT || to == ECAT_STATE_BOOT;
+        default: return to == ECAT_STATE_INIT;
+        }
+    }
+
+    static void SetAlStatus(Slave& slave, uint8_t status, uint16_t code) {
+        slave.memory[ESC_REG_AL_STATUS] = status;
+        EcatPut16(&slave.memory[ESC_REG_AL_STATUS_CODE], code);
+    }
+
+    // Registers the master cannot write: identity and AL status
+    static bool IsReadOnly(uint16_t address) {
+        uint16_t sm = static_cast<uint16_t>((address - ESC_REG_SM0) % ESC_SM_SIZE);
+        return address < ESC_REG_STATION_ADDRESS ||
+               (address >= ESC_REG_AL_STATUS && address < ESC_REG_AL_STATUS_CODE + 2) ||
+               (address >= ESC_REG_SM0 && address < ESC_REG_SM0 + 16 * ESC_SM_SIZE &&
+                (sm == ESC_SM_STATUS || sm == ESC_SM_PDI_CONTROL));
+    }
+
+    static bool IsSyncManager(const Slave& slave, uint16_t index, uint16_t start, uint16_t length, uint8_t control) {
+        const uint8_t* pSm = &slave.memory[ESC_REG_SM0 + index * ESC_SM_SIZE];
+        return EcatGet16(pSm + ESC_SM_START) == start && EcatGet16(pSm + ESC_SM_LENGTH) == length &&
+               pSm[ESC_SM_CONTROL] == control && (pSm[ESC_SM_ACTIVATE] & ESC_SM_ENABLE);
+    }
+
+    // A slave leaves INIT only once the master has set up SM0/SM1 as the
+    // SII describes them, as real slaves check
+    static uint16_t CheckMailboxSyncManagers(const Slave& slave) {
+        if (!IsSyncManager(slave, 0, kMailboxOut, kMailboxSize, kMailboxOutControl) ||
+            !IsSyncManager(slave, 1, kMailboxIn, kMailboxSize, kMailboxInControl)) {
+            return ECAT_AL_CODE_INVALID_MAILBOX;
+        }
+        return ECAT_AL_CODE_NONE;
+    }
+
+    // Back in INIT the slave's firmware turns its sync managers and FMMUs
+    // off again; the master sets them up anew on the way up
+    static void DisableSyncManagers(Slave& slave) {
+        for (uint16_t sm = 0; sm < slave.memory[ESC_REG_SM_COUNT]; sm++) {
+            slave.memory[ESC_REG_SM0 + sm * ESC_SM_SIZE + ESC_SM_ACTIVATE] &= static_cast<uint8_t>(~ESC_SM_ENABLE);
+        }
+        for (uint16_t fmmu = 0; fmmu < slave.memory[ESC_REG_FMMU_COUNT]; fmmu++) {
+            slave.memory[ESC_REG_FMMU0 + fmmu * ESC_FMMU_SIZE + ESC_FMMU_ACTIVATE] = 0;
+        }
+    }
+
+    // A slave with process data leaves PREOP only once the master has set
+    // up its SM2/SM3 as the SII describes them, as real slaves check
+    static uint16_t CheckProcessDataSyncManagers(const Slave& slave) {
+        if (slave.outputSize && !IsSyncManager(slave, 2, kOutputRam, slave.outputSize, kOutputControl)) {
+            return ECAT_AL_CODE_INVALID_OUTPUTS;
+        }
+        if (slave.inputSize && !IsSyncManager(slave, 3, kInputRam, slave.inputSize, kInputControl)) {
+            return ECAT_AL_CODE_INVALID_INPUTS;
+        }
+        return ECAT_AL_CODE_NONE;
+    }
+
+    void OnAlControl(Slave& slave) {
+        uint8_t control = slave.memory[ESC_REG_AL_CONTROL];
+        uint8_t requested = control & ECAT_STATE_MASK;
+        uint8_t status = slave.memory[ESC_REG_AL_STATUS];
+        uint8_t current = status & ECAT_STATE_MASK;
+
+        // An error stays until the master acknowledges it
+        if ((status & ECAT_AL_ERROR) && !(control & ECAT_AL_ERROR)) {
+            return;
+        }
+        if (requested != ECAT_STATE_INIT && requested != ECAT_STATE_PREOP && requested != ECAT_STATE_BOOT &&
+            requested != ECAT_STATE_SAFEOP && requested != ECAT_STATE_OP) {
+            SetAlStatus(slave, static_cast<uint8_t>(current | ECAT_AL_ERROR), ECAT_AL_CODE_UNKNOWN_STATE);
+            return;
+        }
+        if (!IsValidTransition(current, requested)) {
+            SetAlStatus(slave, static_cast<uint8_t>(current | ECAT_AL_ERROR), ECAT_AL_CODE_INVALID_CHANGE);
+            return;
+        }
+        uint16_t code = ECAT_AL_CODE_NONE;
+        if (current == ECAT_STATE_INIT && requested == ECAT_STATE_PREOP) {
+            code = CheckMailboxSyncManagers(slave);
+        } else if (current == ECAT_STATE_PREOP && (requested == ECAT_STATE_SAFEOP || requested == ECAT_STATE_OP)) {
+            code = CheckProcessDataSyncManagers(slave);
+        }
+        if (code != ECAT_AL_CODE_NONE) {
+            SetAlStatus(slave, static_cast<uint8_t>(current | ECAT_AL_ERROR), code);
+            return;
+        }
+        if (requested == ECAT_STATE_INIT && current != ECAT_STATE_INIT) {
+            DisableSyncManagers(slave);
+        }
+        if (requested == current || m_settings.stateChangeDelayUs == 0) {
+            SetAlStatus(slave, requested, ECAT_AL_CODE_NONE);
+            m_stats.stateChanges += (requested != current);
+            return;
+        }
+        SetAlStatus(slave, current, ECAT_AL_CODE_NONE);
+        if (!slave.pendingState) {
+            m_pendingChanges++;
+        }
+        slave.pendingState = requested;
+        slave.pendingDue = std::chrono::steady_clock::now() + std::chrono::microseconds(m_settings.stateChangeDelayUs);
+    }
+
+    void CompletePendingChanges() {
+        auto now = std::chrono::steady_clock::now();
+        for (Slave& slave : m_slaves) {
+            if (slave.pendingState && slave.pendingDue <= now) {
+                SetAlStatus(slave, slave.pendingState, ECAT_AL_CODE_NONE);
+                slave.pendingState = 0;
+                m_pendingChanges--;
+                m_stats.stateChanges++;
+            }
+        }
+    }
+
+    Slave* FindStation(uint16_t station) {
+        if (m_bStationsDirty) {
+            m_stationIndex.clear();
+            for (size_t position = 0; position < m_slaves.size(); position++) {
+                m_stationIndex.emplace(EcatGet16(&m_slaves[position].memory[ESC_REG_STATION_ADDRESS]), position);
+            }
+            m_bStationsDirty = false;
+        }
+        auto it = m_stationIndex.find(station);
+        return it == m_stationIndex.end() ? nullptr : &m_slaves[it->second];
+    }
+
+    // Physical access to one slave's memory; returns its working counter
+    // increment. Broadcast reads OR into the datagram as on a real line.
+    uint16_t PhysicalAccess(Slave& slave, uint16_t offset, uint8_t* pData, uint16_t length,
+                            bool bRead, bool bWrite, bool bOrRead) {
+        if ((Overlaps(offset, length, kMailboxOut, kMailboxSize) || Overlaps(offset, length, kMailboxIn, kMailboxSize)) &&
+            !bOrRead) {
+            return MailboxAccess(slave, offset, pData, length, bRead, bWrite);
+        }
+        if (bWrite && bRead) {
+            m_scratch.assign(pData, pData + length);
+        }
+        if (bRead && slave.bSiiBusy && Overlaps(offset, length, ESC_REG_SII_CONTROL, 14) &&
+            std::chrono::steady_clock::now() >= slave.siiDue) {
+            CompleteSiiRead(slave);
+        }
+        if (bRead && Overlaps(offset, length, ESC_REG_DC_SYSTEM_TIME, 8)) {
+            EcatPut64(&slave.memory[ESC_REG_DC_SYSTEM_TIME], static_cast<uint64_t>(SystemTimeNs(slave, OutboundNs(slave))));
+        }
+        if (bRead) {
+            for (uint16_t i = 0; i < length; i++) {
+                size_t address = static_cast<size_t>(offset) + i;
+                uint8_t value = address < kMemorySize ? slave.memory[address] : 0;
+                pData[i] = bOrRead ? static_cast<uint8_t>(pData[i] | value) : value;
+            }
+        }
+        if (bWrite) {
+            const uint8_t* pSource = bRead ? m_scratch.data() : pData;
+            for (uint16_t i = 0; i < length; i++) {
+                size_t address = static_cast<size_t>(offset) + i;
+                if (address < kMemorySize && !IsReadOnly(static_cast<uint16_t>(address))) {
+                    slave.memory[address] = pSource[i];
+                }
+            }
+            if (Overlaps(offset, length, ESC_REG_STATION_ADDRESS, 2)) {
+                m_bStationsDirty = true;
+            }
+            if (Overlaps(offset, length, ESC_REG_AL_CONTROL, 1)) {
+                OnAlControl(slave);
+            }
+            if (Overlaps(offset, length, ESC_REG_SM0 + ESC_SM_SIZE + ESC_SM_ACTIVATE, 1)) {
+                OnMailboxRepeat(slave);
+            }
+            if (Overlaps(offset, length, ESC_REG_SII_CONTROL, 2) && !slave.bSiiBusy) {
+                OnSiiCommand(slave);
+            }
+            if (Overlaps(offset, length, ESC_REG_DC_RECEIVE_TIME, 4)) {
+                LatchReceiveTimes(slave);
+            }
+            if (offset == ESC_REG_DC_SYSTEM_TIME && length >= 4) {
+                OnSystemTimeWrite(slave, length);
+            }
+        }
+        return static_cast<uint16_t>((bRead ? 1 : 0) + (bWrite ? (bRead ? 2 : 1) : 0));
+    }
+
+    // Logical access through the slave's active FMMUs. Sync managers only
+    // run in SAFEOP and OP, so in other states the slave ignores it.
+    uint16_t LogicalAccess(Slave& slave, uint32_t address, uint8_t* pData, uint16_t length,
+                           bool bRead, bool bWrite) {
+        uint8_t state = slave.memory[ESC_REG_AL_STATUS] & ECAT_STATE_MASK;
+        if (state != ECAT_STATE_SAFEOP && state != ECAT_STATE_OP) {
+            return 0;
+        }
+        bool bDidRead = false;
+        bool bDidWrite = false;
+        uint64_t end = static_cast<uint64_t>(address) + length;
+        for (uint16_t fmmu = 0; fmmu < slave.memory[ESC_REG_FMMU_COUNT]; fmmu++) {
+            const uint8_t* pFmmu = &slave.memory[ESC_REG_FMMU0 + fmmu * ESC_FMMU_SIZE];
+            if (!(pFmmu[ESC_FMMU_ACTIVATE] & 0x01)) {
+                continue;
+            }
+            uint32_t logical = EcatGet32(pFmmu + ESC_FMMU_LOGICAL_START);
+            uint64_t first = std::max<uint64_t>(address, logical);
+            uint64_t last = std::min<uint64_t>(end, static_cast<uint64_t>(logical) + EcatGet16(pFmmu + ESC_FMMU_LENGTH));
+            if (first >= last) {
+                continue;
+            }
+            uint8_t* pFrame = pData + (first - address);
+            size_t physical = EcatGet16(pFmmu + ESC_FMMU_PHYSICAL_START) + (first - logical);
+            size_t count = static_cast<size_t>(last - first);
+            if (physical + count > kMemorySize) {
+                continue;
+            }
+
+            uint8_t type = pFmmu[ESC_FMMU_TYPE];
+            if ((type & ESC_FMMU_WRITE) && bWrite) {
+                memcpy(&slave.memory[physical], pFrame, count);
+                bDidWrite = true;
+            }
+            if ((type & ESC_FMMU_READ) && bRead) {
+                if (!bDidRead && slave.inputSize && !m_bExternalInputs) {
+                    // Fresh input sample: a little-endian counter of the reads
+                    slave.inputCounter++;
+                    memcpy(&slave.memory[kInputRam], &slave.inputCounter,
+                           std::min<size_t>(sizeof(slave.inputCounter), slave.inputSize));
+                }
+                memcpy(pFrame, &slave.memory[physical], count);
+                bDidRead = true;
+            }
+        }
+        uint16_t writeWkc = (bRead && bWrite) ? 2 : 1;
+        return static_cast<uint16_t>((bDidRead ? 1 : 0) + (bDidWrite ? writeWkc : 0));
+    }
+
+    void ProcessDatagram(uint8_t* p, uint16_t length) {
+        EcatCommand command = static_cast<EcatCommand>(p[0]);
+        uint16_t adp = EcatGet16(p + 2);
+        uint16_t ado = EcatGet16(p + 4);
+        uint8_t* pData = p + ECAT_DATAGRAM_HEADER_SIZE;
+        uint16_t wkc = EcatGet16(pData + length);
+        uint16_t count = static_cast<uint16_t>(m_slaves.size());
+
+        // Auto-increment addressing: the slave that sees ADP 0 is addressed,
+        // every slave increments ADP on the way through
+        uint16_t position = static_cast<uint16_t>(0 - adp);
+        Slave* pAuto = position < count ? &m_slaves[position] : nullptr;
+
+        switch (command) {
+        case ECAT_APRD:
+        case ECAT_APWR:
+        case ECAT_APRW:
+            if (pAuto) {
+                wkc += PhysicalAccess(*pAuto, ado, pData, length,
+                                      command != ECAT_APWR, command != ECAT_APRD, false);
+            }
+            EcatPut16(p + 2, static_cast<uint16_t>(adp + count));
+            break;
+        case ECAT_FPRD:
+        case ECAT_FPWR:
+        case ECAT_FPRW:
+            if (Slave* pSlave = FindStation(adp)) {
+                wkc += PhysicalAccess(*pSlave, ado, pData, length,
+                                      command != ECAT_FPWR, command != ECAT_FPRD, false);
+            }
+            break;
+        case ECAT_BRD:
+        case ECAT_BWR:
+        case ECAT_BRW:
+            for (Slave& slave : m_slaves) {
+                wkc += PhysicalAccess(slave, ado, pData, length,
+                                      command != ECAT_BWR, command != ECAT_BRD, true);
+            }
+            EcatPut16(p + 2, static_cast<uint16_t>(adp + count));
+            break;
+        case ECAT_LRD:
+        case ECAT_LWR:
+        case ECAT_LRW:
+            for (Slave& slave : m_slaves) {
+                wkc += LogicalAccess(slave, EcatGet32(p + 2), pData, length,
+                                     command != ECAT_LWR, command != ECAT_LRD);
+            }
+            break;
+        case ECAT_ARMW:
+        case ECAT_FRMW: {
+            // The addressed slave reads, every other slave writes that value
+            const Slave* pSource = (command == ECAT_ARMW) ? pAuto : FindStation(adp);
+            for (Slave& slave : m_slaves) {
+                bool bSource = (&slave == pSource);
+                wkc += PhysicalAccess(slave, ado, pData, length, bSource, !bSource, false);
+            }
+            if (command == ECAT_ARMW) {
+                EcatPut16(p + 2, static_cast<uint16_t>(adp + count));
+            }
+            break;
+        }
+        default:
+            break;
+        }
+        EcatPut16(pData + length, wkc);
+        m_stats.datagrams++;
+    }
+
+public:
+    SimulatedSegment() : m_bStationsDirty(true), m_pendingChanges(0), m_frameHostNs(0), m_pendingMailboxes(0),
+                         m_bExternalInputs(false), m_processFrames(0) {
+        m_settings.forwardingDelayNs = 500;
+        m_settings.linkMbps = 100;
+        m_settings.initialState = ECAT_STATE_INIT;
+        m_settings.stateChangeDelayUs = 0;
+        m_settings.maxDriftPpm = 50;
+        m_settings.siiReadDelayUs = 100;
+        m_settings.sdoDelayUs = 500;
+        m_settings.loseEvery = 0;
+        memset(&m_stats, 0, sizeof(m_stats));
+    }
+
+    // Applies to slaves added afterwards
+    void SetSettings(const Settings& settings) {
+        m_settings = settings;
+    }
+
+    const Settings& GetSettings() const {
+        return m_settings;
+    }
+
+    bool AddSlave(const std::string& name, uint32_t vendorId, uint32_t productCode,
+                  uint16_t inputSize, uint16_t outputSize) {
+        if (inputSize > kMaxProcessData || outputSize > kMaxProcessData) {
+            LogError() << "Error: Simulated slave '" << name << "' exceeds " << kMaxProcessData
+                       << " bytes of process data";
+            return false;
+        }
+        Slave slave;
+        slave.name = name;
+        slave.vendorId = vendorId;
+        slave.productCode = productCode;
+        slave.inputSize = inputSize;
+        slave.outputSize = outputSize;
+        slave.inputCounter = 0;
+        slave.pendingState = 0;
+        slave.memory.assign(kMemorySize, 0);
+        slave.memory[ESC_REG_TYPE] = 0x11;           // ET1100
+        slave.memory[ESC_REG_FMMU_COUNT] = 8;
+        slave.memory[ESC_REG_SM_COUNT] = 8;
+        slave.memory[ESC_REG_RAM_SIZE] = 2;
+        EcatPut16(&slave.memory[ESC_REG_FEATURES], ESC_FEATURE_DC | ESC_FEATURE_DC_64);
+        SetAlStatus(slave, m_settings.initialState, ECAT_AL_CODE_NONE);
+
+        // Crystal error and power-on time differ per slave, but the same
+        // line always gets the same values
+        uint32_t hash = static_cast<uint32_t>(m_slaves.size() + 1) * 2654435761u;
+        slave.drift = (static_cast<int>((hash >> 8) % 2001) - 1000) / 1000.0 * m_settings.maxDriftPpm * 1e-6;
+        slave.clockRate = 1.0 + slave.drift;
+        slave.clockBaseHostNs = HostNowNs();
+        slave.clockBaseLocalNs = static_cast<int64_t>(hash % 60000) * 1000000;
+        slave.lastSyncHostNs = 0;
+        slave.revision = 0x00100000;
+        slave.serial = hash;
+        slave.bSiiBusy = false;
+        slave.bMailboxOutFull = false;
+        slave.bMailboxInFull = false;
+        slave.replyCounter = 0;
+        slave.requestCounter = 0;
+        slave.transfer.bActive = false;
+        BuildEeprom(slave);
+        BuildObjectDictionary(slave);
+        m_slaves.push_back(slave);
+        m_bStationsDirty = true;
+        return true;
+    }
+
+    // Slaves from <Slaves>, unconfigured: station addresses, sync managers
+    // and FMMUs are left to the master
+    bool LoadSlaves(const EtherCATConfig& config) {
+        for (const EtherCATSlaveConfig& slave : config.slaves) {
+            if (!AddSlave(slave.name, slave.vendorId, slave.productCode, slave.inputSize, slave.outputSize)) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    // Lines of any length for scaling measurements
+    void AddSyntheticSlaves(size_t count, uint16_t inputSize, uint16_t outputSize) {
+        for (size_t i = 0; i < count; i++) {
+            AddSlave("Synthetic " + std::to_string(m_slaves.size()), 2, 0, inputSize, outputSize);
+        }
+    }
+
+    // LRW working counter of a line whose every slave is mapped: 2 per
+    // slave with outputs, 1 per slave with inputs
+    uint16_t GetExpectedWkc() const {
+        uint16_t expectedWkc = 0;
+        for (const Slave& slave : m_slaves) {
+            expectedWkc = static_cast<uint16_t>(expectedWkc + (slave.outputSize ? 2 : 0) + (slave.inputSize ? 1 : 0));
+        }
+        return expectedWkc;
+    }
+
+    // Stands in for a master's configuration phase where there is none,
+    // as for benches and slaves started in SAFEOP/OP: station addresses
+    // 1001, 1002, ... and SM2/SM3 plus one output and one input FMMU per
+    // slave, packed in line order from the given logical addresses.
+    // Returns the expected LRW working counter.
+    uint16_t MapProcessData(uint32_t inputAddress, uint32_t outputAddress) {
+        uint32_t nextInput = inputAddress;
+        uint32_t nextOutput = outputAddress;
+        for (size_t position = 0; position < m_slaves.size(); position++) {
+            Slave& slave = m_slaves[position];
+            EcatPut16(&slave.memory[ESC_REG_STATION_ADDRESS], static_cast<uint16_t>(1001 + position));
+            memset(&slave.memory[ESC_REG_FMMU0], 0, 2 * ESC_FMMU_SIZE);
+
+            uint8_t* pMailbox = &slave.memory[ESC_REG_SM0];
+            EcatPut16(pMailbox + ESC_SM_START, kMailboxOut);
+            EcatPut16(pMailbox + ESC_SM_LENGTH, kMailboxSize);
+            pMailbox[ESC_SM_CONTROL] = kMailboxOutControl;
+            pMailbox[ESC_SM_ACTIVATE] = 0x01;
+            pMailbox += ESC_SM_SIZE;
+            EcatPut16(pMailbox + ESC_SM_START, kMailboxIn);
+            EcatPut16(pMailbox + ESC_SM_LENGTH, kMailboxSize);
+            pMailbox[ESC_SM_CONTROL] = kMailboxInControl;
+            pMailbox[ESC_SM_ACTIVATE] = 0x01;
+
+            if (slave.outputSize) {
+                uint8_t* pSm = &slave.memory[ESC_REG_SM0 + 2 * ESC_SM_SIZE];
+                EcatPut16(pSm, kOutputRam);
+                EcatPut16(pSm + 2, slave.outputSize);
+                pSm[4] = kOutputControl;
+                pSm[6] = 0x01;
+                uint8_t* pFmmu = &slave.memory[ESC_REG_FMMU0];
+                EcatPut32(pFmmu + ESC_FMMU_LOGICAL_START, nextOutput);
+                EcatPut16(pFmmu + ESC_FMMU_LENGTH, slave.outputSize);
+                pFmmu[ESC_FMMU_LOGICAL_END_BIT] = 7;
+                EcatPut16(pFmmu + ESC_FMMU_PHYSICAL_START, kOutputRam);
+                pFmmu[ESC_FMMU_TYPE] = ESC_FMMU_WRITE;
+                pFmmu[ESC_FMMU_ACTIVATE] = 0x01;
+                nextOutput += slave.outputSize;
+            }
+            if (slave.inputSize) {
+                uint8_t* pSm = &slave.memory[ESC_REG_SM0 + 3 * ESC_SM_SIZE];
+                EcatPut16(pSm, kInputRam);
+                EcatPut16(pSm + 2, slave.inputSize);
+                pSm[4] = kInputControl;
+                pSm[6] = 0x01;
+                uint8_t* pFmmu = &slave.memory[ESC_REG_FMMU0 + ESC_FMMU_SIZE];
+                EcatPut32(pFmmu + ESC_FMMU_LOGICAL_START, nextInput);
+                EcatPut16(pFmmu + ESC_FMMU_LENGTH, slave.inputSize);
+                pFmmu[ESC_FMMU_LOGICAL_END_BIT] = 7;
+                EcatPut16(pFmmu + ESC_FMMU_PHYSICAL_START, kInputRam);
+                pFmmu[ESC_FMMU_TYPE] = ESC_FMMU_READ;
+                pFmmu[ESC_FMMU_ACTIVATE] = 0x01;
+                nextInput += slave.inputSize;
+            }
+        }
+        m_bStationsDirty = true;
+        return GetExpectedWkc();
+    }
+
+    // Input samples from outside, e.g. a recording: data for the logical
+    // area [address, address + length) goes into the input RAM of the
+    // slaves whose read FMMUs map it. From then on the slaves stop
+    // generating their own samples.
+    void SetInputs(uint32_t address, const uint8_t* pData, size_t length) {
+        m_bExternalInputs = true;
+        uint64_t end = static_cast<uint64_t>(address) + length;
+        for (Slave& slave : m_slaves) {
+            for (uint16_t fmmu = 0; fmmu < slave.memory[ESC_REG_FMMU_COUNT]; fmmu++) {
+                const uint8_t* pFmmu = &slave.memory[ESC_REG_FMMU0 + fmmu * ESC_FMMU_SIZE];
+                if (!(pFmmu[ESC_FMMU_ACTIVATE] & 0x01) || !(pFmmu[ESC_FMMU_TYPE] & ESC_FMMU_READ)) {
+                    continue;
+                }
+                uint32_t logical = EcatGet32(pFmmu + ESC_FMMU_LOGICAL_START);
+                uint64_t first = std::max<uint64_t>(address, logical);
+                uint64_t last = std::min<uint64_t>(end, static_cast<uint64_t>(logical) +
+                                                            EcatGet16(pFmmu + ESC_FMMU_LENGTH));
+                size_t physical = EcatGet16(pFmmu + ESC_FMMU_PHYSICAL_START) + (first - logical);
+                if (first < last && physical + (last - first) <= kMemorySize) {
+                    memcpy(&slave.memory[physical], pData + (first - address), static_cast<size_t>(last - first));
+                }
+            }
+        }
+    }
+
+    // Runs the frame through every slave, in place. Returns false if it
+    // is not an EtherCAT frame or a datagram runs past the frame end.
+    bool ProcessFrame(uint8_t* pFrame, size_t length) {
+        if (!EcatIsEtherCATFrame(pFrame, length)) {
+            m_stats.malformed++;
+            return false;
+        }
+        if (m_pendingChanges) {
+            CompletePendingChanges();
+        }
+        if (m_pendingMailboxes) {
+            CompletePendingMailboxes();
+        }
+        m_frameHostNs = HostNowNs();
+
+        uint8_t* p = pFrame + ECAT_PAYLOAD_OFFSET;
+        const uint8_t* pEnd = p + EcatGetFrameLength(pFrame);
+        bool bProcessData = false;
+        for (;;) {
+            if (p + ECAT_DATAGRAM_HEADER_SIZE > pEnd) {
+                m_stats.malformed++;
+                return false;
+            }
+            uint16_t lengthField = EcatGet16(p + 6);
+            uint16_t dataLength = lengthField & 0x07FF;
+            if (p + ECAT_DATAGRAM_HEADER_SIZE + dataLength + ECAT_WKC_SIZE > pEnd) {
+                m_stats.malformed++;
+                return false;
+            }
+            bProcessData = bProcessData || p[0] == ECAT_LRD || p[0] == ECAT_LWR || p[0] == ECAT_LRW;
+            ProcessDatagram(p, dataLength);
+            if (!(lengthField & ECAT_DATAGRAM_MORE)) {
+                break;
+            }
+            p += ECAT_DATAGRAM_HEADER_SIZE + dataLength + ECAT_WKC_SIZE;
+        }
+
+        // The slaves have acted on a lost frame; only the way back fails
+        if (bProcessData && m_settings.loseEvery && ++m_processFrames % m_settings.loseEvery == 0) {
+            m_stats.framesLost++;
+            return false;
+        }
+
+        // The first slave marks the frame as returned (locally administered source MAC)
+        pFrame[6] |= 0x02;
+        m_stats.frames++;
+        return true;
+    }
+
+    // Time from the first bit sent to the last bit back: the frame's own
+    // wire time (with preamble, FCS and gap) plus every slave's forwarding
+    uint64_t GetReturnDelayNs(size_t frameLength) const {
+        return GetWireTimeNs(frameLength) + m_slaves.size() * m_settings.forwardingDelayNs;
+    }
+
+    // Time the frame occupies the master's link
+    uint64_t GetWireTimeNs(size_t frameLength) const {
+        return (std::max(frameLength, ECAT_MIN_ETH_FRAME) + 24) * 8000 / m_settings.linkMbps;
+    }
+
+    size_t GetSlaveCount() const {
+        return m_slaves.size();
+    }
+
+    uint8_t GetAlStatus(size_t position) const {
+        return m_slaves[position].memory[ESC_REG_AL_STATUS];
+    }
+
+    // Register space and process data RAM of one slave
+    const uint8_t* GetMemory(size_t position) const {
+        return m_slaves[position].memory.data();
+    }
+
+    const std::string& GetSlaveName(size_t position) const {
+        return m_slaves[position].name;
+    }
+
+    const Stats& GetStats() const {
+        return m_stats;
+    }
+};
@@ -0,0 +1,142 @@
+#pragma once
+
+#include <chrono>
+#include <cstring>
+#include <thread>
+#include <vector>
+#include "FrameTransport.h"
+#include "RtMemory.h"
+#include "SimulatedSegment.h"
+
+// In-process loopback to a SimulatedSegment. Kick() runs every committed
+// frame through the segment and queues it for reception; a frame becomes
+// visible to PollRx() once its return delay has passed, with frames of one
+// kick sharing the link back to back as they would on the wire.
+class SimulatedTransport : public FrameTransport {
+public:
+    static const size_t kFrameSize = 2048;
+    static const size_t kDefaultFrames = 256;
+
+    struct Stats {
+        unsigned long txFrames;
+        unsigned long rxFrames;
+        unsigned long kicks;
+        unsigned long rxRingFull;     // dropped, master did not collect its replies
+    };
+
+private:
+    typedef std::chrono::steady_clock Clock;
+
+    struct Slot {
+        std::vector<uint8_t> data;
+        size_t length;
+        Clock::time_point due;
+    };
+
+    SimulatedSegment& m_segment;
+    std::vector<Slot> m_tx;
+    std::vector<Slot> m_rx;           // ring
+    size_t m_txCommitted;
+    size_t m_rxHead;
+    size_t m_rxCount;
+    Clock::time_point m_linkFree;
+    uint8_t m_mac[6];
+    Stats m_stats;
+
+public:
+    explicit SimulatedTransport(SimulatedSegment& segment, size_t frames = kDefaultFrames)
+        : m_segment(segment), m_tx(frames), m_rx(frames), m_txCommitted(0), m_rxHead(0), m_rxCount(0) {
+        for (size_t i = 0; i < frames; i++) {
+            m_tx[i].data.resize(kFrameSize);
+            m_rx[i].data.resize(kFrameSize);
+        }
+        const uint8_t mac[6] = { 0x02, 0x00, 0x00, 0xEC, 0xA7, 0x00 };
+        memcpy(m_mac, mac, sizeof(m_mac));
+        memset(&m_stats, 0, sizeof(m_stats));
+    }
+
+    uint8_t* AcquireTx(size_t* pCapacity) override {
+        if (m_txCommitted >= m_tx.size()) {
+            return nullptr;
+        }
+        *pCapacity = kFrameSize;
+        return m_tx[m_txCommitted].data.data();
+    }
+
+    void CommitTx(size_t length) override {
+        m_tx[m_txCommitted++].length = length;
+    }
+
+    bool Kick() override {
+        RtHeapGuard::Exempt wire;       // the segment is not master code
+        Clock::time_point now = Clock::now();
+        if (m_linkFree < now) {
+            m_linkFree = now;
+        }
+        for (size_t i = 0; i < m_txCommitted; i++) {
+            Slot& tx = m_tx[i];
+            m_stats.txFrames++;
+            if (!m_segment.ProcessFrame(tx.data.data(), tx.length)) {
+                continue;     // not EtherCAT or lost: a real line drops it too
+            }
+            if (m_rxCount == m_rx.size()) {
+                m_stats.rxRingFull++;
+                continue;
+            }
+
+            // Swap buffers instead of copying the frame
+            Slot& rx = m_rx[(m_rxHead + m_rxCount++) % m_rx.size()];
+            rx.data.swap(tx.data);
+            rx.length = tx.length;
+            rx.due = m_linkFree + std::chrono::nanoseconds(m_segment.GetReturnDelayNs(tx.length));
+            m_linkFree += std::chrono::nanoseconds(m_segment.GetWireTimeNs(tx.length));
+        }
+        m_txCommitted = 0;
+        m_stats.kicks++;
+        return true;
+    }
+
+    const uint8_t* PollRx(size_t* pLength) override {
+        if (m_rxCount == 0) {
+            return nullptr;
+        }
+        Slot& slot = m_rx[m_rxHead];
+        if (slot.due > Clock::now()) {
+            return nullptr;
+        }
+        *pLength = slot.length;
+        return slot.data.data();
+    }
+
+    void ReleaseRx() override {
+        m_rxHead = (m_rxHead + 1) % m_rx.size();
+        m_rxCount--;
+        m_stats.rxFrames++;
+    }
+
+    // Nothing else can produce frames, so an empty queue returns at once.
+    // Short waits spin: the delays involved are microseconds.
+    bool WaitRx(long timeoutUs) override {
+        if (m_rxCount == 0) {
+            return false;
+        }
+        Clock::time_point due = m_rx[m_rxHead].due;
+        Clock::time_point deadline = Clock::now() + std::chrono::microseconds(timeoutUs);
+        bool bArrives = due <= deadline;
+        Clock::time_point until = bArrives ? due : deadline;
+        if (until - Clock::now() > std::chrono::microseconds(100)) {
+            std::this_thread::sleep_until(until - std::chrono::microseconds(50));
+        }
+        while (Clock::now() < until) {
+        }
+        return bArrives;
+    }
+
+    const uint8_t* GetMacAddress() const override {
+        return m_mac;
+    }
+
+    const Stats& GetStats() const {
+        return m_stats;
+    }
+};
@@ -0,0 +1,336 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <vector>
+#include "EscRegisters.h"
+#include "EtherCATConfig.h"
+#include "EtherCATDatagramPacker.h"
+#include "FrameTransport.h"
+#include "Logger.h"
+#include "SiiReader.h"
+
+// The register setup slaves expect from the master before they change
+// state: station address and mailbox sync managers before INIT -> PREOP,
+// the process data sync managers and the FMMUs that map them into the LRW
+// before PREOP -> SAFEOP. Sync managers come from the slave's SII sync
+// manager category, process data lengths from <Slaves>; the FMMUs are
+// packed in <Slaves> order from the <ProcessData> logical addresses, the
+// same order the master splits its LRW frames in. Slaves on the line that
+// are not in <Slaves> get their sync managers from the SII alone and no
+// FMMUs. An ENI brings its own register init commands instead; those of
+// a transition replace the built-in setup for it.
+//
+// Usage:
+//   SlaveConfigurator configurator;
+//   configurator.ConfigureMailboxes(transport, packer, config, slaveInfo);       // in INIT
+//   configurator.ConfigureProcessData(transport, packer, config, slaveInfo);     // in PREOP
+//   configurator.RunInitCommands(transport, packer, config, ECAT_TRANSITION_IP); // ENI
+class SlaveConfigurator {
+public:
+    static const uint16_t kFirstStation = 0x1001;
+
+private:
+    // Register images of one slave, kept until the frame is sent
+    struct Registers {
+        uint16_t position;
+        uint8_t station[2];
+        uint8_t syncManagers[2 * ESC_SM_SIZE];
+        uint8_t fmmus[2 * ESC_FMMU_SIZE];
+        uint16_t smFirst;                 // SM number of syncManagers[0]
+    };
+
+    long m_timeoutUs;
+    std::vector<Registers> m_registers;
+    std::vector<uint16_t> m_writePositions;   // slave of each queued write
+
+    static uint32_t AutoIncrement(uint16_t position, uint16_t offset) {
+        return EcatPhysicalAddress(static_cast<uint16_t>(-static_cast<int>(position)), offset);
+    }
+
+    void AddWrite(EtherCATDatagramPacker& packer, uint16_t position, uint16_t offset, uint16_t length,
+                  const uint8_t* pData) {
+        packer.Add(ECAT_APWR, AutoIncrement(position, offset), length, pData);
+        m_writePositions.push_back(position);
+    }
+
+    // Sends the queued writes; every one must have reached its slave
+    bool SendWrites(FrameTransport& transport, EtherCATDatagramPacker& packer, const char* what) {
+        if (!packer.Send(transport) || !packer.Receive(transport, m_timeoutUs)) {
+            LogError() << "Error: " << what << " configuration frame lost";
+            return false;
+        }
+        bool bOk = true;
+        uint16_t failed = 0xFFFF;
+        for (size_t id = 0; id < m_writePositions.size(); id++) {
+            if (packer.GetWkc(id) != 1 && m_writePositions[id] != failed) {
+                failed = m_writePositions[id];
+                LogError() << "Error: Slave " << failed << " did not take its " << what << " configuration";
+                bOk = false;
+            }
+        }
+        return bOk;
+    }
+
+    // AL control writes and AL status reads are AlStateMachine's business
+    static bool IsStateCommand(const EtherCATInitCommand& command) {
+        bool bLogical = command.command == ECAT_LRD || command.command == ECAT_LWR || command.command == ECAT_LRW;
+        return !bLogical && (command.ado == ESC_REG_AL_CONTROL || command.ado == ESC_REG_AL_STATUS);
+    }
+
+    static const char* TransitionName(uint16_t transition) {
+        switch (transition) {
+        case ECAT_TRANSITION_IP: return "IP";
+        case ECAT_TRANSITION_PS: return "PS";
+        case ECAT_TRANSITION_SO: return "SO";
+        default: return "other";
+        }
+    }
+
+    static const SlaveSyncManager* FindSyncManager(const SlaveInfo& slave, uint8_t type, uint16_t* pIndex) {
+        for (size_t i = 0; i < slave.syncManagers.size(); i++) {
+            if (slave.syncManagers[i].type == type) {
+                *pIndex = static_cast<uint16_t>(i);
+                return &slave.syncManagers[i];
+            }
+        }
+        return nullptr;
+    }
+
+    static void PutSyncManager(uint8_t* pSm, const SlaveSyncManager& sm, uint16_t length) {
+        EcatPut16(pSm + ESC_SM_START, sm.start);
+        EcatPut16(pSm + ESC_SM_LENGTH, length);
+        pSm[ESC_SM_CONTROL] = sm.control;
+        pSm[ESC_SM_ACTIVATE] = length ? ESC_SM_ENABLE : 0;
+    }
+
+    static void PutFmmu(uint8_t* pFmmu, uint32_t logical, uint16_t length, uint16_t physical, uint8_t type) {
+        EcatPut32(pFmmu + ESC_FMMU_LOGICAL_START, logical);
+        EcatPut16(pFmmu + ESC_FMMU_LENGTH, length);
+        pFmmu[ESC_FMMU_LOGICAL_END_BIT] = 7;
+        EcatPut16(pFmmu + ESC_FMMU_PHYSICAL_START, physical);
+        pFmmu[ESC_FMMU_TYPE] = type;
+        pFmmu[ESC_FMMU_ACTIVATE] = 0x01;
+    }
+
+    // Output and input sync manager of one slave; SII SM2/SM3 by default.
+    // The two are written in one datagram, so they must be neighbours.
+    bool BuildSyncManagers(Registers& registers, const SlaveInfo& slave, uint16_t outputSize, uint16_t inputSize) {
+        SlaveSyncManager none = {};
+        uint16_t outputIndex = 2;
+        uint16_t inputIndex = 3;
+        const SlaveSyncManager* pOutputs = FindSyncManager(slave, SII_SM_OUTPUTS, &outputIndex);
+        const SlaveSyncManager* pInputs = FindSyncManager(slave, SII_SM_INPUTS, &inputIndex);
+        if ((outputSize && !pOutputs) || (inputSize && !pInputs)) {
+            LogError() << "Error: Slave " << registers.position << " has "
+                       << (outputSize && !pOutputs ? "outputs" : "inputs") << " but no sync manager for them in its SII";
+            return false;
+        }
+        if (inputIndex != outputIndex + 1) {
+            LogError() << "Error: Slave " << registers.position << " uses SM" << outputIndex << "/SM" << inputIndex
+                       << " for process data; only neighbouring output/input sync managers are supported";
+            return false;
+        }
+        registers.smFirst = outputIndex;
+        PutSyncManager(registers.syncManagers, pOutputs ? *pOutputs : none, outputSize);
+        PutSyncManager(registers.syncManagers + ESC_SM_SIZE, pInputs ? *pInputs : none, inputSize);
+        return true;
+    }
+
+public:
+    SlaveConfigurator() : m_timeoutUs(100000) {}
+
+    void SetTimeout(long timeoutUs) {
+        m_timeoutUs = timeoutUs;
+    }
+
+    // True if the ENI has register init commands for the transition that
+    // the master sends itself
+    static bool HasInitCommands(const EtherCATConfig& config, uint16_t transition) {
+        for (const EtherCATInitCommand& command : config.initCommands) {
+            if ((command.transitions & transition) && !IsStateCommand(command)) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    // Sends the ENI register init commands of one transition, in ENI
+    // order, all in one go. A command whose working counter differs from
+    // its <Cnt> (if given) is sent again, up to its <Retries>; false once
+    // one has run out of retries.
+    bool RunInitCommands(FrameTransport& transport, EtherCATDatagramPacker& packer, const EtherCATConfig& config,
+                         uint16_t transition) {
+        std::vector<size_t> pending;
+        size_t skipped = 0;
+        for (size_t i = 0; i < config.initCommands.size(); i++) {
+            const EtherCATInitCommand& command = config.initCommands[i];
+            if (command.transitions & transition) {
+                if (IsStateCommand(command)) {
+                    skipped++;
+                } else {
+                    pending.push_back(i);
+                }
+            }
+        }
+        size_t total = pending.size();
+        if (!total && !skipped) {
+            return true;
+        }
+        std::vector<uint16_t> tries(config.initCommands.size(), 0);
+        while (!pending.empty()) {
+            long timeoutUs = m_timeoutUs;
+            packer.Clear();
+            for (size_t i : pending) {
+                const EtherCATInitCommand& command = config.initCommands[i];
+                const uint8_t* pData = command.dataLength ? &config.initData[command.dataOffset] : nullptr;
+                packer.Add(static_cast<EcatCommand>(command.command), EcatPhysicalAddress(command.adp, command.ado),
+                           command.dataLength, pData);
+                timeoutUs = std::max(timeoutUs, static_cast<long>(command.timeoutMs) * 1000);
+                tries[i]++;
+            }
+            packer.Send(transport);
+            packer.Receive(transport, timeoutUs);
+
+            std::vector<size_t> failed;
+            for (size_t id = 0; id < pending.size(); id++) {
+                const EtherCATInitCommand& command = config.initCommands[pending[id]];
+                bool bReceived = packer.IsReceived(id);
+                if (bReceived && (!command.expectedWkc || packer.GetWkc(id) == command.expectedWkc)) {
+                    continue;
+                }
+                if (tries[pending[id]] > command.retries) {
+                    LogError() << "Error: ENI init command " << pending[id] << " (" << TransitionName(transition)
+                               << ", cmd " << static_cast<int>(command.command) << ", adp 0x" << std::hex
+                               << command.adp << ", ado 0x" << command.ado << std::dec << ") "
+                               << (bReceived ? "got WKC " + std::to_string(packer.GetWkc(id)) + ", expected " +
+                                                   std::to_string(command.expectedWkc)
+                                             : std::string("frame lost"))
+                               << " after " << tries[pending[id]] << " tries";
+                    return false;
+                }
+                failed.push_back(pending[id]);
+            }
+            pending.swap(failed);
+        }
+        LogInfo() << "ENI init commands " << TransitionName(transition) << ": " << total << " sent"
+                  << (skipped ? ", " + std::to_string(skipped) + " state commands left to the state machine" : "");
+        return true;
+    }
+
+    // Station address of the slave at a position: the ENI PhysAddr if
+    // there is one, else 0x1001, 0x1002, ... in line order
+    static uint16_t StationAddress(const EtherCATConfig& config, uint16_t position) {
+        for (const EtherCATSlaveConfig& slave : config.slaves) {
+            if (slave.position == position && slave.stationAddress) {
+                return slave.stationAddress;
+            }
+        }
+        return static_cast<uint16_t>(kFirstStation + position);
+    }
+
+    // Writes the station address of every slave, and SM0/SM1 of those with
+    // a mailbox in their SII, in one go; false if a slave did not take them
+    bool ConfigureMailboxes(FrameTransport& transport, EtherCATDatagramPacker& packer,
+                            const EtherCATConfig& config, const std::vector<SlaveInfo>& slaves) {
+        uint16_t slaveCount = static_cast<uint16_t>(slaves.size());
+        m_registers.assign(slaveCount, Registers());
+        m_writePositions.clear();
+        packer.Clear();
+        unsigned mailboxes = 0;
+        for (uint16_t position = 0; position < slaveCount; position++) {
+            Registers& registers = m_registers[position];
+            memset(&registers, 0, sizeof(registers));
+            registers.position = position;
+            EcatPut16(registers.station, StationAddress(config, position));
+            AddWrite(packer, position, ESC_REG_STATION_ADDRESS, 2, registers.station);
+
+            uint16_t outIndex = 0;
+            uint16_t inIndex = 1;
+            const SlaveSyncManager* pOut = FindSyncManager(slaves[position], SII_SM_MAILBOX_OUT, &outIndex);
+            const SlaveSyncManager* pIn = FindSyncManager(slaves[position], SII_SM_MAILBOX_IN, &inIndex);
+            if (!pOut || !pIn) {
+                continue;
+            }
+            if (inIndex != outIndex + 1) {
+                LogError() << "Error: Slave " << position << " uses SM" << outIndex << "/SM" << inIndex
+                           << " for its mailbox; only neighbouring sync managers are supported";
+                return false;
+            }
+            PutSyncManager(registers.syncManagers, *pOut, pOut->length);
+            PutSyncManager(registers.syncManagers + ESC_SM_SIZE, *pIn, pIn->length);
+            AddWrite(packer, position, static_cast<uint16_t>(ESC_REG_SM0 + outIndex * ESC_SM_SIZE),
+                     sizeof(registers.syncManagers), registers.syncManagers);
+            mailboxes++;
+        }
+        if (!SendWrites(transport, packer, "mailbox")) {
+            return false;
+        }
+        LogInfo() << "Mailboxes: station addresses of " << slaveCount << " slaves and sync managers of "
+                  << mailboxes << " written";
+        return true;
+    }
+
+    // Writes SM2/SM3 and FMMU0 (outputs)/FMMU1 (inputs) of every slave in
+    // one go; false if a slave did not take them
+    bool ConfigureProcessData(FrameTransport& transport, EtherCATDatagramPacker& packer,
+                              const EtherCATConfig& config, const std::vector<SlaveInfo>& slaves) {
+        uint16_t slaveCount = static_cast<uint16_t>(slaves.size());
+        std::vector<const EtherCATSlaveConfig*> configured(slaveCount, nullptr);
+        for (const EtherCATSlaveConfig& slave : config.slaves) {
+            if (slave.position >= slaveCount) {
+                LogError() << "Error: Configured slave '" << slave.name << "' at position " << slave.position
+                           << " is not on the line (" << slaveCount << " slaves)";
+                return false;
+            }
+            configured[slave.position] = &slave;
+        }
+
+        m_registers.assign(slaveCount, Registers());
+        for (uint16_t position = 0; position < slaveCount; position++) {
+            Registers& registers = m_registers[position];
+            memset(&registers, 0, sizeof(registers));
+            registers.position = position;
+            const SlaveInfo& slave = slaves[position];
+            uint16_t outputSize = configured[position] ? configured[position]->outputSize
+                                                       : static_cast<uint16_t>((slave.outputBits + 7) / 8);
+            uint16_t inputSize = configured[position] ? configured[position]->inputSize
+                                                      : static_cast<uint16_t>((slave.inputBits + 7) / 8);
+            if (!BuildSyncManagers(registers, slave, outputSize, inputSize)) {
+                return false;
+            }
+        }
+
+        // Logical addresses in <Slaves> order, as RunProcessData splits them
+        uint32_t nextOutput = config.outputAddress;
+        uint32_t nextInput = config.inputAddress;
+        for (const EtherCATSlaveConfig& slave : config.slaves) {
+            Registers& registers = m_registers[slave.position];
+            if (slave.outputSize) {
+                PutFmmu(registers.fmmus, nextOutput, slave.outputSize,
+                        EcatGet16(registers.syncManagers + ESC_SM_START), ESC_FMMU_WRITE);
+                nextOutput += slave.outputSize;
+            }
+            if (slave.inputSize) {
+                PutFmmu(registers.fmmus + ESC_FMMU_SIZE, nextInput, slave.inputSize,
+                        EcatGet16(registers.syncManagers + ESC_SM_SIZE + ESC_SM_START), ESC_FMMU_READ);
+                nextInput += slave.inputSize;
+            }
+        }
+
+        packer.Clear();
+        m_writePositions.clear();
+        for (const Registers& registers : m_registers) {
+            uint16_t sm = static_cast<uint16_t>(ESC_REG_SM0 + registers.smFirst * ESC_SM_SIZE);
+            AddWrite(packer, registers.position, sm, sizeof(registers.syncManagers), registers.syncManagers);
+            AddWrite(packer, registers.position, ESC_REG_FMMU0, sizeof(registers.fmmus), registers.fmmus);
+        }
+        if (!SendWrites(transport, packer, "process data")) {
+            return false;
+        }
+        LogInfo() << "Process data: sync managers and FMMUs of " << slaveCount << " slaves written";
+        return true;
+    }
+};
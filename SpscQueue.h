@@ -0,0 +1,78 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+
+// Bounded lock-free single-producer/single-consumer ring. One thread may
+// call TryPush and one other thread may call TryPop/Empty; neither ever
+// blocks or allocates. Capacity must be a power of two.
+template <typename T, size_t Capacity>
+class SpscQueue {
+    static_assert(Capacity >= 2 && (Capacity & (Capacity - 1)) == 0,
+                  "SpscQueue capacity must be a power of two");
+
+private:
+    static const size_t kMask = Capacity - 1;
+
+    // Head and tail on separate cache lines so producer and consumer do not
+    // invalidate each other's line on every operation
+    alignas(64) std::atomic<size_t> m_head;     // next slot to pop
+    alignas(64) std::atomic<size_t> m_tail;     // next slot to push
+    alignas(64) T m_slots[Capacity];
+
+public:
+    SpscQueue() : m_head(0), m_tail(0) {}
+
+    SpscQueue(const SpscQueue&) = delete;
+    SpscQueue& operator=(const SpscQueue&) = delete;
+
+    bool TryPush(const T& item) {
+        size_t tail = m_tail.load(std::memory_order_relaxed);
+        if (tail - m_head.load(std::memory_order_acquire) == Capacity) {
+            return false;
+        }
+        m_slots[tail & kMask] = item;
+        m_tail.store(tail + 1, std::memory_order_release);
+        return true;
+    }
+
+    // Reserve/commit variant for producers that fill a slot in place
+    T* BeginPush() {
+        size_t tail = m_tail.load(std::memory_order_relaxed);
+        if (tail - m_head.load(std::memory_order_acquire) == Capacity) {
+            return nullptr;
+        }
+        return &m_slots[tail & kMask];
+    }
+
+    void CommitPush() {
+        m_tail.store(m_tail.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+    }
+
+    bool TryPop(T& item) {
+        size_t head = m_head.load(std::memory_order_relaxed);
+        if (head == m_tail.load(std::memory_order_acquire)) {
+            return false;
+        }
+        item = m_slots[head & kMask];
+        m_head.store(head + 1, std::memory_order_release);
+        return true;
+    }
+
+    // Consumer-side peek/release pair that avoids copying the slot
+    const T* Front() {
+        size_t head = m_head.load(std::memory_order_relaxed);
+        if (head == m_tail.load(std::memory_order_acquire)) {
+            return nullptr;
+        }
+        return &m_slots[head & kMask];
+    }
+
+    void PopFront() {
+        m_head.store(m_head.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+    }
+
+    bool Empty() const {
+        return m_head.load(std::memory_order_acquire) == m_tail.load(std::memory_order_acquire);
+    }
+};
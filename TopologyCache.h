@@ -0,0 +1,145 @@
+#pragma once
+
+#include <cstdint>
+#include <cstdio>
+#include <fstream>
+#include <iterator>
+#include <string>
+#include <vector>
+#include "EtherCATConfig.h"
+#include "EtherCATFrame.h"
+#include "Logger.h"
+#include "SiiReader.h"
+
+// Scanned slaves kept between runs, so a warm start only has to check
+// each slave's identity words instead of reading its whole EEPROM.
+//
+// File layout, little-endian:
+//   header   magic "ECTP", version, config key, slave count,
+//            payload bytes, payload checksum (6 x 4 bytes)
+//   per slave vendor, product, revision, serial, category bytes
+//            (5 x 4 bytes), then the raw SII category area
+// The config key is a hash of the <Slaves> list: editing it invalidates
+// the cache even before any slave is asked.
+class TopologyCache {
+public:
+    static const uint32_t kMagic = 0x50544345;     // "ECTP"
+    static const uint32_t kVersion = 1;
+
+private:
+    static const size_t kHeaderSize = 24;
+    static const size_t kSlaveHeaderSize = 20;
+
+    static uint32_t Fnv1a(const uint8_t* pData, size_t length, uint32_t hash = 2166136261u) {
+        for (size_t i = 0; i < length; i++) {
+            hash = (hash ^ pData[i]) * 16777619u;
+        }
+        return hash;
+    }
+
+    static uint32_t Fnv1a32(uint32_t value, uint32_t hash) {
+        uint8_t bytes[4];
+        EcatPut32(bytes, value);
+        return Fnv1a(bytes, sizeof(bytes), hash);
+    }
+
+public:
+    static uint32_t ConfigKey(const EtherCATConfig& config) {
+        uint32_t hash = Fnv1a32(static_cast<uint32_t>(config.slaves.size()), 2166136261u);
+        for (const EtherCATSlaveConfig& slave : config.slaves) {
+            hash = Fnv1a32(slave.position, hash);
+            hash = Fnv1a32(slave.vendorId, hash);
+            hash = Fnv1a32(slave.productCode, hash);
+            hash = Fnv1a(reinterpret_cast<const uint8_t*>(slave.name.data()), slave.name.size(), hash);
+        }
+        return hash;
+    }
+
+    // False if there is no cache, it is corrupt, or it was written for a
+    // different <Slaves> list; the reason is logged
+    static bool Load(const std::string& path, uint32_t configKey, std::vector<SlaveInfo>& slaves) {
+        std::ifstream file(path, std::ios::binary);
+        if (!file) {
+            LogInfo() << "No topology cache '" << path << "' yet";
+            return false;
+        }
+        std::vector<uint8_t> bytes((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+        if (bytes.size() < kHeaderSize || EcatGet32(&bytes[0]) != kMagic || EcatGet32(&bytes[4]) != kVersion ||
+            EcatGet32(&bytes[16]) != bytes.size() - kHeaderSize ||
+            EcatGet32(&bytes[20]) != Fnv1a(&bytes[kHeaderSize], bytes.size() - kHeaderSize)) {
+            LogWarning() << "Warning: Topology cache '" << path << "' is damaged or from another version";
+            return false;
+        }
+        if (EcatGet32(&bytes[8]) != configKey) {
+            LogInfo() << "Topology cache '" << path << "' was written for a different <Slaves> list";
+            return false;
+        }
+
+        uint32_t count = EcatGet32(&bytes[12]);
+        std::vector<SlaveInfo> loaded(count);
+        size_t at = kHeaderSize;
+        for (SlaveInfo& slave : loaded) {
+            if (at + kSlaveHeaderSize > bytes.size()) {
+                break;
+            }
+            const uint8_t* p = &bytes[at];
+            slave.identity = SlaveIdentity{ EcatGet32(p), EcatGet32(p + 4), EcatGet32(p + 8), EcatGet32(p + 12) };
+            size_t length = EcatGet32(p + 16);
+            at += kSlaveHeaderSize;
+            if (at + length > bytes.size()) {
+                break;
+            }
+            slave.categories.assign(bytes.begin() + at, bytes.begin() + at + length);
+            at += length;
+            if (!slave.ParseCategories()) {
+                at = bytes.size() + 1;
+                break;
+            }
+        }
+        if (at != bytes.size()) {
+            LogWarning() << "Warning: Topology cache '" << path << "' is damaged";
+            return false;
+        }
+        slaves.swap(loaded);
+        return true;
+    }
+
+    // Written to a temporary file and renamed, so a crash never leaves a
+    // half-written cache behind
+    static bool Save(const std::string& path, uint32_t configKey, const std::vector<SlaveInfo>& slaves) {
+        std::vector<uint8_t> bytes(kHeaderSize, 0);
+        for (const SlaveInfo& slave : slaves) {
+            size_t at = bytes.size();
+            bytes.resize(at + kSlaveHeaderSize);
+            EcatPut32(&bytes[at], slave.identity.vendorId);
+            EcatPut32(&bytes[at + 4], slave.identity.productCode);
+            EcatPut32(&bytes[at + 8], slave.identity.revision);
+            EcatPut32(&bytes[at + 12], slave.identity.serial);
+            EcatPut32(&bytes[at + 16], static_cast<uint32_t>(slave.categories.size()));
+            bytes.insert(bytes.end(), slave.categories.begin(), slave.categories.end());
+        }
+        EcatPut32(&bytes[0], kMagic);
+        EcatPut32(&bytes[4], kVersion);
+        EcatPut32(&bytes[8], configKey);
+        EcatPut32(&bytes[12], static_cast<uint32_t>(slaves.size()));
+        EcatPut32(&bytes[16], static_cast<uint32_t>(bytes.size() - kHeaderSize));
+        EcatPut32(&bytes[20], Fnv1a(bytes.data() + kHeaderSize, bytes.size() - kHeaderSize));
+
+        std::string temporary = path + ".tmp";
+        {
+            std::ofstream file(temporary, std::ios::binary | std::ios::trunc);
+            if (!file.write(reinterpret_cast<const char*>(bytes.data()), static_cast<std::streamsize>(bytes.size()))) {
+                LogWarning() << "Warning: Cannot write topology cache '" << temporary << "'";
+                return false;
+            }
+        }
+#ifdef _WIN32
+        std::remove(path.c_str());      // rename does not replace there
+#endif
+        if (std::rename(temporary.c_str(), path.c_str()) != 0) {
+            LogWarning() << "Warning: Cannot replace topology cache '" << path << "'";
+            return false;
+        }
+        return true;
+    }
+};
@@ -0,0 +1,85 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+#include "RtMemory.h"
+
+// Lock-free triple buffer for fixed-size byte images. One producer thread
+// fills the back buffer and publishes it; one consumer thread picks up the
+// newest published buffer. Neither side ever waits, and the consumer always
+// sees a complete image (never a mix of two publishes). Buffers start on
+// cache-line boundaries so the two sides never share a line.
+class TripleBuffer {
+private:
+    struct alignas(64) CacheLine {
+        uint8_t bytes[64];
+    };
+
+    static const uint8_t kIndexMask = 0x03;
+    static const uint8_t kFresh = 0x04;     // middle holds an unread publish
+
+    RtVector<CacheLine> m_storage;
+    size_t m_size;
+    size_t m_stride;                        // bytes per buffer, multiple of 64
+
+    alignas(64) std::atomic<uint8_t> m_middle;
+    alignas(64) uint8_t m_back;             // producer only
+    alignas(64) uint8_t m_front;            // consumer only
+
+    uint8_t* Buffer(uint8_t index) {
+        return reinterpret_cast<uint8_t*>(m_storage.data()) + index * m_stride;
+    }
+
+    const uint8_t* Buffer(uint8_t index) const {
+        return reinterpret_cast<const uint8_t*>(m_storage.data()) + index * m_stride;
+    }
+
+public:
+    TripleBuffer() : m_size(0), m_stride(0), m_middle(1), m_back(0), m_front(2) {}
+
+    TripleBuffer(const TripleBuffer&) = delete;
+    TripleBuffer& operator=(const TripleBuffer&) = delete;
+
+    // Not thread-safe; call before the producer and consumer start. The
+    // buffers come from pArena if given, otherwise from the heap.
+    void Resize(size_t size, RtArena* pArena = nullptr) {
+        m_size = size;
+        m_stride = (size + sizeof(CacheLine) - 1) / sizeof(CacheLine) * sizeof(CacheLine);
+        m_storage = RtVector<CacheLine>(RtAllocator<CacheLine>(pArena));
+        m_storage.assign(3 * m_stride / sizeof(CacheLine), CacheLine());
+        m_middle.store(1, std::memory_order_relaxed);
+        m_back = 0;
+        m_front = 2;
+    }
+
+    size_t Size() const {
+        return m_size;
+    }
+
+    // Producer: buffer to fill, then Publish()
+    uint8_t* Back() {
+        return Buffer(m_back);
+    }
+
+    void Publish() {
+        m_back = m_middle.exchange(static_cast<uint8_t>(m_back | kFresh), std::memory_order_acq_rel) & kIndexMask;
+    }
+
+    // Consumer: switches to the newest published buffer if there is one.
+    // Returns true if Front() changed.
+    bool Update() {
+        if (!(m_middle.load(std::memory_order_relaxed) & kFresh)) {
+            return false;
+        }
+        m_front = m_middle.exchange(m_front, std::memory_order_acq_rel) & kIndexMask;
+        return true;
+    }
+
+    // Consumer: stays valid and unchanged until the next Update()
+    const uint8_t* Front() const {
+        return Buffer(m_front);
+    }
+};
@@ -0,0 +1,378 @@
+#pragma once
+
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <istream>
+#include <string>
+#include <utility>
+#include <vector>
+
+// Attributes of one start tag, in document order
+class XmlAttributes {
+private:
+    std::vector<std::pair<std::string, std::string>> m_items;
+    size_t m_count;
+
+public:
+    XmlAttributes() : m_count(0) {}
+
+    // Keeps the strings' capacity for the next tag
+    void Clear() {
+        m_count = 0;
+    }
+
+    std::pair<std::string, std::string>& Add() {
+        if (m_count == m_items.size()) {
+            m_items.emplace_back();
+        }
+        std::pair<std::string, std::string>& item = m_items[m_count++];
+        item.first.clear();
+        item.second.clear();
+        return item;
+    }
+
+    const std::string* Find(const char* name) const {
+        for (size_t i = 0; i < m_count; i++) {
+            if (m_items[i].first == name) {
+                return &m_items[i].second;
+            }
+        }
+        return nullptr;
+    }
+};
+
+// Receives the document as it is read. path holds the open elements from
+// the root down, the current one last. text is the trimmed character data
+// of the element, meaningful for leaf elements.
+class XmlHandler {
+public:
+    virtual ~XmlHandler() {}
+    virtual void OnStart(const std::vector<std::string>& path, const XmlAttributes& attributes) = 0;
+    virtual void OnEnd(const std::vector<std::string>& path, const std::string& text) = 0;
+};
+
+// Streaming (SAX-style) XML reader: the input is read in 64 KB blocks and
+// every element is handed to the handler as soon as it is complete, so a
+// tens-of-megabytes ENI never sits in memory as a whole. Understands
+// elements, attributes, character and entity references, comments,
+// CDATA, processing instructions and a DOCTYPE (skipped); namespaces are
+// left in the names. Stops at the first error with its line number.
+class XmlReader {
+private:
+    static const size_t kBlockSize = 65536;
+
+    std::istream* m_pInput;
+    std::vector<char> m_block;
+    size_t m_pos;
+    size_t m_end;
+    unsigned long m_line;
+    std::string m_error;
+
+    std::vector<std::string> m_path;
+    XmlAttributes m_attributes;
+    std::string m_text;
+    std::string m_name;
+
+    bool Fill() {
+        if (!m_pInput || !*m_pInput) {
+            return false;
+        }
+        m_pInput->read(m_block.data(), static_cast<std::streamsize>(m_block.size()));
+        m_pos = 0;
+        m_end = static_cast<size_t>(m_pInput->gcount());
+        return m_end > 0;
+    }
+
+    // Next character, or -1 at the end of the input
+    int Get() {
+        if (m_pos == m_end && !Fill()) {
+            return -1;
+        }
+        char c = m_block[m_pos++];
+        if (c == '\n') {
+            m_line++;
+        }
+        return static_cast<unsigned char>(c);
+    }
+
+    int Peek() {
+        if (m_pos == m_end && !Fill()) {
+            return -1;
+        }
+        return static_cast<unsigned char>(m_block[m_pos]);
+    }
+
+    bool Fail(const std::string& what) {
+        if (m_error.empty()) {
+            m_error = "line " + std::to_string(m_line) + ": " + what;
+        }
+        return false;
+    }
+
+    static bool IsSpace(int c) {
+        return c == ' ' || c == '\t' || c == '\r' || c == '\n';
+    }
+
+    static bool IsNameChar(int c) {
+        return c > 0x7F || (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') ||
+               c == '_' || c == ':' || c == '-' || c == '.';
+    }
+
+    void SkipSpace() {
+        while (IsSpace(Peek())) {
+            Get();
+        }
+    }
+
+    bool ReadName(std::string& name) {
+        name.clear();
+        while (IsNameChar(Peek())) {
+            name += static_cast<char>(Get());
+        }
+        return !name.empty() || Fail("name expected");
+    }
+
+    // Consumes input up to and including terminator
+    bool SkipPast(const char* terminator) {
+        size_t length = strlen(terminator);
+        char window[8] = { 0 };             // last characters read, terminators are short
+        for (;;) {
+            int c = Get();
+            if (c < 0) {
+                return Fail(std::string("unterminated markup, '") + terminator + "' expected");
+            }
+            memmove(window, window + 1, length - 1);
+            window[length - 1] = static_cast<char>(c);
+            if (memcmp(window, terminator, length) == 0) {
+                return true;
+            }
+        }
+    }
+
+    static void AppendUtf8(std::string& out, uint32_t code) {
+        if (code < 0x80) {
+            out += static_cast<char>(code);
+        } else if (code < 0x800) {
+            out += static_cast<char>(0xC0 | (code >> 6));
+            out += static_cast<char>(0x80 | (code & 0x3F));
+        } else if (code < 0x10000) {
+            out += static_cast<char>(0xE0 | (code >> 12));
+            out += static_cast<char>(0x80 | ((code >> 6) & 0x3F));
+            out += static_cast<char>(0x80 | (code & 0x3F));
+        } else {
+            out += static_cast<char>(0xF0 | (code >> 18));
+            out += static_cast<char>(0x80 | ((code >> 12) & 0x3F));
+            out += static_cast<char>(0x80 | ((code >> 6) & 0x3F));
+            out += static_cast<char>(0x80 | (code & 0x3F));
+        }
+    }
+
+    // After '&': &lt; &gt; &amp; &quot; &apos; &#n; &#xn;
+    bool ReadReference(std::string& out) {
+        std::string entity;
+        int c;
+        while ((c = Get()) != ';') {
+            if (c < 0 || entity.size() > 10) {
+                return Fail("bad entity reference");
+            }
+            entity += static_cast<char>(c);
+        }
+        if (entity == "lt") {
+            out += '<';
+        } else if (entity == "gt") {
+            out += '>';
+        } else if (entity == "amp") {
+            out += '&';
+        } else if (entity == "quot") {
+            out += '"';
+        } else if (entity == "apos") {
+            out += '\'';
+        } else if (entity.size() > 1 && entity[0] == '#') {
+            bool bHex = entity[1] == 'x';
+            AppendUtf8(out, static_cast<uint32_t>(strtoul(entity.c_str() + (bHex ? 2 : 1), nullptr, bHex ? 16 : 10)));
+        } else {
+            return Fail("unknown entity '&" + entity + ";'");
+        }
+        return true;
+    }
+
+    bool ReadStartTag(XmlHandler& handler) {
+        if (!ReadName(m_name)) {
+            return false;
+        }
+        m_path.push_back(m_name);
+        m_attributes.Clear();
+        for (;;) {
+            SkipSpace();
+            int c = Peek();
+            if (c == '>' || c == '/') {
+                break;
+            }
+            if (c < 0) {
+                return Fail("unterminated start tag <" + m_name + ">");
+            }
+            std::pair<std::string, std::string>& attribute = m_attributes.Add();
+            if (!ReadName(attribute.first)) {
+                return false;
+            }
+            SkipSpace();
+            if (Get() != '=') {
+                return Fail("'=' expected after attribute " + attribute.first);
+            }
+            SkipSpace();
+            int quote = Get();
+            if (quote != '"' && quote != '\'') {
+                return Fail("quoted value expected for attribute " + attribute.first);
+            }
+            while ((c = Get()) != quote) {
+                if (c < 0 || c == '<') {
+                    return Fail("unterminated value of attribute " + attribute.first);
+                }
+                if (c == '&') {
+                    if (!ReadReference(attribute.second)) {
+                        return false;
+                    }
+                } else {
+                    attribute.second += static_cast<char>(c);
+                }
+            }
+        }
+
+        m_text.clear();
+        handler.OnStart(m_path, m_attributes);
+        if (Get() == '/') {
+            if (Get() != '>') {
+                return Fail("'>' expected after '/' in <" + m_name + ">");
+            }
+            handler.OnEnd(m_path, m_text);
+            m_path.pop_back();
+        }
+        return true;
+    }
+
+    bool ReadEndTag(XmlHandler& handler) {
+        if (!ReadName(m_name)) {
+            return false;
+        }
+        SkipSpace();
+        if (Get() != '>') {
+            return Fail("'>' expected in </" + m_name + ">");
+        }
+        if (m_path.empty() || m_path.back() != m_name) {
+            return Fail("</" + m_name + "> does not close " + (m_path.empty() ? "anything" : "<" + m_path.back() + ">"));
+        }
+        size_t first = m_text.find_first_not_of(" \t\r\n");
+        if (first == std::string::npos) {
+            m_text.clear();
+        } else {
+            m_text.erase(m_text.find_last_not_of(" \t\r\n") + 1);
+            m_text.erase(0, first);
+        }
+        handler.OnEnd(m_path, m_text);
+        m_path.pop_back();
+        m_text.clear();
+        return true;
+    }
+
+    // After "<!"
+    bool ReadDeclaration() {
+        int c = Get();
+        if (c == '-') {
+            return (Get() == '-' || Fail("bad comment")) && SkipPast("-->");
+        }
+        if (c == '[') {
+            const char* cdata = "CDATA[";
+            for (const char* p = cdata; *p; p++) {
+                if (Get() != *p) {
+                    return Fail("bad CDATA section");
+                }
+            }
+            size_t start = m_text.size();
+            for (;;) {
+                int d = Get();
+                if (d < 0) {
+                    return Fail("unterminated CDATA section");
+                }
+                m_text += static_cast<char>(d);
+                if (m_text.size() - start >= 3 && m_text.compare(m_text.size() - 3, 3, "]]>") == 0) {
+                    m_text.resize(m_text.size() - 3);
+                    return true;
+                }
+            }
+        }
+        // <!DOCTYPE ...> with an optional internal subset in brackets
+        int depth = 0;
+        while ((c = Get()) != '>' || depth > 0) {
+            if (c < 0) {
+                return Fail("unterminated declaration");
+            }
+            depth += (c == '[') - (c == ']');
+        }
+        return true;
+    }
+
+public:
+    XmlReader() : m_pInput(nullptr), m_block(kBlockSize), m_pos(0), m_end(0), m_line(1) {}
+
+    // "line N: ..." after Parse() failed
+    const std::string& GetError() const {
+        return m_error;
+    }
+
+    bool Parse(std::istream& input, XmlHandler& handler) {
+        m_pInput = &input;
+        m_pos = 0;
+        m_end = 0;
+        m_line = 1;
+        m_error.clear();
+        m_path.clear();
+        m_text.clear();
+        bool bRoot = false;
+
+        for (;;) {
+            int c = Get();
+            if (c < 0) {
+                break;
+            }
+            if (c == '&') {
+                if (!ReadReference(m_text)) {
+                    return false;
+                }
+                continue;
+            }
+            if (c != '<') {
+                if (m_path.empty() && !IsSpace(c) && !(c == 0xEF || c == 0xBB || c == 0xBF)) {
+                    return Fail("text outside the root element");
+                }
+                m_text += static_cast<char>(c);
+                continue;
+            }
+
+            c = Peek();
+            bool bOk;
+            if (c == '?') {
+                bOk = SkipPast("?>");
+            } else if (c == '!') {
+                Get();
+                bOk = ReadDeclaration();
+            } else if (c == '/') {
+                Get();
+                bOk = ReadEndTag(handler);
+            } else {
+                if (m_path.empty() && bRoot) {
+                    return Fail("second root element");
+                }
+                bRoot = true;
+                bOk = ReadStartTag(handler);
+            }
+            if (!bOk) {
+                return false;
+            }
+        }
+        if (!m_path.empty()) {
+            return Fail("<" + m_path.back() + "> is not closed");
+        }
+        return bRoot || Fail("no root element");
+    }
+};
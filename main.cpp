@@ -1,16 +1,48 @@
-#include <iostream>
-#include <windows.h>
-#include <conio.h>
-#include <TcAdsDef.h>
-#include <TcAdsApi.h>
-
-#pragma comment(lib, "TcAdsDll.lib")
+#include <cstring>
+#include <string>
+#include <vector>
+#include "AdsApi.h"
+#include "AdsClientPool.h"
+#include "ConsoleCompat.h"
+#include "AdsNotificationClient.h"
+#include "AdsSymbolCache.h"
+#include "ConfigSnapshot.h"
+#include "CyclicExecutor.h"
+#include "Logger.h"
 
 class EtherCATMaster {
 private:
     long m_nPort;
     AmsAddr m_Addr;
     bool m_bConnected;
+    AdsSymbolCache m_Symbols;
+    AdsNotificationClient m_Notifications;
+    AdsClientPool m_Pool;
+
+    bool ExecuteBatch(std::vector<AdsSymbolCache::Access>& batch, bool write) {
+        if (!m_bConnected) {
+            LogError() << "Error: Not connected to TwinCAT!";
+            return false;
+        }
+
+        long nErr = write ? m_Symbols.WriteBatch(batch.data(), batch.size())
+                          : m_Symbols.ReadBatch(batch.data(), batch.size());
+        if (nErr) {
+            LogError() << "Error " << (write ? "writing" : "reading") << " variable batch: 0x"
+                       << std::hex << nErr;
+            return false;
+        }
+
+        bool bAllOk = true;
+        for (const auto& access : batch) {
+            if (access.result) {
+                LogError() << "Error " << (write ? "writing" : "reading") << " variable '"
+                           << access.pSymbol->name << "': 0x" << std::hex << access.result;
+                bAllOk = false;
+            }
+        }
+        return bAllOk;
+    }
 
 public:
     EtherCATMaster() : m_nPort(0), m_bConnected(false) {
@@ -32,7 +64,7 @@ public:
         // Open communication port
         m_nPort = AdsPortOpen();
         if (m_nPort == 0) {
-            std::cerr << "Error: Failed to open ADS port!" << std::endl;
+            LogError() << "Error: Failed to open ADS port!";
             return false;
         }
 
@@ -42,40 +74,77 @@ public:
         long nErr = AdsSyncReadStateReq(&m_Addr, &nAdsState, &nDeviceState);
         
         if (nErr) {
-            std::cerr << "Error: ADS connection failed! Error code: 0x" 
-                      << std::hex << nErr << std::endl;
+            LogError() << "Error: ADS connection failed! Error code: 0x" 
+                       << std::hex << nErr;
             AdsPortClose();
             return false;
         }
 
         m_bConnected = true;
-        std::cout << "Successfully connected to TwinCAT!" << std::endl;
-        std::cout << "ADS State: " << nAdsState << ", Device State: " << nDeviceState << std::endl;
+        m_Symbols.Attach(m_nPort, m_Addr);
+        m_Notifications.Attach(m_nPort, m_Addr);
+        AdsNotificationClient::EnableRouterEvents();
+        if (m_Pool.FindTarget("plc") == SIZE_MAX) {
+            AmsAddr masterAddr = m_Addr;
+            masterAddr.port = 500; // EtherCAT master device (AMSPORT_R0_IO)
+            m_Pool.AddTarget("plc", m_Addr);
+            m_Pool.AddTarget("master", masterAddr);
+        }
+        m_Pool.Start();
+        LogInfo() << "Successfully connected to TwinCAT!";
+        LogInfo() << "ADS State: " << nAdsState << ", Device State: " << nDeviceState;
         return true;
     }
 
     void Disconnect() {
         if (m_nPort != 0) {
+            // Notifications and handles must be released while the port is
+            // still open; notifications first, they may reference handles
+            m_Pool.Stop();
+            m_Notifications.UnsubscribeAll();
+            AdsNotificationClient::DisableRouterEvents();
+            m_Symbols.ReleaseAll();
             AdsPortClose();
             m_nPort = 0;
         }
         m_bConnected = false;
-        std::cout << "Disconnected from TwinCAT." << std::endl;
+        LogInfo() << "Disconnected from TwinCAT.";
+    }
+
+    // Resolves a variable name to a cached symbol handle. Keep the result
+    // for cyclic access so each read/write is a single ADS request.
+    AdsSymbolCache::Symbol* GetSymbol(const std::string& variableName) {
+        if (!m_bConnected) {
+            LogError() << "Error: Not connected to TwinCAT!";
+            return nullptr;
+        }
+
+        long nErr = 0;
+        AdsSymbolCache::Symbol* pSymbol = m_Symbols.Resolve(variableName, &nErr);
+        if (!pSymbol) {
+            LogError() << "Error resolving variable '" << variableName
+                       << "': 0x" << std::hex << nErr;
+        }
+        return pSymbol;
     }
 
     bool ReadVariable(const std::string& variableName, void* pData, unsigned long nDataSize) {
+        AdsSymbolCache::Symbol* pSymbol = GetSymbol(variableName);
+        return pSymbol && ReadVariable(pSymbol, pData, nDataSize);
+    }
+
+    bool ReadVariable(AdsSymbolCache::Symbol* pSymbol, void* pData, unsigned long nDataSize) {
         if (!m_bConnected) {
-            std::cerr << "Error: Not connected to TwinCAT!" << std::endl;
+            LogError() << "Error: Not connected to TwinCAT!";
             return false;
         }
 
         unsigned long nBytesRead;
-        long nErr = AdsSyncReadReqEx2(m_nPort, &m_Addr, ADSIGRP_SYM_VALBYHND, 
-                                      0, nDataSize, pData, &nBytesRead);
+        long nErr = m_Symbols.Read(pSymbol, pData, nDataSize, &nBytesRead);
         
         if (nErr) {
-            std::cerr << "Error reading variable '" << variableName 
-                      << "': 0x" << std::hex << nErr << std::endl;
+            LogError() << "Error reading variable '" << pSymbol->name 
+                       << "': 0x" << std::hex << nErr;
             return false;
         }
 
@@ -83,30 +152,112 @@ public:
     }
 
     bool WriteVariable(const std::string& variableName, void* pData, unsigned long nDataSize) {
+        AdsSymbolCache::Symbol* pSymbol = GetSymbol(variableName);
+        return pSymbol && WriteVariable(pSymbol, pData, nDataSize);
+    }
+
+    bool WriteVariable(AdsSymbolCache::Symbol* pSymbol, void* pData, unsigned long nDataSize) {
         if (!m_bConnected) {
-            std::cerr << "Error: Not connected to TwinCAT!" << std::endl;
+            LogError() << "Error: Not connected to TwinCAT!";
             return false;
         }
 
-        long nErr = AdsSyncWriteReqEx(m_nPort, &m_Addr, ADSIGRP_SYM_VALBYHND, 
-                                      0, nDataSize, pData);
+        long nErr = m_Symbols.Write(pSymbol, pData, nDataSize);
         
         if (nErr) {
-            std::cerr << "Error writing variable '" << variableName 
-                      << "': 0x" << std::hex << nErr << std::endl;
+            LogError() << "Error writing variable '" << pSymbol->name 
+                       << "': 0x" << std::hex << nErr;
             return false;
         }
 
         return true;
     }
 
+    // Batched tag access: the whole list goes out as ADS sum commands, split
+    // only where a request would exceed the AMS frame limit. Per-tag ADS
+    // errors are left in Access::result; returns false if any tag failed.
+    bool ReadVariables(std::vector<AdsSymbolCache::Access>& batch) {
+        return ExecuteBatch(batch, false);
+    }
+
+    bool WriteVariables(std::vector<AdsSymbolCache::Access>& batch) {
+        return ExecuteBatch(batch, true);
+    }
+
+    bool ResolveVariables(const std::vector<std::string>& names,
+                          std::vector<AdsSymbolCache::Symbol*>& symbols) {
+        if (!m_bConnected) {
+            LogError() << "Error: Not connected to TwinCAT!";
+            return false;
+        }
+
+        long nErr = m_Symbols.ResolveAll(names, symbols);
+        if (nErr) {
+            LogError() << "Error resolving variables: 0x" << std::hex << nErr;
+            return false;
+        }
+
+        bool bAllResolved = true;
+        for (size_t i = 0; i < names.size(); i++) {
+            if (!symbols[i]) {
+                LogError() << "Error resolving variable '" << names[i] << "'";
+                bAllResolved = false;
+            }
+        }
+        return bAllResolved;
+    }
+
+    // Server-side change notification for a PLC variable; samples arrive in
+    // GetNotifications() tagged with the returned subscription id
+    unsigned long SubscribeVariable(const std::string& variableName, unsigned long nDataSize,
+                                    AdsNotificationClient::Mode mode = AdsNotificationClient::ON_CHANGE,
+                                    unsigned long cycleTimeMs = 0, unsigned long maxDelayMs = 0) {
+        AdsSymbolCache::Symbol* pSymbol = GetSymbol(variableName);
+        if (!pSymbol) {
+            return AdsNotificationClient::kInvalidSubscription;
+        }
+
+        long nErr = 0;
+        unsigned long id = m_Notifications.SubscribeHandle(pSymbol->handle, nDataSize, mode,
+                                                           cycleTimeMs, maxDelayMs, &nErr);
+        if (nErr) {
+            LogError() << "Error subscribing to variable '" << variableName
+                       << "': 0x" << std::hex << nErr;
+        }
+        return id;
+    }
+
+    unsigned long SubscribeAdsState() {
+        if (!m_bConnected) {
+            LogError() << "Error: Not connected to TwinCAT!";
+            return AdsNotificationClient::kInvalidSubscription;
+        }
+
+        long nErr = 0;
+        unsigned long id = m_Notifications.SubscribeAdsState(&nErr);
+        if (nErr) {
+            LogError() << "Error subscribing to ADS state: 0x" << std::hex << nErr;
+        }
+        return id;
+    }
+
+    AdsNotificationClient& GetNotifications() {
+        return m_Notifications;
+    }
+
+    // Thread-safe access for gateway threads ("plc", "master" targets);
+    // the methods above belong to the thread that called Connect()
+    AdsClientPool& GetPool() {
+        return m_Pool;
+    }
+
     void PrintSystemInfo() {
         if (!m_bConnected) {
-            std::cerr << "Error: Not connected to TwinCAT!" << std::endl;
+            LogError() << "Error: Not connected to TwinCAT!";
             return;
         }
 
-        std::cout << "\n=== TwinCAT System Information ===" << std::endl;
+        LogInfo() << "\n=== TwinCAT System Information ===";
         
         // Read system information
         AdsVersion version;
@@ -114,51 +265,96 @@ public:
         long nErr = AdsSyncReadDeviceInfoReq(&m_Addr, deviceName, &version);
         
         if (!nErr) {
-            std::cout << "Device Name: " << deviceName << std::endl;
-            std::cout << "Version: " << (int)version.version 
+            LogInfo() << "Device Name: " << deviceName;
+            LogInfo() << "Version: " << (int)version.version 
                       << "." << (int)version.revision 
-                      << "." << (int)version.build << std::endl;
+                      << "." << (int)version.build;
         }
     }
 };
 
-int main() {
-    std::cout << "=== Simple EtherCAT Master Application ===" << std::endl;
-    std::cout << "TwinCAT3 C++ EtherCAT Master Demo" << std::endl;
-    std::cout << "==========================================" << std::endl;
+int main(int argc, char* argv[]) {
+    LogInfo() << "=== Simple EtherCAT Master Application ===";
+    LogInfo() << "TwinCAT3 C++ EtherCAT Master Demo";
+    LogInfo() << "==========================================";
+
+    // Cycle settings from ethercat_config.xml (or the file given as argument)
+    EtherCATConfig config;
+    const char* configPath = (argc > 1) ? argv[1] : "ethercat_config.xml";
+    if (!ConfigSnapshot::LoadConfig(configPath, config)) {
+        LogInfo() << "Using default cycle settings.";
+    } else if (!config.logFile.empty() && !Logger::Instance().SetFile(config.logFile)) {
+        LogWarning() << "Warning: Cannot open log file '" << config.logFile << "'";
+    }
 
     EtherCATMaster master;
 
     // Connect to TwinCAT
     if (!master.Connect()) {
-        std::cerr << "Failed to connect to TwinCAT system!" << std::endl;
-        std::cout << "\nMake sure:" << std::endl;
-        std::cout << "1. TwinCAT3 is installed and running" << std::endl;
-        std::cout << "2. TwinCAT is in RUN mode" << std::endl;
-        std::cout << "3. A PLC project is loaded" << std::endl;
+        LogError() << "Failed to connect to TwinCAT system!";
+        LogInfo() << "\nMake sure:";
+        LogInfo() << "1. TwinCAT3 is installed and running";
+        LogInfo() << "2. TwinCAT is in RUN mode";
+        LogInfo() << "3. A PLC project is loaded";
         return -1;
     }
 
     // Print system information
     master.PrintSystemInfo();
 
-    // Example: Simple monitoring loop
-    std::cout << "\n=== Monitoring Loop ===" << std::endl;
-    std::cout << "Press 'q' + Enter to quit..." << std::endl;
+    // TwinCAT pushes state changes; the main thread only wakes for a
+    // notification or to check the keyboard, so the idle link carries no
+    // traffic and the cycle thread never waits for ADS
+    unsigned long stateSubscription = master.SubscribeAdsState();
+
+    // Per-cycle wake-up and execution records for ecat_trace
+    CycleTrace trace;
+    CyclicExecutor executor;
+    if (trace.Create("EtherCATMaster", static_cast<int64_t>(config.cycleTimeUs) * 1000)) {
+        executor.SetTrace(&trace);
+    }
+    executor.SetStage(CyclicExecutor::READ_INPUTS, [&]() {
+        // Here you would typically read input data from EtherCAT slaves
+    });
+    executor.SetStage(CyclicExecutor::PROCESS, [&]() {
+        // Here you would typically process the input data
+    });
+    executor.SetStage(CyclicExecutor::WRITE_OUTPUTS, [&]() {
+        // Here you would typically write output data to EtherCAT slaves
+    });
+
+    CyclicExecutor::Settings settings;
+    settings.cycleTimeUs = config.cycleTimeUs;
+    settings.priority = config.priority;
+    settings.cpuAffinity = config.cpuAffinity;
+    settings.lockMemory = true;
+
+    // Example: Cyclic operation, monitored from the main thread
+    LogInfo() << "\n=== Cyclic Operation (" << config.cycleTimeUs << " us) ===";
+    LogInfo() << "Press 'q' + Enter to quit...";
+    if (!executor.Start(settings)) {
+        master.Disconnect();
+        return -1;
+    }
 
     char input = 0;
-    int counter = 0;
-    
+    unsigned long events = 0;
+    LogRateLimit connectionLostLog(1, 5000);
+
     while (input != 'q') {
-        // Example of cyclic operation
-        std::cout << "Cycle " << ++counter << " - System running..." << std::endl;
-        
-        // Here you would typically:
-        // 1. Read input data from EtherCAT slaves
-        // 2. Process the data
-        // 3. Write output data to EtherCAT slaves
-        
-        Sleep(1000); // Wait 1 second
+        if (master.GetNotifications().WaitForEvents(50)) {
+            master.GetNotifications().Poll([&](const AdsNotificationEvent& event) {
+                if (event.subscription == stateSubscription) {
+                    unsigned short nAdsState;
+                    memcpy(&nAdsState, event.data, sizeof(nAdsState));
+                    LogInfo() << "Event " << ++events << " - ADS State: " << nAdsState;
+                }
+            });
+
+            if (AdsNotificationClient::PollRouterEvent() == AMSEVENT_ROUTERSTOP) {
+                LogError(connectionLostLog) << "AMS router stopped - connection lost!";
+            }
+        }
 
         // Check for user input (non-blocking)
         if (_kbhit()) {
@@ -166,7 +362,10 @@ int main() {
         }
     }
 
-    std::cout << "\nShutting down EtherCAT Master..." << std::endl;
+    executor.Stop();
+    executor.PrintStats();
+
+    LogInfo() << "\nShutting down EtherCAT Master...";
     master.Disconnect();
 
     return 0;
@@ -0,0 +1,169 @@
+// ChangeDetector: the scalar, SSE2 and AVX2 compares report the same
+// ranges and call the same range and bit subscribers as a byte-by-byte
+// reference, for sizes around the 16, 32 and 64 byte blocks so every path
+// ends in a tail. Instruction sets the CPU lacks fall back and are named.
+#include <algorithm>
+#include <cstdio>
+#include <vector>
+#include "ChangeDetector.h"
+
+struct Event {
+    size_t subscription;
+    uint8_t previous;
+    uint8_t current;
+
+    bool operator==(const Event& other) const {
+        return subscription == other.subscription && previous == other.previous && current == other.current;
+    }
+};
+
+struct Watched {
+    size_t offset;
+    size_t length;
+    uint8_t mask;
+};
+
+static uint32_t s_seed = 12345;
+
+static uint32_t Random() {
+    s_seed = s_seed * 1103515245 + 12345;
+    return s_seed >> 16;
+}
+
+// Next image from the last: a pattern per step, random bytes in between
+static void Mutate(size_t step, std::vector<uint8_t>& image) {
+    size_t size = image.size();
+    switch (step % 6) {
+    case 0:     // unchanged
+        break;
+    case 1:     // every byte
+        for (uint8_t& byte : image) {
+            byte = static_cast<uint8_t>(~byte);
+        }
+        break;
+    case 2:     // alternating bytes, the most ranges
+        for (size_t i = 0; i < size; i += 2) {
+            image[i] ^= 0x01;
+        }
+        break;
+    case 3:     // only the last byte, in the tail
+        if (size) {
+            image[size - 1] ^= 0x80;
+        }
+        break;
+    default:    // a few random bytes and bits
+        for (size_t n = 0; size && n < 1 + step % 5; n++) {
+            image[Random() % size] ^= static_cast<uint8_t>(1u << (Random() % 8));
+        }
+        break;
+    }
+}
+
+static std::vector<ChangeDetector::Range> ReferenceRanges(const std::vector<uint8_t>& previous,
+                                                          const std::vector<uint8_t>& current, bool bFirst) {
+    std::vector<ChangeDetector::Range> ranges;
+    for (size_t i = 0; i < current.size(); i++) {
+        if (!bFirst && previous[i] == current[i]) {
+            continue;
+        }
+        if (!ranges.empty() && ranges.back().offset + ranges.back().length == i) {
+            ranges.back().length++;
+        } else {
+            ranges.push_back({ static_cast<uint32_t>(i), 1 });
+        }
+    }
+    return ranges;
+}
+
+static bool SameRanges(const std::vector<ChangeDetector::Range>& a, const std::vector<ChangeDetector::Range>& b) {
+    if (a.size() != b.size()) {
+        return false;
+    }
+    for (size_t i = 0; i < a.size(); i++) {
+        if (a[i].offset != b[i].offset || a[i].length != b[i].length) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static bool CheckSize(size_t size) {
+    const ChangeDetector::Isa isas[] = { ChangeDetector::ISA_SCALAR, ChangeDetector::ISA_SSE2,
+                                         ChangeDetector::ISA_AVX2 };
+    const size_t kIsas = sizeof(isas) / sizeof(isas[0]);
+    ChangeDetector detectors[kIsas];
+    std::vector<Event> events[kIsas];
+
+    // Ranges of 1 to 5 bytes and single bits, overlapping, up to the last byte
+    std::vector<Watched> watched;
+    for (size_t offset = 0; offset < size; offset += 3) {
+        watched.push_back({ offset, std::min<size_t>(1 + offset % 5, size - offset), 0xFF });
+        watched.push_back({ offset, 1, static_cast<uint8_t>(1u << (offset % 8)) });
+    }
+    if (size) {
+        watched.push_back({ size - 1, 1, 0x80 });
+    }
+    for (size_t d = 0; d < kIsas; d++) {
+        detectors[d].Configure(size, isas[d]);
+        for (size_t s = 0; s < watched.size(); s++) {
+            std::vector<Event>* pEvents = &events[d];
+            auto callback = [pEvents, s](const ChangeDetector::Change& change) {
+                pEvents->push_back({ s, *change.pPrevious, *change.pCurrent });
+            };
+            detectors[d].Subscribe(watched[s].offset, watched[s].length, callback, watched[s].mask);
+        }
+    }
+
+    std::vector<uint8_t> previous(size, 0);
+    std::vector<uint8_t> image(size, 0);
+    for (size_t i = 0; i < size; i++) {
+        image[i] = static_cast<uint8_t>(Random());
+    }
+    for (size_t step = 0; step < 60; step++) {
+        bool bFirst = step == 0;
+        std::vector<ChangeDetector::Range> reference = ReferenceRanges(previous, image, bFirst);
+        std::vector<Event> expected;
+        for (size_t s = 0; s < watched.size(); s++) {
+            bool bFired = bFirst;
+            for (size_t i = watched[s].offset; i < watched[s].offset + watched[s].length; i++) {
+                bFired = bFired || ((previous[i] ^ image[i]) & watched[s].mask) != 0;
+            }
+            if (bFired) {
+                expected.push_back({ s, previous[watched[s].offset], image[watched[s].offset] });
+            }
+        }
+
+        for (size_t d = 0; d < kIsas; d++) {
+            events[d].clear();
+            detectors[d].Update(image.data());
+            // Subscribers fire in range order; compare as sets against the reference
+            std::vector<Event> fired = events[d];
+            std::sort(fired.begin(), fired.end(), [](const Event& a, const Event& b) {
+                return a.subscription < b.subscription;
+            });
+            bool bOk = SameRanges(detectors[d].GetRanges(), reference) && fired == expected &&
+                       (d == 0 || events[d] == events[0]);
+            if (!bOk) {
+                printf("Error: %s differs from the reference on %zu bytes, step %zu (%zu ranges, %zu events, "
+                       "expected %zu and %zu)\n", ChangeDetector::IsaName(detectors[d].GetIsa()), size, step,
+                       detectors[d].GetRanges().size(), fired.size(), reference.size(), expected.size());
+                return false;
+            }
+        }
+        previous = image;
+        Mutate(step, image);
+    }
+    return true;
+}
+
+int main() {
+    const size_t sizes[] = { 0, 1, 7, 8, 9, 15, 16, 17, 31, 32, 33, 47, 63, 64, 65, 95, 127, 128, 129, 200, 257, 4099 };
+    bool bOk = true;
+    for (size_t size : sizes) {
+        bOk = CheckSize(size) && bOk;
+    }
+    printf("%s: scalar, SSE2 and AVX2 (this CPU runs up to %s) agree on %zu image sizes\n", bOk ? "Passed" : "Failed",
+           ChangeDetector::IsaName(ChangeDetector::BestIsa()), sizeof(sizes) / sizeof(sizes[0]));
+    Logger::Instance().Flush();
+    return bOk ? 0 : 1;
+}
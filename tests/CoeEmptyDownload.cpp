@@ -0,0 +1,47 @@
+// CoeMailbox against the in-process simulator: an empty download goes out
+// as a normal initiate with size 0 (expedited would put 4 - 0 into the
+// complete access bit) and reads back empty; 1-4 bytes stay expedited.
+#include <cstdio>
+#include <vector>
+#include "CoeMailbox.h"
+#include "SiiReader.h"
+#include "SimulatedTransport.h"
+
+int main() {
+    SimulatedSegment segment;
+    SimulatedSegment::Settings settings = segment.GetSettings();
+    settings.initialState = ECAT_STATE_PREOP;
+    segment.SetSettings(settings);
+    segment.AddSyntheticSlaves(1, 2, 2);
+    segment.MapProcessData(0x10000, 0x20000);
+    SimulatedTransport transport(segment);
+    EtherCATDatagramPacker packer;
+
+    SiiReader sii;
+    std::vector<SlaveInfo> infos;
+    if (!sii.TakeAccess(transport, packer) || !sii.ReadAll(transport, packer, 1, infos)) {
+        printf("Error: Cannot read the SII of the simulated slave\n");
+        return 1;
+    }
+
+    CoeMailbox mailbox;
+    mailbox.AddSlave(0, infos[0]);
+    const uint8_t bytes[3] = { 0x11, 0x22, 0x33 };
+    size_t empty = mailbox.Download(0, 0x2100, 2, bytes, 0);
+    size_t emptyBack = mailbox.Upload(0, 0x2100, 2);
+    size_t expedited = mailbox.Download(0, 0x2100, 3, bytes, sizeof(bytes));
+    size_t expeditedBack = mailbox.Upload(0, 0x2100, 3);
+    bool bOk = mailbox.Run(transport, packer);
+
+    const CoeMailbox::Request* requests[] = { &mailbox.GetRequest(empty), &mailbox.GetRequest(emptyBack),
+                                              &mailbox.GetRequest(expedited), &mailbox.GetRequest(expeditedBack) };
+    for (const CoeMailbox::Request* pRequest : requests) {
+        bOk = bOk && pRequest->status == CoeMailbox::SDO_DONE;
+    }
+    bOk = bOk && requests[1]->data.empty() && requests[3]->data == std::vector<uint8_t>(bytes, bytes + sizeof(bytes));
+
+    printf("%s: empty download read back %zu bytes, 3-byte expedited download read back %zu bytes\n",
+           bOk ? "Passed" : "Failed", requests[1]->data.size(), requests[3]->data.size());
+    Logger::Instance().Flush();
+    return bOk ? 0 : 1;
+}
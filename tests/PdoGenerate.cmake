@@ -0,0 +1,22 @@
+# Generates the typed PDO header for CONFIG with ecat_pdo, then builds and
+# runs SOURCE against it with the compiler of the main build.
+#
+#   cmake -DECAT_PDO=... -DCONFIG=... -DSOURCE=... -DHEADER=... -DSOURCE_DIR=...
+#         -DWORK_DIR=... -DCXX=... -P PdoGenerate.cmake
+file(MAKE_DIRECTORY ${WORK_DIR})
+execute_process(COMMAND ${ECAT_PDO} ${CONFIG} ${WORK_DIR}/${HEADER} RESULT_VARIABLE result)
+if(NOT result EQUAL 0)
+    message(FATAL_ERROR "ecat_pdo failed on ${CONFIG}")
+endif()
+
+get_filename_component(name ${SOURCE} NAME_WE)
+execute_process(COMMAND ${CXX} -std=c++17 -Wall -I${SOURCE_DIR} -I${WORK_DIR} ${SOURCE} -o ${WORK_DIR}/${name} -pthread
+                RESULT_VARIABLE result)
+if(NOT result EQUAL 0)
+    message(FATAL_ERROR "The header generated from ${CONFIG} does not compile")
+endif()
+
+execute_process(COMMAND ${WORK_DIR}/${name} ${CONFIG} RESULT_VARIABLE result)
+if(NOT result EQUAL 0)
+    message(FATAL_ERROR "${name} failed")
+endif()
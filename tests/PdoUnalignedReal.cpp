@@ -0,0 +1,40 @@
+// Built by PdoGenerate.cmake against the header ecat_pdo generated from
+// pdo_unaligned_real.xml: a REAL after four BOOLs starts at bit 4 and is
+// read and written as its raw bits.
+#include <cstdio>
+#include <cstring>
+#include <type_traits>
+#include "UnalignedPdo.h"
+
+static_assert(std::is_same<decltype(UnalignedPdo::Sensor::Value)::Type, uint32_t>::value, "REAL at bit 4 is raw");
+static_assert(std::is_same<decltype(UnalignedPdo::Sensor::Setpoint)::Type, uint32_t>::value, "REAL at bit 1 is raw");
+
+int main(int argc, char* argv[]) {
+    EtherCATConfig config;
+    if (argc < 2 || !config.Load(argv[1]) || !UnalignedPdo::Check(config)) {
+        printf("Error: %s does not have the generated layout\n", argc < 2 ? "(no configuration)" : argv[1]);
+        return 1;
+    }
+
+    uint8_t inputs[UnalignedPdo::kInputSize] = {};
+    float value = -12.5f;
+    uint32_t raw;
+    memcpy(&raw, &value, sizeof(raw));
+    UnalignedPdo::Sensor::Ready.Write(inputs, true);
+    UnalignedPdo::Sensor::Underrange.Write(inputs, true);
+    UnalignedPdo::Sensor::Value.Write(inputs, raw);
+
+    uint32_t rawBack = UnalignedPdo::Sensor::Value.Read(inputs);
+    float back;
+    memcpy(&back, &rawBack, sizeof(back));
+    bool bOk = back == value && UnalignedPdo::Sensor::Ready.Read(inputs) && !UnalignedPdo::Sensor::Error.Read(inputs) &&
+               UnalignedPdo::Sensor::Underrange.Read(inputs) && (inputs[0] & 0x0F) == 0x09;
+
+    uint8_t outputs[UnalignedPdo::kOutputSize] = {};
+    UnalignedPdo::Sensor::Setpoint.Write(outputs, 0xFFFFFFFFu);
+    bOk = bOk && !UnalignedPdo::Sensor::Enable.Read(outputs) && outputs[0] == 0xFE && outputs[4] == 0x01;
+
+    printf("%s: REAL at bit 4 read back as %g\n", bOk ? "Passed" : "Failed", back);
+    Logger::Instance().Flush();
+    return bOk ? 0 : 1;
+}
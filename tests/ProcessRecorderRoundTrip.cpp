@@ -0,0 +1,131 @@
+// ProcessRecorder and ProcessRecordReader: Encode/Decode across a run of
+// cycles (full change, all zero, unchanged, sparse, alternating bytes),
+// then the same cycles through segment files that roll over, read back
+// in order and after Seek into key and non-key records.
+#include <cstdio>
+#include <filesystem>
+#include <vector>
+#include "ProcessRecorder.h"
+
+static const size_t kSpan = 61;          // odd, so runs end at the image edge
+static const size_t kCycles = 300;
+static const int64_t kPeriodNs = 1000000;
+
+// Cycle i's image, made from the previous one
+static void MakeImage(size_t cycle, std::vector<uint8_t>& image) {
+    switch (cycle % 5) {
+    case 0:     // every byte changes
+        for (size_t j = 0; j < image.size(); j++) {
+            image[j] ^= static_cast<uint8_t>(1 + (cycle + j) % 255);
+        }
+        break;
+    case 1:     // all zero, then unchanged
+    case 2:
+        std::fill(image.begin(), image.end(), 0);
+        break;
+    case 3:     // first, last and one byte in between
+        image.front() = static_cast<uint8_t>(cycle);
+        image[image.size() / 2] = 0x5A;
+        image.back() = static_cast<uint8_t>(~cycle);
+        break;
+    default:    // every other byte, so literals end on single equal bytes
+        for (size_t j = 0; j < image.size(); j += 2) {
+            image[j] = static_cast<uint8_t>(cycle + j);
+        }
+        break;
+    }
+}
+
+static bool CheckCodec(const std::vector<std::vector<uint8_t>>& images) {
+    std::vector<uint8_t> encoded(ProcessRecorder::MaxEncodedSize(kSpan));
+    std::vector<uint8_t> decoded(kSpan, 0);
+    std::vector<uint8_t> key(kSpan);
+    for (size_t i = 0; i < images.size(); i++) {
+        const uint8_t* pPrevious = i ? images[i - 1].data() : nullptr;
+        size_t length = ProcessRecorder::Encode(images[i].data(), pPrevious, kSpan, encoded.data());
+        if (length > encoded.size() || !ProcessRecorder::Decode(encoded.data(), length, decoded.data(), kSpan) ||
+            decoded != images[i]) {
+            printf("Error: Cycle %zu does not decode against the previous one\n", i);
+            return false;
+        }
+        length = ProcessRecorder::Encode(images[i].data(), nullptr, kSpan, encoded.data());
+        std::fill(key.begin(), key.end(), 0);
+        if (!ProcessRecorder::Decode(encoded.data(), length, key.data(), kSpan) || key != images[i]) {
+            printf("Error: Cycle %zu does not decode as a key record\n", i);
+            return false;
+        }
+        if (length > 0 && ProcessRecorder::Decode(encoded.data(), length - 1, key.data(), kSpan)) {
+            printf("Error: Cycle %zu decodes with its last byte cut off\n", i);
+            return false;
+        }
+    }
+    return true;
+}
+
+static bool CheckRecord(const ProcessRecordReader::Record& record, size_t cycle,
+                        const std::vector<std::vector<uint8_t>>& images) {
+    bool bOk = record.cycle == cycle && record.wkc == static_cast<uint16_t>(cycle % 7) &&
+               std::equal(images[cycle].begin(), images[cycle].end(), record.pSpan);
+    if (!bOk) {
+        printf("Error: Record for cycle %llu does not match cycle %zu\n",
+               static_cast<unsigned long long>(record.cycle), cycle);
+    }
+    return bOk;
+}
+
+int main() {
+    std::vector<std::vector<uint8_t>> images;
+    std::vector<uint8_t> image(kSpan, 0);
+    for (size_t i = 0; i < kCycles; i++) {
+        MakeImage(i, image);
+        images.push_back(image);
+    }
+    bool bOk = CheckCodec(images);
+
+    const std::string directory = "recorder_roundtrip_data";
+    std::filesystem::remove_all(directory);
+    ProcessRecorder::Settings settings;
+    settings.directory = directory;
+    settings.files = 64;
+    settings.fileBytes = ProcessRecorder::kDataStart + 4096;      // a few dozen records each
+    settings.keyInterval = 7;
+    ProcessRecorder::Layout layout = { 0x10000, kSpan, 0x10000, 32, 0x10020, kSpan - 32 };
+    ProcessRecorder recorder;
+    bOk = bOk && recorder.Open(settings, layout);
+    for (size_t i = 0; bOk && i < kCycles; i++) {
+        bOk = recorder.Record(i, static_cast<int64_t>(i + 1) * kPeriodNs, static_cast<uint16_t>(i % 7),
+                              images[i].data());
+    }
+    recorder.Close();
+    ProcessRecorder::Stats stats = recorder.GetStats();
+    bOk = bOk && stats.written == kCycles && stats.dropped == 0 && stats.segments > 2;
+
+    ProcessRecordReader reader;
+    bOk = bOk && reader.Open(directory) && reader.GetRecordCount() == kCycles;
+    std::vector<int64_t> times;
+    ProcessRecordReader::Record record;
+    while (bOk && reader.Next(record)) {
+        bOk = CheckRecord(record, times.size(), images);
+        times.push_back(record.timeNs);
+    }
+    bOk = bOk && times.size() == kCycles;
+
+    // Exact times of key and non-key records, times between records, and
+    // one past the end
+    const size_t seeks[] = { 0, 1, 6, 7, 8, 13, 50, 99, 150, kCycles - 1 };
+    for (size_t i = 0; bOk && i < sizeof(seeks) / sizeof(seeks[0]); i++) {
+        size_t cycle = seeks[i];
+        bOk = reader.Seek(times[cycle]) && reader.Next(record) && CheckRecord(record, cycle, images);
+        bOk = bOk && (cycle == 0 || (reader.Seek(times[cycle] - kPeriodNs / 2) && reader.Next(record) &&
+                                     CheckRecord(record, cycle, images)));
+    }
+    bOk = bOk && !reader.Seek(times.back() + 1);
+
+    printf("%s: %zu cycles, %lu segments, %llu of %llu bytes encoded\n", bOk ? "Passed" : "Failed",
+           times.size(), stats.segments, static_cast<unsigned long long>(stats.encodedBytes),
+           static_cast<unsigned long long>(stats.rawBytes));
+    reader.Close();
+    std::filesystem::remove_all(directory);
+    Logger::Instance().Flush();
+    return bOk ? 0 : 1;
+}
@@ -0,0 +1,54 @@
+#!/usr/bin/env bash
+# Runs a client program, optionally against a server started in the
+# background first, and passes if the client exits with 0 and printed a
+# line matching each pattern (grep -E).
+#
+#   run_pair.sh [--server PROGRAM ARGS... --] PROGRAM ARGS... --expect PATTERN...
+#
+# The client's stdin is empty, so interactive masters quit at once after
+# their run. The server is stopped when the client is done; its output is
+# in <server>.log.
+
+server=()
+if [ "$1" = "--server" ]; then
+    shift
+    while [ $# -gt 0 ] && [ "$1" != "--" ]; do
+        server+=("$1")
+        shift
+    done
+    shift
+fi
+client=()
+while [ $# -gt 0 ] && [ "$1" != "--expect" ]; do
+    client+=("$1")
+    shift
+done
+shift
+
+serverPid=
+if [ ${#server[@]} -gt 0 ]; then
+    serverLog=$(basename "${server[0]}").log
+    "${server[@]}" > "$serverLog" 2>&1 &
+    serverPid=$!
+    trap 'kill $serverPid 2> /dev/null; wait $serverPid 2> /dev/null' EXIT
+    sleep 0.5
+    if ! kill -0 $serverPid 2> /dev/null; then
+        echo "Error: ${server[0]} did not start"
+        cat "$serverLog"
+        exit 1
+    fi
+fi
+
+output=$("${client[@]}" < /dev/null 2>&1)
+result=$?
+echo "$output"
+if [ $result -ne 0 ]; then
+    echo "Error: ${client[0]} exited with $result"
+    exit 1
+fi
+for pattern in "$@"; do
+    if ! grep -Eq -- "$pattern" <<< "$output"; then
+        echo "Error: no line matches '$pattern'"
+        exit 1
+    fi
+done